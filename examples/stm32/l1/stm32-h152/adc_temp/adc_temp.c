@@ -26,6 +26,7 @@
 #include <dma.h>
 #include <nvic.h>
 #include <adc.h>
+#include <dmastream.h>
 
 #include <syscall.h>
 #include <stdio.h>
@@ -40,6 +41,18 @@
 volatile int conv_index;
 volatile u32 conv[10];
 volatile bool dma_busy;
+
+static void adc_ready(struct dmastream *s, void *half);
+
+/* 'conv' as two halves of 5 */
+static struct dmastream adc_stream = {
+	.dma = DMA_ADC,
+	.pa = (u32)&ADC_DR,
+	.buf = (void *)conv,
+	.ndt = 10,
+	.mode = DMA_P_TO_M | DMA_M_32BIT | DMA_P_32BIT,
+	.ready = adc_ready,
+};
 volatile int tim9_int_count;
 volatile int adc_regular_int_count;
 volatile int adc_injected_int_count;
@@ -199,26 +212,30 @@ static void dma_setup(void)
 	/* Enable DMA1 clock. */
 	rcc_enable_clock(DMA_RCC_ADC);
 
+	dmastream_init(&adc_stream);
+
 	/* Enable DMA ADC(DMA1 channel1) interrupt. */
 	nvic_enable_irq(DMA_ADC_IRQ);
 
 }
 
-/* DMA ADC(DMA1 Channel1) interrupt */
-void dma_adc_isr(void)
+/* Both halves of 'conv' are done after the second one. */
+static void adc_ready(struct dmastream *s, void *half)
 {
-	if (dma_get_interrupt_mask(DMA_ADC, DMA_COMPLETE) &&
-	    dma_get_interrupt_status(DMA_ADC, DMA_GLOBAL | DMA_COMPLETE) ==
-	    (DMA_GLOBAL | DMA_COMPLETE)) {
-		/* Disable DMA. */
-		dma_disable(DMA_ADC);
+	if (half == s->buf)
+		return;
 
-		/* Clear flag. */
-		dma_busy = false;
+	/* Disable DMA. */
+	dmastream_stop(s);
 
-		/* Clear interrupt. */
-		dma_clear_interrupt(DMA_ADC, DMA_GLOBAL | DMA_COMPLETE);
-	}
+	/* Clear flag. */
+	dma_busy = false;
+}
+
+/* DMA ADC(DMA1 Channel1) interrupt */
+void dma_adc_isr(void)
+{
+	dmastream_isr(&adc_stream);
 }
 
 static void adc_setup(void)
@@ -513,9 +530,7 @@ static void temp_scan_regular_dma(void)
 	dma_busy = true;
 
 	/* Setup DMA controller. */
-	dma_setup_channel(DMA_ADC, (u32)conv, (u32)&ADC_DR, 10,
-			  DMA_M_32BIT | DMA_P_32BIT | DMA_M_INC |
-			  DMA_COMPLETE | DMA_ENABLE);
+	dmastream_start(&adc_stream);
 
 	/* ADC on */
 	adc_enable();
@@ -640,9 +655,7 @@ static void temp_discontinuous_regular_dma(void)
 	dma_busy = true;
 
 	/* Setup DMA controller. */
-	dma_setup_channel(DMA_ADC, (u32)conv, (u32)&ADC_DR, 10,
-			  DMA_M_32BIT | DMA_P_32BIT | DMA_M_INC |
-			  DMA_COMPLETE | DMA_ENABLE);
+	dmastream_start(&adc_stream);
 
 	/* ADC on */
 	adc_enable();
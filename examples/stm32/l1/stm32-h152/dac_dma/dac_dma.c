@@ -24,47 +24,72 @@
 #include <tim.h>
 #include <dma.h>
 #include <dac.h>
+#include <nvic.h>
+#include <dmastream.h>
 
 #define TIMX_CLK_APB1 32000000
 
-#define MAXDATA 32
-
-/* sine wave 1kHz: sampling 32kHz */
-u32 data[MAXDATA] = {
-	2048,
-	2447,
-	2831,
-	3185,
-	3495,
-	3750,
-	3939,
-	4056,
-	4095,
-	4056,
-	3939,
-	3750,
-	3495,
-	3185,
-	2831,
-	2447,
-	2048,
-	1649,
-	1265,
-	911,
-	601,
-	346,
-	157,
-	40,
-	1,
-	40,
-	157,
-	346,
-	601,
-	911,
-	1265,
-	1649
+/* Sampling rate 32kHz */
+#define SAMPLE_RATE 32000
+
+/* 2 x 1 msec */
+#define BUFSIZE (SAMPLE_RATE / 1000 * 2)
+
+/* Sine wave (one cycle) */
+#define SINE_SIZE 32
+static const u16 sine[SINE_SIZE] = {
+	2048, 2447, 2831, 3185, 3495, 3750, 3939, 4056,
+	4095, 4056, 3939, 3750, 3495, 3185, 2831, 2447,
+	2048, 1649, 1265, 911, 601, 346, 157, 40,
+	1, 40, 157, 346, 601, 911, 1265, 1649
+};
+
+static u16 buf[BUFSIZE];
+
+/* Phase (16.16 fixed point index of 'sine') and step */
+static u32 phase;
+static u32 step;
+
+/* Tone frequency: 500Hz - 4kHz, changed by the button */
+static int freq = 500;
+
+static void fill(struct dmastream *s, void *half);
+
+static struct dmastream stream = {
+	.dma = DMA_TIM6_UP,
+	.pa = (u32)&DAC_DHR12R2,
+	.buf = buf,
+	.ndt = BUFSIZE,
+	.mode = DMA_M_TO_P | DMA_M_16BIT | DMA_P_32BIT | DMA_HIGH,
+	.ready = fill,
 };
 
+static void set_freq(int f)
+{
+	step = ((u32)f << 16) / (SAMPLE_RATE / SINE_SIZE);
+}
+
+/* Refill the half sent by DMA. */
+static void fill(struct dmastream *s, void *half)
+{
+	u16 *p = half;
+	int i;
+
+	for (i = 0; i < s->ndt / 2; i++) {
+		p[i] = sine[(phase >> 16) & (SINE_SIZE - 1)];
+		phase += step;
+	}
+
+	/* LED on: the buffer was not refilled in time. */
+	if (dmastream_get_overrun(s))
+		gpio_clear(GPIO_PE10);
+}
+
+void dma_tim6_up_isr(void)
+{
+	dmastream_isr(&stream);
+}
+
 /* Set STM32 to 32 MHz. */
 static void clock_setup(void)
 {
@@ -83,9 +108,6 @@ static void clock_setup(void)
 	 /* Setup PLL (8MHz * 12 / 3 = 32MHz). */
 	rcc_setup_pll(RCC_HSE, 12, 3);
 
-	/* AHB, APB1 and APB2 prescaler value is default. */
-	// rcc_set_prescaler(1, 1, 1);
-
 	/* Enable PLL and wait for it to stabilize. */
 	rcc_enable_osc(RCC_PLL);
 
@@ -95,11 +117,22 @@ static void clock_setup(void)
 
 static void gpio_setup(void)
 {
-	/* Enable GPIOA clock. */
+	/* Enable GPIOA and GPIOE clock. */
 	rcc_enable_clock(RCC_GPIOA);
+	rcc_enable_clock(RCC_GPIOE);
 
-	/* Set GPIO5 (in GPIO port A)(DAC_OUT1) to 'analog'. */
+	/* Set GPIO5 (in GPIO port A)(DAC_OUT2) to 'analog'. */
 	gpio_config_analog(GPIO_PA5);
+
+	/* Set GPIO0 (in GPIO port A) to 'input float' (button). */
+	gpio_config_input(GPIO_FLOAT, GPIO_PA0);
+
+	/* Set GPIO10 (in GPIO port E) to 'output push-pull'. */
+	gpio_config_output(GPIO_PUSHPULL, GPIO_400KHZ, GPIO_NOPUPD,
+			   GPIO_PE10);
+
+	/* LED off */
+	gpio_set(GPIO_PE10);
 }
 
 static void tim_setup(void)
@@ -109,8 +142,8 @@ static void tim_setup(void)
 	rcc_enable_clock(RCC_TIM7);
 
 	/* TIM6 */
-	/* Load prescaler value (320kHz) and set auto-reload value (10). */
-	tim_setup_counter(TIM6, TIMX_CLK_APB1 / 320000 - 1, 10 - 1);
+	/* Load prescaler value (32MHz) and set auto-reload value (32kHz). */
+	tim_setup_counter(TIM6, 0, TIMX_CLK_APB1 / SAMPLE_RATE - 1);
 
 	/* Enable update DMA request. */
 	tim_enable_dma(TIM6, TIM_DMA_UPDATE);
@@ -148,25 +181,14 @@ static void dma_setup(void)
 	/* Enable DMA1 clock. */
 	rcc_enable_clock(DMA_RCC_TIM6_UP);
 
-	/* TIM6_UP is connected to DMA1 channel2 */
+	/* Fill both halves, and start. */
+	set_freq(freq);
+	dmastream_init(&stream);
+	fill(&stream, buf);
+	fill(&stream, buf + BUFSIZE / 2);
+	dmastream_start(&stream);
 
-	/* Set memory address. */
-	// DMA1_CMAR2 = (u32)data;
-
-	/* Set Peripheral address. */
-	// DMA1_CPAR2 = (u32)&DAC_DHR12R1;
-
-	/* Set number of data to transfer. */
-	// DMA1_CNDTR2 = MAXDATA;
-
-	/* Set DMA mode and enable DMA. */
-	// DMA1_CCR2 = (DMA_CCR_MSIZE_32BIT | DMA_CCR_PSIZE_32BIT |
-	//	     DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_DIR |
-	//	     DMA_CCR_EN);
-
-	dma_setup_channel(DMA_TIM6_UP, (u32)data, (u32)&DAC_DHR12R2, MAXDATA,
-			  DMA_M_32BIT | DMA_P_32BIT | DMA_M_INC |
-			  DMA_CIRCULAR | DMA_M_TO_P | DMA_ENABLE);
+	nvic_enable_irq(DMA_TIM6_UP_IRQ);
 }
 
 static void dac_setup(void)
@@ -183,17 +205,26 @@ static void dac_setup(void)
 
 int main(void)
 {
+	bool button = false;
+
 	clock_setup();
 	gpio_setup();
 	tim_setup();
-	dma_setup();
 	dac_setup();
+	dma_setup();
 
 	/* Enable TIM6 counter. */
 	tim_enable_counter(TIM6);
 
-	while (1)
-		__asm__ ("nop");
+	while (1) {
+		/* Button: double the frequency (500Hz -> 4kHz -> 500Hz) */
+		if (gpio_get(GPIO_PA0) && !button) {
+			freq = (freq >= 4000) ? 500 : freq * 2;
+			set_freq(freq);
+		}
+		button = gpio_get(GPIO_PA0);
+		delay_us(10000);
+	}
 
 	return 0;
 }
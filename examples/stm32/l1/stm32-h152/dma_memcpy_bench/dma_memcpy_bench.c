@@ -0,0 +1,231 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <rcc.h>
+#include <pwr.h>
+#include <flash.h>
+#include <gpio.h>
+#include <usart.h>
+#include <systick.h>
+#include <dma.h>
+#include <nvic.h>
+#include <dmacopy.h>
+
+#include <syscall.h>
+#include <stdio.h>
+
+/* Reserved DMA channel */
+#define DMACOPY_CHANNEL		DMA1_CHANNEL1
+
+/* Largest size (bytes) */
+#define MAX_SIZE		4096
+
+/* Number of iterations */
+#define LOOP			16
+
+static const int size[] = {8, 16, 32, 64, 128, 256, 512, 1024, 4096};
+
+static u32 src[MAX_SIZE / 4];
+static u32 dst[MAX_SIZE / 4];
+
+/* SYSCLK (= PCLK1) */
+static int sysclk;
+
+static void clock_setup(void)
+{
+	/* Enable PWR clock. */
+	rcc_enable_clock(RCC_PWR);
+
+	/* Set VCORE to 1.8V */
+	pwr_set_vos(PWR_1_8_V);
+
+	/* Set Flash memory latency (1WS). */
+	flash_enable_64bit_access(1);
+
+	/* Enable external high-speed oscillator 8MHz. */
+	rcc_enable_osc(RCC_HSE);
+
+	 /* Setup PLL (8MHz * 12 / 3 = 32MHz). */
+	rcc_setup_pll(RCC_HSE, 12, 3);
+
+	/* Enable PLL and wait for it to stabilize. */
+	rcc_enable_osc(RCC_PLL);
+
+	/* Enable HSI and MSI (4.194MHz). */
+	rcc_enable_osc(RCC_HSI);
+	rcc_set_msi_range(RCC_MSI_4MHZ);
+	rcc_enable_osc(RCC_MSI);
+}
+
+static void usart_setup(void)
+{
+	/* Enable GPIOD clock. */
+	rcc_enable_clock(RCC_GPIOD);
+
+	/* Enable USART2 clock. */
+	rcc_enable_clock(RCC_USART2);
+
+	/* Setup GPIO pin PD5 as alternate function. */
+	gpio_config_altfn(GPIO_USART1_3, GPIO_PUSHPULL, GPIO_10MHZ,
+			  GPIO_NOPUPD, GPIO_PD_USART2_TX);
+}
+
+/* Select SYSCLK, and set the USART baud rate for it. */
+static void set_clock(rcc_osc_t osc, int hz)
+{
+	/* Wait for the last character. */
+	while (!(USART2_SR & USART_SR_TC))
+		;
+
+	rcc_set_sysclk_source(osc);
+	while (rcc_get_sysclk_source() != osc)
+		;
+	sysclk = hz;
+
+	usart_init(USART2, sysclk, 115200, 8, USART_STOP_1,
+		   USART_PARITY_NONE, USART_FLOW_NONE, USART_TX);
+}
+
+static void systick_setup(void)
+{
+	/* 24-bit down counter, SYSCLK */
+	systick_set_clocksource(SYSTICK_AHB);
+	systick_set_reload(0xffffff);
+	systick_enable_counter();
+}
+
+static void dma_setup(void)
+{
+	/* Enable DMA1 clock. */
+	rcc_enable_clock(RCC_DMA1);
+
+	dmacopy_init(DMACOPY_CHANNEL);
+	nvic_enable_irq(NVIC_DMA1_CHANNEL1_IRQ);
+}
+
+void dma1_channel1_isr(void)
+{
+	dmacopy_isr();
+}
+
+int _write(int file, char *ptr, int len)
+{
+	int i;
+
+	if (file == 1) {
+		for (i = 0; i < len; i++)
+			usart_send_blocking(USART2, ptr[i]);
+		return i;
+	}
+
+	errno = EIO;
+	return -1;
+}
+
+/* SysTick counts down. */
+static int elapsed(int start, int end)
+{
+	return (start - end) & 0xffffff;
+}
+
+/* Cycles of one request */
+static int copy_cycles(int len, bool fill)
+{
+	int start;
+	int i;
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++) {
+		if (fill)
+			dmacopy_memset(dst, i, len, 0, 0);
+		else
+			dmacopy_memcpy(dst, src, len, 0, 0);
+		dmacopy_flush();
+	}
+	return elapsed(start, systick_get_value()) / LOOP;
+}
+
+/* KB/s */
+static int throughput(int len, int cycles)
+{
+	return (len * (sysclk / 1000)) / cycles;
+}
+
+static void bench(const char *name)
+{
+	int cpu;
+	int dma;
+	int set;
+	int even;
+	unsigned int i;
+
+	printf("\r\n%s, SYSCLK %d Hz\r\n", name, sysclk);
+	printf("  size    cpu (KB/s)       dma (KB/s)       set (KB/s)\r\n");
+
+	even = 0;
+	for (i = 0; i < sizeof(size) / sizeof(size[0]); i++) {
+		dmacopy_set_threshold(MAX_SIZE + 1);
+		cpu = copy_cycles(size[i], false);
+
+		dmacopy_set_threshold(0);
+		dma = copy_cycles(size[i], false);
+		set = copy_cycles(size[i], true);
+
+		printf("%6d %6d (%5d) %6d (%5d) %6d (%5d)\r\n", size[i],
+		       cpu, throughput(size[i], cpu),
+		       dma, throughput(size[i], dma),
+		       set, throughput(size[i], set));
+
+		if (!even && dma < cpu)
+			even = size[i];
+	}
+
+	if (even)
+		printf("break-even: %d bytes\r\n", even);
+	else
+		printf("break-even: none\r\n");
+}
+
+int main(void)
+{
+	unsigned int i;
+
+	clock_setup();
+	usart_setup();
+	systick_setup();
+	dma_setup();
+
+	for (i = 0; i < MAX_SIZE / 4; i++)
+		src[i] = i;
+
+	set_clock(RCC_PLL, 32000000);
+	printf("\r\nDMA memcpy/memset (cycles per request)\r\n");
+	bench("PLL");
+
+	set_clock(RCC_HSI, 16000000);
+	bench("HSI");
+
+	set_clock(RCC_MSI, 4194304);
+	bench("MSI");
+
+	while (1)
+		__asm__ ("nop");
+
+	return 0;
+}
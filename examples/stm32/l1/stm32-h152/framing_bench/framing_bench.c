@@ -0,0 +1,296 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <rcc.h>
+#include <pwr.h>
+#include <flash.h>
+#include <gpio.h>
+#include <usart.h>
+#include <systick.h>
+#include <cobs.h>
+#include <slip.h>
+
+#include <syscall.h>
+#include <stdio.h>
+#include <string.h>
+
+/* SYSCLK */
+#define SYSCLK			32000000
+
+/* Frame size (bytes) */
+#define FRAME_SIZE		1024
+
+/* Number of iterations */
+#define LOOP			16
+
+/* Payloads */
+enum {
+	ZERO,				/* All zero */
+	TEXT,				/* No zero, no SLIP special byte */
+	RANDOM,				/* Pseudo-random */
+	PAYLOAD_NUM
+};
+
+static const char * const payload_name[PAYLOAD_NUM] = {
+	"zero", "text", "random"
+};
+
+static u8 frame[FRAME_SIZE];
+static u8 encoded[SLIP_MAX_ENCODED(FRAME_SIZE)];
+static u8 decoded[FRAME_SIZE];
+static u8 copy[FRAME_SIZE];
+
+static int decoded_len;
+
+static void cobs_frame(struct cobs_decoder *d, const u8 *buf, int len);
+static void slip_frame(struct slip_decoder *d, const u8 *buf, int len);
+
+static struct cobs_decoder cobs_dec = {
+	.buf = decoded,
+	.size = FRAME_SIZE,
+	.frame = cobs_frame,
+};
+
+static struct slip_decoder slip_dec = {
+	.buf = decoded,
+	.size = FRAME_SIZE,
+	.frame = slip_frame,
+};
+
+/* Set STM32 to 32 MHz. */
+static void clock_setup(void)
+{
+	/* Enable PWR clock. */
+	rcc_enable_clock(RCC_PWR);
+
+	/* Set VCORE to 1.8V */
+	pwr_set_vos(PWR_1_8_V);
+
+	/* Set Flash memory latency (1WS). */
+	flash_enable_64bit_access(1);
+
+	/* Enable external high-speed oscillator 8MHz. */
+	rcc_enable_osc(RCC_HSE);
+
+	 /* Setup PLL (8MHz * 12 / 3 = 32MHz). */
+	rcc_setup_pll(RCC_HSE, 12, 3);
+
+	/* Enable PLL and wait for it to stabilize. */
+	rcc_enable_osc(RCC_PLL);
+
+	/* Select PLL as SYSCLK source. */
+	rcc_set_sysclk_source(RCC_PLL);
+}
+
+static void usart_setup(void)
+{
+	/* Enable GPIOD clock. */
+	rcc_enable_clock(RCC_GPIOD);
+
+	/* Enable USART2 clock. */
+	rcc_enable_clock(RCC_USART2);
+
+	/* Setup GPIO pin PD5 as alternate function. */
+	gpio_config_altfn(GPIO_USART1_3, GPIO_PUSHPULL, GPIO_10MHZ,
+			  GPIO_NOPUPD, GPIO_PD_USART2_TX);
+
+	/* Setup USART2. */
+	usart_init(USART2, SYSCLK, 115200, 8, USART_STOP_1,
+		   USART_PARITY_NONE, USART_FLOW_NONE, USART_TX);
+}
+
+static void systick_setup(void)
+{
+	/* 24-bit down counter, SYSCLK */
+	systick_set_clocksource(SYSTICK_AHB);
+	systick_set_reload(0xffffff);
+	systick_enable_counter();
+}
+
+int _write(int file, char *ptr, int len)
+{
+	int i;
+
+	if (file == 1) {
+		for (i = 0; i < len; i++)
+			usart_send_blocking(USART2, ptr[i]);
+		return i;
+	}
+
+	errno = EIO;
+	return -1;
+}
+
+static void cobs_frame(struct cobs_decoder *d, const u8 *buf, int len)
+{
+	(void)d;
+	(void)buf;
+
+	decoded_len = len;
+}
+
+static void slip_frame(struct slip_decoder *d, const u8 *buf, int len)
+{
+	(void)d;
+	(void)buf;
+
+	decoded_len = len;
+}
+
+/* SysTick counts down. */
+static int elapsed(int start, int end)
+{
+	return (start - end) & 0xffffff;
+}
+
+static void make_payload(int payload)
+{
+	u32 x = 1;
+	int i;
+
+	for (i = 0; i < FRAME_SIZE; i++) {
+		switch (payload) {
+		case ZERO:
+			frame[i] = 0;
+			break;
+		case TEXT:
+			frame[i] = 'a' + i % 26;
+			break;
+		default:
+			/* xorshift */
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			frame[i] = x;
+			break;
+		}
+	}
+}
+
+/* Cycles of encoding a frame into 'encoded', the encoded length in 'len' */
+static int encode_cycles(bool slip, int *len)
+{
+	struct cobs_encoder ce;
+	struct slip_encoder se;
+	int start;
+	int i;
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++) {
+		if (slip) {
+			slip_encode_begin(&se, encoded, sizeof(encoded), 0,
+					  sizeof(encoded));
+			slip_encode(&se, frame, FRAME_SIZE);
+			*len = slip_encode_end(&se);
+		} else {
+			cobs_encode_begin(&ce, encoded, sizeof(encoded), 0,
+					  sizeof(encoded));
+			cobs_encode(&ce, frame, FRAME_SIZE);
+			*len = cobs_encode_end(&ce);
+		}
+	}
+	return elapsed(start, systick_get_value()) / LOOP;
+}
+
+/* Cycles of decoding 'len' bytes of 'encoded' in 64-byte chunks */
+static int decode_cycles(bool slip, int len)
+{
+	int start;
+	int i;
+	int j;
+	int n;
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++) {
+		for (j = 0; j < len; j += n) {
+			n = (len - j < 64) ? len - j : 64;
+			if (slip)
+				slip_decode(&slip_dec, encoded + j, n);
+			else
+				cobs_decode(&cobs_dec, encoded + j, n);
+		}
+	}
+	return elapsed(start, systick_get_value()) / LOOP;
+}
+
+/* Cycles of the frame copy saved by encoding in place */
+static int copy_cycles(void)
+{
+	int start;
+	int i;
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++)
+		memcpy(copy, frame, FRAME_SIZE);
+	return elapsed(start, systick_get_value()) / LOOP;
+}
+
+/* KB/s */
+static int throughput(int cycles)
+{
+	return (FRAME_SIZE * (SYSCLK / 1000)) / cycles;
+}
+
+static void bench(bool slip)
+{
+	int enc;
+	int dec;
+	int len;
+	int i;
+
+	printf("\r\n%s, %d-byte frame, SYSCLK %d Hz\r\n", slip ? "SLIP" : "COBS",
+	       FRAME_SIZE, SYSCLK);
+	printf("payload  size   encode (KB/s)    decode (KB/s)\r\n");
+
+	for (i = 0; i < PAYLOAD_NUM; i++) {
+		make_payload(i);
+		enc = encode_cycles(slip, &len);
+		decoded_len = -1;
+		dec = decode_cycles(slip, len);
+
+		printf("%-7s %5d %7d (%5d) %7d (%5d)%s\r\n", payload_name[i],
+		       len, enc, throughput(enc), dec, throughput(dec),
+		       (decoded_len == FRAME_SIZE &&
+			!memcmp(decoded, frame, FRAME_SIZE)) ? "" : " NG");
+	}
+}
+
+int main(void)
+{
+	int c;
+
+	clock_setup();
+	usart_setup();
+	systick_setup();
+
+	cobs_decoder_init(&cobs_dec);
+	slip_decoder_init(&slip_dec);
+
+	printf("\r\nCOBS/SLIP codec (cycles per frame)\r\n");
+	bench(false);
+	bench(true);
+
+	c = copy_cycles();
+	printf("\r\nmemcpy %d (%d KB/s)\r\n", c, throughput(c));
+
+	while (1)
+		__asm__ ("nop");
+
+	return 0;
+}
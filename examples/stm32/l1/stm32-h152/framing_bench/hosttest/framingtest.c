@@ -0,0 +1,372 @@
+/*
+ * Host test of the COBS and SLIP codecs (lib/stm32/l1/cobs.c, slip.c)
+ *
+ * Round trips frames at the COBS block boundaries and with the SLIP
+ * special bytes, decodes in chunks of various sizes, checks the error
+ * counters on truncated and oversized frames, and encodes across the end
+ * of a ring buffer. Exits with 1 on a failure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <stm32/l1/cobs.h>
+#include <stm32/l1/slip.h>
+
+/* Largest test frame */
+#define MAX_FRAME	1024
+
+/* Ring buffer for the wrap-around test */
+#define RING_SIZE	600
+
+static int failures;
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			failures++;					\
+		}							\
+	} while (0)
+
+/* The last decoded frame */
+static u8 frame[MAX_FRAME];
+static int frame_len;
+static int frames;
+
+static u8 cobs_buf[MAX_FRAME];
+static u8 slip_buf[MAX_FRAME];
+
+static void cobs_frame(struct cobs_decoder *d, const u8 *buf, int len)
+{
+	(void)d;
+	memcpy(frame, buf, len);
+	frame_len = len;
+	frames++;
+}
+
+static void slip_frame(struct slip_decoder *d, const u8 *buf, int len)
+{
+	(void)d;
+	memcpy(frame, buf, len);
+	frame_len = len;
+	frames++;
+}
+
+static struct cobs_decoder cobs_dec = {
+	.buf = cobs_buf,
+	.size = MAX_FRAME,
+	.frame = cobs_frame,
+};
+
+static struct slip_decoder slip_dec = {
+	.buf = slip_buf,
+	.size = MAX_FRAME,
+	.frame = slip_frame,
+};
+
+static int cobs_encode_frame(u8 *out, const u8 *data, int len)
+{
+	struct cobs_encoder e;
+
+	cobs_encode_begin(&e, out, COBS_MAX_ENCODED(MAX_FRAME), 0,
+			  COBS_MAX_ENCODED(MAX_FRAME));
+	cobs_encode(&e, data, len);
+	return cobs_encode_end(&e);
+}
+
+static int slip_encode_frame(u8 *out, const u8 *data, int len)
+{
+	struct slip_encoder e;
+
+	slip_encode_begin(&e, out, SLIP_MAX_ENCODED(MAX_FRAME), 0,
+			  SLIP_MAX_ENCODED(MAX_FRAME));
+	slip_encode(&e, data, len);
+	return slip_encode_end(&e);
+}
+
+/* Decode 'len' bytes in 'chunk'-byte pieces, and return the frame count. */
+static int decode(bool slip, const u8 *buf, int len, int chunk)
+{
+	int i;
+	int n;
+
+	frames = 0;
+	frame_len = -1;
+	for (i = 0; i < len; i += n) {
+		n = (len - i < chunk) ? len - i : chunk;
+		if (slip)
+			slip_decode(&slip_dec, buf + i, n);
+		else
+			cobs_decode(&cobs_dec, buf + i, n);
+	}
+	return frames;
+}
+
+/* Encode, check the size bound and the delimiters, and decode back. */
+static void round_trip(bool slip, const u8 *data, int len, int chunk)
+{
+	static u8 enc[SLIP_MAX_ENCODED(MAX_FRAME)];
+	int n;
+	int i;
+
+	if (slip) {
+		n = slip_encode_frame(enc, data, len);
+		CHECK(n > 0 && n <= SLIP_MAX_ENCODED(len));
+		CHECK(enc[0] == SLIP_END && enc[n - 1] == SLIP_END);
+		for (i = 1; i < n - 1; i++)
+			CHECK(enc[i] != SLIP_END);
+	} else {
+		n = cobs_encode_frame(enc, data, len);
+		CHECK(n > 0 && n <= COBS_MAX_ENCODED(len));
+		CHECK(enc[n - 1] == 0);
+		for (i = 0; i < n - 1; i++)
+			CHECK(enc[i] != 0);
+	}
+	if (n <= 0)
+		return;
+
+	/* SLIP drops empty frames. */
+	if (slip && !len) {
+		CHECK(decode(slip, enc, n, chunk) == 0);
+		return;
+	}
+	CHECK(decode(slip, enc, n, chunk) == 1);
+	CHECK(frame_len == len && !memcmp(frame, data, len));
+}
+
+static void test_round_trip(void)
+{
+	static const unsigned int sizes[] = {
+		0, 1, 2, 253, 254, 255, 508, 509, 1024
+	};
+	static const int chunks[] = {1, 3, 7, 64, 4096};
+	static u8 data[MAX_FRAME];
+	unsigned int s;
+	unsigned int c;
+	unsigned int i;
+
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+			/* Non-zero bytes */
+			for (i = 0; i < sizes[s]; i++)
+				data[i] = 1 + i % 255;
+			round_trip(false, data, sizes[s], chunks[c]);
+			round_trip(true, data, sizes[s], chunks[c]);
+
+			/* All zero */
+			memset(data, 0, sizes[s]);
+			round_trip(false, data, sizes[s], chunks[c]);
+			round_trip(true, data, sizes[s], chunks[c]);
+
+			/* Every byte value, SLIP END and ESC included */
+			for (i = 0; i < sizes[s]; i++)
+				data[i] = i * 7;
+			round_trip(false, data, sizes[s], chunks[c]);
+			round_trip(true, data, sizes[s], chunks[c]);
+		}
+	}
+}
+
+static void test_cobs_encoding(void)
+{
+	static const u8 empty[] = {0x01, 0x00};
+	static const u8 zero[] = {0x01, 0x01, 0x00};
+	static const u8 mixed[] = {0x03, 0x11, 0x22, 0x02, 0x33, 0x00};
+	static const u8 mixed_data[] = {0x11, 0x22, 0x00, 0x33};
+	static u8 data[508];
+	static u8 enc[COBS_MAX_ENCODED(MAX_FRAME)];
+	int n;
+	int i;
+
+	CHECK(cobs_encode_frame(enc, data, 0) == 2);
+	CHECK(!memcmp(enc, empty, sizeof(empty)));
+
+	data[0] = 0;
+	CHECK(cobs_encode_frame(enc, data, 1) == 3);
+	CHECK(!memcmp(enc, zero, sizeof(zero)));
+
+	CHECK(cobs_encode_frame(enc, mixed_data, 4) == 6);
+	CHECK(!memcmp(enc, mixed, sizeof(mixed)));
+
+	for (i = 0; i < 508; i++)
+		data[i] = 0xaa;
+
+	/* 253 bytes: one block */
+	n = cobs_encode_frame(enc, data, 253);
+	CHECK(n == 255 && enc[0] == 254);
+
+	/* 254 bytes: a full (0xff) block and an empty one */
+	n = cobs_encode_frame(enc, data, 254);
+	CHECK(n == 257 && enc[0] == 0xff && enc[255] == 0x01);
+
+	/* 255 bytes */
+	n = cobs_encode_frame(enc, data, 255);
+	CHECK(n == 258 && enc[0] == 0xff && enc[255] == 0x02);
+
+	/* 508 bytes: two full blocks and an empty one */
+	n = cobs_encode_frame(enc, data, 508);
+	CHECK(n == 512 && enc[0] == 0xff && enc[255] == 0xff &&
+	      enc[510] == 0x01);
+}
+
+static void test_slip_encoding(void)
+{
+	static const u8 data[] = {
+		SLIP_END, 0x01, SLIP_ESC, SLIP_ESC_END, SLIP_ESC_ESC
+	};
+	static const u8 expected[] = {
+		SLIP_END, SLIP_ESC, SLIP_ESC_END, 0x01, SLIP_ESC, SLIP_ESC_ESC,
+		SLIP_ESC_END, SLIP_ESC_ESC, SLIP_END
+	};
+	static u8 enc[SLIP_MAX_ENCODED(MAX_FRAME)];
+
+	CHECK(slip_encode_frame(enc, data, sizeof(data)) == sizeof(expected));
+	CHECK(!memcmp(enc, expected, sizeof(expected)));
+}
+
+static void test_cobs_errors(void)
+{
+	/* The code byte 0x05 announces 4 bytes, only 2 follow. */
+	static const u8 truncated[] = {0x05, 0x11, 0x22, 0x00};
+	static const u8 good[] = {0x02, 0x11, 0x00};
+	static u8 data[MAX_FRAME];
+	static u8 enc[COBS_MAX_ENCODED(MAX_FRAME)];
+	u32 errors;
+	int n;
+
+	errors = cobs_decoder_get_error(&cobs_dec);
+	CHECK(decode(false, truncated, sizeof(truncated), 1) == 0);
+	CHECK(cobs_decoder_get_error(&cobs_dec) == errors + 1);
+
+	/* The decoder resynchronizes at the delimiter. */
+	CHECK(decode(false, good, sizeof(good), 2) == 1);
+	CHECK(frame_len == 1 && frame[0] == 0x11);
+
+	/* Consecutive delimiters are not frames or errors. */
+	errors = cobs_decoder_get_error(&cobs_dec);
+	CHECK(decode(false, (const u8 *)"\0\0\0", 3, 1) == 0);
+	CHECK(cobs_decoder_get_error(&cobs_dec) == errors);
+
+	/* Oversized: one byte more than the decoder buffer */
+	memset(data, 0x55, MAX_FRAME);
+	cobs_dec.size = MAX_FRAME - 1;
+	n = cobs_encode_frame(enc, data, MAX_FRAME);
+	CHECK(decode(false, enc, n, 5) == 0);
+	CHECK(cobs_decoder_get_error(&cobs_dec) == errors + 1);
+	cobs_dec.size = MAX_FRAME;
+	CHECK(decode(false, enc, n, 5) == 1 && frame_len == MAX_FRAME);
+
+	/* Out of encoder space */
+	{
+		struct cobs_encoder e;
+
+		cobs_encode_begin(&e, enc, 10, 0, 10);
+		CHECK(cobs_encode(&e, data, 9) == 0);
+		CHECK(cobs_encode(&e, data, 1) == -1);
+		CHECK(cobs_encode_end(&e) == -1);
+	}
+}
+
+static void test_slip_errors(void)
+{
+	/* ESC followed by END */
+	static const u8 bad_escape[] = {SLIP_END, 0x11, SLIP_ESC, SLIP_END};
+	/* ESC followed by an invalid byte */
+	static const u8 bad_code[] = {SLIP_END, SLIP_ESC, 0x11, SLIP_END};
+	static const u8 good[] = {SLIP_END, 0x22, SLIP_END};
+	static u8 data[MAX_FRAME];
+	static u8 enc[SLIP_MAX_ENCODED(MAX_FRAME)];
+	u32 errors;
+	int n;
+
+	errors = slip_decoder_get_error(&slip_dec);
+	CHECK(decode(true, bad_escape, sizeof(bad_escape), 1) == 0);
+	CHECK(decode(true, bad_code, sizeof(bad_code), 3) == 0);
+	CHECK(slip_decoder_get_error(&slip_dec) == errors + 2);
+
+	CHECK(decode(true, good, sizeof(good), 1) == 1);
+	CHECK(frame_len == 1 && frame[0] == 0x22);
+
+	/* Oversized */
+	memset(data, SLIP_END, MAX_FRAME);
+	errors = slip_decoder_get_error(&slip_dec);
+	slip_dec.size = MAX_FRAME - 1;
+	n = slip_encode_frame(enc, data, MAX_FRAME);
+	CHECK(decode(true, enc, n, 7) == 0);
+	CHECK(slip_decoder_get_error(&slip_dec) == errors + 1);
+	slip_dec.size = MAX_FRAME;
+
+	/* Out of encoder space: an escape does not fit. */
+	{
+		struct slip_encoder e;
+
+		slip_encode_begin(&e, enc, 3, 0, 3);
+		CHECK(slip_encode(&e, data, 1) == 0);
+		CHECK(slip_encode_end(&e) == -1);
+	}
+}
+
+/* Encode from 'pos' near the end of a ring buffer, and decode unwrapped. */
+static void test_ring(bool slip, int pos)
+{
+	static u8 ring[RING_SIZE];
+	static u8 data[300];
+	static u8 enc[RING_SIZE];
+	struct cobs_encoder ce;
+	struct slip_encoder se;
+	int n;
+	int i;
+
+	for (i = 0; i < 300; i++)
+		data[i] = (i % 50) ? i : 0;
+	memset(ring, 0xee, sizeof(ring));
+
+	if (slip) {
+		slip_encode_begin(&se, ring, RING_SIZE, pos, RING_SIZE);
+		CHECK(slip_encode(&se, data, 100) == 0);
+		CHECK(slip_encode(&se, data + 100, 200) == 0);
+		n = slip_encode_end(&se);
+	} else {
+		cobs_encode_begin(&ce, ring, RING_SIZE, pos, RING_SIZE);
+		CHECK(cobs_encode(&ce, data, 100) == 0);
+		CHECK(cobs_encode(&ce, data + 100, 200) == 0);
+		n = cobs_encode_end(&ce);
+	}
+	CHECK(n > 0);
+	if (n <= 0)
+		return;
+
+	for (i = 0; i < n; i++)
+		enc[i] = ring[(pos + i) % RING_SIZE];
+	CHECK(decode(slip, enc, n, 11) == 1);
+	CHECK(frame_len == 300 && !memcmp(frame, data, 300));
+}
+
+int main(void)
+{
+	static const int pos[] = {
+		0, RING_SIZE - 1, RING_SIZE - 2, RING_SIZE - 5, RING_SIZE - 255
+	};
+	unsigned int i;
+
+	cobs_decoder_init(&cobs_dec);
+	slip_decoder_init(&slip_dec);
+
+	test_round_trip();
+	test_cobs_encoding();
+	test_slip_encoding();
+	test_cobs_errors();
+	test_slip_errors();
+	for (i = 0; i < sizeof(pos) / sizeof(pos[0]); i++) {
+		test_ring(false, pos[i]);
+		test_ring(true, pos[i]);
+	}
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2009 Uwe Hermann <uwe@hermann-uwe.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <rcc.h>
+#include <pwr.h>
+#include <flash.h>
+#include <gpio.h>
+#include <usart.h>
+#include <dma.h>
+#include <tim.h>
+#include <nvic.h>
+#include <modbus.h>
+
+/* USART and TIM6 clock frequency */
+#define PCLK1		32000000
+
+/* Baud rate (8E1) */
+#define BAUD		19200
+
+/* Slave address */
+#define ADDRESS		1
+
+/*
+ * Holding register 0: LEDs (bit 0: PE10, bit 1: PE11)
+ * Input register 0, 1: Sample counter (high, low)
+ */
+static volatile u16 leds;
+static volatile u32 samples;
+
+static int read_registers(struct modbus *m, int function, int addr, int n,
+			  u16 *regs);
+static int write_registers(struct modbus *m, int addr, int n,
+			   const u16 *regs);
+
+static struct modbus modbus = {
+	.usart = USART2,
+	.dr = (u32)&USART2_DR,
+	.baud = BAUD,
+	.dma_rx = DMA_USART2_RX,
+	.dma_tx = DMA_USART2_TX,
+	.tim = TIM6,
+	.tim_clock = PCLK1,
+	.de = GPIO_PD4,
+	.address = ADDRESS,
+	.read_registers = read_registers,
+	.write_registers = write_registers,
+};
+
+/* Set STM32 to 32 MHz. */
+static void clock_setup(void)
+{
+	/* Enable PWR clock. */
+	rcc_enable_clock(RCC_PWR);
+
+	/* Set VCORE to 1.8V */
+	pwr_set_vos(PWR_1_8_V);
+
+	/* Set Flash memory latency (1WS). */
+	flash_enable_64bit_access(1);
+
+	/* Enable external high-speed oscillator 8MHz. */
+	rcc_enable_osc(RCC_HSE);
+
+	 /* Setup PLL (8MHz * 12 / 3 = 32MHz). */
+	rcc_setup_pll(RCC_HSE, 12, 3);
+
+	/* Enable PLL and wait for it to stabilize. */
+	rcc_enable_osc(RCC_PLL);
+
+	/* Select PLL as SYSCLK source. */
+	rcc_set_sysclk_source(RCC_PLL);
+}
+
+static void gpio_setup(void)
+{
+	/* Enable GPIOE clock. */
+	rcc_enable_clock(RCC_GPIOE);
+
+	/* Setup GPIO10 and 11 (in GPIO port E) for LED use. */
+	gpio_config_output(GPIO_PUSHPULL, GPIO_10MHZ, GPIO_NOPUPD,
+			   GPIO_PE(10, 11));
+}
+
+static void modbus_setup(void)
+{
+	/* Enable GPIOD clock. */
+	rcc_enable_clock(RCC_GPIOD);
+
+	/* Enable USART2, DMA1 and TIM6 clock. */
+	rcc_enable_clock(RCC_USART2);
+	rcc_enable_clock(DMA_RCC_USART2_RX);
+	rcc_enable_clock(RCC_TIM6);
+
+	/* Enable the USART2 and TIM6 interrupt. */
+	nvic_enable_irq(NVIC_USART2_IRQ);
+	nvic_enable_irq(NVIC_TIM6_IRQ);
+
+	/* Setup GPIO pin PD5 and PD6 as alternate function. */
+	gpio_config_altfn(GPIO_USART1_3, GPIO_PUSHPULL, GPIO_10MHZ,
+			  GPIO_NOPUPD, GPIO_PD(USART2_TX, USART2_RX));
+
+	/* Setup GPIO pin PD4 as DE of the RS-485 transceiver. */
+	gpio_config_output(GPIO_PUSHPULL, GPIO_10MHZ, GPIO_NOPUPD,
+			   GPIO_PD(4));
+
+	/* Setup USART2 (the parity bit is included in the word length). */
+	usart_init(USART2, PCLK1, BAUD, 9, USART_STOP_1, USART_EVEN,
+		   USART_FLOW_NONE, USART_TX_RX);
+
+	/* Start Modbus. */
+	modbus_init(&modbus);
+}
+
+static int read_registers(struct modbus *m, int function, int addr, int n,
+			  u16 *regs)
+{
+	u32 s;
+	int i;
+
+	(void)m;
+
+	if (function == MODBUS_READ_HOLDING_REGISTERS) {
+		if (addr != 0 || n != 1)
+			return MODBUS_ILLEGAL_DATA_ADDRESS;
+		regs[0] = leds;
+		return 0;
+	}
+
+	if (addr + n > 2)
+		return MODBUS_ILLEGAL_DATA_ADDRESS;
+	s = samples;
+	for (i = 0; i < n; i++)
+		regs[i] = (addr + i) ? s : s >> 16;
+	return 0;
+}
+
+static int write_registers(struct modbus *m, int addr, int n,
+			   const u16 *regs)
+{
+	(void)m;
+
+	if (addr != 0 || n != 1)
+		return MODBUS_ILLEGAL_DATA_ADDRESS;
+	if (regs[0] > 3)
+		return MODBUS_ILLEGAL_DATA_VALUE;
+
+	leds = regs[0];
+	if (leds & 1)
+		gpio_set(GPIO_PE10);
+	else
+		gpio_clear(GPIO_PE10);
+	if (leds & 2)
+		gpio_set(GPIO_PE11);
+	else
+		gpio_clear(GPIO_PE11);
+	return 0;
+}
+
+void usart2_isr(void)
+{
+	modbus_usart_isr(&modbus);
+}
+
+void tim6_isr(void)
+{
+	modbus_tim_isr(&modbus);
+}
+
+int main(void)
+{
+	clock_setup();
+	gpio_setup();
+	modbus_setup();
+
+	/* The frames are handled in the interrupt handlers. */
+	while (1)
+		samples++;
+
+	return 0;
+}
@@ -0,0 +1,314 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <rcc.h>
+#include <pwr.h>
+#include <flash.h>
+#include <gpio.h>
+#include <tim.h>
+#include <spi.h>
+#include <dma.h>
+#include <nvic.h>
+#include <spidma.h>
+#include <spibus.h>
+
+#define TIMX_CLK_APB1	32000000
+
+/* Microchip 25LC640A - 64Kbit SPI Serial EEPROM */
+#define ROM_SIZE	8192	/* 8KByte */
+#define COMMAND_READ	0x03
+
+/* Freescale MPL115A1 - Miniature SPI Digital Barometer */
+#define START_CONVERSIONS	0x24
+#define READ_PRESSURE_MSB	0x80
+#define READ_PRESSURE_LSB	0x82
+#define READ_TEMPERATURE_MSB	0x84
+#define READ_TEMPERATURE_LSB	0x86
+
+/* Read block size (bytes) */
+#define BLOCK_SIZE	256
+
+/* EEPROM: mode 3, 8 MHz, nCS = PD5 */
+static const struct spibus_device rom = {
+	.prescaler = 4,
+	.mode = SPI_CLOCK_POLARITY | SPI_CLOCK_PHASE,
+	.cs = GPIO_PD5,
+};
+
+/* Barometer: mode 0, 4 MHz, nCS = PD4 */
+static const struct spibus_device baro = {
+	.prescaler = 8,
+	.mode = 0,
+	.cs = GPIO_PD4,
+};
+
+static struct spibus bus = {
+	.spi = SPI1,
+	.dr = (u32)&SPI1_DR,
+	.dma_rx = DMA_SPI1_RX,
+	.dma_tx = DMA_SPI1_TX,
+};
+
+/* Barometer transactions */
+static const u8 conv_cmd[] = {
+	START_CONVERSIONS, 0
+};
+static const u8 press_cmd[] = {
+	READ_PRESSURE_MSB, 0,
+	READ_PRESSURE_LSB, 0,
+	READ_TEMPERATURE_MSB, 0,
+	READ_TEMPERATURE_LSB, 0,
+	0
+};
+static u8 press_buf[sizeof(press_cmd)];
+
+static const struct spibus_segment conv_seg[] = {
+	{conv_cmd, 0, sizeof(conv_cmd)}
+};
+static const struct spibus_segment press_seg[] = {
+	{press_cmd, press_buf, sizeof(press_cmd)}
+};
+
+static void conv_done(struct spibus_transaction *t, int error);
+static void baro_done(struct spibus_transaction *t, int error);
+
+static struct spibus_transaction conv = {
+	.dev = &baro,
+	.seg = conv_seg,
+	.num_seg = 1,
+	.done = conv_done,
+};
+static struct spibus_transaction press = {
+	.dev = &baro,
+	.seg = press_seg,
+	.num_seg = 1,
+	.done = baro_done,
+};
+
+/* A barometer transaction is queued. */
+static volatile bool baro_busy;
+
+/* Raw ADC values */
+static volatile u16 padc;
+static volatile u16 tadc;
+
+/* Set STM32 to 32 MHz. */
+static void clock_setup(void)
+{
+	/* Enable PWR clock. */
+	rcc_enable_clock(RCC_PWR);
+
+	/* Set VCORE to 1.8V */
+	pwr_set_vos(PWR_1_8_V);
+
+	/* Set Flash memory latency (1WS). */
+	flash_enable_64bit_access(1);
+
+	/* Enable external high-speed oscillator 8MHz. */
+	rcc_enable_osc(RCC_HSE);
+
+	 /* Setup PLL (8MHz * 12 / 3 = 32MHz). */
+	rcc_setup_pll(RCC_HSE, 12, 3);
+
+	/* Enable PLL and wait for it to stabilize. */
+	rcc_enable_osc(RCC_PLL);
+
+	/* Select PLL as SYSCLK source. */
+	rcc_set_sysclk_source(RCC_PLL);
+}
+
+static void gpio_setup(void)
+{
+	/* Enable GPIOE clock. */
+	rcc_enable_clock(RCC_GPIOE);
+
+	/* Set GPIO10 and GPIO11 (in GPIO port E) to 'output push-pull'. */
+	gpio_config_output(GPIO_PUSHPULL, GPIO_400KHZ, GPIO_NOPUPD,
+			   GPIO_PE(10, 11));
+
+	/* LED off */
+	gpio_set(GPIO_PE(10, 11));
+}
+
+/* 10 msec periodic interrupt */
+static void tim_setup(void)
+{
+	/* Enable TIM6 clock. */
+	rcc_enable_clock(RCC_TIM6);
+
+	/* Enable TIM6 interrupt. */
+	nvic_enable_irq(NVIC_TIM6_IRQ);
+
+	/* 10kHz, 100 counts */
+	tim_setup_counter(TIM6, TIMX_CLK_APB1 / 10000 - 1, 100 - 1);
+	tim_clear_interrupt(TIM6, TIM_UPDATE);
+	tim_enable_interrupt(TIM6, TIM_UPDATE);
+	tim_enable_counter(TIM6);
+}
+
+static void spi_setup(void)
+{
+	/* Enable GPIOD clock. */
+	rcc_enable_clock(RCC_GPIOD);
+
+	/* 'nCS' High */
+	gpio_set(GPIO_PD(4, 5));
+
+	/* Set GPIO4 and GPIO5 (in GPIO port D) to 'output push-pull'. */
+	gpio_config_output(GPIO_PUSHPULL, GPIO_40MHZ, GPIO_NOPUPD,
+			   GPIO_PD(4, 5));
+
+	/* Enable SPI1 clock. */
+	rcc_enable_clock(RCC_SPI1);
+
+	/* Set GPIO13-15 (in GPIO port E) to 'altfn push-pull'. */
+	gpio_config_altfn(GPIO_SPI1_2, GPIO_PUSHPULL, GPIO_40MHZ, GPIO_NOPUPD,
+			  GPIO_PE(SPI1_SCK, SPI1_MISO, SPI1_MOSI));
+
+	/* Enable DMA1 clock. */
+	rcc_enable_clock(DMA_RCC_SPI1);
+
+	/* Enable the DMA interrupts. */
+	nvic_enable_irq(DMA_SPI1_RX_IRQ);
+	nvic_enable_irq(DMA_SPI1_TX_IRQ);
+
+	/* The SPI is set up for each device. */
+	spibus_init(&bus);
+}
+
+void dma_spi1_rx_isr(void)
+{
+	spibus_isr(&bus);
+}
+
+void dma_spi1_tx_isr(void)
+{
+	spibus_isr(&bus);
+}
+
+static void conv_done(struct spibus_transaction *t, int error)
+{
+	(void)t;
+	(void)error;
+
+	baro_busy = false;
+}
+
+static void baro_done(struct spibus_transaction *t, int error)
+{
+	(void)t;
+
+	baro_busy = false;
+	if (error)
+		return;
+
+	/* 10-bit values */
+	padc = ((press_buf[1] << 8) | press_buf[3]) >> 6;
+	tadc = ((press_buf[5] << 8) | press_buf[7]) >> 6;
+
+	/* LED(PE11) on/off */
+	gpio_toggle(GPIO_PE11);
+}
+
+/* Start a conversion and read the result 10 msec later. */
+void tim6_isr(void)
+{
+	static bool converting;
+
+	if (!tim_get_interrupt_status(TIM6, TIM_UPDATE))
+		return;
+	tim_clear_interrupt(TIM6, TIM_UPDATE);
+
+	/* The last one is still queued behind the EEPROM. */
+	if (baro_busy)
+		return;
+
+	baro_busy = true;
+	spibus_submit(&bus, converting ? &press : &conv);
+	converting = !converting;
+}
+
+static void rom_done(struct spibus_transaction *t, int error)
+{
+	*(volatile int *)t->arg = error ? -1 : 1;
+}
+
+/* Read a block: instruction and address, then data. */
+static int rom_read(u16 addr, u8 *data, int nbyte)
+{
+	u8 cmd[3];
+	struct spibus_segment seg[2];
+	struct spibus_transaction t;
+	volatile int result = 0;
+
+	cmd[0] = COMMAND_READ;
+	cmd[1] = addr >> 8;
+	cmd[2] = addr & 0xff;
+
+	seg[0].tx = cmd;
+	seg[0].rx = 0;
+	seg[0].len = sizeof(cmd);
+	seg[1].tx = 0;
+	seg[1].rx = data;
+	seg[1].len = nbyte;
+
+	t.dev = &rom;
+	t.seg = seg;
+	t.num_seg = 2;
+	t.done = rom_done;
+	t.arg = (void *)&result;
+	spibus_submit(&bus, &t);
+
+	/* The barometer transactions run meanwhile. */
+	while (!result)
+		;
+
+	return (result < 0) ? -1 : 0;
+}
+
+int main(void)
+{
+	static u8 buf[BLOCK_SIZE];
+	u16 addr;
+
+	clock_setup();
+	gpio_setup();
+	spi_setup();
+	tim_setup();
+
+	/* Read the EEPROM repeatedly. */
+	while (1) {
+		for (addr = 0; addr < ROM_SIZE; addr += BLOCK_SIZE) {
+			if (rom_read(addr, buf, BLOCK_SIZE) < 0)
+				goto spi_error;
+		}
+
+		/* LED(PE10) on/off */
+		gpio_toggle(GPIO_PE10);
+	}
+
+spi_error:
+	/* LED(PE11) on */
+	tim_disable_counter(TIM6);
+	gpio_clear(GPIO_PE11);
+	while (1)
+		;
+
+	return 0;
+}
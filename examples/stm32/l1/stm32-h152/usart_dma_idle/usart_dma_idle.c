@@ -0,0 +1,190 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2009 Uwe Hermann <uwe@hermann-uwe.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <rcc.h>
+#include <pwr.h>
+#include <flash.h>
+#include <gpio.h>
+#include <usart.h>
+#include <dma.h>
+#include <nvic.h>
+#include <usartrx.h>
+
+/* USART clock frequency */
+#define PCLK1		32000000
+
+/* Baud rate */
+#define BAUD		1000000
+
+/* Rx ring buffer size */
+#define RING_SIZE	256
+
+/* Maximum frame size */
+#define FRAME_SIZE	512
+
+static u8 ring[RING_SIZE];
+
+/* The last frame */
+static u8 frame[FRAME_SIZE];
+static volatile int frame_len;
+static volatile bool frame_ready;
+static int rx_len;
+
+static void receive(struct usartrx *r, const u8 *data, int len, bool end);
+
+static struct usartrx rx = {
+	.usart = USART2,
+	.dr = (u32)&USART2_DR,
+	.dma = DMA_USART2_RX,
+	.ring = ring,
+	.size = RING_SIZE,
+	.receive = receive,
+};
+
+/* Set STM32 to 32 MHz. */
+static void clock_setup(void)
+{
+	/* Enable PWR clock. */
+	rcc_enable_clock(RCC_PWR);
+
+	/* Set VCORE to 1.8V */
+	pwr_set_vos(PWR_1_8_V);
+
+	/* Set Flash memory latency (1WS). */
+	flash_enable_64bit_access(1);
+
+	/* Enable external high-speed oscillator 8MHz. */
+	rcc_enable_osc(RCC_HSE);
+
+	 /* Setup PLL (8MHz * 12 / 3 = 32MHz). */
+	rcc_setup_pll(RCC_HSE, 12, 3);
+
+	/* Enable PLL and wait for it to stabilize. */
+	rcc_enable_osc(RCC_PLL);
+
+	/* Select PLL as SYSCLK source. */
+	rcc_set_sysclk_source(RCC_PLL);
+}
+
+static void gpio_setup(void)
+{
+	/* Enable GPIOE clock. */
+	rcc_enable_clock(RCC_GPIOE);
+
+	/* Setup GPIO10 and 11 (in GPIO port E) for LED use. */
+	gpio_config_output(GPIO_PUSHPULL, GPIO_10MHZ, GPIO_NOPUPD,
+			   GPIO_PE(10, 11));
+}
+
+static void usart_setup(void)
+{
+	/* Enable GPIOD clock. */
+	rcc_enable_clock(RCC_GPIOD);
+
+	/* Enable USART2 and DMA1 clock. */
+	rcc_enable_clock(RCC_USART2);
+	rcc_enable_clock(DMA_RCC_USART2_RX);
+
+	/* Enable the USART2 and DMA interrupt. */
+	nvic_enable_irq(NVIC_USART2_IRQ);
+	nvic_enable_irq(DMA_USART2_RX_IRQ);
+
+	/* Setup GPIO pin PD5 and PD6 as alternate function. */
+	gpio_config_altfn(GPIO_USART1_3, GPIO_PUSHPULL, GPIO_10MHZ,
+			  GPIO_NOPUPD, GPIO_PD(USART2_TX, USART2_RX));
+
+	/* Setup USART2. */
+	usart_init(USART2, PCLK1, BAUD, 8, USART_STOP_1,
+		   USART_PARITY_NONE, USART_FLOW_NONE, USART_TX_RX);
+
+	/* Start DMA reception. */
+	usartrx_init(&rx);
+}
+
+/* Collect a frame. The frame is dropped while the last one is sent. */
+static void receive(struct usartrx *r, const u8 *data, int len, bool end)
+{
+	int i;
+
+	(void)r;
+
+	if (!frame_ready) {
+		for (i = 0; i < len && rx_len < FRAME_SIZE; i++)
+			frame[rx_len++] = data[i];
+	}
+
+	if (end) {
+		if (!frame_ready) {
+			frame_len = rx_len;
+			frame_ready = true;
+		}
+		rx_len = 0;
+		gpio_toggle(GPIO_PE10);
+	}
+}
+
+void usart2_isr(void)
+{
+	usartrx_usart_isr(&rx);
+}
+
+void dma_usart2_rx_isr(void)
+{
+	usartrx_dma_isr(&rx);
+}
+
+static void send_number(int n)
+{
+	char buf[8];
+	int i = 0;
+
+	do {
+		buf[i++] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	while (i)
+		usart_send_blocking(USART2, buf[--i]);
+}
+
+int main(void)
+{
+	int i;
+
+	clock_setup();
+	gpio_setup();
+	usart_setup();
+
+	/* Send back each frame with its length. */
+	while (1) {
+		if (!frame_ready)
+			continue;
+
+		gpio_toggle(GPIO_PE11);
+		send_number(frame_len);
+		usart_send_blocking(USART2, ':');
+		usart_send_blocking(USART2, ' ');
+		for (i = 0; i < frame_len; i++)
+			usart_send_blocking(USART2, frame[i]);
+		usart_send_blocking(USART2, '\r');
+		usart_send_blocking(USART2, '\n');
+		frame_ready = false;
+	}
+
+	return 0;
+}
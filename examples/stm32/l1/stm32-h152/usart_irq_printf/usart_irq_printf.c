@@ -24,6 +24,7 @@
 #include <gpio.h>
 #include <nvic.h>
 #include <usart.h>
+#include <usartbuf.h>
 #include <tim.h>
 
 #include <syscall.h>
@@ -35,13 +36,21 @@
 /* Timer clock frequency */
 #define TIMX_CLK_APB1	32000000
 
-/* Maximum queue size */
-#define QUEUESIZE	1024
+/* Ring buffer size */
+#define TX_SIZE		1024
+#define RX_SIZE		64
 
-/* Tx, Rx queue */
-volatile u8 queue[QUEUESIZE];
-volatile int head;
-volatile int tail;
+static u8 tx_ring[TX_SIZE];
+static u8 rx_ring[RX_SIZE];
+
+/* Buffered USART2 */
+static struct usartbuf usart = {
+	.usart = USART2,
+	.rx_ring = rx_ring,
+	.rx_size = RX_SIZE,
+	.tx_ring = tx_ring,
+	.tx_size = TX_SIZE,
+};
 
 /* Flag */
 volatile bool wakeup;
@@ -99,64 +108,17 @@ static void usart_setup(void)
 	gpio_config_altfn(GPIO_USART1_3, GPIO_PUSHPULL, GPIO_10MHZ,
 			  GPIO_NOPUPD, GPIO_PD(USART2_TX, USART2_RX));
 
-	/* Enable USART2 Receive interrupt. */
-	usart_enable_interrupt(USART2, USART_RXNE);
-
 	/* Setup USART2. */
 	usart_init(USART2, PCLK1, 115200, 8, USART_STOP_1,
 		   USART_PARITY_NONE, USART_FLOW_NONE, USART_TX_RX);
+
+	/* Enable USART2 Receive interrupt. */
+	usartbuf_init(&usart);
 }
 
 void usart2_isr(void)
 {
-	u32 mask;
-	u32 status;
-
-	/* Check sprious. */
-	if (!(mask =
-	      usart_get_interrupt_mask(USART2, USART_RXNE | USART_TXE)) ||
-	    !(status =
-	      usart_get_interrupt_status(USART2, USART_RXNE | USART_TXE)))
-		return;
-
-	/* Check if we were called because of RXNE. */
-	if (mask & status & USART_RXNE) {
-		if ((tail + 1) % QUEUESIZE != head) {
-			/* Indicate that we got data. */
-			gpio_toggle(GPIO_PE10);
-
-			/* Retrieve the data from the peripheral. */
-			queue[tail++] = usart_recv(USART2);
-
-			/* next pointer */
-			tail %= QUEUESIZE;
-
-			/* Enable transmit interrupt */
-			if (!(mask & USART_TXE))
-				usart_enable_interrupt(USART2, USART_TXE);
-		} else {	/* overflow */
-			/* Clear interrupt. */
-			usart_recv(USART2);
-		}
-
-	}
-
-	/* Check if we were called because of TXE. */
-	if (mask & status & USART_TXE) {
-		if (head != tail) {
-			/* Indicate that we are sending out data. */
-			gpio_toggle(GPIO_PE11);
-
-			/* Put data into the transmit register. */
-			usart_send(USART2, queue[head++]);
-
-			/* next pointer */
-			head %= QUEUESIZE;
-		} else {
-			/* Disable the TXE interrupt */
-			usart_disable_interrupt(USART2, USART_TXE);
-		}
-	}
+	usartbuf_isr(&usart);
 }
 
 int _write(int file, char *ptr, int len)
@@ -164,23 +126,10 @@ int _write(int file, char *ptr, int len)
 	int i;
 
 	if (file == 1) {
-		/* Disable the USART2 interrupt. */
-		nvic_disable_irq(NVIC_USART2_IRQ);
-
-		for (i = 0; i < len && (tail + 1) % QUEUESIZE != head; i++) {
-			/* Enqueue. */
-			queue[tail++] = *ptr++;
-
-			/* next pointer */
-			tail %= QUEUESIZE;
-		}
-
-		/* Enable transmit interrupt. */
-		usart_enable_interrupt(USART2, USART_TXE);
-
-		/* Enable the USART2 interrupt. */
-		nvic_enable_irq(NVIC_USART2_IRQ);
-
+		/* Wait only if the Tx ring buffer is full. */
+		for (i = 0; i < len; i += usartbuf_write(&usart, ptr + i,
+							 len - i))
+			;
 		return i;
 	}
 
@@ -226,6 +175,8 @@ int main(void)
 	int counter = 0;
 	float fcounter = 0.0;
 	double dcounter = 0.0;
+	u8 buf[16];
+	int n;
 
 	clock_setup();
 	gpio_setup();
@@ -233,6 +184,13 @@ int main(void)
 	tim_setup();
 
 	while (1) {
+		/* Echo back the received data. */
+		n = usartbuf_read(&usart, buf, sizeof(buf));
+		if (n) {
+			gpio_toggle(GPIO_PE10);
+			usartbuf_write(&usart, buf, n);
+		}
+
 		if (wakeup) {
 			printf("Hello World! %i %f %lf\r\n", counter, fcounter,
 			       dcounter);
@@ -23,6 +23,9 @@
 #include <flash.h>
 #include <gpio.h>
 #include <usart.h>
+#include <dma.h>
+#include <nvic.h>
+#include <usartlog.h>
 
 #include <syscall.h>
 #include <stdio.h>
@@ -30,6 +33,21 @@
 /* USART clock frequency */
 #define PCLK1	32000000
 
+/* Ring buffer size */
+#define LOG_SIZE	1024
+
+static u8 log_ring[LOG_SIZE];
+
+/* printf() output, dropped while the ring buffer is full */
+static struct usartlog stdout_log = {
+	.usart = USART2,
+	.dr = (u32)&USART2_DR,
+	.dma = DMA_USART2_TX,
+	.ring = log_ring,
+	.size = LOG_SIZE,
+	.policy = USARTLOG_DROP,
+};
+
 static void clock_setup(void)
 {
 	/* Enable PWR clock. */
@@ -71,8 +89,12 @@ static void usart_setup(void)
 	/* Enable GPIOD clock. */
 	rcc_enable_clock(RCC_GPIOD);
 
-	/* Enable USART2 clock. */
+	/* Enable USART2 and DMA1 clock. */
 	rcc_enable_clock(RCC_USART2);
+	rcc_enable_clock(DMA_RCC_USART2_TX);
+
+	/* Enable the DMA interrupt. */
+	nvic_enable_irq(DMA_USART2_TX_IRQ);
 
 	/* Setup GPIO pin PD5 as alternate function. */
 	gpio_config_altfn(GPIO_USART1_3, GPIO_PUSHPULL, GPIO_10MHZ,
@@ -81,20 +103,14 @@ static void usart_setup(void)
 	/* Setup USART2. */
 	usart_init(USART2, PCLK1, 115200, 8, USART_STOP_1,
 		   USART_PARITY_NONE, USART_FLOW_NONE, USART_TX);
+
+	/* printf() -> DMA */
+	usartlog_init(&stdout_log);
 }
 
-int _write(int file, char *ptr, int len)
+void dma_usart2_tx_isr(void)
 {
-	int i;
-
-	if (file == 1) {
-		for (i = 0; i < len; i++)
-			usart_send_blocking(USART2, ptr[i]);
-		return i;
-	}
-
-	errno = EIO;
-	return -1;
+	usartlog_dma_isr(&stdout_log);
 }
 
 int main(void)
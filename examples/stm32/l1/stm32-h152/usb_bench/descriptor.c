@@ -0,0 +1,170 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <usbdev.h>
+
+#include <usb/standard.h>
+#include <usb/descriptor.h>
+#include <usb/langid.h>
+
+#include "usb_bench.h"
+#include "descriptor.h"
+
+/* Configuration */
+struct config_desc {
+	struct usb_config_descriptor config;
+	/* Alternate setting 0: bulk and interrupt */
+	struct usb_interface_descriptor bulk_if;
+	struct usb_endpoint_descriptor bulk_sink_endp;
+	struct usb_endpoint_descriptor bulk_source_endp;
+	struct usb_endpoint_descriptor bulk_loop_rx_endp;
+	struct usb_endpoint_descriptor bulk_loop_tx_endp;
+	/* Alternate setting 1: bulk, interrupt and isochronous */
+	struct usb_interface_descriptor iso_if;
+	struct usb_endpoint_descriptor iso_sink_endp;
+	struct usb_endpoint_descriptor iso_source_endp;
+	struct usb_endpoint_descriptor iso_loop_rx_endp;
+	struct usb_endpoint_descriptor iso_loop_tx_endp;
+	struct usb_endpoint_descriptor iso_endp;
+} __attribute__ ((packed));
+
+/* Endpoints of both alternate settings */
+#define SINK_ENDPOINT_DESCRIPTOR					\
+	USB_ENDPOINT_DESCRIPTOR_INIT(					\
+		.bEndpointAddress = SINK_ENUM,				\
+		.bmAttributes = USB_ENDPOINT_TRANS_BULK,		\
+		.wMaxPacketSize = BULK_SIZE,				\
+		.bInterval = 0,						\
+	)
+#define SOURCE_ENDPOINT_DESCRIPTOR					\
+	USB_ENDPOINT_DESCRIPTOR_INIT(					\
+		.bEndpointAddress = SOURCE_ENUM,			\
+		.bmAttributes = USB_ENDPOINT_TRANS_BULK,		\
+		.wMaxPacketSize = BULK_SIZE,				\
+		.bInterval = 0,						\
+	)
+#define LOOP_RX_ENDPOINT_DESCRIPTOR					\
+	USB_ENDPOINT_DESCRIPTOR_INIT(					\
+		.bEndpointAddress = LOOP_RX_ENUM,			\
+		.bmAttributes = USB_ENDPOINT_TRANS_INTERRUPT,		\
+		.wMaxPacketSize = LOOP_SIZE,				\
+		.bInterval = LOOP_INTERVAL,				\
+	)
+#define LOOP_TX_ENDPOINT_DESCRIPTOR					\
+	USB_ENDPOINT_DESCRIPTOR_INIT(					\
+		.bEndpointAddress = LOOP_TX_ENUM,			\
+		.bmAttributes = USB_ENDPOINT_TRANS_INTERRUPT,		\
+		.wMaxPacketSize = LOOP_SIZE,				\
+		.bInterval = LOOP_INTERVAL,				\
+	)
+
+/* Device Descriptor */
+static const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) =
+USB_DEVICE_DESCRIPTOR_INIT(
+	.bcdUSB = 0x0200,
+	.bDeviceClass = 0,
+	.bDeviceSubClass = 0,
+	.bDeviceProtocol = 0,
+	.bMaxPacketSize0 = MAXPACKETSIZE0,
+	.idVendor = BENCH_VID,
+	.idProduct = BENCH_PID,
+	.bcdDevice = 0x0010,
+	.iManufacturer = STRING_MANUFACTURER,
+	.iProduct = STRING_PRODUCT,
+	.iSerialNumber = 0,
+	.bNumConfigurations = 1,
+);
+
+static const struct config_desc config_desc __attribute__ ((aligned(2))) = {
+	/* Configuration Descriptor */
+	.config = USB_CONFIG_DESCRIPTOR_INIT(struct config_desc,
+		.bNumInterfaces = NUM_INTERFACE,
+		.bConfigurationValue = CONFIGURATION_VALUE,
+		.iConfiguration = 0,
+		.bmAttributes = USB_CONFIG_ATTR_D7,
+		.bMaxPower = 100 / 2,
+	),
+	/* Interface Descriptor (alternate setting 0) */
+	.bulk_if = USB_INTERFACE_DESCRIPTOR_INIT(
+		.bInterfaceNumber = INTERFACE_BENCH,
+		.bAlternateSetting = ALT_BULK,
+		.bNumEndpoints = 4,
+		.bInterfaceClass = USB_CLASS_VENDOR,
+		.bInterfaceSubClass = 0,
+		.bInterfaceProtocol = 0,
+		.iInterface = 0,
+	),
+	.bulk_sink_endp = SINK_ENDPOINT_DESCRIPTOR,
+	.bulk_source_endp = SOURCE_ENDPOINT_DESCRIPTOR,
+	.bulk_loop_rx_endp = LOOP_RX_ENDPOINT_DESCRIPTOR,
+	.bulk_loop_tx_endp = LOOP_TX_ENDPOINT_DESCRIPTOR,
+	/* Interface Descriptor (alternate setting 1) */
+	.iso_if = USB_INTERFACE_DESCRIPTOR_INIT(
+		.bInterfaceNumber = INTERFACE_BENCH,
+		.bAlternateSetting = ALT_ISO,
+		.bNumEndpoints = 5,
+		.bInterfaceClass = USB_CLASS_VENDOR,
+		.bInterfaceSubClass = 0,
+		.bInterfaceProtocol = 0,
+		.iInterface = 0,
+	),
+	.iso_sink_endp = SINK_ENDPOINT_DESCRIPTOR,
+	.iso_source_endp = SOURCE_ENDPOINT_DESCRIPTOR,
+	.iso_loop_rx_endp = LOOP_RX_ENDPOINT_DESCRIPTOR,
+	.iso_loop_tx_endp = LOOP_TX_ENDPOINT_DESCRIPTOR,
+	/* Isochronous source endpoint */
+	.iso_endp = USB_ENDPOINT_DESCRIPTOR_INIT(
+		.bEndpointAddress = ISO_ENUM,
+		.bmAttributes = (USB_ENDPOINT_TRANS_ISOCHRONOUS |
+				 USB_ENDPOINT_SYNC_ASYNC |
+				 USB_ENDPOINT_USAGE_DATA),
+		.wMaxPacketSize = ISO_SIZE,
+		.bInterval = ISO_INTERVAL,
+	),
+};
+
+/* String Descriptors */
+static USB_DEFINE_LANGID_DESCRIPTOR(langid, LANGID_ENGLISH_US);
+static USB_DEFINE_STRING_DESCRIPTOR(manufacturer, L"MPC Research Ltd.");
+static USB_DEFINE_STRING_DESCRIPTOR(product, L"USB Benchmark");
+
+static const void * const string_desc[NUM_STRING_DESC] = {
+	[STRING_LANGID] = &langid,
+	[STRING_MANUFACTURER] = &manufacturer,
+	[STRING_PRODUCT] = &product,
+};
+
+/* Control OUT data */
+static u8 outbuf[MAX_DATA_OUT] __attribute__ ((aligned(4)));
+
+/* USB device */
+const struct usbdev_device bench_device = {
+	.device = &dev_desc,
+	.config = &config_desc.config,
+	.langid = LANGID_ENGLISH_US,
+	.num_string = NUM_STRING_DESC - 1,
+	.string_desc = string_desc,
+	.dbl_buf = ((1 << (SINK_ENUM & 0xf)) | (1 << (SOURCE_ENUM & 0xf))),
+	.buf = outbuf,
+	.bufsize = MAX_DATA_OUT,
+	.request = bench_request,
+	.set_configuration = bench_set_configuration,
+	.set_interface = bench_set_interface,
+	.reset = bench_reset,
+};
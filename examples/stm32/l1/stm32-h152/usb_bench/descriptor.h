@@ -17,10 +17,11 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-bool standard_request_error(struct usb_setup_data *req);
-int standard_request(struct usb_setup_data *req, u8 *buf, u8 **data);
-void standard_reset(void);
-
-extern usb_standard_state_t standard_state;
-
+extern const struct usbdev_device bench_device;
 
+/* usb_bench.c */
+int bench_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		  u8 **data);
+void bench_set_configuration(int value);
+void bench_set_interface(int interface, int altsetting);
+void bench_reset(void);
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <libusb-1.0/libusb.h>
+
+#include "../usb_bench.h"
+#include "usbbench.h"
+
+/* Isochronous transfers in flight */
+#define ISO_TRANSFERS	4
+
+static libusb_context *ctx;
+static libusb_device_handle *dev_handle;
+
+static struct libusb_transfer *iso_transfer[ISO_TRANSFERS];
+static unsigned char iso_buf[ISO_TRANSFERS][ISO_PACKETS * ISO_SIZE];
+static int iso_done[ISO_TRANSFERS];
+static int iso_next;
+
+static int error(const char *s, int r)
+{
+	fprintf(stderr, "%s failed: %s\n", s, libusb_error_name(r));
+	return -1;
+}
+
+static int usb_open(void)
+{
+	int r;
+	int i;
+
+	r = libusb_init(&ctx);
+	if (r < 0)
+		return error("libusb_init()", r);
+
+	for (i = 0; i < 3; i++) {
+		dev_handle = libusb_open_device_with_vid_pid(ctx, BENCH_VID,
+							     BENCH_PID);
+		if (dev_handle)
+			break;
+		usleep(100000);
+	}
+	if (!dev_handle) {
+		fprintf(stderr, "libusb_open_device_with_vid_pid() failed.\n");
+		libusb_exit(ctx);
+		return -1;
+	}
+
+	r = libusb_claim_interface(dev_handle, INTERFACE_BENCH);
+	if (r < 0) {
+		error("libusb_claim_interface()", r);
+		libusb_close(dev_handle);
+		libusb_exit(ctx);
+		return -1;
+	}
+	return 0;
+}
+
+static void usb_close(void)
+{
+	libusb_release_interface(dev_handle, INTERFACE_BENCH);
+	libusb_close(dev_handle);
+	libusb_exit(ctx);
+}
+
+static int usb_get_stats(uint32_t *stats)
+{
+	unsigned char buf[4 * NUM_STAT];
+	int r;
+	int i;
+
+	r = libusb_control_transfer(dev_handle,
+				    LIBUSB_REQUEST_TYPE_VENDOR |
+				    LIBUSB_RECIPIENT_DEVICE |
+				    LIBUSB_ENDPOINT_IN, BENCH_REQ_GET_STATS, 0,
+				    0, buf, sizeof(buf), TIMEOUT);
+	if (r < 0)
+		return error("libusb_control_transfer()", r);
+
+	/* Little endian */
+	for (i = 0; i < NUM_STAT; i++)
+		stats[i] = (buf[4 * i] | (buf[4 * i + 1] << 8) |
+			    (buf[4 * i + 2] << 16) |
+			    ((uint32_t)buf[4 * i + 3] << 24));
+	return 0;
+}
+
+static int usb_clear_stats(void)
+{
+	int r;
+
+	r = libusb_control_transfer(dev_handle,
+				    LIBUSB_REQUEST_TYPE_VENDOR |
+				    LIBUSB_RECIPIENT_DEVICE |
+				    LIBUSB_ENDPOINT_OUT, BENCH_REQ_CLEAR_STATS, 0,
+				    0, NULL, 0, TIMEOUT);
+	if (r < 0)
+		return error("libusb_control_transfer()", r);
+	return 0;
+}
+
+static int usb_set_altsetting(int alt)
+{
+	int r;
+
+	r = libusb_set_interface_alt_setting(dev_handle, INTERFACE_BENCH, alt);
+	if (r < 0)
+		return error("libusb_set_interface_alt_setting()", r);
+	return 0;
+}
+
+static int transfer(unsigned char ep, unsigned char *buf, int len,
+		    int interrupt)
+{
+	int transferred;
+	int r;
+
+	if (interrupt)
+		r = libusb_interrupt_transfer(dev_handle, ep, buf, len,
+					      &transferred, TIMEOUT);
+	else
+		r = libusb_bulk_transfer(dev_handle, ep, buf, len,
+					 &transferred, TIMEOUT);
+	if (r < 0)
+		return error(interrupt ? "libusb_interrupt_transfer()" :
+			     "libusb_bulk_transfer()", r);
+	return transferred;
+}
+
+static int usb_bulk_in(unsigned char *buf, int len)
+{
+	return transfer(SOURCE_ENUM, buf, len, 0);
+}
+
+static int usb_bulk_out(unsigned char *buf, int len)
+{
+	return transfer(SINK_ENUM, buf, len, 0);
+}
+
+static int usb_intr_out(unsigned char *buf, int len)
+{
+	return transfer(LOOP_RX_ENUM, buf, len, 1);
+}
+
+static int usb_intr_in(unsigned char *buf, int len)
+{
+	return transfer(LOOP_TX_ENUM, buf, len, 1);
+}
+
+static void LIBUSB_CALL iso_callback(struct libusb_transfer *t)
+{
+	*(int *)t->user_data = 1;
+}
+
+static int usb_iso_start(void)
+{
+	int r;
+	int i;
+
+	for (i = 0; i < ISO_TRANSFERS; i++) {
+		iso_transfer[i] = libusb_alloc_transfer(ISO_PACKETS);
+		if (!iso_transfer[i]) {
+			fprintf(stderr, "libusb_alloc_transfer() failed.\n");
+			return -1;
+		}
+		libusb_fill_iso_transfer(iso_transfer[i], dev_handle, ISO_ENUM,
+					 iso_buf[i], sizeof(iso_buf[i]),
+					 ISO_PACKETS, iso_callback,
+					 &iso_done[i], TIMEOUT);
+		libusb_set_iso_packet_lengths(iso_transfer[i], ISO_SIZE);
+		iso_done[i] = 0;
+		r = libusb_submit_transfer(iso_transfer[i]);
+		if (r < 0)
+			return error("libusb_submit_transfer()", r);
+	}
+	iso_next = 0;
+	return 0;
+}
+
+static int usb_iso_read(unsigned char *buf, int *len)
+{
+	struct libusb_transfer *t;
+	int r;
+	int i;
+
+	t = iso_transfer[iso_next];
+	while (!iso_done[iso_next]) {
+		r = libusb_handle_events_completed(ctx, &iso_done[iso_next]);
+		if (r < 0)
+			return error("libusb_handle_events_completed()", r);
+	}
+	if (t->status != LIBUSB_TRANSFER_COMPLETED) {
+		fprintf(stderr, "Isochronous transfer failed: %d\n",
+			t->status);
+		return -1;
+	}
+
+	for (i = 0; i < ISO_PACKETS; i++) {
+		if (t->iso_packet_desc[i].status ==
+		    LIBUSB_TRANSFER_COMPLETED)
+			len[i] = t->iso_packet_desc[i].actual_length;
+		else
+			len[i] = -1;
+	}
+	memcpy(buf, iso_buf[iso_next], sizeof(iso_buf[iso_next]));
+
+	/* Resubmit. */
+	iso_done[iso_next] = 0;
+	r = libusb_submit_transfer(t);
+	if (r < 0)
+		return error("libusb_submit_transfer()", r);
+	iso_next = (iso_next + 1) % ISO_TRANSFERS;
+	return 0;
+}
+
+static void usb_iso_stop(void)
+{
+	int i;
+
+	for (i = 0; i < ISO_TRANSFERS; i++) {
+		if (!iso_transfer[i])
+			continue;
+		if (!iso_done[i] &&
+		    libusb_cancel_transfer(iso_transfer[i]) == 0)
+			while (!iso_done[i])
+				libusb_handle_events_completed(ctx,
+							       &iso_done[i]);
+		libusb_free_transfer(iso_transfer[i]);
+		iso_transfer[i] = NULL;
+	}
+}
+
+const struct bench_ops usb_ops = {
+	.name = "usb",
+	.open = usb_open,
+	.close = usb_close,
+	.get_stats = usb_get_stats,
+	.clear_stats = usb_clear_stats,
+	.set_altsetting = usb_set_altsetting,
+	.bulk_in = usb_bulk_in,
+	.bulk_out = usb_bulk_out,
+	.intr_out = usb_intr_out,
+	.intr_in = usb_intr_in,
+	.iso_start = usb_iso_start,
+	.iso_read = usb_iso_read,
+	.iso_stop = usb_iso_stop,
+};
@@ -0,0 +1,193 @@
+/*
+ * Mock device
+ *
+ * Behaves like the firmware on a full-speed bus without hardware: 19 bulk
+ * packets per frame, interrupt packets in the next frame, one isochronous
+ * packet per frame and one lost isochronous packet every MOCK_ISO_DROP.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "../usb_bench.h"
+#include "usbbench.h"
+
+/* Bulk packets per frame */
+#define MOCK_BULK_PACKETS	19
+
+/* Lost isochronous packets */
+#define MOCK_ISO_DROP		1000
+
+static uint32_t stats[NUM_STAT];
+static struct timespec start;
+static unsigned char loop_buf[LOOP_SIZE];
+static int loop_len = -1;
+static int altsetting;
+static uint32_t iso_seq;
+static long iso_frame;
+
+/* Time since open (usec) */
+static long now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return ((t.tv_sec - start.tv_sec) * 1000000L +
+		(t.tv_nsec - start.tv_nsec) / 1000);
+}
+
+static void wait_until(long usec)
+{
+	struct timespec t;
+	long d;
+
+	d = usec - now();
+	if (d <= 0)
+		return;
+	t.tv_sec = d / 1000000;
+	t.tv_nsec = (d % 1000000) * 1000;
+	nanosleep(&t, NULL);
+}
+
+/* Wait for the start of the next frame. */
+static void next_frame(void)
+{
+	wait_until((now() / 1000 + 1) * 1000);
+}
+
+static int mock_open(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	memset(stats, 0, sizeof(stats));
+	loop_len = -1;
+	altsetting = ALT_BULK;
+	return 0;
+}
+
+static void mock_close(void)
+{
+}
+
+static int mock_get_stats(uint32_t *s)
+{
+	memcpy(s, stats, sizeof(stats));
+	return 0;
+}
+
+static int mock_clear_stats(void)
+{
+	memset(stats, 0, sizeof(stats));
+	return 0;
+}
+
+static int mock_set_altsetting(int alt)
+{
+	if (alt != ALT_BULK && alt != ALT_ISO)
+		return -1;
+	altsetting = alt;
+	return 0;
+}
+
+/* Time of 'len' bytes of bulk transfer (usec) */
+static long bulk_time(int len)
+{
+	return ((len + BULK_SIZE - 1) / BULK_SIZE) * 1000L / MOCK_BULK_PACKETS;
+}
+
+static int mock_bulk_in(unsigned char *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (i % BULK_SIZE) / 2;
+	wait_until(now() + bulk_time(len));
+	stats[STAT_SOURCE_BYTES] += len;
+	return len;
+}
+
+static int mock_bulk_out(unsigned char *buf, int len)
+{
+	(void)buf;
+
+	wait_until(now() + bulk_time(len));
+	stats[STAT_SINK_BYTES] += len;
+	return len;
+}
+
+static int mock_intr_out(unsigned char *buf, int len)
+{
+	if (len > LOOP_SIZE || loop_len >= 0)
+		return -1;
+	next_frame();
+	memcpy(loop_buf, buf, len);
+	loop_len = len;
+	stats[STAT_LOOP_PACKETS]++;
+	return len;
+}
+
+static int mock_intr_in(unsigned char *buf, int len)
+{
+	int n;
+
+	if (loop_len < 0)
+		return -1;
+	next_frame();
+	n = (loop_len < len ? loop_len : len);
+	memcpy(buf, loop_buf, n);
+	loop_len = -1;
+	return n;
+}
+
+static int mock_iso_start(void)
+{
+	if (altsetting != ALT_ISO)
+		return -1;
+	iso_frame = now() / 1000;
+	return 0;
+}
+
+static int mock_iso_read(unsigned char *buf, int *len)
+{
+	unsigned char *p;
+	int i;
+
+	iso_frame += ISO_PACKETS;
+	wait_until(iso_frame * 1000);
+
+	for (i = 0; i < ISO_PACKETS; i++) {
+		p = buf + i * ISO_SIZE;
+		p[0] = iso_seq;
+		p[1] = iso_seq >> 8;
+		p[2] = iso_seq >> 16;
+		p[3] = iso_seq >> 24;
+		p[4] = iso_frame - ISO_PACKETS + i;
+		p[5] = ((iso_frame - ISO_PACKETS + i) >> 8) & 0x07;
+		memset(p + ISO_HEADER_SIZE, 0xa5, ISO_SIZE - ISO_HEADER_SIZE);
+		len[i] = ISO_SIZE;
+		if (iso_seq % MOCK_ISO_DROP == MOCK_ISO_DROP - 1)
+			len[i] = -1;
+		iso_seq++;
+		stats[STAT_ISO_PACKETS]++;
+	}
+	return 0;
+}
+
+static void mock_iso_stop(void)
+{
+}
+
+const struct bench_ops mock_ops = {
+	.name = "mock",
+	.open = mock_open,
+	.close = mock_close,
+	.get_stats = mock_get_stats,
+	.clear_stats = mock_clear_stats,
+	.set_altsetting = mock_set_altsetting,
+	.bulk_in = mock_bulk_in,
+	.bulk_out = mock_bulk_out,
+	.intr_out = mock_intr_out,
+	.intr_in = mock_intr_in,
+	.iso_start = mock_iso_start,
+	.iso_read = mock_iso_read,
+	.iso_stop = mock_iso_stop,
+};
@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../usb_bench.h"
+#include "usbbench.h"
+
+/* Defaults */
+#define DURATION	5		/* sec */
+#define BULK_LENGTH	4096		/* bytes per bulk transfer */
+
+static const struct bench_ops *ops = &usb_ops;
+static double duration = DURATION;
+static int bulk_length = BULK_LENGTH;
+
+/* Samples (usec) */
+struct samples {
+	double *v;
+	int n;
+	int size;
+};
+
+static double now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+static void add_sample(struct samples *s, double v)
+{
+	if (s->n == s->size) {
+		s->size = (s->size ? s->size * 2 : 1024);
+		s->v = realloc(s->v, s->size * sizeof(double));
+		if (!s->v) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+	s->v[s->n++] = v;
+}
+
+static int compare(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile (per mille) of the sorted samples */
+static double percentile(struct samples *s, int p)
+{
+	int i;
+
+	i = ((long long)s->n * p + 999) / 1000 - 1;
+	if (i < 0)
+		i = 0;
+	return s->v[i];
+}
+
+static void print_samples(const char *name, struct samples *s)
+{
+	if (!s->n)
+		return;
+	qsort(s->v, s->n, sizeof(double), compare);
+	printf("  %s (usec): min %.0f  p50 %.0f  p90 %.0f  p99 %.0f  "
+	       "p99.9 %.0f  max %.0f  (%d samples)\n", name, s->v[0],
+	       percentile(s, 500), percentile(s, 900), percentile(s, 990),
+	       percentile(s, 999), s->v[s->n - 1], s->n);
+	free(s->v);
+	s->v = NULL;
+	s->n = 0;
+	s->size = 0;
+}
+
+static int device_stats(uint32_t *stats)
+{
+	if (ops->get_stats(stats) < 0)
+		return -1;
+	printf("  device: sink %u, source %u bytes, loop %u, iso %u packets, "
+	       "%u frames without iso\n", stats[STAT_SINK_BYTES],
+	       stats[STAT_SOURCE_BYTES], stats[STAT_LOOP_PACKETS],
+	       stats[STAT_ISO_PACKETS], stats[STAT_ISO_MISSED]);
+	return 0;
+}
+
+/* Bulk IN (in != 0) or OUT throughput */
+static int bulk_test(int in)
+{
+	struct samples s = {NULL, 0, 0};
+	uint32_t stats[NUM_STAT];
+	unsigned char *buf;
+	double t0;
+	double t;
+	double start;
+	double elapsed;
+	long long bytes = 0;
+	int r;
+
+	buf = malloc(bulk_length);
+	if (!buf)
+		return -1;
+	memset(buf, 0x5a, bulk_length);
+	if (ops->clear_stats() < 0)
+		return -1;
+
+	start = now();
+	do {
+		t0 = now();
+		if (in)
+			r = ops->bulk_in(buf, bulk_length);
+		else
+			r = ops->bulk_out(buf, bulk_length);
+		t = now();
+		if (r < 0) {
+			free(buf);
+			return -1;
+		}
+		bytes += r;
+		add_sample(&s, t - t0);
+		elapsed = (t - start) / 1e6;
+	} while (elapsed < duration);
+	free(buf);
+
+	printf("bulk %s: %lld bytes in %.2f sec, %.1f kB/s\n",
+	       in ? "IN" : "OUT", bytes, elapsed, bytes / elapsed / 1000);
+	print_samples("transfer", &s);
+	if (device_stats(stats) < 0)
+		return -1;
+
+	/* The device counts every packet sent or received. */
+	if (!in && stats[STAT_SINK_BYTES] != (uint32_t)bytes) {
+		fprintf(stderr, "bulk OUT: device received %u bytes\n",
+			stats[STAT_SINK_BYTES]);
+		return -1;
+	}
+	return 0;
+}
+
+/* Interrupt OUT -> IN round trip */
+static int latency_test(void)
+{
+	struct samples s = {NULL, 0, 0};
+	uint32_t stats[NUM_STAT];
+	unsigned char out[LOOP_SIZE];
+	unsigned char in[LOOP_SIZE];
+	unsigned int seq = 0;
+	double t0;
+	double t;
+	double start;
+	int n;
+	int i;
+
+	if (ops->clear_stats() < 0)
+		return -1;
+
+	start = now();
+	do {
+		for (i = 0; i < LOOP_SIZE; i++)
+			out[i] = seq + i;
+		t0 = now();
+		if (ops->intr_out(out, LOOP_SIZE) < 0)
+			return -1;
+		n = ops->intr_in(in, LOOP_SIZE);
+		t = now();
+		if (n < 0)
+			return -1;
+		if (n != LOOP_SIZE || memcmp(in, out, LOOP_SIZE)) {
+			fprintf(stderr, "interrupt: loopback data mismatch "
+				"(packet %u)\n", seq);
+			return -1;
+		}
+		add_sample(&s, t - t0);
+		seq++;
+	} while ((t - start) / 1e6 < duration);
+
+	printf("interrupt round trip: %u packets\n", seq);
+	print_samples("latency", &s);
+	return device_stats(stats);
+}
+
+/* Isochronous IN packet loss */
+static int iso_test(void)
+{
+	struct samples s = {NULL, 0, 0};
+	uint32_t stats[NUM_STAT];
+	unsigned char buf[ISO_PACKETS * ISO_SIZE];
+	int len[ISO_PACKETS];
+	unsigned char *p;
+	uint32_t seq;
+	uint32_t next = 0;
+	long long received = 0;
+	long long lost = 0;
+	int first = 1;
+	double t0;
+	double t;
+	double start;
+	int r = 0;
+	int i;
+
+	if (ops->set_altsetting(ALT_ISO) < 0)
+		return -1;
+	if (ops->clear_stats() < 0 || ops->iso_start() < 0) {
+		ops->iso_stop();
+		ops->set_altsetting(ALT_BULK);
+		return -1;
+	}
+
+	start = now();
+	t0 = start;
+	do {
+		r = ops->iso_read(buf, len);
+		t = now();
+		if (r < 0)
+			break;
+		add_sample(&s, t - t0);
+		t0 = t;
+
+		for (i = 0; i < ISO_PACKETS; i++) {
+			/* Missing or short: counted by the sequence gap */
+			if (len[i] < ISO_HEADER_SIZE)
+				continue;
+			p = buf + i * ISO_SIZE;
+			seq = (p[0] | (p[1] << 8) | (p[2] << 16) |
+			       ((uint32_t)p[3] << 24));
+			if (!first && seq != next)
+				lost += (uint32_t)(seq - next);
+			first = 0;
+			next = seq + 1;
+			received++;
+		}
+	} while ((t - start) / 1e6 < duration);
+
+	ops->iso_stop();
+	if (ops->set_altsetting(ALT_BULK) < 0 || r < 0)
+		return -1;
+
+	printf("isochronous IN: %lld packets, %lld lost (%.3f%%)\n",
+	       received, lost,
+	       received + lost ? 100.0 * lost / (received + lost) : 0.0);
+	print_samples("transfer interval", &s);
+	return device_stats(stats);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-m] [-t seconds] [-s bytes] "
+		"[bulk-in|bulk-out|latency|iso]...\n"
+		"  -m  use the mock device\n"
+		"  -t  duration of each test (default %d)\n"
+		"  -s  bulk transfer length (default %d)\n",
+		name, DURATION, BULK_LENGTH);
+}
+
+static int run(const char *test)
+{
+	if (!strcmp(test, "bulk-in"))
+		return bulk_test(1);
+	if (!strcmp(test, "bulk-out"))
+		return bulk_test(0);
+	if (!strcmp(test, "latency"))
+		return latency_test();
+	if (!strcmp(test, "iso"))
+		return iso_test();
+	fprintf(stderr, "Unknown test: %s\n", test);
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *all[] = {"bulk-in", "bulk-out", "latency", "iso"};
+	int c;
+	int r = 0;
+	int i;
+
+	while ((c = getopt(argc, argv, "mt:s:")) != -1) {
+		switch (c) {
+		case 'm':
+			ops = &mock_ops;
+			break;
+		case 't':
+			duration = atof(optarg);
+			break;
+		case 's':
+			bulk_length = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (duration <= 0 || bulk_length <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (ops->open() < 0)
+		return 1;
+	printf("device: %s, %.1f sec per test\n", ops->name, duration);
+
+	if (optind < argc) {
+		for (i = optind; i < argc && r == 0; i++)
+			r = run(argv[i]);
+	} else {
+		for (i = 0; i < 4 && r == 0; i++)
+			r = run(all[i]);
+	}
+
+	ops->close();
+	return (r < 0 ? 1 : 0);
+}
@@ -0,0 +1,38 @@
+/*
+ * Device access for usbbench: the USB device (libusb) or the mock device.
+ * All functions return 0 (or the number of bytes) on success, and a
+ * negative value on error.
+ */
+
+#include <stdint.h>
+
+/* Isochronous packets per call of iso_read() */
+#define ISO_PACKETS	32
+
+struct bench_ops {
+	const char *name;
+	int (*open)(void);
+	void (*close)(void);
+	int (*get_stats)(uint32_t *stats);
+	int (*clear_stats)(void);
+	int (*set_altsetting)(int alt);
+	int (*bulk_in)(unsigned char *buf, int len);
+	int (*bulk_out)(unsigned char *buf, int len);
+	int (*intr_out)(unsigned char *buf, int len);
+	int (*intr_in)(unsigned char *buf, int len);
+	/*
+	 * Start/stop the isochronous IN stream. iso_read() waits for the
+	 * next ISO_PACKETS packets, and returns the length of each packet
+	 * (-1 if lost) in 'len'. The packets are ISO_SIZE bytes apart in
+	 * 'buf'.
+	 */
+	int (*iso_start)(void);
+	int (*iso_read)(unsigned char *buf, int *len);
+	void (*iso_stop)(void);
+};
+
+extern const struct bench_ops usb_ops;
+extern const struct bench_ops mock_ops;
+
+/* Timeout (msec) */
+#define TIMEOUT		1000
@@ -0,0 +1,439 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <rcc.h>
+#include <pwr.h>
+#include <flash.h>
+#include <tim.h>
+#include <syscfg.h>
+#include <nvic.h>
+#include <usbdevfs.h>
+#include <usbdev.h>
+
+#include <usb/standard.h>
+
+#include "usb_bench.h"
+#include "descriptor.h"
+
+/* Timer clock frequency */
+#define TIMX_CLK_APB1		32000000
+
+/* Endpoint ID */
+#define EP_SINK			(SINK_ENUM & 0xf)
+#define EP_SOURCE		(SOURCE_ENUM & 0xf)
+#define EP_LOOP_RX		(LOOP_RX_ENUM & 0xf)
+#define EP_LOOP_TX		(LOOP_TX_ENUM & 0xf)
+#define EP_ISO			(ISO_ENUM & 0xf)
+
+/* Statistics (updated in both USB interrupts) */
+static volatile u32 stats[NUM_STAT];
+static u32 stats_snapshot[NUM_STAT];
+
+/* Bulk data */
+static u16 sink_data[BULK_SIZE / 2];
+static u16 source_data[BULK_SIZE / 2];
+
+/* Isochronous source */
+static u16 iso_data[ISO_SIZE / 2];
+static u32 iso_seq;
+static volatile bool iso_active;
+static volatile bool iso_sent;		/* CTR_TX in this frame */
+
+static void sink_rx(void);
+static void source_tx(void);
+static void loop_rx(void);
+static void loop_tx(void);
+static void iso_tx(void);
+
+/* Endpoint callbacks */
+static const struct usbdevfs_callback callback[] = {
+	{
+		.ep_id = 0,
+		.setup = usbdev_control_setup,
+		.rx = usbdev_control_rx,
+		.tx = usbdev_control_tx,
+	},
+	{
+		.ep_id = EP_SINK,
+		.rx = sink_rx,
+	},
+	{
+		.ep_id = EP_SOURCE,
+		.tx = source_tx,
+	},
+	{
+		.ep_id = EP_LOOP_RX,
+		.rx = loop_rx,
+	},
+	{
+		.ep_id = EP_LOOP_TX,
+		.tx = loop_tx,
+	},
+	{
+		.ep_id = EP_ISO,
+		.tx = iso_tx,
+	},
+};
+
+/* --- Endpoints ----------------------------------------------------------- */
+
+/* Bulk sink (USB high priority interrupt) */
+static void sink_rx(void)
+{
+	int n;
+
+	usbdevfs_complete_dbl_buf_rx(EP_SINK);
+
+	/* Read and discard both buffers. */
+	while ((n = usbdevfs_read_dbl_buf(EP_SINK, sink_data, BULK_SIZE)) >= 0)
+		stats[STAT_SINK_BYTES] += n;
+}
+
+/* Fill the free buffers of the bulk source. */
+static void source_fill(void)
+{
+	while (usbdevfs_get_dbl_buf_tx_free(EP_SOURCE))
+		usbdevfs_write_dbl_buf(EP_SOURCE, source_data, BULK_SIZE);
+}
+
+/* Bulk source (USB high priority interrupt) */
+static void source_tx(void)
+{
+	usbdevfs_complete_dbl_buf_tx(EP_SOURCE);
+	stats[STAT_SOURCE_BYTES] += BULK_SIZE;
+
+	source_fill();
+}
+
+/* Interrupt loopback OUT (USB low priority interrupt) */
+static void loop_rx(void)
+{
+	u16 buf[LOOP_SIZE / 2];
+	int n;
+
+	/* Clear interrupt. */
+	usbdevfs_clear_endpoint_interrupt(EP_LOOP_RX);
+
+	/* Send it back. Rx stays NAK until the IN packet is sent. */
+	n = usbdevfs_read(EP_LOOP_RX, buf, LOOP_SIZE);
+	usbdevfs_write(EP_LOOP_TX, buf, n);
+
+	/* TX NAK->VALID */
+	usbdevfs_start_endpoint_tx(EP_LOOP_TX);
+
+	stats[STAT_LOOP_PACKETS]++;
+}
+
+/* Interrupt loopback IN (USB low priority interrupt) */
+static void loop_tx(void)
+{
+	/* Clear interrupt. */
+	usbdevfs_clear_endpoint_interrupt(EP_LOOP_TX);
+
+	/* Rx NAK -> VALID */
+	usbdevfs_enable_endpoint_rx(EP_LOOP_RX);
+}
+
+/* Write the next isochronous packet into the buffer not used by the USB. */
+static void iso_write(bool data1)
+{
+	iso_data[0] = iso_seq;
+	iso_data[1] = iso_seq >> 16;
+	iso_data[2] = usbdevfs_get_frame_number();
+	iso_seq++;
+
+	if (data1)
+		usbdevfs_write0(EP_ISO, iso_data, ISO_SIZE);
+	else
+		usbdevfs_write1(EP_ISO, iso_data, ISO_SIZE);
+}
+
+/* Isochronous source (USB high priority interrupt) */
+static void iso_tx(void)
+{
+	bool data1;
+
+	data1 = usbdevfs_get_ep_status(EP_ISO, USBDEVFS_TX_DATA1);
+
+	/* Clear interrupt. */
+	usbdevfs_clear_endpoint_interrupt(EP_ISO);
+
+	iso_write(data1);
+	iso_sent = true;
+	stats[STAT_ISO_PACKETS]++;
+}
+
+/* Start the source endpoints of the alternate setting. */
+static void start(int altsetting)
+{
+	nvic_disable_irq(NVIC_USB_HP_IRQ);
+
+	source_fill();
+
+	iso_active = (altsetting == ALT_ISO);
+	if (iso_active) {
+		/* Both buffers */
+		iso_write(false);
+		iso_write(true);
+		iso_sent = true;
+	}
+
+	nvic_enable_irq(NVIC_USB_HP_IRQ);
+}
+
+/* Start of frame (USB low priority interrupt) */
+static void sof(void)
+{
+	nvic_disable_irq(NVIC_USB_HP_IRQ);
+
+	if (iso_active) {
+		if (!iso_sent)
+			stats[STAT_ISO_MISSED]++;
+		iso_sent = false;
+	}
+
+	nvic_enable_irq(NVIC_USB_HP_IRQ);
+}
+
+/* --- usbdev callbacks ---------------------------------------------------- */
+
+/*
+ * Vendor Requests
+ *
+ * | bmRequestType | bRequest              | wValue | wIndex | wLength
+ * | 11000000B     | BENCH_REQ_GET_STATS   | 0      | 0      | 4 * NUM_STAT
+ * | 01000000B     | BENCH_REQ_CLEAR_STATS | 0      | 0      | 0
+ */
+int bench_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		  u8 **data)
+{
+	int i;
+
+	(void)buf;
+
+	if ((req->bmRequestType & ~USB_DIR_IN) !=
+	    (USB_TYPE_VENDOR | USB_RECIP_DEVICE) || req->wValue || req->wIndex)
+		return -1;
+
+	switch (req->bRequest) {
+	case BENCH_REQ_GET_STATS:
+		if (!(req->bmRequestType & USB_DIR_IN) ||
+		    req->wLength != sizeof(stats_snapshot))
+			return -1;
+		nvic_disable_irq(NVIC_USB_HP_IRQ);
+		for (i = 0; i < NUM_STAT; i++)
+			stats_snapshot[i] = stats[i];
+		nvic_enable_irq(NVIC_USB_HP_IRQ);
+		*data = (u8 *)stats_snapshot;
+		return sizeof(stats_snapshot);
+	case BENCH_REQ_CLEAR_STATS:
+		if ((req->bmRequestType & USB_DIR_IN) || req->wLength)
+			return -1;
+		if (stage == USBDEV_STAGE_STATUS) {
+			nvic_disable_irq(NVIC_USB_HP_IRQ);
+			for (i = 0; i < NUM_STAT; i++)
+				stats[i] = 0;
+			nvic_enable_irq(NVIC_USB_HP_IRQ);
+		}
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+void bench_set_configuration(int value)
+{
+	iso_active = false;
+	if (value)
+		start(ALT_BULK);
+}
+
+void bench_set_interface(int interface, int altsetting)
+{
+	if (interface == INTERFACE_BENCH)
+		start(altsetting);
+}
+
+void bench_reset(void)
+{
+	iso_active = false;
+}
+
+/* --- Setup --------------------------------------------------------------- */
+
+/* Set STM32 to 32 MHz. */
+static void clock_setup(void)
+{
+	/* Enable PWR clock. */
+	rcc_enable_clock(RCC_PWR);
+
+	/* Set VCORE to 1.8V */
+	pwr_set_vos(PWR_1_8_V);
+
+	/* Enable 64bit flash memory access (1WS). */
+	flash_enable_64bit_access(1);
+
+	/* Enable external high-speed oscillator 8MHz. */
+	rcc_enable_osc(RCC_HSE);
+
+	 /* Setup PLL (8MHz * 12 / 3 = 32MHz). */
+	rcc_setup_pll(RCC_HSE, 12, 3);
+
+	/* Enable PLL and wait for it to stabilize. */
+	rcc_enable_osc(RCC_PLL);
+
+	/* Select PLL as SYSCLK source. */
+	rcc_set_sysclk_source(RCC_PLL);
+}
+
+static void tim_setup(void)
+{
+	/* Enable TIM6 clock. */
+	rcc_enable_clock(RCC_TIM6);
+
+	/* Enable one-pulse mode. */
+	tim_enable_one_pulse_mode(TIM6);
+
+	/* Generate update interrupt on counter overflow. */
+	tim_disable_update_interrupt_on_any(TIM6);
+
+	/* Load prescaler value (2MHz). */
+	tim_load_prescaler_value(TIM6, TIMX_CLK_APB1 / 2000000 - 1);
+}
+
+/* 1 - 32767 usec */
+static void delay_us(u16 us)
+{
+	/* Set auto-reload value (us * 2). */
+	tim_set_autoreload_value(TIM6, (us << 1) - 1);
+
+	/* Enable counter. */
+	tim_enable_counter(TIM6);
+
+	/* Wait for update interrupt flag. */
+	while (!tim_get_interrupt_status(TIM6, TIM_UPDATE))
+		;
+
+	/* Clear update interrupt flag. */
+	tim_clear_interrupt(TIM6, TIM_UPDATE);
+}
+
+static void usb_setup(void)
+{
+	int i;
+
+	/* Enable USB and SYSCFG clock. */
+	rcc_enable_clock(RCC_USB);
+	rcc_enable_clock(RCC_SYSCFG);
+
+	/* Enable USB interrupts. */
+	nvic_enable_irq(NVIC_USB_LP_IRQ);
+	nvic_enable_irq(NVIC_USB_HP_IRQ);
+
+	/* Exit Power Down. */
+	usbdevfs_disable_function(USBDEVFS_POWER_DOWN);
+
+	/* Wait T_STARTUP. */
+	delay_us(USBDEVFS_T_STARTUP);
+
+	/* Clear USB reset. */
+	usbdevfs_disable_function(USBDEVFS_FORCE_RESET);
+
+	/* Assign packet memory to endpoint */
+	usbdev_init(&bench_device);
+
+	/* Set endpoint callbacks. */
+	usbdevfs_set_callback(callback, sizeof(callback) / sizeof(callback[0]));
+
+	/* Fill pattern */
+	for (i = 0; i < BULK_SIZE / 2; i++)
+		source_data[i] = i;
+	for (i = ISO_HEADER_SIZE / 2; i < ISO_SIZE / 2; i++)
+		iso_data[i] = 0xa5a5;
+}
+
+/* USB high priority interrupt (bulk sink/source, isochronous source) */
+void usb_hp_isr(void)
+{
+	usbdevfs_dispatch_hp();
+}
+
+/* USB low priority interrupt */
+void usb_lp_isr(void)
+{
+	u16 mask;
+	u16 status;
+
+	/* Interrupt mask */
+	mask = usbdevfs_get_interrupt_mask(USBDEVFS_CORRECT_TRANSFER |
+					   USBDEVFS_RESET | USBDEVFS_SOF);
+	/* Spurious */
+	if (!mask)
+		return;
+
+	/* Interrupt status */
+	status = usbdevfs_get_interrupt_status(USBDEVFS_CORRECT_TRANSFER |
+					       USBDEVFS_RESET | USBDEVFS_SOF);
+	/* Spurious */
+	if (!status)
+		return;
+
+	/* Correct transfer */
+	if (mask & status & USBDEVFS_CORRECT_TRANSFER)
+		usbdevfs_dispatch();
+
+	/* Start of frame */
+	if (mask & status & USBDEVFS_SOF) {
+		sof();
+
+		/* Clear interrupt. */
+		usbdevfs_clear_interrupt(USBDEVFS_SOF);
+	}
+
+	/* USB RESET */
+	if (mask & status & USBDEVFS_RESET) {
+		/* Reset USB device state. */
+		usbdev_reset();
+
+		/* Clear interrupt. */
+		usbdevfs_clear_interrupt(USBDEVFS_RESET);
+	}
+}
+
+int main(void)
+{
+	clock_setup();
+	tim_setup();
+	usb_setup();
+
+	/* Attach the device to USB. */
+	syscfg_enable_usb_pullup();
+
+	/* Clear interrupt. */
+	usbdevfs_clear_interrupt(USBDEVFS_ALL_INTERRUPT);
+
+	/* Enable interrupt. */
+	usbdevfs_enable_interrupt(USBDEVFS_CORRECT_TRANSFER | USBDEVFS_RESET |
+				  USBDEVFS_SOF);
+
+	while (1)
+		__asm__ ("wfi");
+
+	return 0;
+}
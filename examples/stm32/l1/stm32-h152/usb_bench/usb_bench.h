@@ -0,0 +1,98 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Vendor-specific interface for the USB benchmark.
+ * This file is also included by the host command (hostcommand/usbbench).
+ */
+
+#define BENCH_VID		0x2975
+#define BENCH_PID		0x0005
+
+/* Configuration value */
+/* Value to use as an argument to the USB_REQ_SET_CONFIGURATION request */
+#define CONFIGURATION_VALUE	1
+
+/* Maximum packet size for endpoint zero */
+#define MAXPACKETSIZE0		16
+
+/* Maximum OUT data length */
+#define MAX_DATA_OUT		16
+
+/* Interfaces */
+enum {
+	INTERFACE_BENCH,
+	NUM_INTERFACE
+};
+
+/* Alternate settings (isochronous endpoint in alternate setting 1) */
+#define ALT_BULK		0
+#define ALT_ISO			1
+
+/* Bulk sink (OUT, double-buffered) */
+#define SINK_ENUM		0x01
+/* Bulk source (IN, double-buffered) */
+#define SOURCE_ENUM		0x82
+/* Maximum packet size for bulk endpoint */
+#define BULK_SIZE		64
+
+/* Interrupt loopback (OUT -> IN) */
+#define LOOP_RX_ENUM		0x03
+#define LOOP_TX_ENUM		0x84
+/* Maximum packet size for interrupt endpoint */
+#define LOOP_SIZE		16
+/* Interval for polling endpoint */
+#define LOOP_INTERVAL		1
+
+/* Isochronous source (IN) */
+#define ISO_ENUM		0x85
+/* Maximum packet size for isochronous endpoint */
+#define ISO_SIZE		64
+/* Interval for polling endpoint */
+#define ISO_INTERVAL		1
+
+/*
+ * Isochronous packet: 32-bit sequence number (little endian), 16-bit frame
+ * number and a fill pattern
+ */
+#define ISO_HEADER_SIZE		6
+
+/* String index */
+enum {
+	STRING_LANGID,
+	STRING_MANUFACTURER,
+	STRING_PRODUCT,
+	NUM_STRING_DESC
+};
+
+/* Vendor requests (bmRequestType = 0xc0 or 0x40) */
+enum {
+	BENCH_REQ_GET_STATS,	/* IN: u32 statistics[NUM_STAT] */
+	BENCH_REQ_CLEAR_STATS	/* OUT: no data */
+};
+
+/* Statistics */
+enum {
+	STAT_SINK_BYTES,	/* Bytes received by the bulk sink */
+	STAT_SOURCE_BYTES,	/* Bytes sent by the bulk source */
+	STAT_LOOP_PACKETS,	/* Packets looped back */
+	STAT_ISO_PACKETS,	/* Isochronous packets sent */
+	STAT_ISO_MISSED,	/* Frames without an isochronous IN */
+	NUM_STAT
+};
@@ -23,9 +23,6 @@
 #include "bulk.h"
 #include "v25ter.h"
 
-/* Endpoint state */
-extern ep_state_t endpoint_state[MAXENDPOINT];
-
 /* USART Tx queue */
 extern u8 tx_queue[TXQUEUESIZE];
 extern volatile int tx_head;
@@ -69,7 +66,7 @@ int bulk_puts(char *string1, char *string2)
 	}
 	command_len = i;
 
-	if (endpoint_state[3] == EP_STATE_ENABLE && !busy) {
+	if (endpoint_enabled(DATA_TX_ENUM) && !busy) {
 		/* Write packet. */
 		usbdevfs_write(3, (u16 *)command_buf, command_len);
 
@@ -105,7 +102,7 @@ int bulk_puts_cont(void)
 	/* Data is sent. */
 	command_len = 0;
 
-	if (endpoint_state[2] == EP_STATE_ENABLE)
+	if (endpoint_enabled(DATA_RX_ENUM))
 		/* Rx NAK -> VALID */
 		usbdevfs_enable_endpoint_rx(2);
 
@@ -117,7 +114,7 @@ int bulk_tx(void)
 	int i;
 	u8 buf[DATA_SIZE] __attribute__ ((aligned(2)));
 
-	if (endpoint_state[3] != EP_STATE_ENABLE || busy)
+	if (!endpoint_enabled(DATA_TX_ENUM) || busy)
 		return -1;
 
 	/* Copy data from Rx queue to buffer. */
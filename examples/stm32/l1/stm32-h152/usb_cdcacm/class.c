@@ -17,7 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <usbdevfs.h>
+#include <usbdev.h>
 
 #include <usb/standard.h>
 #include <usb/cdc.h>
@@ -41,7 +41,7 @@ static int databits;
 static int control_line_state;
 
 /* --- Class-specific Requests --------------------------------------------- */
-bool class_request_error(struct usb_setup_data *req)
+static bool class_request_error(struct usb_setup_data *req)
 {
 	switch (req->bRequest) {
 	case USB_CDC_REQ_SEND_ENCAPSULATED_COMMAND:
@@ -164,25 +164,25 @@ bool class_request_error(struct usb_setup_data *req)
 	return false;
 }
 
-bool class_request_check_data(struct usb_setup_data *req, u8 *buf)
+int class_check_data(struct usb_setup_data *req, u8 *buf)
 {
 	struct usb_cdc_line_coding *p;
 
 	if (req->bRequest == USB_CDC_REQ_SET_LINE_CODING) {
 		p = (struct usb_cdc_line_coding *)buf;
 		if (p->bCharFormat > 2)
-			return true;
+			return -1;
 		if (p->bParityType > 4)
-			return true;
+			return -1;
 		if (!(p->bDataBits == 8 ||
 		      (p->bDataBits == 7 &&
 		       p->bParityType != USB_CDC_LINE_CODING_PARITYTYPE_NONE)))
-			return true;
+			return -1;
 	}
-	return false;
+	return 0;
 }
 
-int class_request(struct usb_setup_data *req, u8 *buf, u8 **data)
+static int cdc_request(struct usb_setup_data *req, u8 *buf, u8 **data)
 {
 	int i;
 	char *r;
@@ -274,6 +274,31 @@ int class_request(struct usb_setup_data *req, u8 *buf, u8 **data)
 	return len;
 }
 
+int class_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		  u8 **data)
+{
+	/* Class-specific Request */
+	if ((req->bmRequestType & USB_TYPE_MASK) != USB_TYPE_CLASS)
+		return -1;
+
+	switch (stage) {
+	case USBDEV_STAGE_SETUP:
+		/* Check error. */
+		if (class_request_error(req))
+			return -1;
+
+		/* GET request */
+		if (req->bmRequestType & USB_DIR_IN)
+			return cdc_request(req, buf, data);
+		break;
+	case USBDEV_STAGE_STATUS:
+		/* SET request */
+		return cdc_request(req, buf, data);
+	}
+
+	return 0;
+}
+
 /* --- USB CDC-ACM Functions ----------------------------------------------- */
 
 /* Notification */
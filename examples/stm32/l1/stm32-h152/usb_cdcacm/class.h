@@ -17,8 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-bool class_request_error(struct usb_setup_data *req);
-bool class_request_check_data(struct usb_setup_data *req, u8 *buf);
-int class_request(struct usb_setup_data *req, u8 *buf, u8 **data);
+int class_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		  u8 **data);
+int class_check_data(struct usb_setup_data *req, u8 *buf);
 int class_notify(u8 *buf);
 void class_reset(void);
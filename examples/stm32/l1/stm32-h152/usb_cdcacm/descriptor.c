@@ -17,12 +17,15 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <usbdev.h>
+
 #include <usb/standard.h>
 #include <usb/langid.h>
 #include <usb/cdc.h>
 
 #include "usb_cdcacm.h"
 #include "descriptor.h"
+#include "class.h"
 
 /* struct usb_cdc_union_descriptor_1 */
 USB_CDC_UNION_DESCRIPTOR(1);
@@ -46,7 +49,7 @@ struct config_desc {
 } __attribute__ ((packed));
 
 /* Device Descriptor */
-const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) = {
+static const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) = {
 	.bLength = sizeof(struct usb_device_descriptor),
 	.bDescriptorType = USB_DT_DEVICE,
 	.bcdUSB = 0x0200,
@@ -63,7 +66,7 @@ const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) = {
 	.bNumConfigurations = 1,
 };
 
-const struct config_desc config_desc __attribute__ ((aligned(2))) = {
+static const struct config_desc config_desc __attribute__ ((aligned(2))) = {
 	/* Configuration Descriptor */
 	.config = {
 		.bLength = sizeof(struct usb_config_descriptor),
@@ -158,11 +161,10 @@ const struct config_desc config_desc __attribute__ ((aligned(2))) = {
 };
 
 /* Strings */
-const u16 langid[] = {LANGID_ENGLISH_US, 0};
-const u16 string1[] = L"MPC Research Ltd.";
-const u16 string2[] = L"CDC-ACM";
-u16 string3[25];
-const u16 *string_english_us[MAX_STRING_INDEX] = {
+static const u16 string1[] = L"MPC Research Ltd.";
+static const u16 string2[] = L"CDC-ACM";
+static u16 string3[25];		/* Serial number (unique device ID) */
+static const u16 * const string_english_us[MAX_STRING_INDEX] = {
 	string1,
 	string2,
 	string3
@@ -187,52 +189,19 @@ void set_serial_number(u32 *uid)
 	string3[24] = L'\0';
 }
 
-/* Make string descriptor from NULL-terminated string. */
-static int make_string_descriptor(int index, u16 *buf)
-{
-	int i;
-	const u16 *p;
-	u8 *s;
-
-	if (index == 0)
-		p = langid;	/* LANGID */
-	else
-		p = string_english_us[index - 1]; /* UNICODE encoded string */
-
-	/* Copy data (not include EOS(0)). */
-	for (i = 1; *p; i++)
-		*(buf + i) = *p++;
-
-	/* Add bLength and bDescriptorType. */
-	s = (u8 *)buf;
-	*s++ = i * sizeof(u16);
-	*s = USB_DT_STRING;
-
-	/* Return descriptor size. */
-	return i * (int)sizeof(u16);
-}
-
-int get_descriptor(int type, int index, u8 *buf, u8 **data)
-{
-	int len;
-
-	switch (type) {
-	case USB_DT_DEVICE:
-		len = sizeof(dev_desc);
-		*data = (u8 *)&dev_desc;
-		break;
-	case USB_DT_CONFIGURATION:
-		len = sizeof(config_desc);
-		*data = (u8 *)&config_desc;
-		break;
-	case USB_DT_STRING:
-		len = make_string_descriptor(index, (u16 *)buf);
-		*data = buf;
-		break;
-	default:
-		len = 0;
-		break;
-	}
-
-	return len;
-}
+/* Control OUT data */
+static u8 outbuf[MAX_DATA_OUT] __attribute__ ((aligned(4)));
+
+/* USB device */
+const struct usbdev_device cdcacm_device = {
+	.device = &dev_desc,
+	.config = &config_desc.config,
+	.langid = LANGID_ENGLISH_US,
+	.num_string = MAX_STRING_INDEX,
+	.string = string_english_us,
+	.buf = outbuf,
+	.bufsize = MAX_DATA_OUT,
+	.request = class_request,
+	.check_data = class_check_data,
+	.reset = class_reset,
+};
@@ -17,4 +17,4 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-int get_descriptor(int type, int index, u8 *buf, u8 **data);
+extern const struct usbdev_device cdcacm_device;
@@ -18,6 +18,7 @@
  */
 
 #include <usbdevfs.h>
+#include <usbdev.h>
 
 #include <usb/standard.h>
 
@@ -29,11 +30,10 @@ static volatile bool busy;
 
 void interrupt_notify(void)
 {
-	extern ep_state_t endpoint_state[MAXENDPOINT];
 	u8 buf[NOTIFICATION_SIZE] __attribute__ ((aligned(2)));
 	int len;
 
-	if (endpoint_state[1] == EP_STATE_ENABLE && !busy) {
+	if (endpoint_enabled(NOTIFICATION_ENUM) && !busy) {
 		len = class_notify(buf);
 		if (len > 0) {
 			/* Write packet. */
@@ -1,24 +0,0 @@
-/*
- * This file is part of the libopencm3 project.
- *
- * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
- *
- * This program is free software: you can redistribute it and/or modify
- * it under the terms of the GNU General Public License as published by
- * the Free Software Foundation, either version 3 of the License, or
- * (at your option) any later version.
- *
- * This program is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License
- * along with this program.  If not, see <http://www.gnu.org/licenses/>.
- */
-
-bool standard_request_error(struct usb_setup_data *req);
-int standard_request(struct usb_setup_data *req, u8 *buf, u8 **data);
-void standard_reset(void);
-
-extern usb_standard_state_t standard_state;
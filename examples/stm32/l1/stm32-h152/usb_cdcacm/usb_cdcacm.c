@@ -26,11 +26,12 @@
 #include <syscfg.h>
 #include <nvic.h>
 #include <usbdevfs.h>
+#include <usbdev.h>
 #include <dbgmcu.h>
 #include <desig.h>
 
 #include "usb_cdcacm.h"
-#include "control.h"
+#include "descriptor.h"
 #include "interrupt.h"
 #include "bulk.h"
 
@@ -41,11 +42,6 @@
 /* USART clock frequency */
 #define PCLK1			32000000
 
-/* Packet buffer memory */
-#define BUFFER_TABLE_ADDRESS	0
-#define PACKET_MEMORY_START	(BUFFER_TABLE_ADDRESS + \
-				 USBDEVFS_BUFFER_TABLE_SIZE)
-
 /* USART Tx queue */
 u8 tx_queue[TXQUEUESIZE];
 volatile int tx_head;
@@ -504,8 +500,6 @@ void usart_stop_break(void)
 
 static void usb_setup(void)
 {
-	int offset;
-
 	/* Enable USB and SYSCFG clock. */
 	rcc_enable_clock(RCC_USB);
 	rcc_enable_clock(RCC_SYSCFG);
@@ -522,16 +516,15 @@ static void usb_setup(void)
 	/* Clear USB reset. */
 	usbdevfs_disable_function(USBDEVFS_FORCE_RESET);
 
-	/* Set buffer table address */
-	usbdevfs_set_buffer_table_address(BUFFER_TABLE_ADDRESS);
+	/* Assign packet memory to endpoints. */
+	usbdev_init(&cdcacm_device);
+}
 
-	/* Assign packet memory to endpoint */
-	offset = usbdevfs_assign_packet_memory_tx(0, PACKET_MEMORY_START,
-						  MAXPACKETSIZE0);
-	offset = usbdevfs_assign_packet_memory_rx(0, offset, MAXPACKETSIZE0);
-	offset = usbdevfs_assign_packet_memory_tx(1, offset, NOTIFICATION_SIZE);
-	offset = usbdevfs_assign_packet_memory_rx(2, offset, DATA_SIZE);
-	offset = usbdevfs_assign_packet_memory_tx(3, offset, DATA_SIZE);
+/* Is the endpoint enabled (configured and not halted)? */
+bool endpoint_enabled(u8 address)
+{
+	return (usbdev_get_configuration() &&
+		!usbdev_get_endpoint_halt(address));
 }
 
 static void rx_packet(int ep_id, bool setup)
@@ -541,13 +534,13 @@ static void rx_packet(int ep_id, bool setup)
 	if (ep_id == 0) {
 		if (setup) {
 			/* Device request */
-			control_setup();
+			usbdev_control_setup();
 
 			/* Notification (if it exists) */
 			interrupt_notify();
 		} else {
 			/* OUT data */
-			control_rx();
+			usbdev_control_rx();
 		}
 	} else if (ep_id == 2) {
 		if (command_state) {
@@ -573,7 +566,7 @@ static void tx_packet(int ep_id)
 
 	switch (ep_id) {
 	case 0:
-		control_tx();
+		usbdev_control_tx();
 		break;
 	case 1:
 		/* Clear interrupt. */
@@ -640,17 +633,8 @@ static void usb_reset(void)
 	/* Enable USART2 Receive interrupt. */
 	usart_enable_interrupt(USART2, USART_RXNE);
 
-	/* Set endpoint type and address. */
-	usbdevfs_setup_endpoint(0, USBDEVFS_CONTROL, 0);
-	usbdevfs_setup_endpoint(1, USBDEVFS_INTERRUPT, NOTIFICATION_ENUM);
-	usbdevfs_setup_endpoint(2, USBDEVFS_BULK, DATA_RX_ENUM);
-	usbdevfs_setup_endpoint(3, USBDEVFS_BULK, DATA_TX_ENUM);
-
-	/* Set default address. */
-	usbdevfs_set_device_address(0);
-
-	/* Reset control transfer state. */
-	control_reset();
+	/* Reset endpoints, device and class state. */
+	usbdev_reset();
 
 	/* Reset interrupt transfer state. */
 	interrupt_reset();
@@ -27,15 +27,9 @@
 /* Maximum OUT data length */
 #define MAX_DATA_OUT		16
 
-/* Maximum IN data length */
-#define MAX_DATA_IN		64
-
 /* Maximun interface number */
 #define MAXINTERFACE		2
 
-/* Maximum endpoint number */
-#define MAXENDPOINT		4
-
 /* Communications Class Interface */
 #define INTERFACE_COMM		0
 /* Notification endpoint */
@@ -63,13 +57,6 @@
 #define TXQUEUESIZE		(DATA_SIZE * 2)
 #define RXQUEUESIZE		DATA_SIZE
 
-/* Endpoint state */
-typedef enum {
-	EP_STATE_DISABLE,
-	EP_STATE_ENABLE,
-	EP_STATE_HALT
-} ep_state_t;
-
 typedef enum {
 	ESCAPE_STATE0,
 	ESCAPE_STATE1,		/* + */
@@ -85,3 +72,5 @@ void usart_start_break(u16 period);
 void usart_stop_break(void);
 
 void start_escape_timer(void);
+
+bool endpoint_enabled(u8 address);
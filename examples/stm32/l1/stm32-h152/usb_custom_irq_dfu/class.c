@@ -19,6 +19,7 @@
 
 #include <gpio.h>
 #include <scb.h>
+#include <usbdev.h>
 
 #include <usb/standard.h>
 #include <usb/dfu.h>
@@ -39,7 +40,7 @@
  *
  */
 
-bool vendor_request_error(struct usb_setup_data *req)
+static bool vendor_request_error(struct usb_setup_data *req)
 {
 	switch (req->bRequest) {
 	case 0:
@@ -86,7 +87,7 @@ bool vendor_request_error(struct usb_setup_data *req)
 	return false;
 }
 
-int vendor_request(struct usb_setup_data *req, u8 *buf, u8 **data)
+static int vendor_request(struct usb_setup_data *req, u8 *buf, u8 **data)
 {
 	u16 *p;
 
@@ -109,7 +110,7 @@ int vendor_request(struct usb_setup_data *req, u8 *buf, u8 **data)
 
 /* --- Class-specific Requests --------------------------------------------- */
 
-bool class_request_error(struct usb_setup_data *req)
+static bool class_request_error(struct usb_setup_data *req)
 {
 	switch (req->bRequest) {
 	case USB_DFU_REQ_DETACH:
@@ -184,7 +185,7 @@ bool class_request_error(struct usb_setup_data *req)
 	return false;
 }
 
-int class_request(struct usb_setup_data *req, u8 *buf, u8 **data)
+static int dfu_request(struct usb_setup_data *req, u8 *buf, u8 **data)
 {
 	struct usb_dfu_status *p;
 	int len;
@@ -216,3 +217,40 @@ int class_request(struct usb_setup_data *req, u8 *buf, u8 **data)
 
 	return len;
 }
+
+/* Vendor-specific and class-specific Requests */
+int class_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		  u8 **data)
+{
+	bool vendor;
+
+	switch (req->bmRequestType & USB_TYPE_MASK) {
+	case USB_TYPE_VENDOR:
+		vendor = true;
+		break;
+	case USB_TYPE_CLASS:
+		vendor = false;
+		break;
+	default:
+		return -1;
+	}
+
+	switch (stage) {
+	case USBDEV_STAGE_SETUP:
+		/* Check error. */
+		if (vendor ? vendor_request_error(req) : class_request_error(req))
+			return -1;
+
+		/* GET request */
+		if (req->bmRequestType & USB_DIR_IN)
+			return (vendor ? vendor_request(req, buf, data) :
+				dfu_request(req, buf, data));
+		break;
+	case USBDEV_STAGE_STATUS:
+		/* SET request */
+		return (vendor ? vendor_request(req, buf, data) :
+			dfu_request(req, buf, data));
+	}
+
+	return 0;
+}
@@ -17,12 +17,15 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <usbdev.h>
+
 #include <usb/standard.h>
 #include <usb/langid.h>
 #include <usb/dfu.h>
 
 #include "usb_custom_irq_dfu.h"
 #include "descriptor.h"
+#include "class.h"
 
 /* Configuration */
 struct config_desc {
@@ -33,7 +36,7 @@ struct config_desc {
 } __attribute__ ((packed));
 
 /* Device Descriptor */
-const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) = {
+static const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) = {
 	.bLength = sizeof(struct usb_device_descriptor),
 	.bDescriptorType = USB_DT_DEVICE,
 	.bcdUSB = 0x0200,
@@ -50,7 +53,7 @@ const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) = {
 	.bNumConfigurations = 1,
 };
 
-const struct config_desc config_desc __attribute__ ((aligned(2))) = {
+static const struct config_desc config_desc __attribute__ ((aligned(2))) = {
 	/* Configuration Descriptor */
 	.config = {
 		.bLength = sizeof(struct usb_config_descriptor),
@@ -99,22 +102,25 @@ const struct config_desc config_desc __attribute__ ((aligned(2))) = {
 };
 
 /* Strings */
-const u16 lang[] = {LANGID_ENGLISH_US, LANGID_JAPANESE, 0};
-const u16 string1[] = L"MPC Research Ltd.";
-const u16 string2[] = L"Custom Device";
-u16 string3[25];
-const u16 string4[] = L"有限会社エムピーシーリサーチ";
-const u16 string5[] = L"カスタムデバイス";
-const u16 *string_english_us[] = {
+static const u16 string1[] = L"MPC Research Ltd.";
+static const u16 string2[] = L"Custom Device";
+static u16 string3[25];		/* Serial number (unique device ID) */
+static const u16 string4[] = L"有限会社エムピーシーリサーチ";
+static const u16 string5[] = L"カスタムデバイス";
+static const u16 * const string_english_us[MAX_STRING_INDEX] = {
 	string1,
 	string2,
 	string3
 };
-const u16 *string_japanese[] = {
+static const u16 * const string_japanese[MAX_STRING_INDEX] = {
 	string4,
 	string5,
 	string3
 };
+static const struct usbdev_language language[] = {
+	{LANGID_ENGLISH_US, string_english_us},
+	{LANGID_JAPANESE, string_japanese}
+};
 
 void set_serial_number(u32 *uid)
 {
@@ -135,54 +141,12 @@ void set_serial_number(u32 *uid)
 	string3[24] = L'\0';
 }
 
-/* Make string descriptor from NULL-terminated string. */
-static int make_string_descriptor(int index, int langid, u16 *buf)
-{
-	int i;
-	const u16 *p;
-	u8 *s;
-
-	if (index == 0)
-		p = lang;	/* LANGID */
-	else if (langid == LANGID_ENGLISH_US)
-		p = string_english_us[index - 1]; /* UNICODE encoded string */
-	else
-		p = string_japanese[index - 1]; /* JAPANESE string */
-
-	/* Copy data (not include EOS(0)). */
-	for (i = 1; *p; i++)
-		*(buf + i) = *p++;
-
-	/* Add bLength and bDescriptorType. */
-	s = (u8 *)buf;
-	*s++ = i * sizeof(u16);
-	*s = USB_DT_STRING;
-
-	/* Return descriptor size. */
-	return i * (int)sizeof(u16);
-}
-
-int get_descriptor(int type, int index, int langid, u8 *buf, u8 **data)
-{
-	int len;
-
-	switch (type) {
-	case USB_DT_DEVICE:
-		len = sizeof(dev_desc);
-		*data = (u8 *)&dev_desc;
-		break;
-	case USB_DT_CONFIGURATION:
-		len = sizeof(config_desc);
-		*data = (u8 *)&config_desc;
-		break;
-	case USB_DT_STRING:
-		len = make_string_descriptor(index, langid, (u16 *)buf);
-		*data = buf;
-		break;
-	default:
-		len = 0;
-		break;
-	}
-
-	return len;
-}
+/* USB device */
+const struct usbdev_device custom_device = {
+	.device = &dev_desc,
+	.config = &config_desc.config,
+	.num_string = MAX_STRING_INDEX,
+	.num_language = sizeof(language) / sizeof(language[0]),
+	.language = language,
+	.request = class_request,
+};
@@ -17,5 +17,5 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-int get_descriptor(int type, int index, int langid, u8 *buf, u8 **data);
+extern const struct usbdev_device custom_device;
 
@@ -24,25 +24,19 @@
 #include <tim.h>
 #include <syscfg.h>
 #include <usbdevfs.h>
+#include <usbdev.h>
 #include <nvic.h>
 #include <exti.h>
 #include <scb.h>
 #include <dbgmcu.h>
 #include <desig.h>
 
-#include <usb/standard.h>
-
 #include "usb_custom_irq_dfu.h"
-#include "control.h"
+#include "descriptor.h"
 
 /* Timer clock frequency */
 #define TIMX_CLK_APB1		32000000
 
-/* Packet buffer memory */
-#define BUFFER_TABLE_ADDRESS	0
-#define PACKET_MEMORY_START	(BUFFER_TABLE_ADDRESS + \
-				 USBDEVFS_BUFFER_TABLE_SIZE)
-
 /* statistics */
 unsigned int usb_overrun;
 unsigned int usb_error;
@@ -149,8 +143,6 @@ static void delay_us(u16 us)
 
 static void usb_setup(void)
 {
-	int offset;
-
 	/* Enable USB and SYSCFG clock. */
 	rcc_enable_clock(RCC_USB);
 	rcc_enable_clock(RCC_SYSCFG);
@@ -176,13 +168,8 @@ static void usb_setup(void)
 	/* Clear USB reset. */
 	usbdevfs_disable_function(USBDEVFS_FORCE_RESET);
 
-	/* Set buffer table address */
-	usbdevfs_set_buffer_table_address(BUFFER_TABLE_ADDRESS);
-
 	/* Assign packet memory to endpoint0 */
-	offset = usbdevfs_assign_packet_memory_tx(0, PACKET_MEMORY_START,
-						  MAXPACKETSIZE0);
-	usbdevfs_assign_packet_memory_rx(0, offset, MAXPACKETSIZE0);
+	usbdev_init(&custom_device);
 }
 
 static void exti_setup(void)
@@ -241,14 +228,8 @@ static void usb_reset(void)
 	/* Disable button interrupt. */
 	exti_disable_interrupt(EXTI0);
 
-	/* Set endpoint type and address. */
-	usbdevfs_setup_endpoint(0, USBDEVFS_CONTROL, 0);
-
-	/* Set default address. */
-	usbdevfs_set_device_address(0);
-
-	/* Reset control transfer state. */
-	control_reset();
+	/* Reset USB device state. */
+	usbdev_reset();
 }
 
 /* USB (low priority) interrupt */
@@ -285,13 +266,13 @@ void usb_lp_isr(void)
 		/* Rx (OUT/SETUP transaction) */
 		if ((status & USBDEVFS_DIR) && (trans & USBDEVFS_RX)) {
 			if (trans & USBDEVFS_SETUP)
-				control_setup();
+				usbdev_control_setup();
 			else
-				control_rx();
+				usbdev_control_rx();
 		}
 		/* Tx (IN transaction) */
 		if (!(status & USBDEVFS_DIR) && (trans & USBDEVFS_TX))
-			control_tx();
+			usbdev_control_tx();
 	}
 
 	/* Packet memory area over/underrun */
@@ -327,7 +308,7 @@ void usb_lp_isr(void)
 		exti_clear_interrupt(0xffffff);
 
 		/* Enable button interrupt. */
-		if (device_status & USB_DEV_STATUS_REMOTE_WAKEUP)
+		if (usbdev_get_remote_wakeup())
 			exti_enable_interrupt(EXTI0);
 
 		/* Slow down clock (32MHz -> 65kHz) */
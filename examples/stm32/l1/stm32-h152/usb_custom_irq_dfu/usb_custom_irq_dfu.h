@@ -27,15 +27,9 @@
 /* Maximun transfer size (FLASH_PAGE_SIZE) */
 #define MAXTRANSFERSIZE		256
 
-/* Maximum IN data length */
-#define MAX_DATA_IN		64
-
 /* Maximun interface number */
 #define MAXINTERFACE		2
 
-/* Maximum endpoint number */
-#define MAXENDPOINT		1
-
 /* Vendor Interface */
 #define INTERFACE_VENDOR	0
 
@@ -45,6 +39,4 @@
 /* Maximum string index */
 #define MAX_STRING_INDEX	3
 
-extern u16 device_status;
-
 void set_serial_number(u32 *uid);
@@ -17,6 +17,10 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <flash.h>
+#include <nvic.h>
+#include <usbdev.h>
+
 #include <usb/standard.h>
 #include <usb/dfu.h>
 
@@ -25,11 +29,35 @@
 
 static volatile usb_dfu_status_t dfu_status = USB_DFU_STATUS_OK;
 static volatile usb_dfu_state_t dfu_state = USB_DFU_STATE_DFU_IDLE;
-static volatile int block_num;
-static volatile int block_len;
-static u32 *block_buf;
 static volatile u32 addr_pointer = APP_ADDRESS;
 
+/*
+ * Download blocks
+ *
+ * DFU_DNLOAD puts a block into the queue, and the main loop programs it
+ * while the host sends the next one. The USB interrupt only writes
+ * block_in and op_queued, and the main loop block_out and op_done.
+ */
+struct block {
+	u32 addr;
+	int nword;		/* Multiple of half-page */
+	u32 data[MAXTRANSFERSIZE / 4];
+};
+
+static struct block block[NUM_BLOCK];
+static volatile unsigned int block_in;	/* Blocks queued */
+static volatile unsigned int block_out;	/* Blocks programmed */
+static volatile int op_queued;		/* Flash operations queued */
+static volatile int op_done;		/* Flash operations done */
+
+/* Error of the blocks in the background */
+static volatile usb_dfu_status_t program_status = USB_DFU_STATUS_OK;
+
+static bool queue_full(void)
+{
+	return (block_in - block_out >= NUM_BLOCK);
+}
+
 /* --- Class-specific Requests --------------------------------------------- */
 
 /*
@@ -87,6 +115,10 @@ static bool dfu_dnload_error(struct usb_setup_data *req)
 	      dfu_state == USB_DFU_STATE_DFU_DNLOAD_IDLE))
 			return true;
 
+	/* Blocks of the aborted download are still being programmed. */
+	if (req->wLength && queue_full())
+		return true;
+
 	return false;
 }
 
@@ -247,7 +279,7 @@ static bool dfu_abort_error(struct usb_setup_data *req)
 	return false;
 }
 
-bool class_request_error(struct usb_setup_data *req)
+static bool class_request_error(struct usb_setup_data *req)
 {
 	bool r = false;
 
@@ -288,12 +320,70 @@ bool class_request_error(struct usb_setup_data *req)
 	return r;
 }
 
+/* Erase (one per page) and half-page programming operations */
+static int block_ops(int nword)
+{
+	return (nword * 4 + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE +
+		nword * 4 / HALF_PAGE_SIZE;
+}
+
+/* Put the block into the queue (a free entry is always available). */
+static void queue_block(u8 *buf, int len)
+{
+	struct block *b;
+	u32 *s;
+	int n;
+	int i;
+
+	if (program_addr_error(addr_pointer) ||
+	    program_addr_error(addr_pointer + len - 1)) {
+		dfu_status = USB_DFU_STATUS_ERR_ADDRESS;
+		dfu_state = USB_DFU_STATE_DFU_ERROR;
+		return;
+	}
+
+	b = &block[block_in % NUM_BLOCK];
+	b->addr = addr_pointer;
+
+	/* Pad to half-page with the erased value (0). */
+	n = (len + 3) / 4;
+	b->nword = ((len + HALF_PAGE_SIZE - 1) / HALF_PAGE_SIZE *
+		    HALF_PAGE_SIZE / 4);
+	s = (u32 *)buf;
+	for (i = 0; i < n; i++)
+		b->data[i] = *s++;
+	if (len & 3)
+		b->data[n - 1] &= (1 << ((len & 3) * 8)) - 1;
+	for (; i < b->nword; i++)
+		b->data[i] = 0;
+
+	op_queued += block_ops(b->nword);
+	block_in++;
+	addr_pointer += MAXTRANSFERSIZE;
+}
+
+/* Time until a queue entry is free (or all the blocks are programmed) */
+static int queue_time(bool all)
+{
+	unsigned int i;
+	int n;
+
+	if (!all && !queue_full())
+		return 0;
+
+	/* Operations left, except the blocks after the oldest one */
+	n = op_queued - op_done;
+	if (!all)
+		for (i = block_out + 1; i != block_in; i++)
+			n -= block_ops(block[i % NUM_BLOCK].nword);
+
+	/* One more operation for the software overhead */
+	return program_time(n + 1);
+}
+
 /* DFU_DNLOAD */
 static int request_dfu_dnload(struct usb_setup_data *req, u8 *buf)
 {
-	block_num = req->wValue;
-	block_len = req->wLength;
-	block_buf = (u32 *)buf;
 	if (dfu_state == USB_DFU_STATE_DFU_IDLE) {
 		dfu_state = USB_DFU_STATE_DFU_DNLOAD_SYNC;
 	} else if (dfu_state == USB_DFU_STATE_DFU_DNLOAD_IDLE) {
@@ -302,6 +392,8 @@ static int request_dfu_dnload(struct usb_setup_data *req, u8 *buf)
 		else
 			dfu_state = USB_DFU_STATE_DFU_MANIFEST_SYNC;
 	}
+	if (req->wLength)
+		queue_block(buf, req->wLength);
 	return 0;
 }
 
@@ -327,26 +419,36 @@ static int request_dfu_upload(struct usb_setup_data *req, u8 **data)
 /* DFU_GETSTATUS */
 static int request_dfu_getstatus(u8 *buf, u8 **data)
 {
-	static bool block_complete;
 	struct usb_dfu_status *p;
-	int t;
+	int t = 0;
 
-	if (dfu_state == USB_DFU_STATE_DFU_DNLOAD_SYNC) {
-		if (!block_complete) {
-			block_complete = true;
+	if ((dfu_state == USB_DFU_STATE_DFU_DNLOAD_SYNC ||
+	     dfu_state == USB_DFU_STATE_DFU_MANIFEST_SYNC) &&
+	    program_status != USB_DFU_STATUS_OK) {
+		/* A block failed in the background. */
+		dfu_status = program_status;
+		dfu_state = USB_DFU_STATE_DFU_ERROR;
+	} else if (dfu_state == USB_DFU_STATE_DFU_DNLOAD_SYNC) {
+		/* Busy only if the queue is full. */
+		t = queue_time(false);
+		if (t)
 			dfu_state = USB_DFU_STATE_DFU_DNBUSY;
-		} else {
-			block_complete = false;
+		else
 			dfu_state = USB_DFU_STATE_DFU_DNLOAD_IDLE;
-		}
 	} else if (dfu_state == USB_DFU_STATE_DFU_MANIFEST_SYNC) {
-		dfu_state = USB_DFU_STATE_DFU_MANIFEST_WAIT_RESET;
+		/* Wait for the rest of the blocks. */
+		if (block_in != block_out) {
+			t = queue_time(true);
+			dfu_state = USB_DFU_STATE_DFU_MANIFEST;
+		} else {
+			dfu_state = USB_DFU_STATE_DFU_MANIFEST_WAIT_RESET;
+		}
 	}
 
 	p = (struct usb_dfu_status *)buf;
 	p->bStatus = dfu_status;
-	if (dfu_state == USB_DFU_STATE_DFU_DNBUSY) {
-		t = program_time(block_len / 4 + 1);
+	if (dfu_state == USB_DFU_STATE_DFU_DNBUSY ||
+	    dfu_state == USB_DFU_STATE_DFU_MANIFEST) {
 		p->bwPollTimeout[0] = (t & 0xff);
 		p->bwPollTimeout[1] = ((t >> 8) & 0xff);
 		p->bwPollTimeout[2] = ((t >> 16) & 0xff);
@@ -366,6 +468,7 @@ static int request_dfu_getstatus(u8 *buf, u8 **data)
 static int request_dfu_clrstatus(void)
 {
 	dfu_status = USB_DFU_STATUS_OK;
+	program_status = USB_DFU_STATUS_OK;
 	dfu_state = USB_DFU_STATE_DFU_IDLE;
 	addr_pointer = APP_ADDRESS;
 	return 0;
@@ -387,7 +490,7 @@ static int request_dfu_abort(void)
 	return 0;
 }
 
-int class_request(struct usb_setup_data *req, u8 *buf, u8 **data)
+static int dfu_request(struct usb_setup_data *req, u8 *buf, u8 **data)
 {
 	switch (req->bRequest) {
 	// case USB_DFU_REQ_DETACH:
@@ -411,10 +514,36 @@ int class_request(struct usb_setup_data *req, u8 *buf, u8 **data)
 	return -1;
 }
 
+int class_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		  u8 **data)
+{
+	/* Class-specific Request */
+	if ((req->bmRequestType & USB_TYPE_MASK) != USB_TYPE_CLASS)
+		return -1;
+
+	switch (stage) {
+	case USBDEV_STAGE_SETUP:
+		/* Check error. */
+		if (class_request_error(req))
+			return -1;
+
+		/* GET request */
+		if (req->bmRequestType & USB_DIR_IN)
+			return dfu_request(req, buf, data);
+		break;
+	case USBDEV_STAGE_STATUS:
+		/* SET request */
+		return dfu_request(req, buf, data);
+	}
+
+	return 0;
+}
+
 void class_reset(void)
 {
 	dfu_state = USB_DFU_STATE_DFU_IDLE;
 	dfu_status = USB_DFU_STATUS_OK;
+	program_status = USB_DFU_STATUS_OK;
 	addr_pointer = APP_ADDRESS;
 }
 
@@ -428,55 +557,86 @@ static bool erase_error(u32 *p, int nword)
 	return false;
 }
 
-static bool verify_error(u32 *d, u32 *s, int nword)
+/* Erase and program the block. */
+static usb_dfu_status_t program_block(struct block *b)
 {
-	int i;
+	u32 crc;
+	u32 a;
+	int n;
 
-	for (i = 0; i < nword; i++)
-		if (*d++ != *s++)
-			return true;
-	return false;
+	crc = program_crc(b->data, b->nword);
+
+	/* Erase */
+	for (a = b->addr; a < b->addr + b->nword * 4; a += FLASH_PAGE_SIZE) {
+		n = FLASH_PAGE_SIZE / 4;
+		if (erase_error((u32 *)a, n)) {
+			program_erase(a);
+			/* Erase check */
+			if (erase_error((u32 *)a, n))
+				return USB_DFU_STATUS_ERR_CHECK_ERASED;
+		}
+		op_done++;
+	}
+
+	/* Program (half-page) */
+	for (a = b->addr; a < b->addr + b->nword * 4; a += HALF_PAGE_SIZE) {
+		program_memory((u32 *)a, b->data + (a - b->addr) / 4,
+			       HALF_PAGE_SIZE / 4);
+		op_done++;
+	}
+
+	/* Verify */
+	if (program_crc((u32 *)b->addr, b->nword) != crc)
+		return USB_DFU_STATUS_ERR_VERIFY;
+
+	return USB_DFU_STATUS_OK;
 }
 
+/* Program the queued blocks (main loop). */
 void block_transfer(void)
 {
-	int len;
+	struct block *b;
+	usb_dfu_status_t status;
+	int done;
 
-	if (dfu_state != USB_DFU_STATE_DFU_DNBUSY)
+	if (block_out == block_in)
 		return;
 
-	/* Address check */
-	if (program_addr_error(addr_pointer)) {
-		dfu_status = USB_DFU_STATUS_ERR_ADDRESS;
-		dfu_state = USB_DFU_STATE_DFU_ERROR;
-		return;
-	}
+	b = &block[block_out % NUM_BLOCK];
+	done = op_done + block_ops(b->nword);
 
-	/* Erase */
-	len = block_len / sizeof(u32);
-	if (erase_error((u32 *)addr_pointer, len)) {
-		program_erase(addr_pointer);
-		/* Erase check */
-		if (erase_error((u32 *)addr_pointer, len)) {
-			dfu_status = USB_DFU_STATUS_ERR_CHECK_ERASED;
-			dfu_state = USB_DFU_STATE_DFU_ERROR;
-			return;
-		}
-	}
+	status = program_block(b);
 
-	/* Program */
-	program_memory((u32 *)addr_pointer, block_buf, len);
+	nvic_disable_irq(NVIC_USB_LP_IRQ);
 
-	/* Verify */
-	if (verify_error((u32 *)addr_pointer, block_buf, len)) {
-		dfu_status = USB_DFU_STATUS_ERR_VERIFY;
-		dfu_state = USB_DFU_STATE_DFU_ERROR;
-		return;
+	/* Including the skipped operations (no erase needed, error) */
+	op_done = done;
+	block_out++;
+
+	if (status != USB_DFU_STATUS_OK) {
+		program_status = status;
+		/* Don't boot the partial image. */
+		program_erase(APP_ADDRESS);
 	}
 
-	addr_pointer += MAXTRANSFERSIZE;
+	if (dfu_state == USB_DFU_STATE_DFU_DNBUSY) {
+		if (program_status != USB_DFU_STATUS_OK) {
+			dfu_status = program_status;
+			dfu_state = USB_DFU_STATE_DFU_ERROR;
+		} else {
+			dfu_state = USB_DFU_STATE_DFU_DNLOAD_SYNC;
+		}
+	} else if (dfu_state == USB_DFU_STATE_DFU_MANIFEST &&
+		   block_out == block_in) {
+		if (program_status != USB_DFU_STATUS_OK) {
+			dfu_status = program_status;
+			dfu_state = USB_DFU_STATE_DFU_ERROR;
+		} else {
+			dfu_state = USB_DFU_STATE_DFU_MANIFEST_WAIT_RESET;
+		}
+	}
 
-	dfu_state = USB_DFU_STATE_DFU_DNLOAD_SYNC;
+	nvic_enable_irq(NVIC_USB_LP_IRQ);
 }
 
 bool dfu_wait_reset(void)
@@ -25,22 +25,19 @@
 #include <syscfg.h>
 #include <nvic.h>
 #include <usbdevfs.h>
+#include <usbdev.h>
 #include <scb.h>
 #include <dbgmcu.h>
 #include <desig.h>
 #include <wwdg.h>
+#include <crc.h>
 
 #include "usb_dfu.h"
-#include "control.h"
+#include "descriptor.h"
 
 /* Timer clock frequency */
 #define TIMX_CLK_APB1		32000000
 
-/* USB packet buffer memory */
-#define BUFFER_TABLE_ADDRESS	0
-#define PACKET_MEMORY_START	(BUFFER_TABLE_ADDRESS + \
-				 USBDEVFS_BUFFER_TABLE_SIZE)
-
 extern unsigned _stack;
 
 static u32 flash_size;
@@ -120,8 +117,6 @@ static void delay_us(u16 us)
 
 static void usb_setup(void)
 {
-	int offset;
-
 	/* Enable USB and SYSCFG clock. */
 	rcc_enable_clock(RCC_USB);
 	rcc_enable_clock(RCC_SYSCFG);
@@ -138,13 +133,8 @@ static void usb_setup(void)
 	/* Clear USB reset. */
 	usbdevfs_disable_function(USBDEVFS_FORCE_RESET);
 
-	/* Set buffer table address */
-	usbdevfs_set_buffer_table_address(BUFFER_TABLE_ADDRESS);
-
 	/* Assign packet memory to endpoint */
-	offset = usbdevfs_assign_packet_memory_tx(0, PACKET_MEMORY_START,
-						  MAXPACKETSIZE0);
-	offset = usbdevfs_assign_packet_memory_rx(0, offset, MAXPACKETSIZE0);
+	usbdev_init(&dfu_device);
 }
 
 static void usb_reset(void)
@@ -159,14 +149,8 @@ static void usb_reset(void)
 		wwdg_reset(0);
 	}
 
-	/* Set endpoint type and address. */
-	usbdevfs_setup_endpoint(0, USBDEVFS_CONTROL, 0);
-
-	/* Set default address. */
-	usbdevfs_set_device_address(0);
-
-	/* Reset control transfer state. */
-	control_reset();
+	/* Reset USB device state. */
+	usbdev_reset();
 }
 
 /* USB (low priority) interrupt */
@@ -205,16 +189,16 @@ void usb_lp_isr(void)
 		if ((status & USBDEVFS_DIR) && (trans & USBDEVFS_RX)) {
 			if (trans & USBDEVFS_SETUP)
 				/* SETUP */
-				control_setup();
+				usbdev_control_setup();
 			else
 				/* OUT */
-				control_rx();
+				usbdev_control_rx();
 		}
 
 		/* Tx (IN transaction) */
 		if (!(status & USBDEVFS_DIR) && (trans & USBDEVFS_TX))
 			/* IN */
-			control_tx();
+			usbdev_control_tx();
 	}
 
 	/* USB RESET */
@@ -252,6 +236,7 @@ void program_erase(u32 addr)
 	gpio_set(GPIO_PE11);
 }
 
+/* 'nword' is a multiple of HALF_PAGE_SIZE / 4. */
 void program_memory(u32 *d, u32 *s, int nword)
 {
 	int i;
@@ -259,15 +244,20 @@ void program_memory(u32 *d, u32 *s, int nword)
 	gpio_clear(GPIO_PE11);
 	flash_unlock_pecr();
 	flash_unlock_program_memory();
-	for (i = 0; i < nword; i++) {
-		*d++ = *s++;
-		flash_wait_for_last_operation();
-	}
+	for (i = 0; i < nword; i += HALF_PAGE_SIZE / 4)
+		flash_program_half_page((u32)(d + i), s + i);
 	flash_lock_program_memory();
 	flash_lock_pecr();
 	gpio_set(GPIO_PE11);
 }
 
+/* CRC-32 (CRC calculation unit) */
+u32 program_crc(u32 *p, int nword)
+{
+	crc_reset();
+	return crc_calculate(p, nword);
+}
+
 int main(void)
 {
 	bool softreset;
@@ -322,6 +312,9 @@ int main(void)
 	tim_setup();
 	usb_setup();
 
+	/* Enable CRC clock (block verification). */
+	rcc_enable_clock(RCC_CRC);
+
 	/* Set serial number (unique device ID). */
 	desig_get_unique_id(dev_id, uid);
 	set_serial_number(uid);
@@ -24,17 +24,17 @@
 /* Maximum packet size for endpoint zero */
 #define MAXPACKETSIZE0		64
 
-/* Maximun transfer size (FLASH_PAGE_SIZE) */
-#define MAXTRANSFERSIZE		256
+/* Maximun transfer size (4 * FLASH_PAGE_SIZE) */
+#define MAXTRANSFERSIZE		1024
 
-/* Maximum OUT data length */
-#define MAX_DATA_OUT		MAXTRANSFERSIZE
+/* Number of download blocks programmed in the background */
+#define NUM_BLOCK		2
 
-/* Maximum IN data length */
-#define MAX_DATA_IN		MAXTRANSFERSIZE
+/* Half-page (32 words) */
+#define HALF_PAGE_SIZE		(FLASH_PAGE_SIZE / 2)
 
-/* Maximun interface number */
-#define MAXINTERFACE		1
+/* Maximum OUT data length */
+#define MAX_DATA_OUT		MAXTRANSFERSIZE
 
 /* Maximum string index */
 #define MAX_STRING_INDEX	4
@@ -48,6 +48,7 @@ bool program_addr_error(u32 addr);
 int program_time(int n);
 void program_erase(u32 addr);
 void program_memory(u32 *d, u32 *s, int nword);
+u32 program_crc(u32 *p, int nword);
 
 void block_transfer(void);
 bool dfu_wait_reset(void);
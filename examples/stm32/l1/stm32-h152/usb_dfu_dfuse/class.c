@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <usbdev.h>
+
 #include <usb/standard.h>
 #include <usb/dfu.h>
 
@@ -34,7 +36,7 @@ static u8 *block_buf;
 static volatile u32 addr_pointer = 0x08000000;
 
 /* --- Class-specific Requests --------------------------------------------- */
-bool class_request_error(struct usb_setup_data *req)
+static bool class_request_error(struct usb_setup_data *req)
 {
 	bool r = false;
 
@@ -257,7 +259,7 @@ bool class_request_error(struct usb_setup_data *req)
 	return r;
 }
 
-int class_request_check_data(struct usb_setup_data *req, u8 *buf)
+int class_check_data(struct usb_setup_data *req, u8 *buf)
 {
 	u8 cmd;
 
@@ -280,7 +282,7 @@ int class_request_check_data(struct usb_setup_data *req, u8 *buf)
 	return 0;
 }
 
-int class_request(struct usb_setup_data *req, u8 *buf, u8 **data)
+static int dfu_request(struct usb_setup_data *req, u8 *buf, u8 **data)
 {
 	int len = 0;
 	struct usb_dfu_status *p;
@@ -373,6 +375,31 @@ int class_request(struct usb_setup_data *req, u8 *buf, u8 **data)
 	return len;
 }
 
+int class_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		  u8 **data)
+{
+	/* Class-specific Request */
+	if ((req->bmRequestType & USB_TYPE_MASK) != USB_TYPE_CLASS)
+		return -1;
+
+	switch (stage) {
+	case USBDEV_STAGE_SETUP:
+		/* Check error. */
+		if (class_request_error(req))
+			return -1;
+
+		/* GET request */
+		if (req->bmRequestType & USB_DIR_IN)
+			return dfu_request(req, buf, data);
+		break;
+	case USBDEV_STAGE_STATUS:
+		/* SET request */
+		return dfu_request(req, buf, data);
+	}
+
+	return 0;
+}
+
 void class_reset(void)
 {
 	dfu_status = USB_DFU_STATUS_OK;
@@ -25,22 +25,18 @@
 #include <syscfg.h>
 #include <nvic.h>
 #include <usbdevfs.h>
+#include <usbdev.h>
 #include <scb.h>
 #include <dbgmcu.h>
 #include <desig.h>
 #include <wwdg.h>
 
 #include "usb_dfu_dfuse.h"
-#include "control.h"
+#include "descriptor.h"
 
 /* Timer clock frequency */
 #define TIMX_CLK_APB1		32000000
 
-/* Packet buffer memory */
-#define BUFFER_TABLE_ADDRESS	0
-#define PACKET_MEMORY_START	(BUFFER_TABLE_ADDRESS + \
-				 USBDEVFS_BUFFER_TABLE_SIZE)
-
 extern unsigned _stack;
 
 static u32 flash_size;
@@ -120,8 +116,6 @@ static void delay_us(u16 us)
 
 static void usb_setup(void)
 {
-	int offset;
-
 	/* Enable USB and SYSCFG clock. */
 	rcc_enable_clock(RCC_USB);
 	rcc_enable_clock(RCC_SYSCFG);
@@ -138,25 +132,14 @@ static void usb_setup(void)
 	/* Clear USB reset. */
 	usbdevfs_disable_function(USBDEVFS_FORCE_RESET);
 
-	/* Set buffer table address */
-	usbdevfs_set_buffer_table_address(BUFFER_TABLE_ADDRESS);
-
 	/* Assign packet memory to endpoint */
-	offset = usbdevfs_assign_packet_memory_tx(0, PACKET_MEMORY_START,
-						  MAXPACKETSIZE0);
-	offset = usbdevfs_assign_packet_memory_rx(0, offset, MAXPACKETSIZE0);
+	usbdev_init(&dfuse_device);
 }
 
 static void usb_reset(void)
 {
-	/* Set endpoint type and address. */
-	usbdevfs_setup_endpoint(0, USBDEVFS_CONTROL, 0);
-
-	/* Set default address. */
-	usbdevfs_set_device_address(0);
-
-	/* Reset control transfer state. */
-	control_reset();
+	/* Reset USB device state. */
+	usbdev_reset();
 }
 
 /* USB (low priority) interrupt */
@@ -195,16 +178,16 @@ void usb_lp_isr(void)
 		if ((status & USBDEVFS_DIR) && (trans & USBDEVFS_RX)) {
 			if (trans & USBDEVFS_SETUP)
 				/* SETUP */
-				control_setup();
+				usbdev_control_setup();
 			else
 				/* OUT */
-				control_rx();
+				usbdev_control_rx();
 		}
 
 		/* Tx (IN transaction) */
 		if (!(status & USBDEVFS_DIR) && (trans & USBDEVFS_TX))
 			/* IN */
-			control_tx();
+			usbdev_control_tx();
 	}
 
 	/* USB RESET */
@@ -30,12 +30,6 @@
 /* Maximum OUT data length */
 #define MAX_DATA_OUT		MAXTRANSFERSIZE
 
-/* Maximum IN data length */
-#define MAX_DATA_IN		MAXTRANSFERSIZE
-
-/* Maximun interface number */
-#define MAXINTERFACE		1
-
 /* Maximum string index */
 #define MAX_STRING_INDEX	3
 
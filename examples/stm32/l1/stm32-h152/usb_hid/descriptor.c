@@ -0,0 +1,210 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <usbdev.h>
+#include <hiddev.h>
+
+#include <usb/standard.h>
+#include <usb/descriptor.h>
+#include <usb/langid.h>
+#include <usb/hid.h>
+#include <usb/hut.h>
+
+#include "usb_hid.h"
+#include "descriptor.h"
+
+/* struct usb_hid_descriptor_1 */
+USB_HID_DESCRIPTOR(1);
+
+/* Configuration */
+struct config_desc {
+	struct usb_config_descriptor config;
+	struct usb_interface_descriptor hid_if;
+	struct usb_hid_descriptor_1 hid;
+	struct usb_endpoint_descriptor in_endp;
+	struct usb_endpoint_descriptor out_endp;
+} __attribute__ ((packed));
+
+/* HID Report Descriptor */
+static const u8 report[] __attribute__ ((aligned(2))) = {
+	/* Usage Page (Vendor Defined (0)) */
+	USB_HID_USAGE_PAGE | USB_HID_SIZE_2,
+	0, USB_HID_VENDOR_PAGE >> 8,
+	/* Usage (Vendor Usage 1) */
+	USB_HID_USAGE | USB_HID_SIZE_1,
+	1,
+	/* Collenction (Application) */
+	USB_HID_COLLECTION | USB_HID_SIZE_1,
+	USB_HID_APPLICATION,
+	/* Logical Maximum (0xff) */
+	USB_HID_LOGICAL_MAX | USB_HID_SIZE_2,
+	0xff, 0,
+	/* Logical Minimum (0) */
+	USB_HID_LOGICAL_MIN | USB_HID_SIZE_1,
+	0,
+	/* Report Size (8) */
+	USB_HID_REPORT_SIZE | USB_HID_SIZE_1,
+	8,
+
+	/* Report ID (1) */
+	USB_HID_REPORT_ID | USB_HID_SIZE_1,
+	REPORT_ID_INPUT,
+	/* Usage (Vendor Usage 1) */
+	USB_HID_USAGE | USB_HID_SIZE_1,
+	1,
+	/* Report Count (5) */
+	USB_HID_REPORT_COUNT | USB_HID_SIZE_1,
+	REPORT_SIZE_INPUT - 1,
+	/* Input (Data, Variable, Absolute) */
+	USB_HID_INPUT | USB_HID_SIZE_1,
+	USB_HID_DATA | USB_HID_VARIABLE | USB_HID_ABSOLUTE,
+
+	/* Report ID (2) */
+	USB_HID_REPORT_ID | USB_HID_SIZE_1,
+	REPORT_ID_LED,
+	/* Usage (Vendor Usage 2) */
+	USB_HID_USAGE | USB_HID_SIZE_1,
+	2,
+	/* Report Count (1) */
+	USB_HID_REPORT_COUNT | USB_HID_SIZE_1,
+	REPORT_SIZE_LED - 1,
+	/* Output (Data, Variable, Absolute) */
+	USB_HID_OUTPUT | USB_HID_SIZE_1,
+	USB_HID_DATA | USB_HID_VARIABLE | USB_HID_ABSOLUTE,
+
+	/* Report ID (3) */
+	USB_HID_REPORT_ID | USB_HID_SIZE_1,
+	REPORT_ID_PERIOD,
+	/* Usage (Vendor Usage 3) */
+	USB_HID_USAGE | USB_HID_SIZE_1,
+	3,
+	/* Report Count (2) */
+	USB_HID_REPORT_COUNT | USB_HID_SIZE_1,
+	REPORT_SIZE_PERIOD - 1,
+	/* Feature (Data, Variable, Absolute) */
+	USB_HID_FEATURE | USB_HID_SIZE_1,
+	USB_HID_DATA | USB_HID_VARIABLE | USB_HID_ABSOLUTE,
+
+	/* End Collection */
+	USB_HID_END_COLLECTION | USB_HID_SIZE_0,
+};
+
+/* Device Descriptor */
+static const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) =
+USB_DEVICE_DESCRIPTOR_INIT(
+	.bcdUSB = 0x0200,
+	.bDeviceClass = 0,
+	.bDeviceSubClass = 0,
+	.bDeviceProtocol = 0,
+	.bMaxPacketSize0 = MAXPACKETSIZE0,
+	.idVendor = 0x2975,
+	.idProduct = 0x0007,
+	.bcdDevice = 0x0010,
+	.iManufacturer = STRING_MANUFACTURER,
+	.iProduct = STRING_PRODUCT,
+	.iSerialNumber = 0,
+	.bNumConfigurations = 1,
+);
+
+static const struct config_desc config_desc __attribute__ ((aligned(2))) = {
+	/* Configuration Descriptor */
+	.config = USB_CONFIG_DESCRIPTOR_INIT(struct config_desc,
+		.bNumInterfaces = NUM_INTERFACE,
+		.bConfigurationValue = CONFIGURATION_VALUE,
+		.iConfiguration = 0,
+		.bmAttributes = (USB_CONFIG_ATTR_D7 |
+				 USB_CONFIG_ATTR_REMOTE_WAKEUP),
+		.bMaxPower = 100 / 2,
+	),
+	/* Interface Descriptor */
+	.hid_if = USB_INTERFACE_DESCRIPTOR_INIT(
+		.bInterfaceNumber = INTERFACE_HID,
+		.bAlternateSetting = 0,
+		.bNumEndpoints = 2,
+		.bInterfaceClass = USB_CLASS_HID,
+		.bInterfaceSubClass = USB_HID_SUBCLASS_UNDEFINED,
+		.bInterfaceProtocol = USB_HID_PROTO_UNDEFINED,
+		.iInterface = 0,
+	),
+	/* HID Descriptor */
+	.hid = {
+		.bLength = sizeof(struct usb_hid_descriptor_1),
+		.bDescriptorType = USB_DT_HID,
+		.bcdHID = 0x0111,
+		.bCountryCode = 0,
+		.bNumDescriptors = 1,
+		.descriptor[0] = {USB_DT_REPORT, sizeof(report)},
+	},
+	/* Interrupt IN endpoint */
+	.in_endp = USB_ENDPOINT_DESCRIPTOR_INIT(
+		.bEndpointAddress = IN_ENUM,
+		.bmAttributes = USB_ENDPOINT_TRANS_INTERRUPT,
+		.wMaxPacketSize = INTERRUPT_SIZE,
+		.bInterval = INTERRUPT_INTERVAL,
+	),
+	/* Interrupt OUT endpoint */
+	.out_endp = USB_ENDPOINT_DESCRIPTOR_INIT(
+		.bEndpointAddress = OUT_ENUM,
+		.bmAttributes = USB_ENDPOINT_TRANS_INTERRUPT,
+		.wMaxPacketSize = INTERRUPT_SIZE,
+		.bInterval = INTERRUPT_INTERVAL,
+	),
+};
+
+/* String Descriptors */
+static USB_DEFINE_LANGID_DESCRIPTOR(langid, LANGID_ENGLISH_US);
+static USB_DEFINE_STRING_DESCRIPTOR(manufacturer, L"MPC Research Ltd.");
+static USB_DEFINE_STRING_DESCRIPTOR(product, L"USB HID");
+
+static const void * const string_desc[NUM_STRING_DESC] = {
+	[STRING_LANGID] = &langid,
+	[STRING_MANUFACTURER] = &manufacturer,
+	[STRING_PRODUCT] = &product,
+};
+
+/* Control OUT data */
+static u8 outbuf[MAX_DATA_OUT] __attribute__ ((aligned(4)));
+
+/* USB device */
+const struct usbdev_device hid_device = {
+	.device = &dev_desc,
+	.config = &config_desc.config,
+	.langid = LANGID_ENGLISH_US,
+	.num_string = NUM_STRING_DESC - 1,
+	.string_desc = string_desc,
+	.buf = outbuf,
+	.bufsize = MAX_DATA_OUT,
+	.request = hiddev_request,
+	.set_configuration = hiddev_set_configuration,
+	.reset = hiddev_reset,
+};
+
+/* HID port */
+const struct hiddev_port hid_port = {
+	.interface = INTERFACE_HID,
+	.in_ep = IN_ENUM & 0xf,
+	.out_ep = OUT_ENUM & 0xf,
+	.packet_size = INTERRUPT_SIZE,
+	.report_id = true,
+	.hid_desc = (const u8 *)&config_desc.hid,
+	.report_desc = report,
+	.report_desc_len = sizeof(report),
+	.get_report = hid_get_report,
+	.set_report = hid_set_report,
+};
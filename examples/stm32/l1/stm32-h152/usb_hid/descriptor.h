@@ -17,10 +17,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-bool standard_request_error(struct usb_setup_data *req);
-int standard_request(struct usb_setup_data *req, u8 *buf, u8 **data);
-void standard_reset(void);
-
-extern usb_standard_state_t standard_state;
-
+extern const struct usbdev_device hid_device;
+extern const struct hiddev_port hid_port;
 
+/* usb_hid.c */
+int hid_get_report(int type, int id, u8 *buf, int len);
+int hid_set_report(int type, int id, const u8 *buf, int len);
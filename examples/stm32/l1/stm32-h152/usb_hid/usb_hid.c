@@ -0,0 +1,388 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <rcc.h>
+#include <pwr.h>
+#include <flash.h>
+#include <gpio.h>
+#include <tim.h>
+#include <syscfg.h>
+#include <exti.h>
+#include <nvic.h>
+#include <usbdevfs.h>
+#include <usbdev.h>
+#include <usbdevpm.h>
+#include <hiddev.h>
+
+#include <usb/hid.h>
+
+#include "usb_hid.h"
+#include "descriptor.h"
+
+/* Timer clock frequency */
+#define TIMX_CLK_APB1		32000000
+
+/* Minimum input report period (usec) */
+#define MIN_PERIOD		50
+
+/* Input report period (usec) */
+static int period = DEFAULT_PERIOD;
+
+/* Sequence number of the input report */
+static u16 seq;
+
+/* LED state (output report) */
+static int led_state;
+
+/* Endpoint callbacks */
+static const struct usbdevfs_callback callback[] = {
+	{
+		.ep_id = 0,
+		.setup = usbdev_control_setup,
+		.rx = usbdev_control_rx,
+		.tx = usbdev_control_tx,
+	},
+	{
+		.ep_id = IN_ENUM & 0xf,
+		.tx = hiddev_in_tx,
+	},
+	{
+		.ep_id = OUT_ENUM & 0xf,
+		.rx = hiddev_out_rx,
+	},
+};
+
+/* --- Reports ------------------------------------------------------------- */
+
+static void set_led(int led)
+{
+	led_state = led;
+	if (led & 1)
+		gpio_clear(GPIO_PE10);
+	else
+		gpio_set(GPIO_PE10);
+	if (led & 2)
+		gpio_clear(GPIO_PE11);
+	else
+		gpio_set(GPIO_PE11);
+}
+
+int hid_get_report(int type, int id, u8 *buf, int len)
+{
+	if (type != USB_HID_REPORT_TYPE_FEATURE || id != REPORT_ID_PERIOD ||
+	    len < REPORT_SIZE_PERIOD)
+		return -1;
+
+	buf[0] = REPORT_ID_PERIOD;
+	buf[1] = period;
+	buf[2] = period >> 8;
+	return REPORT_SIZE_PERIOD;
+}
+
+int hid_set_report(int type, int id, const u8 *buf, int len)
+{
+	int p;
+
+	if (!len || buf[0] != id)
+		return -1;
+
+	if (type == USB_HID_REPORT_TYPE_OUTPUT && id == REPORT_ID_LED &&
+	    len == REPORT_SIZE_LED) {
+		set_led(buf[1]);
+		return 0;
+	}
+
+	if (type == USB_HID_REPORT_TYPE_FEATURE && id == REPORT_ID_PERIOD &&
+	    len == REPORT_SIZE_PERIOD) {
+		p = buf[1] | (buf[2] << 8);
+		if (p < MIN_PERIOD)
+			return -1;
+		period = p;
+		tim_set_autoreload_value(TIM7, period - 1);
+		return 0;
+	}
+
+	return -1;
+}
+
+/* Input report generator */
+void tim7_isr(void)
+{
+	u8 report[REPORT_SIZE_INPUT];
+	u16 frame;
+
+	/* Clear update interrupt flag. */
+	tim_clear_interrupt(TIM7, TIM_UPDATE);
+
+	frame = usbdevfs_get_frame_number();
+	report[0] = REPORT_ID_INPUT;
+	report[1] = gpio_get(GPIO_PA0) ? 1 : 0;
+	report[2] = seq;
+	report[3] = seq >> 8;
+	report[4] = frame;
+	report[5] = frame >> 8;
+
+	/* Faster than the host polls. The queued report is replaced. */
+	if (!hiddev_send_report(report, REPORT_SIZE_INPUT))
+		seq++;
+}
+
+/* --- Suspend ------------------------------------------------------------ */
+
+static void suspend(void)
+{
+	/* Stop the input reports. */
+	tim_disable_counter(TIM7);
+
+	/* LED off */
+	gpio_set(GPIO_PE(10, 11));
+
+	/* Button wakes up the host. */
+	exti_clear_interrupt(EXTI0);
+	if (usbdev_get_remote_wakeup())
+		exti_enable_interrupt(EXTI0);
+}
+
+static void resume(void)
+{
+	exti_disable_interrupt(EXTI0);
+	set_led(led_state);
+	tim_enable_counter(TIM7);
+}
+
+static const struct usbdevpm pm = {
+	.suspend = suspend,
+	.resume = resume,
+};
+
+/* Button (remote wakeup) */
+void exti0_isr(void)
+{
+	/* Clear interrupt. */
+	exti_clear_interrupt(EXTI0);
+
+	usbdevpm_remote_wakeup();
+}
+
+/* --- Setup --------------------------------------------------------------- */
+
+/* Set STM32 to 32 MHz. */
+static void clock_setup(void)
+{
+	/* Enable PWR clock. */
+	rcc_enable_clock(RCC_PWR);
+
+	/* Set VCORE to 1.8V */
+	pwr_set_vos(PWR_1_8_V);
+
+	/* Enable 64bit flash memory access (1WS). */
+	flash_enable_64bit_access(1);
+
+	/* Enable external high-speed oscillator 8MHz. */
+	rcc_enable_osc(RCC_HSE);
+
+	 /* Setup PLL (8MHz * 12 / 3 = 32MHz). */
+	rcc_setup_pll(RCC_HSE, 12, 3);
+
+	/* Enable PLL and wait for it to stabilize. */
+	rcc_enable_osc(RCC_PLL);
+
+	/* Select PLL as SYSCLK source. */
+	rcc_set_sysclk_source(RCC_PLL);
+}
+
+static void gpio_setup(void)
+{
+	/* Enable GPIOA and GPIOE clock. */
+	rcc_enable_clock(RCC_GPIOA);
+	rcc_enable_clock(RCC_GPIOE);
+
+	/* Set GPIO0 (in GPIO port A) to 'input float' (button). */
+	gpio_config_input(GPIO_FLOAT, GPIO_PA0);
+
+	/* Set GPIO10 and GPIO11 (in GPIO port E) to 'output push-pull'. */
+	gpio_config_output(GPIO_PUSHPULL, GPIO_400KHZ, GPIO_NOPUPD,
+			   GPIO_PE(10, 11));
+
+	/* LED off */
+	set_led(0);
+
+	/* Button interrupt (enabled while suspended) */
+	exti_set_trigger(EXTI0, EXTI_RISING);
+	nvic_enable_irq(NVIC_EXTI0_IRQ);
+}
+
+static void tim_setup(void)
+{
+	/* Enable TIM6 and TIM7 clock. */
+	rcc_enable_clock(RCC_TIM6);
+	rcc_enable_clock(RCC_TIM7);
+
+	/* Enable one-pulse mode. */
+	tim_enable_one_pulse_mode(TIM6);
+
+	/* Generate update interrupt on counter overflow. */
+	tim_disable_update_interrupt_on_any(TIM6);
+
+	/* Load prescaler value (2MHz). */
+	tim_load_prescaler_value(TIM6, TIMX_CLK_APB1 / 2000000 - 1);
+
+	/* TIM7: 1MHz, update interrupt every 'period' usec */
+	tim_setup_counter(TIM7, TIMX_CLK_APB1 / 1000000 - 1, period - 1);
+	tim_enable_interrupt(TIM7, TIM_UPDATE);
+	nvic_enable_irq(NVIC_TIM7_IRQ);
+}
+
+/* 1 - 32767 usec */
+static void delay_us(u16 us)
+{
+	/* Set auto-reload value (us * 2). */
+	tim_set_autoreload_value(TIM6, (us << 1) - 1);
+
+	/* Enable counter. */
+	tim_enable_counter(TIM6);
+
+	/* Wait for update interrupt flag. */
+	while (!tim_get_interrupt_status(TIM6, TIM_UPDATE))
+		;
+
+	/* Clear update interrupt flag. */
+	tim_clear_interrupt(TIM6, TIM_UPDATE);
+}
+
+static void usb_setup(void)
+{
+	/* Enable USB and SYSCFG clock. */
+	rcc_enable_clock(RCC_USB);
+	rcc_enable_clock(RCC_SYSCFG);
+
+	/* Enable USB Low priority interrupt. */
+	nvic_enable_irq(NVIC_USB_LP_IRQ);
+
+	/* Exit Power Down. */
+	usbdevfs_disable_function(USBDEVFS_POWER_DOWN);
+
+	/* Wait T_STARTUP. */
+	delay_us(USBDEVFS_T_STARTUP);
+
+	/* Clear USB reset. */
+	usbdevfs_disable_function(USBDEVFS_FORCE_RESET);
+
+	/* Assign packet memory to endpoint */
+	usbdev_init(&hid_device);
+
+	/* Set endpoint callbacks. */
+	usbdevfs_set_callback(callback, sizeof(callback) / sizeof(callback[0]));
+
+	/* Enable USB wakeup (EXTI18) interrupt. */
+	usbdevpm_init(&pm);
+}
+
+/* USB (low priority) interrupt */
+void usb_lp_isr(void)
+{
+	u16 mask;
+	u16 status;
+
+	/* Interrupt mask */
+	mask = usbdevfs_get_interrupt_mask(USBDEVFS_CORRECT_TRANSFER |
+					   USBDEVFS_EXPECTED_SOF |
+					   USBDEVFS_SUSPEND | USBDEVFS_WAKEUP |
+					   USBDEVFS_RESET | USBDEVFS_SOF);
+	/* Spurious */
+	if (!mask)
+		return;
+
+	/* Interrupt status */
+	status = usbdevfs_get_interrupt_status(USBDEVFS_CORRECT_TRANSFER |
+					       USBDEVFS_EXPECTED_SOF |
+					       USBDEVFS_SUSPEND |
+					       USBDEVFS_WAKEUP |
+					       USBDEVFS_RESET | USBDEVFS_SOF);
+	/* Spurious */
+	if (!status)
+		return;
+
+	/* Wakeup (before the other interrupts, clocks are restored) */
+	if (mask & status & USBDEVFS_WAKEUP)
+		usbdevpm_wakeup();
+
+	/* Correct transfer */
+	if (mask & status & USBDEVFS_CORRECT_TRANSFER)
+		usbdevfs_dispatch();
+
+	/* Start of frame (idle rate) */
+	if (mask & status & USBDEVFS_SOF) {
+		hiddev_sof();
+
+		/* Clear interrupt. */
+		usbdevfs_clear_interrupt(USBDEVFS_SOF);
+	}
+
+	/* Expected start of frame (remote wakeup) */
+	if (mask & status & USBDEVFS_EXPECTED_SOF)
+		usbdevpm_esof();
+
+	/* USB RESET */
+	if (mask & status & USBDEVFS_RESET) {
+		/* Reset USB device state. */
+		usbdev_reset();
+
+		/* Clear interrupt. */
+		usbdevfs_clear_interrupt(USBDEVFS_RESET);
+	}
+
+	/* Suspend (Stop mode on the next WFI) */
+	if (mask & status & USBDEVFS_SUSPEND)
+		usbdevpm_suspend();
+}
+
+/* USB wakeup (EXTI18) interrupt */
+void usb_fs_wkup_isr(void)
+{
+	usbdevpm_wakeup();
+}
+
+int main(void)
+{
+	clock_setup();
+	gpio_setup();
+	tim_setup();
+	hiddev_init(&hid_port);
+	usb_setup();
+
+	/* Attach the device to USB. */
+	syscfg_enable_usb_pullup();
+
+	/* Clear interrupt. */
+	usbdevfs_clear_interrupt(USBDEVFS_ALL_INTERRUPT);
+
+	/* Enable interrupt. */
+	usbdevfs_enable_interrupt(USBDEVFS_CORRECT_TRANSFER | USBDEVFS_SUSPEND |
+				  USBDEVFS_WAKEUP | USBDEVFS_RESET |
+				  USBDEVFS_SOF);
+
+	/* Start the input reports. */
+	tim_enable_counter(TIM7);
+
+	while (1)
+		__asm__ ("wfi");
+
+	return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Configuration value */
+/* Value to use as an argument to the USB_REQ_SET_CONFIGURATION request */
+#define CONFIGURATION_VALUE	1
+
+/* Maximum packet size for endpoint zero */
+#define MAXPACKETSIZE0		64
+
+/* Maximum OUT data length */
+#define MAX_DATA_OUT		16
+
+/* Interfaces */
+enum {
+	INTERFACE_HID,
+	NUM_INTERFACE
+};
+
+/* Interrupt IN endpoint */
+#define IN_ENUM			0x81
+/* Interrupt OUT endpoint */
+#define OUT_ENUM		0x02
+/* Maximum packet size for interrupt endpoint */
+#define INTERRUPT_SIZE		8
+/* Interval for polling endpoint (1 msec) */
+#define INTERRUPT_INTERVAL	1
+
+/* String index */
+enum {
+	STRING_LANGID,
+	STRING_MANUFACTURER,
+	STRING_PRODUCT,
+	NUM_STRING_DESC
+};
+
+/*
+ * Reports
+ *
+ * 1: Input   button, sequence number (16-bit), frame number (16-bit)
+ * 2: Output  LEDs (bit 0: PE10, bit 1: PE11)
+ * 3: Feature input report period (usec, 16-bit)
+ *
+ * Multi-byte fields are little endian.
+ */
+#define REPORT_ID_INPUT		1
+#define REPORT_ID_LED		2
+#define REPORT_ID_PERIOD	3
+
+#define REPORT_SIZE_INPUT	6
+#define REPORT_SIZE_LED		2
+#define REPORT_SIZE_PERIOD	3
+
+/* Default input report period (usec) */
+#define DEFAULT_PERIOD		250
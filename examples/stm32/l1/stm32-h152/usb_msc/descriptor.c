@@ -0,0 +1,145 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <usbdev.h>
+#include <msc.h>
+
+#include <usb/standard.h>
+#include <usb/descriptor.h>
+#include <usb/langid.h>
+#include <usb/msc.h>
+
+#include "usb_msc.h"
+#include "descriptor.h"
+
+/* struct usb_string_descriptor_24 */
+USB_STRING_DESCRIPTOR(24);
+
+/* Configuration */
+struct config_desc {
+	struct usb_config_descriptor config;
+	struct usb_interface_descriptor msc_if;
+	struct usb_endpoint_descriptor rx_endp;
+	struct usb_endpoint_descriptor tx_endp;
+} __attribute__ ((packed));
+
+/* Device Descriptor */
+static const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) =
+USB_DEVICE_DESCRIPTOR_INIT(
+	.bcdUSB = 0x0200,
+	.bDeviceClass = 0,
+	.bDeviceSubClass = 0,
+	.bDeviceProtocol = 0,
+	.bMaxPacketSize0 = MAXPACKETSIZE0,
+	.idVendor = 0x2975,
+	.idProduct = 0x0006,
+	.bcdDevice = 0x0010,
+	.iManufacturer = STRING_MANUFACTURER,
+	.iProduct = STRING_PRODUCT,
+	.iSerialNumber = STRING_SERIAL_NUMBER,
+	.bNumConfigurations = 1,
+);
+
+static const struct config_desc config_desc __attribute__ ((aligned(2))) = {
+	/* Configuration Descriptor */
+	.config = USB_CONFIG_DESCRIPTOR_INIT(struct config_desc,
+		.bNumInterfaces = NUM_INTERFACE,
+		.bConfigurationValue = CONFIGURATION_VALUE,
+		.iConfiguration = 0,
+		.bmAttributes = USB_CONFIG_ATTR_D7,
+		.bMaxPower = 100 / 2,
+	),
+	/* Mass Storage Interface Descriptor (SCSI, Bulk-Only Transport) */
+	.msc_if = USB_INTERFACE_DESCRIPTOR_INIT(
+		.bInterfaceNumber = INTERFACE_MSC,
+		.bAlternateSetting = 0,
+		.bNumEndpoints = 2,
+		.bInterfaceClass = USB_CLASS_MSC,
+		.bInterfaceSubClass = USB_MSC_SUBCLASS_SCSI,
+		.bInterfaceProtocol = USB_MSC_PROTO_BBB,
+		.iInterface = 0,
+	),
+	/* Data rx endpoint */
+	.rx_endp = USB_ENDPOINT_DESCRIPTOR_INIT(
+		.bEndpointAddress = DATA_RX_ENUM,
+		.bmAttributes = USB_ENDPOINT_TRANS_BULK,
+		.wMaxPacketSize = DATA_SIZE,
+		.bInterval = DATA_INTERVAL,
+	),
+	/* Data tx endpoint */
+	.tx_endp = USB_ENDPOINT_DESCRIPTOR_INIT(
+		.bEndpointAddress = DATA_TX_ENUM,
+		.bmAttributes = USB_ENDPOINT_TRANS_BULK,
+		.wMaxPacketSize = DATA_SIZE,
+		.bInterval = DATA_INTERVAL,
+	),
+};
+
+/* String Descriptors */
+static USB_DEFINE_LANGID_DESCRIPTOR(langid, LANGID_ENGLISH_US);
+static USB_DEFINE_STRING_DESCRIPTOR(manufacturer, L"MPC Research Ltd.");
+static USB_DEFINE_STRING_DESCRIPTOR(product, L"USB Mass Storage");
+/* Serial number (unique device ID, required by Bulk-Only Transport) */
+static struct usb_string_descriptor_24 serial_number __attribute__ ((aligned(2)));
+
+static const void * const string_desc[NUM_STRING_DESC] = {
+	[STRING_LANGID] = &langid,
+	[STRING_MANUFACTURER] = &manufacturer,
+	[STRING_PRODUCT] = &product,
+	[STRING_SERIAL_NUMBER] = &serial_number,
+};
+
+void set_serial_number(u32 *uid)
+{
+	int i;
+	int j;
+	int d;
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 8; j++) {
+			d = (*uid >> (4 * j)) & 0xf;
+			if (d < 10)
+				serial_number.wData[23 - (i * 8 + j)] = L'0' + d;
+			else
+				serial_number.wData[23 - (i * 8 + j)] =
+					L'A' + (d - 10);
+		}
+		uid++;
+	}
+	serial_number.bLength = sizeof(serial_number);
+	serial_number.bDescriptorType = USB_DT_STRING;
+}
+
+/* Control OUT data */
+static u8 outbuf[MAX_DATA_OUT] __attribute__ ((aligned(4)));
+
+/* USB device */
+const struct usbdev_device msc_device = {
+	.device = &dev_desc,
+	.config = &config_desc.config,
+	.langid = LANGID_ENGLISH_US,
+	.num_string = NUM_STRING_DESC - 1,
+	.string_desc = string_desc,
+	.dbl_buf = ((1 << (DATA_RX_ENUM & 0xf)) | (1 << (DATA_TX_ENUM & 0xf))),
+	.buf = outbuf,
+	.bufsize = MAX_DATA_OUT,
+	.request = msc_request,
+	.set_configuration = msc_set_configuration,
+	.reset = msc_reset,
+};
@@ -17,10 +17,12 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-bool standard_request_error(struct usb_setup_data *req);
-int standard_request(struct usb_setup_data *req, u8 *buf, u8 **data);
-void standard_reset(void);
-
-extern usb_standard_state_t standard_state;
-
+/*
+ * Block device of the disk (disk_flash.c, disk_eeprom.c or disk_spi.c)
+ *
+ * disk_init() sets up the hardware. The disk is accessed from the USB
+ * interrupt handlers after that.
+ */
+extern const struct msc_blockdev disk;
 
+void disk_init(void);
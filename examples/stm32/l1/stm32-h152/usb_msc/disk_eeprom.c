@@ -0,0 +1,83 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Disk in the data EEPROM (4KB)
+ *
+ * Only the words with different data are written (3.94 msec each).
+ */
+
+#include <flash.h>
+#include <usbdev.h>
+#include <msc.h>
+
+#include "disk.h"
+
+#define DISK_ADDRESS		DATA_EEPROM_BASE
+#define DISK_SIZE		(4 * 1024)
+
+static int disk_read(u32 lba, u8 *buf);
+static int disk_write(u32 lba, const u8 *buf);
+
+const struct msc_blockdev disk = {
+	.block_count = DISK_SIZE / MSC_BLOCK_SIZE,
+	.read = disk_read,
+	.write = disk_write,
+};
+
+static int disk_read(u32 lba, u8 *buf)
+{
+	u32 *s;
+	u32 *d;
+	int i;
+
+	s = (u32 *)(DISK_ADDRESS + lba * MSC_BLOCK_SIZE);
+	d = (u32 *)buf;
+	for (i = 0; i < MSC_BLOCK_SIZE / 4; i++)
+		*d++ = *s++;
+	return 0;
+}
+
+static int disk_write(u32 lba, const u8 *buf)
+{
+	volatile u32 *d;
+	const u32 *s;
+	int i;
+
+	d = (volatile u32 *)(DISK_ADDRESS + lba * MSC_BLOCK_SIZE);
+	s = (const u32 *)buf;
+
+	flash_unlock_pecr();
+	FLASH_SR = FLASH_SR_ERROR;
+
+	for (i = 0; i < MSC_BLOCK_SIZE / 4; i++, d++, s++) {
+		if (*d == *s)
+			continue;
+		*d = *s;
+		flash_wait_for_last_operation();
+	}
+
+	flash_lock_pecr();
+
+	return (FLASH_SR & FLASH_SR_ERROR) ? -1 : 0;
+}
+
+void disk_init(void)
+{
+}
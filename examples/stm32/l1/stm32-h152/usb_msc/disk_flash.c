@@ -0,0 +1,100 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Disk in the upper half of the program memory (64KB)
+ *
+ * A block is written by erasing two pages and programming four half-pages.
+ * Blocks with the same data are not written.
+ */
+
+#include <flash.h>
+#include <usbdev.h>
+#include <msc.h>
+
+#include "disk.h"
+
+#define DISK_ADDRESS		0x08010000
+#define DISK_SIZE		(64 * 1024)
+
+#define HALF_PAGE_SIZE		(FLASH_PAGE_SIZE / 2)
+
+static int disk_read(u32 lba, u8 *buf);
+static int disk_write(u32 lba, const u8 *buf);
+
+const struct msc_blockdev disk = {
+	.block_count = DISK_SIZE / MSC_BLOCK_SIZE,
+	.read = disk_read,
+	.write = disk_write,
+};
+
+static int disk_read(u32 lba, u8 *buf)
+{
+	u32 *s;
+	u32 *d;
+	int i;
+
+	s = (u32 *)(DISK_ADDRESS + lba * MSC_BLOCK_SIZE);
+	d = (u32 *)buf;
+	for (i = 0; i < MSC_BLOCK_SIZE / 4; i++)
+		*d++ = *s++;
+	return 0;
+}
+
+static int disk_write(u32 lba, const u8 *buf)
+{
+	u32 addr;
+	const u32 *s;
+	u32 *d;
+	int i;
+
+	addr = DISK_ADDRESS + lba * MSC_BLOCK_SIZE;
+
+	/* Skip the same data. */
+	s = (const u32 *)buf;
+	d = (u32 *)addr;
+	for (i = 0; i < MSC_BLOCK_SIZE / 4; i++) {
+		if (*d++ != *s++)
+			break;
+	}
+	if (i == MSC_BLOCK_SIZE / 4)
+		return 0;
+
+	flash_unlock_pecr();
+	flash_unlock_program_memory();
+	FLASH_SR = FLASH_SR_ERROR;
+
+	for (i = 0; i < MSC_BLOCK_SIZE; i += FLASH_PAGE_SIZE) {
+		flash_erase_page(addr + i);
+		flash_wait_for_last_operation();
+	}
+	FLASH_PECR &= ~(FLASH_PECR_ERASE | FLASH_PECR_PROG);
+
+	for (i = 0; i < MSC_BLOCK_SIZE; i += HALF_PAGE_SIZE)
+		flash_program_half_page(addr + i, (u32 *)(buf + i));
+
+	flash_lock_program_memory();
+	flash_lock_pecr();
+
+	return (FLASH_SR & FLASH_SR_ERROR) ? -1 : 0;
+}
+
+void disk_init(void)
+{
+}
@@ -0,0 +1,191 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Disk in the SPI serial EEPROM (Microchip 25LC640A, 8KB)
+ *
+ * SPI1 (PE13: SCK, PE14: MISO, PE15: MOSI) and PD5 (nCS) as in spi_rom.
+ * A block is written in 16 pages. The write cycle (5 msec max.) is polled
+ * with the status register.
+ */
+
+#include <rcc.h>
+#include <gpio.h>
+#include <spi.h>
+#include <usbdev.h>
+#include <msc.h>
+
+#include "disk.h"
+
+#define ROM_SIZE	8192	/* 8KByte */
+#define PAGE_SIZE	32	/* 32Byte */
+#define COMMAND_READ	0x03
+#define COMMAND_WRITE	0x02
+#define COMMAND_WREN	0x06
+#define COMMAND_RDSR	0x05
+#define STATUS_WIP	(1 << 0)	/* Write-In-Process */
+
+static int disk_read(u32 lba, u8 *buf);
+static int disk_write(u32 lba, const u8 *buf);
+
+const struct msc_blockdev disk = {
+	.block_count = ROM_SIZE / MSC_BLOCK_SIZE,
+	.read = disk_read,
+	.write = disk_write,
+};
+
+/* Instruction and address */
+static int rom_command(u8 command, u16 addr)
+{
+	int r;
+
+	/* Instruction */
+	if ((r = spi_transfer(SPI1, command)) < 0)
+		return r;
+
+	/* Address (high byte) */
+	if ((r = spi_transfer(SPI1, addr >> 8)) < 0)
+		return r;
+
+	/* Address (low byte) */
+	if ((r = spi_transfer(SPI1, addr & 0xff)) < 0)
+		return r;
+
+	return 0;
+}
+
+/* Wait for the end of the write cycle. */
+static int rom_wait(void)
+{
+	int r;
+
+	/* 'nCS' Low */
+	gpio_clear(GPIO_PD5);
+
+	/* Read Status Register */
+	if ((r = spi_transfer(SPI1, COMMAND_RDSR)) < 0)
+		goto out;
+	do {
+		if ((r = spi_transfer(SPI1, 0)) < 0)
+			goto out;
+	} while (r & STATUS_WIP);
+	r = 0;
+
+out:
+	/* 'nCS' High */
+	gpio_set(GPIO_PD5);
+
+	return r;
+}
+
+/* Page Write */
+static int rom_write_page(u16 addr, const u8 *data)
+{
+	int r;
+	int i;
+
+	/* Write Enable */
+	gpio_clear(GPIO_PD5);
+	r = spi_transfer(SPI1, COMMAND_WREN);
+	gpio_set(GPIO_PD5);
+	if (r < 0)
+		return r;
+
+	/* 'nCS' Low */
+	gpio_clear(GPIO_PD5);
+
+	if ((r = rom_command(COMMAND_WRITE, addr)) < 0)
+		goto out;
+
+	/* Data */
+	for (i = 0; i < PAGE_SIZE; i++) {
+		if ((r = spi_transfer(SPI1, *data++)) < 0)
+			goto out;
+	}
+	r = 0;
+
+out:
+	/* 'nCS' High */
+	gpio_set(GPIO_PD5);
+
+	return r;
+}
+
+static int disk_read(u32 lba, u8 *buf)
+{
+	int r;
+	int i;
+
+	/* 'nCS' Low */
+	gpio_clear(GPIO_PD5);
+
+	if ((r = rom_command(COMMAND_READ, lba * MSC_BLOCK_SIZE)) < 0)
+		goto out;
+
+	/* Data */
+	for (i = 0; i < MSC_BLOCK_SIZE; i++) {
+		if ((r = spi_transfer(SPI1, 0)) < 0)
+			goto out;
+		*buf++ = r;
+	}
+	r = 0;
+
+out:
+	/* 'nCS' High */
+	gpio_set(GPIO_PD5);
+
+	return r < 0 ? -1 : 0;
+}
+
+static int disk_write(u32 lba, const u8 *buf)
+{
+	u16 addr;
+	int i;
+
+	addr = lba * MSC_BLOCK_SIZE;
+	for (i = 0; i < MSC_BLOCK_SIZE; i += PAGE_SIZE) {
+		if (rom_write_page(addr + i, buf + i) < 0 || rom_wait() < 0)
+			return -1;
+	}
+	return 0;
+}
+
+void disk_init(void)
+{
+	/* Enable GPIOD and GPIOE clock. */
+	rcc_enable_clock(RCC_GPIOD);
+	rcc_enable_clock(RCC_GPIOE);
+
+	/* 'nCS' High */
+	gpio_set(GPIO_PD5);
+
+	/* Set GPIO5 (in GPIO port D) to 'output push-pull'. */
+	gpio_config_output(GPIO_PUSHPULL, GPIO_40MHZ, GPIO_NOPUPD, GPIO_PD5);
+
+	/* Enable SPI1 clock. */
+	rcc_enable_clock(RCC_SPI1);
+
+	/* Set GPIO13-15 (in GPIO port E) to 'altfn push-pull'. */
+	gpio_config_altfn(GPIO_SPI1_2, GPIO_PUSHPULL, GPIO_40MHZ, GPIO_NOPUPD,
+			  GPIO_PE(SPI1_SCK, SPI1_MISO, SPI1_MOSI));
+
+	/* 8MHz (fPCLK / 4) */
+	spi_set_mode(SPI1, 4, SPI_NSS_SOFTWARE | SPI_NSS_HIGH | SPI_MASTER |
+		     SPI_ENABLE);
+}
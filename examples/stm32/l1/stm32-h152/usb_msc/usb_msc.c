@@ -0,0 +1,242 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <rcc.h>
+#include <pwr.h>
+#include <flash.h>
+#include <tim.h>
+#include <syscfg.h>
+#include <nvic.h>
+#include <usbdevfs.h>
+#include <usbdev.h>
+#include <msc.h>
+#include <dbgmcu.h>
+#include <desig.h>
+
+#include "usb_msc.h"
+#include "descriptor.h"
+#include "disk.h"
+
+/* Timer clock frequency */
+#define TIMX_CLK_APB1		32000000
+
+/* Endpoint ID */
+#define EP_DATA_RX		(DATA_RX_ENUM & 0xf)
+#define EP_DATA_TX		(DATA_TX_ENUM & 0xf)
+
+static u8 block[MSC_BLOCK_SIZE] __attribute__ ((aligned(4)));
+static u8 cache[CACHE_BLOCKS * MSC_BLOCK_SIZE] __attribute__ ((aligned(4)));
+
+static const struct msc_port msc_port = {
+	.interface = INTERFACE_MSC,
+	.data_rx_ep = EP_DATA_RX,
+	.data_tx_ep = EP_DATA_TX,
+	.packet_size = DATA_SIZE,
+	.dev = &disk,
+	.vendor = "MPC",
+	.product = "USB Mass Storage",
+	.revision = "0.10",
+	.block = block,
+	.cache = cache,
+	.cache_blocks = CACHE_BLOCKS,
+};
+
+/* Endpoint callbacks */
+static const struct usbdevfs_callback callback[] = {
+	{
+		.ep_id = 0,
+		.setup = usbdev_control_setup,
+		.rx = usbdev_control_rx,
+		.tx = usbdev_control_tx,
+	},
+	{
+		.ep_id = EP_DATA_RX,
+		.rx = msc_data_rx,
+	},
+	{
+		.ep_id = EP_DATA_TX,
+		.tx = msc_data_tx,
+	},
+};
+
+/* Set STM32 to 32 MHz. */
+static void clock_setup(void)
+{
+	/* Enable PWR clock. */
+	rcc_enable_clock(RCC_PWR);
+
+	/* Set VCORE to 1.8V */
+	pwr_set_vos(PWR_1_8_V);
+
+	/* Enable 64bit flash memory access (1WS). */
+	flash_enable_64bit_access(1);
+
+	/* Enable external high-speed oscillator 8MHz. */
+	rcc_enable_osc(RCC_HSE);
+
+	 /* Setup PLL (8MHz * 12 / 3 = 32MHz). */
+	rcc_setup_pll(RCC_HSE, 12, 3);
+
+	/* Enable PLL and wait for it to stabilize. */
+	rcc_enable_osc(RCC_PLL);
+
+	/* Select PLL as SYSCLK source. */
+	rcc_set_sysclk_source(RCC_PLL);
+}
+
+static void tim_setup(void)
+{
+	/* Enable TIM6 clock. */
+	rcc_enable_clock(RCC_TIM6);
+
+	/* Enable one-pulse mode. */
+	tim_enable_one_pulse_mode(TIM6);
+
+	/* Generate update interrupt on counter overflow. */
+	tim_disable_update_interrupt_on_any(TIM6);
+
+	/* Load prescaler value (2MHz). */
+	tim_load_prescaler_value(TIM6, TIMX_CLK_APB1 / 2000000 - 1);
+}
+
+/* 1 - 32767 usec */
+static void delay_us(u16 us)
+{
+	/* Set auto-reload value (us * 2). */
+	tim_set_autoreload_value(TIM6, (us << 1) - 1);
+
+	/* Enable counter. */
+	tim_enable_counter(TIM6);
+
+	/* Wait for update interrupt flag. */
+	while (!tim_get_interrupt_status(TIM6, TIM_UPDATE))
+		;
+
+	/* Clear update interrupt flag. */
+	tim_clear_interrupt(TIM6, TIM_UPDATE);
+}
+
+static void usb_setup(void)
+{
+	/* Enable USB and SYSCFG clock. */
+	rcc_enable_clock(RCC_USB);
+	rcc_enable_clock(RCC_SYSCFG);
+
+	/*
+	 * Enable USB interrupts. Both have the same priority, and don't
+	 * preempt each other.
+	 */
+	nvic_enable_irq(NVIC_USB_LP_IRQ);
+	nvic_enable_irq(NVIC_USB_HP_IRQ);
+
+	/* Exit Power Down. */
+	usbdevfs_disable_function(USBDEVFS_POWER_DOWN);
+
+	/* Wait T_STARTUP. */
+	delay_us(USBDEVFS_T_STARTUP);
+
+	/* Clear USB reset. */
+	usbdevfs_disable_function(USBDEVFS_FORCE_RESET);
+
+	/* Assign packet memory to endpoint */
+	usbdev_init(&msc_device);
+
+	/* Set endpoint callbacks. */
+	usbdevfs_set_callback(callback, sizeof(callback) / sizeof(callback[0]));
+}
+
+/* USB high priority interrupt (double-buffered bulk endpoints) */
+void usb_hp_isr(void)
+{
+	usbdevfs_dispatch_hp();
+}
+
+/* USB low priority interrupt */
+void usb_lp_isr(void)
+{
+	u16 mask;
+	u16 status;
+
+	/* Interrupt mask */
+	mask = usbdevfs_get_interrupt_mask(USBDEVFS_CORRECT_TRANSFER |
+					   USBDEVFS_RESET | USBDEVFS_SOF);
+	/* Spurious */
+	if (!mask)
+		return;
+
+	/* Interrupt status */
+	status = usbdevfs_get_interrupt_status(USBDEVFS_CORRECT_TRANSFER |
+					       USBDEVFS_RESET | USBDEVFS_SOF);
+	/* Spurious */
+	if (!status)
+		return;
+
+	/* Correct transfer */
+	if (mask & status & USBDEVFS_CORRECT_TRANSFER)
+		usbdevfs_dispatch();
+
+	/* Start of frame (flush the cache when idle) */
+	if (mask & status & USBDEVFS_SOF) {
+		msc_sof();
+
+		/* Clear interrupt. */
+		usbdevfs_clear_interrupt(USBDEVFS_SOF);
+	}
+
+	/* USB RESET */
+	if (mask & status & USBDEVFS_RESET) {
+		/* Reset USB device state. */
+		usbdev_reset();
+
+		/* Clear interrupt. */
+		usbdevfs_clear_interrupt(USBDEVFS_RESET);
+	}
+}
+
+int main(void)
+{
+	u16 dev_id;
+	u32 uid[3];
+
+	clock_setup();
+	tim_setup();
+	disk_init();
+	msc_init(&msc_port);
+	usb_setup();
+
+	/* Set serial number (unique device ID). */
+	dev_id = dbgmcu_get_device_id() & DBGMCU_IDCODE_DEV_ID_MASK;
+	desig_get_unique_id(dev_id, uid);
+	set_serial_number(uid);
+
+	/* Attach the device to USB. */
+	syscfg_enable_usb_pullup();
+
+	/* Clear interrupt. */
+	usbdevfs_clear_interrupt(USBDEVFS_ALL_INTERRUPT);
+
+	/* Enable interrupt. */
+	usbdevfs_enable_interrupt(USBDEVFS_CORRECT_TRANSFER | USBDEVFS_RESET |
+				  USBDEVFS_SOF);
+
+	while (1)
+		__asm__ ("wfi");
+
+	return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Configuration value */
+/* Value to use as an argument to the USB_REQ_SET_CONFIGURATION request */
+#define CONFIGURATION_VALUE	1
+
+/* Maximum packet size for endpoint zero */
+#define MAXPACKETSIZE0		64
+
+/* Maximum OUT data length */
+#define MAX_DATA_OUT		16
+
+/* Interfaces */
+enum {
+	INTERFACE_MSC,
+	NUM_INTERFACE
+};
+
+/* Data rx endpoint (double-buffered) */
+#define DATA_RX_ENUM		0x01
+/* Data tx endpoint (double-buffered) */
+#define DATA_TX_ENUM		0x82
+/* Maximum packet size for data endpoint */
+#define DATA_SIZE		64
+/* Interval for polling endpoint */
+#define DATA_INTERVAL		0
+
+/* String index */
+enum {
+	STRING_LANGID,
+	STRING_MANUFACTURER,
+	STRING_PRODUCT,
+	STRING_SERIAL_NUMBER,
+	NUM_STRING_DESC
+};
+
+/* Number of cache blocks */
+#define CACHE_BLOCKS		4
+
+void set_serial_number(u32 *uid);
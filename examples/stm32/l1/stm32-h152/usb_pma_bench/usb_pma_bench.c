@@ -0,0 +1,271 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <rcc.h>
+#include <pwr.h>
+#include <flash.h>
+#include <gpio.h>
+#include <usart.h>
+#include <systick.h>
+#include <usbdevfs.h>
+
+#include <syscall.h>
+#include <stdio.h>
+
+/* USART clock frequency */
+#define PCLK1		32000000
+
+/* Packet size */
+#define PACKET_SIZE	64
+
+/* Number of iterations */
+#define LOOP		1000
+
+/* Packet buffer memory */
+static const struct usbdevfs_packet_memory packet_memory[] = {
+	{1, USBDEVFS_BULK, 0x01, PACKET_SIZE},
+	{1, USBDEVFS_BULK, 0x81, PACKET_SIZE}
+};
+
+static u8 buf[PACKET_SIZE + 4] __attribute__ ((aligned(4)));
+static u8 ring[PACKET_SIZE * 2];
+
+static void clock_setup(void)
+{
+	/* Enable PWR clock. */
+	rcc_enable_clock(RCC_PWR);
+
+	/* Set VCORE to 1.8V */
+	pwr_set_vos(PWR_1_8_V);
+
+	/* Set Flash memory latency (1WS). */
+	flash_enable_64bit_access(1);
+
+	/* Enable external high-speed oscillator 8MHz. */
+	rcc_enable_osc(RCC_HSE);
+
+	 /* Setup PLL (8MHz * 12 / 3 = 32MHz). */
+	rcc_setup_pll(RCC_HSE, 12, 3);
+
+	/* Enable PLL and wait for it to stabilize. */
+	rcc_enable_osc(RCC_PLL);
+
+	/* Select PLL as SYSCLK source. */
+	rcc_set_sysclk_source(RCC_PLL);
+}
+
+static void usart_setup(void)
+{
+	/* Enable GPIOD clock. */
+	rcc_enable_clock(RCC_GPIOD);
+
+	/* Enable USART2 clock. */
+	rcc_enable_clock(RCC_USART2);
+
+	/* Setup GPIO pin PD5 as alternate function. */
+	gpio_config_altfn(GPIO_USART1_3, GPIO_PUSHPULL, GPIO_10MHZ,
+			  GPIO_NOPUPD, GPIO_PD_USART2_TX);
+
+	/* Setup USART2. */
+	usart_init(USART2, PCLK1, 115200, 8, USART_STOP_1,
+		   USART_PARITY_NONE, USART_FLOW_NONE, USART_TX);
+}
+
+static void systick_setup(void)
+{
+	/* 24-bit down counter, SYSCLK */
+	systick_set_clocksource(SYSTICK_AHB);
+	systick_set_reload(0xffffff);
+	systick_enable_counter();
+}
+
+static void usb_setup(void)
+{
+	/* Enable USB clock (packet memory access). */
+	rcc_enable_clock(RCC_USB);
+
+	/* Assign packet memory to endpoint 1. */
+	usbdevfs_allocate_packet_memory(packet_memory,
+					sizeof(packet_memory) /
+					sizeof(packet_memory[0]));
+}
+
+int _write(int file, char *ptr, int len)
+{
+	int i;
+
+	if (file == 1) {
+		for (i = 0; i < len; i++)
+			usart_send_blocking(USART2, ptr[i]);
+		return i;
+	}
+
+	errno = EIO;
+	return -1;
+}
+
+/* Previous implementation */
+static int loop_write(int ep_id, u16 *b, int len)
+{
+	u32 *d;
+	int i;
+
+	d = (u32 *)(USB_DEV_FS_SRAM_BASE + USB_ADDR_TX(ep_id) * 2);
+
+	for (i = 0; i < len / 2; i++)
+		*d++ = *b++;
+
+	if (len % 2)
+		*d = *(u8 *)b;
+
+	USB_COUNT_TX(ep_id) = len;
+
+	return len;
+}
+
+static int loop_read(int ep_id, u16 *b, int buflen)
+{
+	u32 *s;
+	int len;
+	int n;
+	int i;
+
+	s = (u32 *)(USB_DEV_FS_SRAM_BASE + USB_ADDR_RX(ep_id) * 2);
+	len = USB_COUNT_RX(ep_id) & 0x3ff;
+
+	if (buflen < len)
+		n = buflen;
+	else
+		n = len;
+	for (i = 0; i < n / 2; i++)
+		*b++ = *s++;
+
+	if (n % 2)
+		*(u8 *)b = *s;
+
+	return len;
+}
+
+/* SysTick counts down. */
+static int elapsed(int start, int end)
+{
+	return (start - end) & 0xffffff;
+}
+
+static int overhead(void)
+{
+	int start;
+	int i;
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++)
+		__asm__ volatile ("");
+	return elapsed(start, systick_get_value());
+}
+
+static void print_result(const char *name, int cycles, int base)
+{
+	printf("%-24s %4d cycles\r\n", name, (cycles - base) / LOOP);
+}
+
+static void bench(void)
+{
+	int base;
+	int start;
+	int i;
+
+	base = overhead();
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++)
+		loop_write(1, (u16 *)buf, PACKET_SIZE);
+	print_result("loop write", elapsed(start, systick_get_value()), base);
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++)
+		usbdevfs_write(1, (u16 *)buf, PACKET_SIZE);
+	print_result("write (aligned)", elapsed(start, systick_get_value()),
+		     base);
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++)
+		usbdevfs_write(1, (u16 *)(buf + 2), PACKET_SIZE);
+	print_result("write (half-word)", elapsed(start, systick_get_value()),
+		     base);
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++)
+		usbdevfs_write(1, (u16 *)(buf + 1), PACKET_SIZE);
+	print_result("write (byte)", elapsed(start, systick_get_value()),
+		     base);
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++)
+		usbdevfs_write_ring(1, ring, sizeof(ring), sizeof(ring) - 31,
+				    PACKET_SIZE);
+	print_result("write ring", elapsed(start, systick_get_value()), base);
+
+	/* Reception byte count */
+	USB_COUNT_RX(1) = (USB_COUNT_RX(1) & ~0x3ff) | PACKET_SIZE;
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++)
+		loop_read(1, (u16 *)buf, PACKET_SIZE);
+	print_result("loop read", elapsed(start, systick_get_value()), base);
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++)
+		usbdevfs_read(1, (u16 *)buf, PACKET_SIZE);
+	print_result("read (aligned)", elapsed(start, systick_get_value()),
+		     base);
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++)
+		usbdevfs_read(1, (u16 *)(buf + 2), PACKET_SIZE);
+	print_result("read (half-word)", elapsed(start, systick_get_value()),
+		     base);
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++)
+		usbdevfs_read(1, (u16 *)(buf + 1), PACKET_SIZE);
+	print_result("read (byte)", elapsed(start, systick_get_value()),
+		     base);
+
+	start = systick_get_value();
+	for (i = 0; i < LOOP; i++)
+		usbdevfs_read_ring(1, ring, sizeof(ring), sizeof(ring) - 31,
+				   PACKET_SIZE);
+	print_result("read ring", elapsed(start, systick_get_value()), base);
+}
+
+int main(void)
+{
+	clock_setup();
+	usart_setup();
+	systick_setup();
+	usb_setup();
+
+	printf("\r\nPMA copy, %d-byte packet, SYSCLK 32 MHz\r\n", PACKET_SIZE);
+	bench();
+
+	while (1)
+		__asm__ ("nop");
+
+	return 0;
+}
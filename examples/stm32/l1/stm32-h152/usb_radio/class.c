@@ -17,7 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <usbdevfs.h>
+#include <usbdev.h>
 
 #include <usb/standard.h>
 #include <usb/audio10.h>
@@ -25,9 +25,13 @@
 
 #include "usb_radio.h"
 #include "class.h"
+#include "descriptor.h"
 
 unsigned int idle_duration;
 
+/* Wait state */
+wait_state_t wait_state;
+
 /* --- Audio Class-specific Requests --------------------------------------- */
 
 static bool audio_class_request_error(struct usb_setup_data *req)
@@ -488,7 +492,7 @@ static void hid_class_reset(void)
 
 /* ------------------------------------------------------------------------- */
 
-bool class_request_error(struct usb_setup_data *req)
+static bool class_request_error(struct usb_setup_data *req)
 {
 	if ((req->wIndex & 0xff) == INTERFACE_AC)
 		return audio_class_request_error(req);
@@ -498,16 +502,8 @@ bool class_request_error(struct usb_setup_data *req)
 		return true;
 }
 
-int class_request_check_data(struct usb_setup_data *req, u8 *buf)
-{
-	if ((req->wIndex & 0xff) == INTERFACE_HID)
-		return hid_class_request_check_data(req, buf);
-
-	return 0;
-}
-
-int class_request(struct usb_setup_data *req, u8 *buf, u8 **data,
-		  wait_state_t state)
+static int radio_class_request(struct usb_setup_data *req, u8 *buf, u8 **data,
+			       wait_state_t state)
 {
 	if ((req->wIndex & 0xff) == INTERFACE_AC)
 		return audio_class_request(req, buf, data);
@@ -517,7 +513,86 @@ int class_request(struct usb_setup_data *req, u8 *buf, u8 **data,
 		return -1;
 }
 
+/*
+ * A request waiting for the Si4703 returns USBDEV_WAIT, and the main loop
+ * calls usbdev_control_resume() when the device request is done.
+ */
+int class_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		  u8 **data)
+{
+	int r;
+
+	/* HID class descriptors (bmRequestType = 10000001B) */
+	if (req->bmRequestType == (USB_DIR_IN | USB_TYPE_STANDARD |
+				   USB_RECIP_INTERFACE) &&
+	    req->bRequest == USB_REQ_GET_DESCRIPTOR) {
+		if (req->wIndex != INTERFACE_HID || (req->wValue & 0xff) ||
+		    usbdev_get_state() != USB_STATE_CONFIGURED)
+			return -1;
+		return get_hid_descriptor(req->wValue >> 8, buf, data);
+	}
+
+	/* Class-specific Request */
+	if ((req->bmRequestType & USB_TYPE_MASK) != USB_TYPE_CLASS)
+		return -1;
+
+	switch (stage) {
+	case USBDEV_STAGE_SETUP:
+		/* Check error. */
+		if (class_request_error(req))
+			return -1;
+
+		/* GET request */
+		if (req->bmRequestType & USB_DIR_IN) {
+			r = radio_class_request(req, buf, data, wait_state);
+			if (r == -WAIT_STATE_SETUP_BUSY ||
+			    r == -WAIT_STATE_SETUP_DEVICE) {
+				/* Set wait state. */
+				wait_state = -r;
+				return USBDEV_WAIT;
+			}
+
+			/* Clear wait state. */
+			wait_state = WAIT_STATE_NONE;
+			return r;
+		}
+		break;
+	case USBDEV_STAGE_STATUS:
+		/* Clear wait state. */
+		wait_state = WAIT_STATE_NONE;
+
+		/* SET request */
+		return radio_class_request(req, buf, data, wait_state);
+	}
+
+	return 0;
+}
+
+int class_check_data(struct usb_setup_data *req, u8 *buf)
+{
+	int r;
+
+	if ((req->wIndex & 0xff) != INTERFACE_HID)
+		return 0;
+
+	r = hid_class_request_check_data(req, buf);
+	if (r == -WAIT_STATE_DATA_BUSY) {
+		/* Hold the status stage until the Si4703 is free. */
+		wait_state = WAIT_STATE_DATA_BUSY;
+		return USBDEV_WAIT;
+	}
+	if (r == -WAIT_STATE_DATA_DEVICE) {
+		/* The Si4703 is written at the status stage. */
+		wait_state = WAIT_STATE_DATA_DEVICE;
+		return 0;
+	}
+	return r;
+}
+
 void class_reset(void)
 {
 	hid_class_reset();
+
+	/* Clear wait state. */
+	wait_state = WAIT_STATE_NONE;
 }
@@ -17,8 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-bool class_request_error(struct usb_setup_data *req);
-int class_request_check_data(struct usb_setup_data *req, u8 *buf);
-int class_request(struct usb_setup_data *req, u8 *buf, u8 **data,
-		  wait_state_t state);
+int class_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		  u8 **data);
+int class_check_data(struct usb_setup_data *req, u8 *buf);
 void class_reset(void);
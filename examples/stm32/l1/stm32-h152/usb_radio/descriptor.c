@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <usbdev.h>
+
 #include <usb/standard.h>
 #include <usb/langid.h>
 #include <usb/audio10.h>
@@ -25,6 +27,7 @@
 
 #include "usb_radio.h"
 #include "descriptor.h"
+#include "class.h"
 
  /* struct usb_audio_ac_if_header_descriptor_1 */
 USB_AUDIO_AC_IF_HEADER_DESCRIPTOR(1);
@@ -60,7 +63,7 @@ struct config_desc {
 } __attribute__ ((packed));
 
 /* HID Report Descriptor */
-const u8 report[] __attribute__ ((aligned(2))) = {
+static const u8 report[] __attribute__ ((aligned(2))) = {
 	/* Usage Page (Vendor Defined (0)) */
 	USB_HID_USAGE_PAGE | USB_HID_SIZE_2,
 	0, USB_HID_VENDOR_PAGE >> 8,
@@ -255,7 +258,7 @@ const u8 report[] __attribute__ ((aligned(2))) = {
 };
 
 /* Device Descriptor */
-const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) = {
+static const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) = {
 	.bLength = sizeof(struct usb_device_descriptor),
 	.bDescriptorType = USB_DT_DEVICE,
 	.bcdUSB = 0x0200,
@@ -272,7 +275,7 @@ const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) = {
 	.bNumConfigurations = 1,
 };
 
-const struct config_desc config_desc __attribute__ ((aligned(2))) = {
+static const struct config_desc config_desc __attribute__ ((aligned(2))) = {
 	/* Configuration Descriptor */
 	.config = {
 		.bLength = sizeof(struct usb_config_descriptor),
@@ -453,40 +456,15 @@ const struct config_desc config_desc __attribute__ ((aligned(2))) = {
 };
 
 /* Strings */
-const u16 langid[] = {LANGID_ENGLISH_US, 0};
-const u16 string1[] = L"MPC Research Ltd.";
-const u16 string2[] = L"FM Radio";
-const u16 *string_english_us[MAX_STRING_INDEX] = {
+static const u16 string1[] = L"MPC Research Ltd.";
+static const u16 string2[] = L"FM Radio";
+static const u16 * const string_english_us[MAX_STRING_INDEX] = {
 	string1,
 	string2
 };
 
-/* Make string descriptor from NULL-terminated string. */
-static int make_string_descriptor(int index, u16 *buf)
-{
-	int i;
-	const u16 *p;
-	u8 *s;
-
-	if (index == 0)
-		p = langid;	/* LANGID */
-	else
-		p = string_english_us[index - 1]; /* UNICODE encoded string */
-
-	/* Copy data (not include EOS(0)). */
-	for (i = 1; *p; i++)
-		*(buf + i) = *p++;
-
-	/* Add bLength and bDescriptorType. */
-	s = (u8 *)buf;
-	*s++ = i * sizeof(u16);
-	*s = USB_DT_STRING;
-
-	/* Return descriptor size. */
-	return i * (int)sizeof(u16);
-}
-
-int get_descriptor(int type, int index, u8 *buf, u8 **data)
+/* HID class descriptors */
+int get_hid_descriptor(int type, u8 *buf, u8 **data)
 {
 	int len;
 	u8 *s;
@@ -494,18 +472,6 @@ int get_descriptor(int type, int index, u8 *buf, u8 **data)
 	int i;
 
 	switch (type) {
-	case USB_DT_DEVICE:
-		len = sizeof(dev_desc);
-		*data = (u8 *)&dev_desc;
-		break;
-	case USB_DT_CONFIGURATION:
-		len = sizeof(config_desc);
-		*data = (u8 *)&config_desc;
-		break;
-	case USB_DT_STRING:
-		len = make_string_descriptor(index, (u16 *)buf);
-		*data = buf;
-		break;
 	case USB_DT_HID:
 		len = sizeof(struct usb_hid_descriptor_1);
 		s = (u8 *)&config_desc.hid;
@@ -519,9 +485,26 @@ int get_descriptor(int type, int index, u8 *buf, u8 **data)
 		*data = (u8 *)report;
 		break;
 	default:
-		len = 0;
+		len = -1;
 		break;
 	}
 
 	return len;
 }
+
+/* Control OUT data */
+static u8 outbuf[MAX_DATA_OUT] __attribute__ ((aligned(4)));
+
+/* USB device */
+const struct usbdev_device radio_device = {
+	.device = &dev_desc,
+	.config = &config_desc.config,
+	.langid = LANGID_ENGLISH_US,
+	.num_string = MAX_STRING_INDEX,
+	.string = string_english_us,
+	.buf = outbuf,
+	.bufsize = MAX_DATA_OUT,
+	.request = class_request,
+	.check_data = class_check_data,
+	.reset = class_reset,
+};
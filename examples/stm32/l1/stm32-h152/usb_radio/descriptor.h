@@ -17,5 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-int get_descriptor(int type, int index, u8 *buf, u8 **data);
+extern const struct usbdev_device radio_device;
+
+int get_hid_descriptor(int type, u8 *buf, u8 **data);
 
@@ -28,10 +28,12 @@
 #include <exti.h>
 #include <syscfg.h>
 #include <usbdevfs.h>
+#include <usbdev.h>
 #include <i2c.h>
+#include <dmastream.h>
 
 #include "usb_radio.h"
-#include "control.h"
+#include "descriptor.h"
 
 /*
  * Si4703 FM Tuner Basic Breakout
@@ -75,14 +77,9 @@
 #define T_BUF		2	/* 1.3us: STOP to START Time */
 #define T_POWERUP	110	/* 110ms: Powerup Time */
 
-/* USB packet buffer memory */
-#define BUFFER_TABLE_ADDRESS	0
-#define PACKET_MEMORY_START	(BUFFER_TABLE_ADDRESS + \
-				 USBDEVFS_BUFFER_TABLE_SIZE)
-
-/* Audio stream buffer */
-#define MAX_BUF			4
-#define BUF_QUEUE_SIZE		(MAX_BUF + 1)
+/* Endpoint ID */
+#define AS_EP			(AS_ENUM & 0xf)
+#define INTERRUPT_EP		(INTERRUPT_ENUM & 0xf)
 
 /* Si4703 device request */
 volatile device_request_t devreq;
@@ -104,14 +101,21 @@ static volatile bool i2c_status;
 static volatile bool i2c_timeout;
 static volatile bool adc_overrun;
 
-/* Audio stream buffer queue */
-static u32 adc_buf[MAX_BUF][AS_SIZE / sizeof(u32)];
-static u32 *buf_queue[BUF_QUEUE_SIZE];
-static volatile int buf_head;
-static volatile int buf_tail;
+/* Audio stream buffer (one frame per half) */
+static u32 adc_buf[2][AS_SIZE / sizeof(u32)];
+
+static void adc_ready(struct dmastream *s, void *half);
+
+static struct dmastream adc_stream = {
+	.dma = DMA_ADC,
+	.pa = (u32)&ADC_DR,
+	.buf = adc_buf,
+	.ndt = AS_SIZE,
+	.mode = DMA_P_TO_M | DMA_M_16BIT | DMA_P_32BIT,
+	.ready = adc_ready,
+};
 
 /* Buffer pointer */
-static volatile u32 *dma_buf;
 static volatile u32 *exti_buf;
 static volatile u32 *tx_buf;
 
@@ -131,8 +135,6 @@ static u32 tx_loss1;
 static u32 interrupt_send;
 static u32 interrupt_int;
 static u32 dma_count;
-static u32 alloc_count;
-static u32 free_count;
 
 
 /* Set STM32 to 32 MHz. */
@@ -386,75 +388,28 @@ static void dma_setup(void)
 	/* Enable DMA1 clock. */
 	rcc_enable_clock(DMA_RCC_ADC);
 
+	dmastream_init(&adc_stream);
+
 	/* Enable DMA1 channel1 interrupt. */
 	nvic_enable_irq(DMA_ADC_IRQ);
 }
 
-static void init_buf(void)
+/* A frame of samples is ready. */
+static void adc_ready(struct dmastream *s, void *half)
 {
-	int i;
-
-	for (i = 0; i < MAX_BUF; i++)
-		buf_queue[i] = adc_buf[i];
-	buf_head = 0;
-	buf_tail = MAX_BUF;
-}
+	(void)s;
 
-static u32 *alloc_buf(void)
-{
-	u32 *r;
-
-	alloc_count++;
-	if (buf_head == buf_tail)
-		return 0;
-	r = buf_queue[buf_head++];
-	buf_head %= BUF_QUEUE_SIZE;
-	return r;
-}
+	exti_buf = half;
+	dma_count++;
 
-static void free_buf(u32 *buf)
-{
-	free_count++;
-	if ((buf_tail + 1) % BUF_QUEUE_SIZE == buf_head)
-		return;
-	buf_queue[buf_tail++] = buf;
-	buf_tail %= BUF_QUEUE_SIZE;
+	/* Generate software interrupt. */
+	exti_set_software_interrupt(EXTI5);
 }
 
 /* DMA1 (channel1) interrupt */
 void dma_adc_isr(void)
 {
-	/* Interrupt mask */
-	if (!dma_get_interrupt_mask(DMA_ADC, DMA_COMPLETE))
-		return;
-
-	/* Interrupt status */
-	if (dma_get_interrupt_status(DMA_ADC, DMA_GLOBAL | DMA_COMPLETE) !=
-	    (DMA_GLOBAL | DMA_COMPLETE))
-		return;
-
-	/* Disable DMA. */
-	dma_disable(DMA_ADC);
-
-	/* Save data buffer. */
-	exti_buf = dma_buf;
-
-	/* Set DMA mode and enable DMA. */
-	if ((dma_buf = alloc_buf())) {
-		dma_setup_channel(DMA_ADC,
-				  (u32)dma_buf, (u32)&ADC_DR,
-				  AS_SIZE / sizeof(u16),
-				  DMA_M_16BIT | DMA_P_32BIT |
-				  DMA_M_INC | DMA_P_TO_M |
-				  DMA_COMPLETE | DMA_ENABLE);
-		dma_count++;
-	}
-
-	/* Generate software interrupt. */
-	exti_set_software_interrupt(EXTI5);
-
-	/* Clear interrupt. */
-	dma_clear_interrupt(DMA_ADC, DMA_COMPLETE | DMA_GLOBAL);
+	dmastream_isr(&adc_stream);
 }
 
 static void exti_setup(void)
@@ -483,10 +438,8 @@ void exti9_5_isr(void)
 		/* Disable USB high priority interrupt. */
 		nvic_disable_irq(NVIC_USB_HP_IRQ);
 
-		if (tx_buf) {
-			free_buf((u32 *)tx_buf);
+		if (tx_buf)
 			tx_loss1++;
-		}
 		tx_buf = exti_buf;
 
 		/* Enable USB high priority interrupt. */
@@ -505,8 +458,6 @@ void exti9_5_isr(void)
 
 static void usb_setup(void)
 {
-	int offset;
-
 	/* Enable USB clock. */
 	rcc_enable_clock(RCC_USB);
 
@@ -525,19 +476,24 @@ static void usb_setup(void)
 	/* Clear USB reset. */
 	usbdevfs_disable_function(USBDEVFS_FORCE_RESET);
 
-	/* Set buffer table address */
-	usbdevfs_set_buffer_table_address(BUFFER_TABLE_ADDRESS);
-
 	/* Assign packet memory to endpoint */
-	offset = usbdevfs_assign_packet_memory_tx(0, PACKET_MEMORY_START,
-						  MAXPACKETSIZE0);
-	offset = usbdevfs_assign_packet_memory_rx(0, offset, MAXPACKETSIZE0);
-	offset = usbdevfs_assign_packet_memory_tx0(1, offset, AS_SIZE);
-	offset = usbdevfs_assign_packet_memory_tx1(1, offset, AS_SIZE);
-	offset = usbdevfs_assign_packet_memory_tx(2, offset, INTERRUPT_SIZE);
-
-	usbdevfs_write0(1, (u16 *)adc_buf[0], AS_SIZE);
-	usbdevfs_write1(1, (u16 *)adc_buf[0], AS_SIZE);
+	usbdev_init(&radio_device);
+
+	usbdevfs_write0(AS_EP, (u16 *)adc_buf[0], AS_SIZE);
+	usbdevfs_write1(AS_EP, (u16 *)adc_buf[0], AS_SIZE);
+}
+
+/* Alternate setting 1 of the audio stream interface */
+static bool stream_enabled(void)
+{
+	return (usbdev_get_interface(INTERFACE_AS) != 0);
+}
+
+/* Interrupt IN endpoint (configured and not halted) */
+static bool interrupt_enabled(void)
+{
+	return (usbdev_get_configuration() &&
+		!usbdev_get_endpoint_halt(INTERRUPT_ENUM));
 }
 
 /* USB (high priority) interrupt */
@@ -564,17 +520,16 @@ void usb_hp_isr(void)
 	trans = usbdevfs_get_ep_status(ep_id, USBDEVFS_TX | USBDEVFS_TX_DATA1);
 
 	/* Isochronous endpoint Tx (IN transaction) */
-	if (ep_id != 1 || !(trans & USBDEVFS_TX))
+	if (ep_id != AS_EP || !(trans & USBDEVFS_TX))
 		return;
 
 	if (tx_buf) {
-		if (endpoint_state[1] == EP_STATE_ENABLE) {
+		if (stream_enabled()) {
 			if (trans & USBDEVFS_TX_DATA1)
-				usbdevfs_write0(1, (u16 *)tx_buf, AS_SIZE);
+				usbdevfs_write0(AS_EP, (u16 *)tx_buf, AS_SIZE);
 			else
-				usbdevfs_write1(1, (u16 *)tx_buf, AS_SIZE);
+				usbdevfs_write1(AS_EP, (u16 *)tx_buf, AS_SIZE);
 		}
-		free_buf((u32 *)tx_buf);
 		tx_buf = 0;
 	} else {
 		tx_loss++;
@@ -587,41 +542,23 @@ void usb_hp_isr(void)
 static void sof(void)
 {
 	/* Audio Stream */
-	if (endpoint_state[1] == EP_STATE_ENABLE) {
+	if (stream_enabled()) {
+		/* Start DMA, a half per frame. */
 		if (!dma_running) {
-			/* Set DMA mode and enable DMA. */
-			if ((dma_buf = alloc_buf())) {
-				dma_setup_channel(DMA_ADC,
-						  (u32)dma_buf, (u32)&ADC_DR,
-						  AS_SIZE / sizeof(u16),
-						  DMA_M_16BIT | DMA_P_32BIT |
-						  DMA_M_INC | DMA_P_TO_M |
-						  DMA_COMPLETE | DMA_ENABLE);
-				dma_count++;
-				dma_running = true;
-			}
+			dmastream_start(&adc_stream);
+			dma_running = true;
 		}
 
 		/* Start timer. */
-		if (dma_running) {
-			/* Set counter. */
-			tim_set_counter(TIM3, 0);
-
-			/* Enable counter. */
-			tim_enable_counter(TIM3);
-
-			/* Set counter. */
-			tim_set_counter(TIM9,
-					TIMX_CLK_APB2 / SAMPLING_FREQ - 1);
-
-			/* Enable counter. */
-			tim_enable_counter(TIM9);
-		}
+		tim_set_counter(TIM3, 0);
+		tim_enable_counter(TIM3);
+		tim_set_counter(TIM9, TIMX_CLK_APB2 / SAMPLING_FREQ - 1);
+		tim_enable_counter(TIM9);
 	}
 
 	/* Interrupt In */
 	frame_count++;
-	if (endpoint_state[2] == EP_STATE_ENABLE &&
+	if (interrupt_enabled() &&
 	    idle_duration && frame_count > idle_duration * 4 &&
 	    !interrupt_busy &&
 	    devreq == DEVICE_REQUEST_NONE &&
@@ -634,12 +571,16 @@ static void sof(void)
 static void rx_packet(int ep_id, bool setup)
 {
 	if (ep_id == 0) {
-		if (setup)
+		if (setup) {
+			/* A new request cancels the held one. */
+			wait_state = WAIT_STATE_NONE;
+
 			/* Device request */
-			control_setup();
-		else
+			usbdev_control_setup();
+		} else {
 			/* OUT data */
-			control_rx();
+			usbdev_control_rx();
+		}
 	}
 }
 
@@ -647,7 +588,7 @@ static void tx_packet(int ep_id)
 {
 	if (ep_id == 0)
 		/* IN data */
-		control_tx();
+		usbdev_control_tx();
 	else {
 		/* Clear interrupt. */
 		usbdevfs_clear_endpoint_interrupt(ep_id);
@@ -662,25 +603,14 @@ static void usb_reset(void)
 	tim_disable_counter(TIM9);
 
 	/* Disable DMA. */
-	dma_disable(DMA_ADC);
+	dmastream_stop(&adc_stream);
 	dma_running = false;
 
-	/* Reset buffer allocator. */
-	init_buf();
-
 	/* Clear buffer. */
 	tx_buf = 0;
 
-	/* Set endpoint type and address. */
-	usbdevfs_setup_endpoint(0, USBDEVFS_CONTROL, 0);
-	usbdevfs_setup_endpoint(1, USBDEVFS_ISOCHRONOUS, AS_ENUM);
-	usbdevfs_setup_endpoint(2, USBDEVFS_INTERRUPT, INTERRUPT_ENUM);
-
-	/* Set default address. */
-	usbdevfs_set_device_address(0);
-
-	/* Reset control transfer state. */
-	control_reset();
+	/* Reset USB device state. */
+	usbdev_reset();
 }
 
 /* USB (low priority) interrupt */
@@ -1054,18 +984,18 @@ static void send_interrupt(void)
 	int i;
 	u8 buf[13] __attribute__ ((aligned(2)));
 
-	if (endpoint_state[2] == EP_STATE_ENABLE &&
+	if (interrupt_enabled() &&
 	    idle_duration && frame_count > idle_duration * 4) {
 		buf[0] = 18;	/* Report ID */
 		for (i = 0; i < 6; i++) {
 			buf[i * 2 + 1] = si4703_reg[10 + i] >> 8;
 			buf[i * 2 + 2] = si4703_reg[10 + i] & 0xff;
 		}
-		usbdevfs_write(2, (u16 *)buf, sizeof(buf));
+		usbdevfs_write(INTERRUPT_EP, (u16 *)buf, sizeof(buf));
 		interrupt_busy = true;
 
 		/* Enable endpoint. */
-		usbdevfs_start_endpoint_tx(2);
+		usbdevfs_start_endpoint_tx(INTERRUPT_EP);
 
 		frame_count = 0;
 		interrupt_send++;
@@ -1149,7 +1079,7 @@ int main(void)
 				send_interrupt();
 
 			devreq = DEVICE_REQUEST_NONE;
-			control_restart();
+			usbdev_control_resume();
 
 			/* Enable USB low priority interrupt. */
 			nvic_enable_irq(NVIC_USB_LP_IRQ);
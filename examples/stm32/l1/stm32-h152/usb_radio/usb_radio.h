@@ -27,15 +27,6 @@
 /* Maximum OUT data length */
 #define MAX_DATA_OUT		64
 
-/* Maximum IN data length */
-#define MAX_DATA_IN		128
-
-/* Maximun interface number */
-#define MAXINTERFACE		3
-
-/* Maximum endpoint number */
-#define MAXENDPOINT		3
-
 /* Audio Control Interface */
 #define INTERFACE_AC		0
 
@@ -71,15 +62,6 @@
 #define SAMPLING_FREQ		48000
 
 
-/* Endpoint state */
-typedef enum {
-	EP_STATE_DISABLE,
-	EP_STATE_ENABLE,
-	EP_STATE_HALT
-} ep_state_t;
-
-extern ep_state_t endpoint_state[MAXENDPOINT];
-
 /* Wait state */
 typedef enum {
 	WAIT_STATE_NONE = 0,
@@ -0,0 +1,205 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <usart.h>
+#include <dma.h>
+#include <usbdev.h>
+#include <cdcacm.h>
+
+#include <usb/standard.h>
+#include <usb/descriptor.h>
+#include <usb/langid.h>
+#include <usb/cdc.h>
+
+#include "usb_serial.h"
+#include "descriptor.h"
+
+/* struct usb_cdc_union_descriptor_1 */
+USB_CDC_UNION_DESCRIPTOR(1);
+
+/* struct usb_string_descriptor_24 */
+USB_STRING_DESCRIPTOR(24);
+
+/* Communications Class Specific Interface Descriptor */
+struct cdcacm_functional_descriptors {
+	struct usb_cdc_header_descriptor header;
+	struct usb_cdc_acm_descriptor acm;
+	struct usb_cdc_union_descriptor_1 cdc_union;
+} __attribute__ ((packed));
+
+/* Configuration */
+struct config_desc {
+	struct usb_config_descriptor config;
+	struct usb_interface_descriptor comm_if;
+	struct cdcacm_functional_descriptors cdcacm_func;
+	struct usb_endpoint_descriptor comm_endp;
+	struct usb_interface_descriptor data_if;
+	struct usb_endpoint_descriptor rx_endp;
+	struct usb_endpoint_descriptor tx_endp;
+} __attribute__ ((packed));
+
+/* Device Descriptor */
+static const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) =
+USB_DEVICE_DESCRIPTOR_INIT(
+	.bcdUSB = 0x0200,
+	.bDeviceClass = USB_CLASS_COMM,
+	.bDeviceSubClass = 0,
+	.bDeviceProtocol = 0,
+	.bMaxPacketSize0 = MAXPACKETSIZE0,
+	.idVendor = 0x2975,
+	.idProduct = 0x0003,
+	.bcdDevice = 0x0020,
+	.iManufacturer = STRING_MANUFACTURER,
+	.iProduct = STRING_PRODUCT,
+	.iSerialNumber = STRING_SERIAL_NUMBER,
+	.bNumConfigurations = 1,
+);
+
+static const struct config_desc config_desc __attribute__ ((aligned(2))) = {
+	/* Configuration Descriptor */
+	.config = USB_CONFIG_DESCRIPTOR_INIT(struct config_desc,
+		.bNumInterfaces = NUM_INTERFACE,
+		.bConfigurationValue = CONFIGURATION_VALUE,
+		.iConfiguration = 0,
+		.bmAttributes = USB_CONFIG_ATTR_D7,
+		.bMaxPower = 100 / 2,
+	),
+	/* Commucations Class Interface Descriptor */
+	.comm_if = USB_INTERFACE_DESCRIPTOR_INIT(
+		.bInterfaceNumber = INTERFACE_COMM,
+		.bAlternateSetting = 0,
+		.bNumEndpoints = 1,
+		.bInterfaceClass = USB_CLASS_COMM,
+		.bInterfaceSubClass = USB_COMM_SUBCLASS_ACM,
+		.bInterfaceProtocol = 0,
+		.iInterface = 0,
+	),
+	/* Communications Class Specific Interface Descriptor */
+	.cdcacm_func = {
+		/* Header Functional Descriptor */
+		.header = {
+			.bFunctionLength =
+			sizeof(struct usb_cdc_header_descriptor),
+			.bDescriptorType = USB_DT_CS_INTERFACE,
+			.bDescriptorSubtype = USB_COMM_TYPE_HEADER,
+			.bcdCDC = 0x0120,
+		},
+		/* Abstract Control Management Functional Descriptor */
+		.acm = {
+			.bFunctionLength =
+			sizeof(struct usb_cdc_acm_descriptor),
+			.bDescriptorType = USB_DT_CS_INTERFACE,
+			.bDescriptorSubtype = USB_COMM_TYPE_ACM,
+			.bmCapabilities = (USB_CDC_ACM_CAP_LINE |
+					   USB_CDC_ACM_CAP_BREAK),
+		},
+		/* Union Interface Functional Descriptor */
+		.cdc_union = {
+			.bFunctionLength =
+			sizeof(struct usb_cdc_union_descriptor_1),
+			.bDescriptorType = USB_DT_CS_INTERFACE,
+			.bDescriptorSubtype = USB_COMM_TYPE_UNION,
+			.bControlInterface = INTERFACE_COMM,
+			.bSubordinateInterface[0] = INTERFACE_DATA,
+		},
+	},
+	/* Notification endpoint */
+	.comm_endp = USB_ENDPOINT_DESCRIPTOR_INIT(
+		.bEndpointAddress = NOTIFICATION_ENUM,
+		.bmAttributes = USB_ENDPOINT_TRANS_INTERRUPT,
+		.wMaxPacketSize = NOTIFICATION_SIZE,
+		.bInterval = NOTIFICATION_INTERVAL,
+	),
+	/* Data Class Interface Descriptor */
+	.data_if = USB_INTERFACE_DESCRIPTOR_INIT(
+		.bInterfaceNumber = INTERFACE_DATA,
+		.bAlternateSetting = 0,
+		.bNumEndpoints = 2,
+		.bInterfaceClass = USB_CLASS_DATA,
+		.bInterfaceSubClass = 0,
+		.bInterfaceProtocol = 0,
+		.iInterface = 0,
+	),
+	/* Data rx endpoint */
+	.rx_endp = USB_ENDPOINT_DESCRIPTOR_INIT(
+		.bEndpointAddress = DATA_RX_ENUM,
+		.bmAttributes = USB_ENDPOINT_TRANS_BULK,
+		.wMaxPacketSize = DATA_SIZE,
+		.bInterval = DATA_INTERVAL,
+	),
+	/* Data tx endpoint */
+	.tx_endp = USB_ENDPOINT_DESCRIPTOR_INIT(
+		.bEndpointAddress = DATA_TX_ENUM,
+		.bmAttributes = USB_ENDPOINT_TRANS_BULK,
+		.wMaxPacketSize = DATA_SIZE,
+		.bInterval = DATA_INTERVAL,
+	),
+};
+
+/* String Descriptors */
+static USB_DEFINE_LANGID_DESCRIPTOR(langid, LANGID_ENGLISH_US);
+static USB_DEFINE_STRING_DESCRIPTOR(manufacturer, L"MPC Research Ltd.");
+static USB_DEFINE_STRING_DESCRIPTOR(product, L"USB Serial");
+/* Serial number (unique device ID) */
+static struct usb_string_descriptor_24 serial_number __attribute__ ((aligned(2)));
+
+static const void * const string_desc[NUM_STRING_DESC] = {
+	[STRING_LANGID] = &langid,
+	[STRING_MANUFACTURER] = &manufacturer,
+	[STRING_PRODUCT] = &product,
+	[STRING_SERIAL_NUMBER] = &serial_number,
+};
+
+void set_serial_number(u32 *uid)
+{
+	int i;
+	int j;
+	int d;
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 8; j++) {
+			d = (*uid >> (4 * j)) & 0xf;
+			if (d < 10)
+				serial_number.wData[23 - (i * 8 + j)] = L'0' + d;
+			else
+				serial_number.wData[23 - (i * 8 + j)] =
+					L'A' + (d - 10);
+		}
+		uid++;
+	}
+	serial_number.bLength = sizeof(serial_number);
+	serial_number.bDescriptorType = USB_DT_STRING;
+}
+
+/* Control OUT data */
+static u8 outbuf[MAX_DATA_OUT] __attribute__ ((aligned(4)));
+
+/* USB device */
+const struct usbdev_device serial_device = {
+	.device = &dev_desc,
+	.config = &config_desc.config,
+	.langid = LANGID_ENGLISH_US,
+	.num_string = NUM_STRING_DESC - 1,
+	.string_desc = string_desc,
+	.buf = outbuf,
+	.bufsize = MAX_DATA_OUT,
+	.request = cdcacm_request,
+	.set_configuration = cdcacm_set_configuration,
+	.reset = cdcacm_reset,
+};
@@ -17,7 +17,4 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-void control_rx(void);
-void control_tx(void);
-void control_setup(void);
-void control_reset(void);
+extern const struct usbdev_device serial_device;
@@ -0,0 +1,283 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <rcc.h>
+#include <pwr.h>
+#include <flash.h>
+#include <gpio.h>
+#include <tim.h>
+#include <syscfg.h>
+#include <nvic.h>
+#include <usart.h>
+#include <dma.h>
+#include <usbdevfs.h>
+#include <usbdev.h>
+#include <cdcacm.h>
+#include <dbgmcu.h>
+#include <desig.h>
+
+#include "usb_serial.h"
+#include "descriptor.h"
+
+/* Timer clock frequency */
+#define TIMX_CLK_APB1		32000000
+
+/* USART2 clock frequency */
+#define PCLK1			32000000
+
+/* Endpoint ID */
+#define EP_NOTIFICATION		(NOTIFICATION_ENUM & 0xf)
+#define EP_DATA_RX		(DATA_RX_ENUM & 0xf)
+#define EP_DATA_TX		(DATA_TX_ENUM & 0xf)
+
+static u8 rx_ring[RX_RING_SIZE];
+static u8 tx_ring[TX_RING_SIZE];
+
+static const struct cdcacm_port serial_port = {
+	.interface = INTERFACE_COMM,
+	.notification_ep = EP_NOTIFICATION,
+	.data_rx_ep = EP_DATA_RX,
+	.data_tx_ep = EP_DATA_TX,
+	.packet_size = DATA_SIZE,
+	.usart = USART2,
+	.clock = PCLK1,
+	.dr = (u32)&USART2_DR,
+	.dma_rx = DMA_USART2_RX,
+	.dma_tx = DMA_USART2_TX,
+	.rx_ring = rx_ring,
+	.rx_size = RX_RING_SIZE,
+	.tx_ring = tx_ring,
+	.tx_size = TX_RING_SIZE,
+};
+
+/* Endpoint callbacks */
+static const struct usbdevfs_callback callback[] = {
+	{
+		.ep_id = 0,
+		.setup = usbdev_control_setup,
+		.rx = usbdev_control_rx,
+		.tx = usbdev_control_tx,
+	},
+	{
+		.ep_id = EP_NOTIFICATION,
+		.tx = cdcacm_notification_tx,
+	},
+	{
+		.ep_id = EP_DATA_RX,
+		.rx = cdcacm_data_rx,
+	},
+	{
+		.ep_id = EP_DATA_TX,
+		.tx = cdcacm_data_tx,
+	},
+};
+
+/* Set STM32 to 32 MHz. */
+static void clock_setup(void)
+{
+	/* Enable PWR clock. */
+	rcc_enable_clock(RCC_PWR);
+
+	/* Set VCORE to 1.8V */
+	pwr_set_vos(PWR_1_8_V);
+
+	/* Enable 64bit flash memory access (1WS). */
+	flash_enable_64bit_access(1);
+
+	/* Enable external high-speed oscillator 8MHz. */
+	rcc_enable_osc(RCC_HSE);
+
+	 /* Setup PLL (8MHz * 12 / 3 = 32MHz). */
+	rcc_setup_pll(RCC_HSE, 12, 3);
+
+	/* Enable PLL and wait for it to stabilize. */
+	rcc_enable_osc(RCC_PLL);
+
+	/* Select PLL as SYSCLK source. */
+	rcc_set_sysclk_source(RCC_PLL);
+}
+
+static void tim_setup(void)
+{
+	/* Enable TIM6 clock. */
+	rcc_enable_clock(RCC_TIM6);
+
+	/* Enable one-pulse mode. */
+	tim_enable_one_pulse_mode(TIM6);
+
+	/* Generate update interrupt on counter overflow. */
+	tim_disable_update_interrupt_on_any(TIM6);
+
+	/* Load prescaler value (2MHz). */
+	tim_load_prescaler_value(TIM6, TIMX_CLK_APB1 / 2000000 - 1);
+}
+
+/* 1 - 32767 usec */
+static void delay_us(u16 us)
+{
+	/* Set auto-reload value (us * 2). */
+	tim_set_autoreload_value(TIM6, (us << 1) - 1);
+
+	/* Enable counter. */
+	tim_enable_counter(TIM6);
+
+	/* Wait for update interrupt flag. */
+	while (!tim_get_interrupt_status(TIM6, TIM_UPDATE))
+		;
+
+	/* Clear update interrupt flag. */
+	tim_clear_interrupt(TIM6, TIM_UPDATE);
+}
+
+static void usart_setup(void)
+{
+	/* Enable GPIOD clock for USART2_TX and USART2_RX. */
+	rcc_enable_clock(RCC_GPIOD);
+
+	/* Enable USART2 and DMA1 clock. */
+	rcc_enable_clock(RCC_USART2);
+	rcc_enable_clock(RCC_DMA1);
+
+	/* Enable the USART2 Rx and Tx DMA interrupt. */
+	nvic_enable_irq(DMA_USART2_RX_IRQ);
+	nvic_enable_irq(DMA_USART2_TX_IRQ);
+
+	/* Setup GPIO pins for USART2 transmit and receive. */
+	gpio_config_altfn(GPIO_USART1_3, GPIO_PUSHPULL, GPIO_10MHZ,
+			  GPIO_NOPUPD, GPIO_PD(USART2_TX, USART2_RX));
+
+	/* Start the bridge (115200 bps, 8N1). */
+	cdcacm_init(&serial_port);
+}
+
+static void usb_setup(void)
+{
+	/* Enable USB and SYSCFG clock. */
+	rcc_enable_clock(RCC_USB);
+	rcc_enable_clock(RCC_SYSCFG);
+
+	/* Enable USB Low priority interrupt. */
+	nvic_enable_irq(NVIC_USB_LP_IRQ);
+
+	/* Exit Power Down. */
+	usbdevfs_disable_function(USBDEVFS_POWER_DOWN);
+
+	/* Wait T_STARTUP. */
+	delay_us(USBDEVFS_T_STARTUP);
+
+	/* Clear USB reset. */
+	usbdevfs_disable_function(USBDEVFS_FORCE_RESET);
+
+	/* Assign packet memory to endpoint */
+	usbdev_init(&serial_device);
+
+	/* Set endpoint callbacks. */
+	usbdevfs_set_callback(callback, sizeof(callback) / sizeof(callback[0]));
+}
+
+/* USB (low priority) interrupt */
+void usb_lp_isr(void)
+{
+	u16 mask;
+	u16 status;
+
+	/* Interrupt mask */
+	mask = usbdevfs_get_interrupt_mask(USBDEVFS_CORRECT_TRANSFER |
+					   USBDEVFS_RESET | USBDEVFS_SOF);
+	/* Spurious */
+	if (!mask)
+		return;
+
+	/* Interrupt status */
+	status = usbdevfs_get_interrupt_status(USBDEVFS_CORRECT_TRANSFER |
+					       USBDEVFS_RESET | USBDEVFS_SOF);
+	/* Spurious */
+	if (!status)
+		return;
+
+	/* Correct transfer */
+	if (mask & status & USBDEVFS_CORRECT_TRANSFER)
+		usbdevfs_dispatch();
+
+	/* Start of frame */
+	if (mask & status & USBDEVFS_SOF) {
+		cdcacm_sof();
+
+		/* Clear interrupt. */
+		usbdevfs_clear_interrupt(USBDEVFS_SOF);
+	}
+
+	/* USB RESET */
+	if (mask & status & USBDEVFS_RESET) {
+		/* Reset USB device state. */
+		usbdev_reset();
+
+		/* Clear interrupt. */
+		usbdevfs_clear_interrupt(USBDEVFS_RESET);
+	}
+}
+
+/* USART2 Rx DMA half transfer and transfer complete */
+void dma_usart2_rx_isr(void)
+{
+	/* Don't preempt the USB interrupt handler. */
+	nvic_disable_irq(NVIC_USB_LP_IRQ);
+	cdcacm_usart_rx_isr();
+	nvic_enable_irq(NVIC_USB_LP_IRQ);
+}
+
+/* USART2 Tx DMA transfer complete */
+void dma_usart2_tx_isr(void)
+{
+	/* Don't preempt the USB interrupt handler. */
+	nvic_disable_irq(NVIC_USB_LP_IRQ);
+	cdcacm_usart_tx_complete();
+	nvic_enable_irq(NVIC_USB_LP_IRQ);
+}
+
+int main(void)
+{
+	u16 dev_id;
+	u32 uid[3];
+
+	clock_setup();
+	tim_setup();
+	usart_setup();
+	usb_setup();
+
+	/* Set serial number (unique device ID). */
+	dev_id = dbgmcu_get_device_id() & DBGMCU_IDCODE_DEV_ID_MASK;
+	desig_get_unique_id(dev_id, uid);
+	set_serial_number(uid);
+
+	/* Attach the device to USB. */
+	syscfg_enable_usb_pullup();
+
+	/* Clear interrupt. */
+	usbdevfs_clear_interrupt(USBDEVFS_ALL_INTERRUPT);
+
+	/* Enable interrupt. */
+	usbdevfs_enable_interrupt(USBDEVFS_CORRECT_TRANSFER | USBDEVFS_RESET |
+				  USBDEVFS_SOF);
+
+	while (1)
+		__asm__ ("wfi");
+
+	return 0;
+}
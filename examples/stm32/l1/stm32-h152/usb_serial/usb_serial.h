@@ -0,0 +1,66 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Configuration value */
+/* Value to use as an argument to the USB_REQ_SET_CONFIGURATION request */
+#define CONFIGURATION_VALUE	1
+
+/* Maximum packet size for endpoint zero */
+#define MAXPACKETSIZE0		64
+
+/* Maximum OUT data length */
+#define MAX_DATA_OUT		16
+
+/* Interfaces */
+enum {
+	INTERFACE_COMM,		/* Communications Class Interface */
+	INTERFACE_DATA,		/* Data Class Interface */
+	NUM_INTERFACE
+};
+
+/* Notification endpoint */
+#define NOTIFICATION_ENUM	0x81
+/* Maximum packet size for notification endpoint */
+#define NOTIFICATION_SIZE	16
+/* Interval for polling endpoint */
+#define NOTIFICATION_INTERVAL	128
+
+/* Data rx endpoint */
+#define DATA_RX_ENUM		0x02
+/* Data tx endpoint */
+#define DATA_TX_ENUM		0x83
+/* Maximum packet size for data endpoint */
+#define DATA_SIZE		64
+/* Interval for polling endpoint */
+#define DATA_INTERVAL		1
+
+/* String index */
+enum {
+	STRING_LANGID,
+	STRING_MANUFACTURER,
+	STRING_PRODUCT,
+	STRING_SERIAL_NUMBER,
+	NUM_STRING_DESC
+};
+
+/* Ring buffer size (USART Rx: 5.5 msec at 921600 bps) */
+#define RX_RING_SIZE		512
+#define TX_RING_SIZE		512
+
+void set_serial_number(u32 *uid);
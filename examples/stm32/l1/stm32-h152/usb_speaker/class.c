@@ -17,13 +17,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <usbdevfs.h>
+#include <usbdev.h>
 
 #include <usb/standard.h>
 #include <usb/audio10.h>
 
 #include "usb_speaker.h"
 #include "class.h"
+#include "stream.h"
 
 /* Multe */
 static bool mute;
@@ -33,7 +34,7 @@ static s16 volume[3];
 
 /* --- Class-specific Requests --------------------------------------------- */
 
-bool class_request_error(struct usb_setup_data *req)
+static bool class_request_error(struct usb_setup_data *req)
 {
 	int cs;
 	int cn;
@@ -106,7 +107,7 @@ bool class_request_error(struct usb_setup_data *req)
 	return false;
 }
 
-int class_request(struct usb_setup_data *req, u8 *buf, u8 **data)
+static int audio_request(struct usb_setup_data *req, u8 *buf, u8 **data)
 {
 	int cs;
 	int cn;
@@ -175,8 +176,54 @@ int class_request(struct usb_setup_data *req, u8 *buf, u8 **data)
 	return len;
 }
 
+int class_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		  u8 **data)
+{
+	/* Class-specific Request */
+	if ((req->bmRequestType & USB_TYPE_MASK) != USB_TYPE_CLASS)
+		return -1;
+
+	switch (stage) {
+	case USBDEV_STAGE_SETUP:
+		/* Check error. */
+		if (class_request_error(req))
+			return -1;
+
+		/* GET request */
+		if (req->bmRequestType & USB_DIR_IN)
+			return audio_request(req, buf, data);
+		break;
+	case USBDEV_STAGE_STATUS:
+		/* SET request */
+		return audio_request(req, buf, data);
+	}
+
+	return 0;
+}
+
+void class_set_configuration(int value)
+{
+	(void)value;
+
+	stream_stop();
+}
+
+void class_set_interface(int interface, int altsetting)
+{
+	if (interface != INTERFACE_AS)
+		return;
+
+	if (altsetting)
+		stream_start();
+	else
+		stream_stop();
+}
+
 void class_reset(void)
 {
+	/* Stop streaming. */
+	stream_stop();
+
 	/* Set volume */
 	volume[1] = DEFAULT_VOLUME;
 	volume[2] = DEFAULT_VOLUME;
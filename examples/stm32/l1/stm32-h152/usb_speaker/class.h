@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-bool class_request_error(struct usb_setup_data *req);
-int class_request(struct usb_setup_data *req, u8 *buf, u8 **data);
+int class_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		  u8 **data);
+void class_set_configuration(int value);
+void class_set_interface(int interface, int altsetting);
 void class_reset(void);
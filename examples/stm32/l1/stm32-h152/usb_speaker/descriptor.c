@@ -17,12 +17,15 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <usbdev.h>
+
 #include <usb/standard.h>
 #include <usb/langid.h>
 #include <usb/audio10.h>
 
 #include "usb_speaker.h"
 #include "descriptor.h"
+#include "class.h"
 
  /* struct usb_audio_ac_if_header_descriptor_1 */
 USB_AUDIO_AC_IF_HEADER_DESCRIPTOR(1);
@@ -50,10 +53,11 @@ struct config_desc {
 	struct usb_audio_type_i_format_type_descriptor_1 format;
 	struct usb_audio_endpoint_descriptor as_endp;
 	struct usb_audio_as_endpoint_descriptor cs_as_endp;
+	struct usb_audio_endpoint_descriptor fb_endp;
 } __attribute__ ((packed));
 
 /* Device Descriptor */
-const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) = {
+static const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) = {
 	.bLength = sizeof(struct usb_device_descriptor),
 	.bDescriptorType = USB_DT_DEVICE,
 	.bcdUSB = 0x0200,
@@ -70,7 +74,7 @@ const struct usb_device_descriptor dev_desc __attribute__ ((aligned(2))) = {
 	.bNumConfigurations = 1,
 };
 
-const struct config_desc config_desc __attribute__ ((aligned(2))) = {
+static const struct config_desc config_desc __attribute__ ((aligned(2))) = {
 	/* Configuration Descriptor */
 	.config = {
 		.bLength = sizeof(struct usb_config_descriptor),
@@ -167,7 +171,7 @@ const struct config_desc config_desc __attribute__ ((aligned(2))) = {
 		.bDescriptorType = USB_DT_INTERFACE,
 		.bInterfaceNumber = 1,
 		.bAlternateSetting = 1,
-		.bNumEndpoints = 1,
+		.bNumEndpoints = 2,
 		.bInterfaceClass = USB_CLASS_AUDIO,
 		.bInterfaceSubClass = USB_AUDIO_SUBCLASS_AUDIOSTREAMING,
 		.bInterfaceProtocol = USB_AUDIO_PROTO_UNDEFINED,
@@ -202,12 +206,12 @@ const struct config_desc config_desc __attribute__ ((aligned(2))) = {
 		.bLength = sizeof(struct usb_audio_endpoint_descriptor),
 		.bDescriptorType = USB_DT_ENDPOINT,
 		.bEndpointAddress = AS_ENUM,
-		.bmAttributes = (USB_ENDPOINT_SYNC_SYNC |
+		.bmAttributes = (USB_ENDPOINT_SYNC_ASYNC |
 				 USB_ENDPOINT_TRANS_ISOCHRONOUS),
 		.wMaxPacketSize = AS_SIZE,
 		.bInterval = AS_INTERVAL,
 		.bRefresh = 0,
-		.bSynchAddress = 0,
+		.bSynchAddress = FEEDBACK_ENUM,
 	},
 	/* Class-Specific AS Isochronous Audio Data Endpoint Descriptor */
 	.cs_as_endp = {
@@ -218,63 +222,41 @@ const struct config_desc config_desc __attribute__ ((aligned(2))) = {
 		.bLockDelayUnits = 0,
 		.wLockDelay = 0,
 	},
+	/* Standard AS Isochronous Synch Endpoint Descriptor */
+	.fb_endp = {
+		.bLength = sizeof(struct usb_audio_endpoint_descriptor),
+		.bDescriptorType = USB_DT_ENDPOINT,
+		.bEndpointAddress = FEEDBACK_ENUM,
+		.bmAttributes = USB_ENDPOINT_TRANS_ISOCHRONOUS,
+		.wMaxPacketSize = FEEDBACK_SIZE,
+		.bInterval = 1,
+		.bRefresh = FEEDBACK_REFRESH,
+		.bSynchAddress = 0,
+	},
 };
 
 /* Strings */
-const u16 langid[] = {LANGID_ENGLISH_US, 0};
-const u16 string1[] = L"MPC Research Ltd.";
-const u16 string2[] = L"USB Speaker";
-const u16 *string_english_us[MAX_STRING_INDEX] = {
+static const u16 string1[] = L"MPC Research Ltd.";
+static const u16 string2[] = L"USB Speaker";
+static const u16 * const string_english_us[MAX_STRING_INDEX] = {
 	string1,
 	string2
 };
 
-/* Make string descriptor from NULL-terminated string. */
-static int make_string_descriptor(int index, u16 *buf)
-{
-	int i;
-	const u16 *p;
-	u8 *s;
-
-	if (index == 0)
-		p = langid;	/* LANGID */
-	else
-		p = string_english_us[index - 1]; /* UNICODE encoded string */
+/* Control OUT data */
+static u8 outbuf[MAX_DATA_OUT] __attribute__ ((aligned(4)));
 
-	/* Copy data (not include EOS(0)). */
-	for (i = 1; *p; i++)
-		*(buf + i) = *p++;
-
-	/* Add bLength and bDescriptorType. */
-	s = (u8 *)buf;
-	*s++ = i * sizeof(u16);
-	*s = USB_DT_STRING;
-
-	/* Return descriptor size. */
-	return i * (int)sizeof(u16);
-}
-
-int get_descriptor(int type, int index, u8 *buf, u8 **data)
-{
-	int len;
-
-	switch (type) {
-	case USB_DT_DEVICE:
-		len = sizeof(dev_desc);
-		*data = (u8 *)&dev_desc;
-		break;
-	case USB_DT_CONFIGURATION:
-		len = sizeof(config_desc);
-		*data = (u8 *)&config_desc;
-		break;
-	case USB_DT_STRING:
-		len = make_string_descriptor(index, (u16 *)buf);
-		*data = buf;
-		break;
-	default:
-		len = 0;
-		break;
-	}
-
-	return len;
-}
+/* USB device */
+const struct usbdev_device speaker_device = {
+	.device = &dev_desc,
+	.config = &config_desc.config,
+	.langid = LANGID_ENGLISH_US,
+	.num_string = MAX_STRING_INDEX,
+	.string = string_english_us,
+	.buf = outbuf,
+	.bufsize = MAX_DATA_OUT,
+	.request = class_request,
+	.set_configuration = class_set_configuration,
+	.set_interface = class_set_interface,
+	.reset = class_reset,
+};
@@ -0,0 +1,262 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tim.h>
+#include <nvic.h>
+#include <dac.h>
+#include <dma.h>
+#include <usbdevfs.h>
+
+#include "usb_speaker.h"
+#include "stream.h"
+
+/* Endpoint ID */
+#define AS_EP			(AS_ENUM & 0xf)
+#define FEEDBACK_EP		(FEEDBACK_ENUM & 0xf)
+
+/* Frame number (11 bits) */
+#define FRAME_MASK		0x7ff
+
+/*
+ * Feedback (samples per frame, 10.14 format)
+ *
+ * The sample clock is TIMX_CLK_APB1 / SAMPLE_PERIOD, and is measured against
+ * SOF. A FIFO level error of 1 sample adds 2^FEEDBACK_GAIN.
+ */
+#define FEEDBACK_NOMINAL	(((TIMX_CLK_APB1 / 1000) << 14) / SAMPLE_PERIOD)
+#define FEEDBACK_MIN		((SAMPLING_FREQ / 1000 - 1) << 14)
+#define FEEDBACK_MAX		((AS_SIZE / 4) << 14)
+#define FEEDBACK_GAIN		4
+
+/* Sample FIFO (played by DMA in circular mode) */
+static u32 fifo[FIFO_SIZE];
+static int wr;			/* Write position */
+static int rd;			/* DMA position at the last SOF */
+static u32 written;		/* Number of samples written */
+static u32 played;		/* Number of samples played */
+static bool playing;
+
+/* Feedback */
+static u32 feedback;
+static u32 fb_position;		/* Play position (1/16384 sample) */
+static u16 fb_frame;
+static bool fb_valid;
+
+/* Statistics */
+static u32 underrun;
+static u32 overrun;
+static u32 short_packet;
+
+static void start_playback(void)
+{
+	rd = 0;
+	played = 0;
+	fb_valid = false;
+
+	/* Set DMA mode and enable DMA. */
+	dma_setup_channel(DMA_TIM7_UP, (u32)fifo, (u32)&DAC_DHR12LD, FIFO_SIZE,
+			  DMA_M_32BIT | DMA_P_32BIT | DMA_M_INC | DMA_M_TO_P |
+			  DMA_CIRCULAR | DMA_ENABLE);
+
+	/* Set counter. */
+	tim_set_counter(TIM7, SAMPLE_PERIOD - 1);
+
+	/* Enable counter. */
+	tim_enable_counter(TIM7);
+
+	playing = true;
+}
+
+static void stop_playback(void)
+{
+	/* Disable TIM7. */
+	tim_disable_counter(TIM7);
+
+	/* Disable DMA. */
+	dma_disable(DMA_TIM7_UP);
+
+	/* Clear FIFO. */
+	wr = 0;
+	written = 0;
+	playing = false;
+}
+
+/* Write the feedback value to the buffer which is not used by USB. */
+static void write_feedback(bool data1)
+{
+	u32 f = feedback;
+
+	if (data1)
+		usbdevfs_write0(FEEDBACK_EP, (u16 *)&f, FEEDBACK_SIZE);
+	else
+		usbdevfs_write1(FEEDBACK_EP, (u16 *)&f, FEEDBACK_SIZE);
+}
+
+/* Alternate setting 1 (usbdev has enabled the endpoints.) */
+void stream_start(void)
+{
+	nvic_disable_irq(NVIC_USB_HP_IRQ);
+
+	stop_playback();
+
+	/* Both buffers */
+	feedback = FEEDBACK_NOMINAL;
+	write_feedback(false);
+	write_feedback(true);
+
+	nvic_enable_irq(NVIC_USB_HP_IRQ);
+}
+
+/* Alternate setting 0, SET_CONFIGURATION or USB RESET */
+void stream_stop(void)
+{
+	nvic_disable_irq(NVIC_USB_HP_IRQ);
+
+	stop_playback();
+
+	nvic_enable_irq(NVIC_USB_HP_IRQ);
+}
+
+/* Isochronous OUT (USB high priority interrupt) */
+void stream_rx(void)
+{
+	static u32 packet[AS_SIZE / sizeof(u32)];
+	int n;
+	int i;
+	int space;
+
+	/* Read data from packet buffer. */
+	if (usbdevfs_get_ep_status(AS_EP, USBDEVFS_RX_DATA1))
+		n = usbdevfs_read0(AS_EP, (u16 *)packet, AS_SIZE);
+	else
+		n = usbdevfs_read1(AS_EP, (u16 *)packet, AS_SIZE);
+
+	/* Clear interrupt. */
+	usbdevfs_clear_endpoint_interrupt(AS_EP);
+
+	/* Partial sample (data error ?) */
+	if (n % sizeof(u32))
+		short_packet++;
+	n /= sizeof(u32);
+	if (!n)
+		return;
+
+	/* FIFO free space */
+	if (playing) {
+		space = FIFO_SIZE - dma_get_number_of_data(DMA_TIM7_UP) -
+			wr - 1;
+		if (space < 0)
+			space += FIFO_SIZE;
+	} else {
+		space = FIFO_SIZE - wr - 1;
+	}
+	if (n > space) {
+		overrun++;
+		return;
+	}
+
+	/* -32768, 32767 => 0, 0xfff0 */
+	for (i = 0; i < n; i++) {
+		fifo[wr] = (packet[i] & 0xfff0fff0) ^ 0x80008000;
+		if (++wr == FIFO_SIZE)
+			wr = 0;
+	}
+	written += n;
+
+	if (!playing && written >= FIFO_START)
+		start_playback();
+}
+
+/* Isochronous IN (USB high priority interrupt) */
+void stream_feedback_tx(void)
+{
+	bool data1;
+
+	data1 = usbdevfs_get_ep_status(FEEDBACK_EP, USBDEVFS_TX_DATA1);
+
+	/* Clear interrupt. */
+	usbdevfs_clear_endpoint_interrupt(FEEDBACK_EP);
+
+	write_feedback(data1);
+}
+
+/* Start of frame (USB low priority interrupt) */
+void stream_sof(void)
+{
+	int n;
+	int cnt;
+	int pos;
+	int level;
+	u32 position;
+	u16 frame;
+	int f;
+
+	nvic_disable_irq(NVIC_USB_HP_IRQ);
+
+	if (!playing) {
+		nvic_enable_irq(NVIC_USB_HP_IRQ);
+		return;
+	}
+
+	/* DMA position and the phase of the sample clock */
+	do {
+		n = dma_get_number_of_data(DMA_TIM7_UP);
+		cnt = tim_get_counter(TIM7);
+	} while (n != dma_get_number_of_data(DMA_TIM7_UP));
+	frame = usbdevfs_get_frame_number() & FRAME_MASK;
+
+	pos = FIFO_SIZE - n;
+	played += (pos - rd + FIFO_SIZE) % FIFO_SIZE;
+	rd = pos;
+	level = written - played;
+
+	/* DMA has passed the write position. */
+	if (level < 0) {
+		underrun++;
+		stop_playback();
+		nvic_enable_irq(NVIC_USB_HP_IRQ);
+		return;
+	}
+
+	nvic_enable_irq(NVIC_USB_HP_IRQ);
+
+	position = (played << 14) + ((u32)cnt << 14) / SAMPLE_PERIOD;
+	if (!fb_valid) {
+		fb_position = position;
+		fb_frame = frame;
+		fb_valid = true;
+		return;
+	}
+
+	n = (frame - fb_frame) & FRAME_MASK;
+	if (n < (1 << FEEDBACK_REFRESH))
+		return;
+
+	/* Samples per frame, and FIFO level correction */
+	f = (position - fb_position) / n;
+	f += (FIFO_START - level) * (1 << FEEDBACK_GAIN);
+	if (f < FEEDBACK_MIN)
+		f = FEEDBACK_MIN;
+	if (f > FEEDBACK_MAX)
+		f = FEEDBACK_MAX;
+	feedback = f;
+
+	fb_position = position;
+	fb_frame = frame;
+}
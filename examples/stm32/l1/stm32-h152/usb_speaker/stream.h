@@ -17,7 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-void control_rx(void);
-void control_tx(void);
-void control_setup(void);
-void control_reset(void);
+void stream_start(void);
+void stream_stop(void);
+void stream_rx(void);
+void stream_feedback_tx(void);
+void stream_sof(void);
@@ -28,33 +28,14 @@
 #include <dma.h>
 #include <syscfg.h>
 #include <usbdevfs.h>
+#include <usbdev.h>
 
 #include "usb_speaker.h"
-#include "control.h"
-
-extern u8 *outp;
-extern int outlen;
-
-/* Timer clock frequency */
-#define TIMX_CLK_APB1		32000000
-
-/* Packet buffer memory */
-#define BUFFER_TABLE_ADDRESS	0
-#define PACKET_MEMORY_START	(BUFFER_TABLE_ADDRESS + \
-				 USBDEVFS_BUFFER_TABLE_SIZE)
-
-/* Maximum queue size */
-#define QUEUESIZE		4
-
-/* Rx queue */
-static u32 queue[QUEUESIZE][AS_SIZE / sizeof(u32)];
-static volatile int head;
-static volatile int tail;
-static volatile int data_len[QUEUESIZE]; /* Reception word count */
+#include "descriptor.h"
+#include "stream.h"
 
 /* Statistics */
 static u32 usb_error;
-static u32 short_packet;
 
 /* Set STM32 to 32 MHz. */
 static void clock_setup(void)
@@ -113,7 +94,7 @@ static void tim_setup(void)
 	tim_load_prescaler_value(TIM6, TIMX_CLK_APB1 / 2000000 - 1);
 
 	/* Set Auto-Reload value (prescaler = 0). */
-	tim_set_autoreload_value(TIM7, TIMX_CLK_APB1 / SAMPLING_FREQ - 1);
+	tim_set_autoreload_value(TIM7, SAMPLE_PERIOD - 1);
 
 	/* Enable update DMA request. */
 	tim_enable_dma(TIM7, TIM_DMA_UPDATE);
@@ -221,40 +202,36 @@ static void dma_setup(void)
 {
 	/* Enable DMA1 clock. */
 	rcc_enable_clock(DMA_RCC_TIM7_UP);
-
-	/* Enable DMA1 channel3 interrupt. */
-	nvic_enable_irq(DMA_TIM7_UP_IRQ);
 }
 
-/* DMA1 (channel3) interrupt */
-void dma_tim7_up_isr(void)
+/* Isochronous endpoint Rx (OUT transaction) */
+static void as_rx(void)
 {
-	/* Interrupt mask */
-	if (!dma_get_interrupt_mask(DMA_TIM7_UP, DMA_COMPLETE))
-		return;
-
-	/* Interrupt status */
-	if (dma_get_interrupt_status(DMA_TIM7_UP, DMA_GLOBAL | DMA_COMPLETE) !=
-	    (DMA_GLOBAL | DMA_COMPLETE))
-		return;
-
-	/* Disable TIM7. */
-	tim_disable_counter(TIM7);
-
-	/* Disable DMA. */
-	dma_disable(DMA_TIM7_UP);
+	static int count;
 
-	/* Dequeue. */
-	head = (head + 1) % QUEUESIZE;
+	stream_rx();
 
-	/* Clear interrupt. */
-	dma_clear_interrupt(DMA_TIM7_UP, DMA_COMPLETE | DMA_GLOBAL);
+	/* LED ON/OFF */
+	if (++count == 100) {
+		gpio_toggle(GPIO_PE11);
+		count = 0;
+	}
 }
 
+/* Isochronous endpoint callbacks */
+static const struct usbdevfs_callback callback[] = {
+	{
+		.ep_id = 1,
+		.rx = as_rx,
+	},
+	{
+		.ep_id = 2,
+		.tx = stream_feedback_tx,
+	},
+};
+
 static void usb_setup(void)
 {
-	int offset;
-
 	/* Enable USB and SYSCFG clock. */
 	rcc_enable_clock(RCC_USB);
 	rcc_enable_clock(RCC_SYSCFG);
@@ -274,110 +251,17 @@ static void usb_setup(void)
 	/* Clear USB reset. */
 	usbdevfs_disable_function(USBDEVFS_FORCE_RESET);
 
-	/* Set buffer table address */
-	usbdevfs_set_buffer_table_address(BUFFER_TABLE_ADDRESS);
+	/* Assign packet memory to endpoints. */
+	usbdev_init(&speaker_device);
 
-	/* Assign packet memory to endpoint */
-	offset = usbdevfs_assign_packet_memory_tx(0, PACKET_MEMORY_START,
-						  MAXPACKETSIZE0);
-	offset = usbdevfs_assign_packet_memory_rx(0, offset, MAXPACKETSIZE0);
-	offset = usbdevfs_assign_packet_memory_rx0(1, offset, AS_SIZE);
-	offset = usbdevfs_assign_packet_memory_rx1(1, offset, AS_SIZE);
+	/* Set endpoint callbacks. */
+	usbdevfs_set_callback(callback, sizeof(callback) / sizeof(callback[0]));
 }
 
 /* USB (high priority) interrupt */
 void usb_hp_isr(void)
 {
-	u16 status;
-	u16 mask;
-	int ep_id;
-	u16 trans;
-	int n;
-	int i;
-	u32 *p;
-	u32 tmp;
-	static int count;
-
-	/* Interrupt mask */
-	mask = usbdevfs_get_interrupt_mask(USBDEVFS_CORRECT_TRANSFER);
-	if (!mask)
-		return;
-
-	/* Interrupt status */
-	status = usbdevfs_get_interrupt_status(USBDEVFS_CORRECT_TRANSFER |
-					       USBDEVFS_EP_ID);
-	if (!(status & USBDEVFS_CORRECT_TRANSFER))
-		return;
-
-	/* Correct transfer */
-	ep_id = status & USBDEVFS_EP_ID;
-	trans = usbdevfs_get_ep_status(ep_id, USBDEVFS_RX | USBDEVFS_RX_DATA1);
-
-	/* Isochronous endpoint Rx (OUT transaction) */
-	if (ep_id != 1 || !(trans & USBDEVFS_RX))
-		return;
-
-	/* Read data from packet buffer. */
-	if (trans & USBDEVFS_RX_DATA1)
-		n = usbdevfs_read0(ep_id, (u16 *)queue[tail], AS_SIZE);
-	else
-		n = usbdevfs_read1(ep_id, (u16 *)queue[tail], AS_SIZE);
-
-	/* too short packet (data error ?) */
-	if (n < AS_SIZE)
-		short_packet++;
-
-	if (n >= (int)sizeof(u32)) {
-		/* -32768, 32767 => 0, 0xfff0 */
-		p = queue[tail];
-		for (i = 0; i < n; i += 4) {
-			tmp = *p;
-			*p++ = (tmp & 0xfff0fff0) ^ 0x80008000;
-		}
-
-		/* Data length (word count) */
-		data_len[tail] = n / sizeof(u32);
-
-		/* Disable DMA1 channel3 interrupt. */
-		nvic_disable_irq(DMA_TIM7_UP_IRQ);
-
-		/* Enqueue. */
-		if ((tail + 1) % QUEUESIZE != head) {
-			tail = (tail + 1) % QUEUESIZE;
-
-			/* LED ON/OFF */
-			if (++count == 100) {
-				gpio_toggle(GPIO_PE11);
-				count = 0;
-			}
-		}
-
-		/* Enable DMA1 channel3 interrupt. */
-		nvic_enable_irq(DMA_TIM7_UP_IRQ);
-	}
-
-	/* Clear interrupt. */
-	usbdevfs_clear_endpoint_interrupt(1);
-}
-
-static void sof(void)
-{
-	if (head != tail) {
-		/* Set DMA mode and enable DMA. */
-		dma_setup_channel(DMA_TIM7_UP,
-				  (u32)queue[head], (u32)&DAC_DHR12LD,
-				  data_len[head],
-				  DMA_M_32BIT | DMA_P_32BIT |
-				  DMA_M_INC | DMA_M_TO_P |
-				  DMA_COMPLETE | DMA_ENABLE);
-
-		/* Set counter. */
-		tim_set_counter(TIM7,
-				TIMX_CLK_APB1 / SAMPLING_FREQ - 1);
-
-		/* Enable counter. */
-		tim_enable_counter(TIM7);
-	}
+	usbdevfs_dispatch_hp();
 }
 
 static void rx_packet(int ep_id, bool setup)
@@ -387,39 +271,17 @@ static void rx_packet(int ep_id, bool setup)
 
 	if (setup)
 		/* Device request */
-		control_setup();
+		usbdev_control_setup();
 	else
 		/* OUT data */
-		control_rx();
+		usbdev_control_rx();
 }
 
 static void tx_packet(int ep_id)
 {
 	if (ep_id == 0)
 		/* IN data */
-		control_tx();
-}
-
-static void usb_reset(void)
-{
-	/* Disable TIM7. */
-	tim_disable_counter(TIM7);
-
-	/* Disable DMA. */
-	dma_disable(DMA_TIM7_UP);
-
-	/* Clear queue. */
-	head = tail = 0;
-
-	/* Set endpoint type and address. */
-	usbdevfs_setup_endpoint(0, USBDEVFS_CONTROL, 0);
-	usbdevfs_setup_endpoint(1, USBDEVFS_ISOCHRONOUS, AS_ENUM);
-
-	/* Set default address. */
-	usbdevfs_set_device_address(0);
-
-	/* Reset control transfer state. */
-	control_reset();
+		usbdev_control_tx();
 }
 
 /* USB (low priority) interrupt */
@@ -449,7 +311,7 @@ void usb_lp_isr(void)
 
 	/* Start of frame */
 	if (mask & status & USBDEVFS_SOF) {
-		sof();
+		stream_sof();
 		/* Clear interrupt. */
 		usbdevfs_clear_interrupt(USBDEVFS_SOF);
 	}
@@ -478,7 +340,7 @@ void usb_lp_isr(void)
 
 	/* USB RESET */
 	if (mask & status & USBDEVFS_RESET) {
-		usb_reset();
+		usbdev_reset();
 		/* Clear interrupt. */
 		usbdevfs_clear_interrupt(USBDEVFS_RESET);
 	}
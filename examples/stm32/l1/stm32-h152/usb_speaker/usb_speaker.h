@@ -22,20 +22,11 @@
 #define CONFIGURATION_VALUE	1
 
 /* Maximum packet size for endpoint zero */
-#define MAXPACKETSIZE0		32
+#define MAXPACKETSIZE0		16
 
 /* Maximum OUT data length */
 #define MAX_DATA_OUT		2
 
-/* Maximum IN data length */
-#define MAX_DATA_IN		64
-
-/* Maximun interface number */
-#define MAXINTERFACE		2
-
-/* Maximum endpoint number */
-#define MAXENDPOINT		2
-
 /* Audio Control Interface */
 #define INTERFACE_AC		0
 
@@ -43,10 +34,16 @@
 #define INTERFACE_AS		1
 /* AS endpoint address */
 #define AS_ENUM			1
-/* Maximum packet size for data endpoint */
-#define AS_SIZE			192
+/* Maximum packet size for data endpoint (49 samples) */
+#define AS_SIZE			196
 /* Interval for polling endpoint */
 #define AS_INTERVAL		1
+/* Feedback endpoint address */
+#define FEEDBACK_ENUM		0x82
+/* Maximum packet size for feedback endpoint (10.14 format) */
+#define FEEDBACK_SIZE		3
+/* Feedback period (2^FEEDBACK_REFRESH msec) */
+#define FEEDBACK_REFRESH	5
 
 /* Maximum string index */
 #define MAX_STRING_INDEX	2
@@ -61,6 +58,16 @@
 /* Sampling Frequency */
 #define SAMPLING_FREQ		48000
 
+/* Timer clock frequency */
+#define TIMX_CLK_APB1		32000000
+/* Sample period (TIM7 clock) */
+#define SAMPLE_PERIOD		(TIMX_CLK_APB1 / SAMPLING_FREQ)
+
+/* Sample FIFO size (stereo samples) */
+#define FIFO_SIZE		512
+/* FIFO level to start playback, and to keep by feedback (3 msec) */
+#define FIFO_START		(3 * SAMPLING_FREQ / 1000)
+
 /* Volume */
 #define MIN_VOLUME		(-63 * 256)
 #define MAX_VOLUME		(0 * 256)
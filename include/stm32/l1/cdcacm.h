@@ -0,0 +1,104 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * USB CDC-ACM to USART bridge
+ *
+ * Universal Serial Bus Class Definitions for Communication Devices
+ * Revision 1.2
+ *
+ * PSTN Subclass (Abstract Control Model) Revision 1.2
+ *
+ * USART Rx data is written into 'rx_ring' by DMA in circular mode, and is
+ * copied from there to the packet memory of the IN endpoint. OUT packets
+ * are copied from the packet memory into 'tx_ring', which is sent by USART
+ * Tx DMA. Line coding is applied to the USART.
+ *
+ * Include usart.h, dma.h and usbdev.h before this file.
+ */
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * CDC-ACM port
+ *
+ * interface:	Communications Class Interface number
+ * notification_ep: Notification endpoint (ep_id)
+ * data_rx_ep:	Data OUT endpoint (ep_id)
+ * data_tx_ep:	Data IN endpoint (ep_id)
+ * packet_size:	Maximum packet size of the data endpoints
+ * usart:	USART
+ * clock:	USART clock frequency
+ * dr:		USART data register address
+ * dma_rx:	USART Rx DMA channel
+ * dma_tx:	USART Tx DMA channel
+ * rx_ring:	USART Rx (USB IN) ring buffer
+ * rx_size:	USART Rx ring buffer size (even)
+ * tx_ring:	USART Tx (USB OUT) ring buffer
+ * tx_size:	USART Tx ring buffer size (> packet_size)
+ *
+ * If the host does not read the data in time, the unread data in the Rx
+ * ring buffer is discarded, and bOverRun is notified by SERIAL_STATE.
+ * MARK and SPACE parity are not supported, and the parity bit of
+ * 7-bit data is passed to the host.
+ */
+struct cdcacm_port {
+	int interface;
+	int notification_ep;
+	int data_rx_ep;
+	int data_tx_ep;
+	int packet_size;
+	usart_t usart;
+	int clock;
+	u32 dr;
+	dma_channel_t dma_rx;
+	dma_channel_t dma_tx;
+	u8 *rx_ring;
+	int rx_size;
+	u8 *tx_ring;
+	int tx_size;
+};
+
+/*
+ * cdcacm_request(), cdcacm_set_configuration() and cdcacm_reset() are
+ * usbdev callbacks. Call cdcacm_data_rx/tx() and cdcacm_notification_tx()
+ * on CTR of the endpoints, cdcacm_sof() on SOF, cdcacm_usart_rx_isr() on
+ * the Rx DMA interrupt (half transfer and transfer complete, which count
+ * the laps of the ring buffer), and cdcacm_usart_tx_complete() on the Tx
+ * DMA transfer complete interrupt. These functions must not preempt each
+ * other.
+ *
+ * cdcacm_notify_serial_state() sends SERIAL_STATE ('state' is kept for
+ * the overrun notifications). cdcacm_get_overrun() returns the number of
+ * Rx ring buffer overruns.
+ */
+void cdcacm_init(const struct cdcacm_port *port);
+int cdcacm_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		   u8 **data);
+void cdcacm_set_configuration(int value);
+void cdcacm_reset(void);
+void cdcacm_data_rx(void);
+void cdcacm_data_tx(void);
+void cdcacm_notification_tx(void);
+void cdcacm_sof(void);
+void cdcacm_usart_rx_isr(void);
+void cdcacm_usart_tx_complete(void);
+int cdcacm_notify_serial_state(u16 state);
+int cdcacm_get_control_line_state(void);
+u32 cdcacm_get_overrun(void);
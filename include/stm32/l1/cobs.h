@@ -0,0 +1,99 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3.h>
+
+/*
+ * Consistent Overhead Byte Stuffing (COBS)
+ *
+ * A frame is encoded without zero bytes and terminated by a zero byte.
+ *
+ * The encoder writes directly into a ring buffer or a linear (DMA)
+ * buffer: the code byte of each block is reserved and filled in when the
+ * block ends, so the frame must not be sent before cobs_encode_end().
+ * The decoder takes the received data in chunks of any size (e.g. from
+ * the usartrx 'receive' callback) and passes each frame when its
+ * delimiter arrives.
+ *
+ * S. Cheshire and M. Baker, "Consistent Overhead Byte Stuffing",
+ * IEEE/ACM Transactions on Networking, Vol. 7, No. 2, April 1999
+ */
+
+/* --- Definitions --------------------------------------------------------- */
+
+/* Maximum encoded size of 'len' bytes (including the delimiter) */
+#define COBS_MAX_ENCODED(len)		((len) + (len) / 254 + 2)
+
+/*
+ * COBS encoder (private, set by cobs_encode_begin())
+ */
+struct cobs_encoder {
+	u8 *buf;
+	int size;
+	int pos;			/* Write position */
+	int space;			/* Bytes left */
+	int code_pos;			/* Position of the code byte */
+	int code;			/* Code (block length + 1) */
+	int len;			/* Bytes written */
+};
+
+/*
+ * COBS decoder
+ *
+ * buf:		Decoded frame buffer
+ * size:	Decoded frame buffer size
+ * frame:	Called with each decoded frame.
+ *
+ * The other members are private.
+ */
+struct cobs_decoder {
+	u8 *buf;
+	int size;
+	void (*frame)(struct cobs_decoder *d, const u8 *buf, int len);
+
+	int len;			/* Bytes decoded */
+	int n;				/* Data bytes left in the block */
+	bool zero;			/* A zero follows the block. */
+	bool in_frame;			/* A code byte was received. */
+	bool error;			/* Drop the frame. */
+	u32 errors;
+};
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * cobs_encode_begin() starts a frame at 'pos' of 'buf' ('size' bytes,
+ * wrapped around at the end), using 'space' bytes at most. Use pos = 0
+ * and space = size for a linear buffer. cobs_encode() appends data and
+ * returns 0, or -1 if out of space. cobs_encode_end() writes the last code
+ * byte and the delimiter, and returns the encoded length, or -1 if the
+ * frame did not fit.
+ *
+ * cobs_decoder_init() resets the decoder. cobs_decode() decodes 'len'
+ * bytes and calls 'frame' for each frame. cobs_decoder_get_error()
+ * returns the number of frames dropped (corrupted or longer than 'size').
+ * Empty frames (consecutive delimiters) are ignored.
+ */
+void cobs_encode_begin(struct cobs_encoder *e, u8 *buf, int size, int pos,
+		       int space);
+int cobs_encode(struct cobs_encoder *e, const void *data, int len);
+int cobs_encode_end(struct cobs_encoder *e);
+void cobs_decoder_init(struct cobs_decoder *d);
+void cobs_decode(struct cobs_decoder *d, const void *data, int len);
+u32 cobs_decoder_get_error(struct cobs_decoder *d);
@@ -17,10 +17,33 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-bool standard_request_error(struct usb_setup_data *req);
-int standard_request(struct usb_setup_data *req, u8 *buf, u8 **data);
-void standard_reset(void);
+#include <libopencm3.h>
 
-extern usb_standard_state_t standard_state;
+/*
+ * Cortex-M3 core
+ *
+ * PM0056: STM32F10xxx/20xxx/21xxx/L1xxxx Cortex-M3 programming manual
+ * (27-May-2013 Rev 5)
+ *
+ * 2.1.3 Core registers (PRIMASK)
+ */
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * irq_save() masks the interrupts (PRIMASK = 1), and returns the previous
+ * PRIMASK for irq_restore(). They can be nested.
+ */
+static inline u32 irq_save(void)
+{
+	u32 primask;
 
+	__asm__ volatile ("mrs %0, primask\n\tcpsid i" : "=r" (primask) : :
+			  "memory");
+	return primask;
+}
 
+static inline void irq_restore(u32 primask)
+{
+	__asm__ volatile ("msr primask, %0" : : "r" (primask) : "memory");
+}
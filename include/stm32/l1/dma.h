@@ -316,6 +316,44 @@ enum dma_channel {
 	DMA2_CHANNEL5	/* (**) */
 };
 
+/* --- DMA Channel descriptor ---------------------------------------------- */
+
+/* Channel position, for DMA_CHANNEL_DESC() */
+#define DMA_CHANNEL_BASE(dma)		((dma) < DMA2_CHANNEL1 ? \
+					 DMA1_BASE : DMA2_BASE)
+#define DMA_CHANNEL_NUM(dma)		((dma) < DMA2_CHANNEL1 ? \
+					 (dma) : (dma) - DMA2_CHANNEL1)
+#define DMA_CHANNEL_SHIFT(dma)		(4 * DMA_CHANNEL_NUM(dma))
+
+/*
+ * Channel descriptor
+ *
+ * base:	DMA1_BASE or DMA2_BASE (DMA_ISR, DMA_IFCR)
+ * ccr:		DMA_CCRx address, followed by DMA_CNDTRx, DMA_CPARx and
+ *		DMA_CMARx
+ * shift:	Position of the channel flags in DMA_ISR and DMA_IFCR
+ */
+struct dma_channel_desc {
+	u32 base;
+	u32 ccr;
+	int shift;
+};
+
+#define DMA_CHANNEL_DESC(dma)						\
+	{								\
+		.base = DMA_CHANNEL_BASE(dma),				\
+		.ccr = DMA_CHANNEL_BASE(dma) + 0x08 +			\
+			0x14 * DMA_CHANNEL_NUM(dma),			\
+		.shift = DMA_CHANNEL_SHIFT(dma),			\
+	}
+
+#define DMA_DESC_CCR(desc)		MMIO32((desc)->ccr)
+#define DMA_DESC_CNDTR(desc)		MMIO32((desc)->ccr + 0x04)
+#define DMA_DESC_CPAR(desc)		MMIO32((desc)->ccr + 0x08)
+#define DMA_DESC_CMAR(desc)		MMIO32((desc)->ccr + 0x0c)
+#define DMA_DESC_ISR(desc)		DMA_ISR((desc)->base)
+#define DMA_DESC_IFCR(desc)		DMA_IFCR((desc)->base)
+
 /* --- DMA request mapping ------------------------------------------------- */
 
 #define DMA_ADC				DMA1_CHANNEL1
@@ -579,6 +617,7 @@ enum {
 };
 
 void dma_setup_channel(dma_channel_t dma, u32 ma, u32 pa, int ndt, int mode);
+int dma_get_number_of_data(dma_channel_t dma);
 void dma_enable(dma_channel_t dma);
 void dma_disable(dma_channel_t dma);
 void dma_enable_interrupt(dma_channel_t dma, int ch_int);
@@ -586,3 +625,32 @@ void dma_disable_interrupt(dma_channel_t dma, int ch_int);
 int dma_get_interrupt_mask(dma_channel_t dma, int ch_int);
 int dma_get_interrupt_status(dma_channel_t dma, int ch_int);
 void dma_clear_interrupt(dma_channel_t dma, int ch_int);
+const struct dma_channel_desc *dma_get_channel_desc(dma_channel_t dma);
+
+/*
+ * Inline accessors of a channel descriptor (dma_get_channel_desc()), for
+ * the interrupt handlers: keep the descriptor at init, and avoid the
+ * function call and the table lookup on every interrupt.
+ */
+static inline int dma_desc_get_number_of_data(const struct dma_channel_desc *d)
+{
+	return DMA_DESC_CNDTR(d) & 0xffff;
+}
+
+static inline void dma_desc_disable(const struct dma_channel_desc *d)
+{
+	DMA_DESC_CCR(d) &= ~DMA_CCR_EN;
+}
+
+static inline int
+dma_desc_get_interrupt_status(const struct dma_channel_desc *d, int ch_int)
+{
+	return (DMA_DESC_ISR(d) >> d->shift) & ch_int;
+}
+
+static inline void dma_desc_clear_interrupt(const struct dma_channel_desc *d,
+					    int ch_int)
+{
+	/* Writing 0 to DMA_IFCR has no effect. */
+	DMA_DESC_IFCR(d) = ch_int << d->shift;
+}
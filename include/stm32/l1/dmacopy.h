@@ -0,0 +1,66 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Asynchronous memory copy and fill by DMA (memory-to-memory)
+ *
+ * Requests are queued and executed in order on one reserved DMA channel.
+ * The DMA data size is the largest one (32, 16 or 8 bits) allowed by the
+ * alignment of the addresses, and the remaining bytes are copied by the
+ * CPU. Requests shorter than the threshold are copied by the CPU, because
+ * the setup and the interrupt cost more than the copy itself (see the
+ * dma_memcpy_bench example).
+ *
+ * Include dma.h before this file.
+ */
+
+/* --- Definitions --------------------------------------------------------- */
+
+/* Number of queued requests */
+#define DMACOPY_QUEUE_SIZE		8
+
+/* Default threshold (bytes) */
+#define DMACOPY_THRESHOLD		64
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * dmacopy_init() reserves the DMA channel. Enable the DMA clock and the
+ * channel interrupt, and call dmacopy_isr() in the interrupt handler.
+ *
+ * dmacopy_memcpy() and dmacopy_memset() return 0 when the request is
+ * queued, or -1 if the queue is full. 'done' (may be NULL) is called with
+ * 'arg' when the request is completed, in the DMA interrupt handler, or
+ * before the function returns if the request is done by the CPU at once.
+ * The buffers must not overlap.
+ *
+ * dmacopy_busy() returns true while requests remain, dmacopy_flush() waits
+ * for them (not in an interrupt handler). dmacopy_get_error() returns the
+ * number of DMA transfer errors; the failed request is completed.
+ */
+void dmacopy_init(dma_channel_t dma);
+void dmacopy_set_threshold(int bytes);
+int dmacopy_memcpy(void *dst, const void *src, int len,
+		   void (*done)(void *arg), void *arg);
+int dmacopy_memset(void *dst, int c, int len, void (*done)(void *arg),
+		   void *arg);
+void dmacopy_isr(void);
+bool dmacopy_busy(void);
+void dmacopy_flush(void);
+u32 dmacopy_get_error(void);
@@ -0,0 +1,77 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Circular double-buffer DMA stream
+ *
+ * The DMA channel runs in circular mode over 'buf', and the half transfer
+ * and transfer complete interrupts hand over one half of the buffer at a
+ * time. For peripheral to memory, the ready half holds new data. For
+ * memory to peripheral, the ready half has been sent and can be refilled.
+ *
+ * Include dma.h before this file.
+ */
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * DMA stream
+ *
+ * dma:		DMA channel
+ * pa:		Peripheral address
+ * buf:		Buffer (two halves)
+ * ndt:		Number of data of the buffer (even)
+ * mode:	DMA_P_TO_M or DMA_M_TO_P, data sizes and priority
+ *		(DMA_CIRCULAR, DMA_M_INC and the interrupts are added.)
+ * ready:	Called in dmastream_isr() with the ready half (ndt / 2
+ *		data). If NULL, poll with dmastream_get().
+ *
+ * The other members are private.
+ */
+struct dmastream {
+	dma_channel_t dma;
+	u32 pa;
+	void *buf;
+	int ndt;
+	int mode;
+	void (*ready)(struct dmastream *s, void *half);
+
+	const struct dma_channel_desc *desc;
+	int half_bytes;
+	volatile u32 produced;		/* Halves done by the DMA */
+	u32 consumed;			/* Halves released */
+	volatile u32 overrun;		/* Halves lost */
+	volatile u32 error;		/* Transfer errors */
+};
+
+/*
+ * Call dmastream_isr() in the interrupt handler of the DMA channel.
+ * dmastream_get() returns the oldest ready half (or NULL), and counts the
+ * halves overwritten before they were read as overrun. Call
+ * dmastream_release() when the half returned by dmastream_get() is done;
+ * it returns -1 if the DMA already overwrote the half.
+ */
+void dmastream_init(struct dmastream *s);
+void dmastream_start(struct dmastream *s);
+void dmastream_stop(struct dmastream *s);
+void dmastream_isr(struct dmastream *s);
+void *dmastream_get(struct dmastream *s);
+int dmastream_release(struct dmastream *s);
+u32 dmastream_get_overrun(struct dmastream *s);
+u32 dmastream_get_error(struct dmastream *s);
@@ -236,5 +236,6 @@ void flash_disable_fixed_time_data_write(void);
 void flash_wait_for_last_operation(void);
 void flash_erase_double_word(u32 address);
 void flash_erase_page(u32 page_address);
-void flash_program_half_page(u32 address, u32 *data);
+void flash_program_half_page(u32 address, u32 *data)
+	__attribute__ ((long_call));
 void flash_program_double_word(u32 address, u32 *data);
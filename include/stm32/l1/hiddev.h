@@ -0,0 +1,97 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * USB HID device
+ *
+ * Device Class Definition for Human Interface Devices (HID) Version 1.11
+ *
+ * Input reports are sent on the interrupt IN endpoint. One report is in
+ * the packet memory waiting for the host, and the rest wait in a queue.
+ * A queued report is replaced by a newer report with the same report ID,
+ * so only the latest state is sent when the host lags behind, and the
+ * queue never holds more than one report per ID.
+ *
+ * Output reports are received on the interrupt OUT endpoint (optional) or
+ * by SET_REPORT. Feature reports are handled by GET_REPORT and SET_REPORT.
+ *
+ * Include usbdev.h before this file.
+ */
+
+/* --- Definitions --------------------------------------------------------- */
+
+/* Input report queue size (reports) */
+#define HIDDEV_QUEUE_SIZE	8
+
+/* Maximum report size (bytes) */
+#define HIDDEV_REPORT_SIZE_MAX	64
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * HID port
+ *
+ * interface:	Interface number
+ * in_ep:	Interrupt IN endpoint (ep_id)
+ * out_ep:	Interrupt OUT endpoint (ep_id), 0 if none
+ * packet_size:	Maximum packet size of the interrupt endpoints
+ * report_id:	Reports have a report ID (the first byte).
+ * hid_desc:	HID descriptor (in the configuration descriptor)
+ * report_desc:	Report descriptor
+ * report_desc_len: Report descriptor length
+ * get_report:	GET_REPORT. Put the report into 'buf' (up to 'len' bytes),
+ *		and return the length or -1 to stall.
+ * set_report:	SET_REPORT and output reports on the OUT endpoint. Return 0,
+ *		or -1 to stall (SET_REPORT only).
+ *
+ * 'type' is USB_HID_REPORT_TYPE_*, and 'id' is 0 if report_id is false.
+ * Callbacks may be NULL.
+ */
+struct hiddev_port {
+	int interface;
+	int in_ep;
+	int out_ep;
+	int packet_size;
+	bool report_id;
+	const u8 *hid_desc;
+	const u8 *report_desc;
+	int report_desc_len;
+	int (*get_report)(int type, int id, u8 *buf, int len);
+	int (*set_report)(int type, int id, const u8 *buf, int len);
+};
+
+/*
+ * hiddev_request(), hiddev_set_configuration() and hiddev_reset() are
+ * usbdev callbacks. Call hiddev_in_tx() and hiddev_out_rx() on CTR of the
+ * endpoints, and hiddev_sof() on SOF (idle rate).
+ *
+ * hiddev_send_report() queues an input report (the report ID first), and
+ * returns 0, or -1 if the device is not configured or the queue is full.
+ * It may be called from any context.
+ */
+void hiddev_init(const struct hiddev_port *port);
+int hiddev_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		   u8 **data);
+void hiddev_set_configuration(int value);
+void hiddev_reset(void);
+void hiddev_in_tx(void);
+void hiddev_out_rx(void);
+void hiddev_sof(void);
+int hiddev_send_report(const u8 *report, int len);
+int hiddev_get_protocol(void);
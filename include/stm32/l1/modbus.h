@@ -0,0 +1,140 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Modbus RTU slave and master
+ *
+ * USART Rx data is written into the frame buffer by DMA. The IDLE
+ * interrupt (1 character time without data) starts a one-pulse timer for
+ * the rest of the 3.5 character inter-frame gap, and the frame is
+ * processed at the timer update if no data arrived meanwhile. Frames are
+ * sent by DMA with DE (driver enable of an RS-485 transceiver) set until
+ * the USART transmission complete interrupt. The inter-character timeout
+ * (1.5 characters) is not checked.
+ *
+ * MODBUS over Serial Line Specification and Implementation Guide V1.02
+ * MODBUS Application Protocol Specification V1.1b3
+ *
+ * Include usart.h, dma.h and tim.h before this file.
+ */
+
+/* --- Definitions --------------------------------------------------------- */
+
+/* Maximum ADU size (address + PDU + CRC) */
+#define MODBUS_ADU_MAX			256
+
+/* Timer tick (us) */
+#define MODBUS_TICK			50
+
+/* Broadcast address */
+#define MODBUS_BROADCAST		0
+
+/* Function codes */
+#define MODBUS_READ_HOLDING_REGISTERS	3
+#define MODBUS_READ_INPUT_REGISTERS	4
+#define MODBUS_WRITE_SINGLE_REGISTER	6
+#define MODBUS_WRITE_MULTIPLE_REGISTERS	16
+
+/* Exception codes */
+#define MODBUS_ILLEGAL_FUNCTION		1
+#define MODBUS_ILLEGAL_DATA_ADDRESS	2
+#define MODBUS_ILLEGAL_DATA_VALUE	3
+#define MODBUS_SLAVE_DEVICE_FAILURE	4
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * Modbus RTU node
+ *
+ * usart:	USART (8 data bits with parity, or 2 stop bits)
+ * dr:		USART data register address
+ * baud:	Baud rate
+ * dma_rx:	USART Rx DMA channel
+ * dma_tx:	USART Tx DMA channel
+ * tim:		Timer (the update interrupt only)
+ * tim_clock:	Timer clock frequency
+ * de:		DE pin (GPIO_Pxy, active high), or 0 if none
+ * address:	Slave address (1 - 247), or 0 for a master
+ * timeout:	Response timeout of a master (ms, < 3276)
+ *
+ * read_registers: Slave. Read 'n' holding (MODBUS_READ_HOLDING_REGISTERS)
+ *		or input (MODBUS_READ_INPUT_REGISTERS) registers from 'addr'
+ *		into 'regs'. Return 0 or an exception code.
+ * write_registers: Slave. Write 'n' holding registers from 'addr'.
+ *		Return 0 or an exception code.
+ * request:	Slave. Other function codes. The response PDU replaces the
+ *		request PDU in 'pdu' (253 bytes). Return the response length,
+ *		or the negated exception code.
+ * response:	Master. Called with the response PDU, or with len = -1 on
+ *		timeout or a corrupted response.
+ *
+ * Callbacks are called in the interrupt handlers, and may be NULL
+ * (MODBUS_ILLEGAL_FUNCTION). The other members are private.
+ */
+struct modbus {
+	usart_t usart;
+	u32 dr;
+	int baud;
+	dma_channel_t dma_rx;
+	dma_channel_t dma_tx;
+	tim_t tim;
+	int tim_clock;
+	int de;
+	int address;
+	int timeout;
+
+	int (*read_registers)(struct modbus *m, int function, int addr, int n,
+			      u16 *regs);
+	int (*write_registers)(struct modbus *m, int addr, int n,
+			       const u16 *regs);
+	int (*request)(struct modbus *m, u8 *pdu, int len);
+	void (*response)(struct modbus *m, const u8 *pdu, int len);
+
+	volatile int state;
+	int gap;			/* Rest of t3.5 after IDLE (ticks) */
+	int ndt;			/* Rx DMA count at IDLE */
+	int slave;			/* Master: addressed slave */
+	volatile u32 error;
+	u8 rx[MODBUS_ADU_MAX];
+	u8 tx[MODBUS_ADU_MAX];
+};
+
+/*
+ * modbus_init() sets up the timer and starts reception. Set up the USART
+ * (usart_init()) and the DE pin as output before. Enable the USART and
+ * timer interrupts in NVIC, and call modbus_usart_isr() and
+ * modbus_tim_isr() in the interrupt handlers. They must not preempt each
+ * other. No DMA interrupts are used.
+ *
+ * modbus_master_send() sends a request PDU (function code and data, up to
+ * 253 bytes) to 'slave' (MODBUS_BROADCAST for all), and returns 0, or -1
+ * if busy. 'response' is called when the response arrives, or at once
+ * after a broadcast is sent with len = 0. modbus_busy() returns true while
+ * a frame is sent or a response is awaited.
+ *
+ * modbus_get_error() returns the number of frames dropped for a CRC error.
+ * modbus_crc16() calculates the CRC of 'buf' (sent low byte first).
+ */
+void modbus_init(struct modbus *m);
+void modbus_usart_isr(struct modbus *m);
+void modbus_tim_isr(struct modbus *m);
+int modbus_master_send(struct modbus *m, int slave, const u8 *pdu, int len);
+bool modbus_busy(struct modbus *m);
+u32 modbus_get_error(struct modbus *m);
+u16 modbus_crc16(const u8 *buf, int len);
@@ -0,0 +1,107 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * USB Mass Storage Class (Bulk-Only Transport, SCSI transparent command set)
+ *
+ * Universal Serial Bus Mass Storage Class Bulk-Only Transport Revision 1.0
+ *
+ * One logical unit of MSC_BLOCK_SIZE-byte blocks on a block device. Writes
+ * go through a write-back cache of 'cache_blocks' blocks, which is flushed
+ * when an entry is reused, on SYNCHRONIZE CACHE, START STOP UNIT and
+ * PREVENT ALLOW MEDIUM REMOVAL, and after MSC_FLUSH_DELAY idle frames.
+ * READ(10) is served from the cache or read block by block into 'block'
+ * and streamed to the double-buffered IN endpoint.
+ *
+ * Include usbdev.h before this file.
+ */
+
+/* --- Definitions --------------------------------------------------------- */
+
+/* Block size (bytes) */
+#define MSC_BLOCK_SIZE		512
+
+/* Maximum number of cache blocks */
+#define MSC_CACHE_MAX		8
+
+/* Idle time before the cache is flushed (SOF frames) */
+#define MSC_FLUSH_DELAY		500
+
+/*
+ * Block device
+ *
+ * block_count:	Number of blocks
+ * read:	Read a block into 'buf'. Return 0, or -1 on error.
+ * write:	Write a block. Return 0, or -1 on error. NULL if write-protected.
+ */
+struct msc_blockdev {
+	u32 block_count;
+	int (*read)(u32 lba, u8 *buf);
+	int (*write)(u32 lba, const u8 *buf);
+};
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * MSC port
+ *
+ * interface:	Interface number
+ * data_rx_ep:	Bulk OUT endpoint (ep_id, double-buffered)
+ * data_tx_ep:	Bulk IN endpoint (ep_id, double-buffered)
+ * packet_size:	Maximum packet size of the bulk endpoints (<= 64)
+ * dev:		Block device
+ * vendor:	INQUIRY vendor identification (up to 8 characters)
+ * product:	INQUIRY product identification (up to 16 characters)
+ * revision:	INQUIRY product revision level (up to 4 characters)
+ * block:	Block buffer (MSC_BLOCK_SIZE bytes, 4-byte aligned)
+ * cache:	Cache buffer (cache_blocks * MSC_BLOCK_SIZE bytes, 4-byte
+ *		aligned)
+ * cache_blocks: Number of cache blocks (1 - MSC_CACHE_MAX)
+ */
+struct msc_port {
+	int interface;
+	int data_rx_ep;
+	int data_tx_ep;
+	int packet_size;
+	const struct msc_blockdev *dev;
+	const char *vendor;
+	const char *product;
+	const char *revision;
+	u8 *block;
+	u8 *cache;
+	int cache_blocks;
+};
+
+/*
+ * msc_request(), msc_set_configuration() and msc_reset() are usbdev
+ * callbacks. Call msc_data_rx/tx() on CTR of the endpoints and msc_sof()
+ * on SOF. These functions and msc_flush() must not preempt each other.
+ * The block device is accessed from them.
+ *
+ * msc_flush() writes the dirty cache blocks, and returns 0 or -1 on error.
+ */
+void msc_init(const struct msc_port *port);
+int msc_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		u8 **data);
+void msc_set_configuration(int value);
+void msc_reset(void);
+void msc_data_rx(void);
+void msc_data_tx(void);
+void msc_sof(void);
+int msc_flush(void);
@@ -0,0 +1,97 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3.h>
+
+/*
+ * Serial Line Internet Protocol (SLIP) framing
+ *
+ * END bytes in a frame are replaced by ESC ESC_END, and ESC bytes by
+ * ESC ESC_ESC. Each frame is sent between END bytes.
+ *
+ * The encoder writes directly into a ring buffer or a linear (DMA) buffer,
+ * and the decoder takes the received data in chunks of any size, as the
+ * COBS codec (cobs.h) does.
+ *
+ * RFC 1055 A Nonstandard for Transmission of IP Datagrams over Serial
+ * Lines: SLIP
+ */
+
+/* --- Definitions --------------------------------------------------------- */
+
+#define SLIP_END			0xc0
+#define SLIP_ESC			0xdb
+#define SLIP_ESC_END			0xdc
+#define SLIP_ESC_ESC			0xdd
+
+/* Maximum encoded size of 'len' bytes (including both END bytes) */
+#define SLIP_MAX_ENCODED(len)		((len) * 2 + 2)
+
+/*
+ * SLIP encoder (private, set by slip_encode_begin())
+ */
+struct slip_encoder {
+	u8 *buf;
+	int size;
+	int pos;			/* Write position */
+	int space;			/* Bytes left */
+	int len;			/* Bytes written */
+};
+
+/*
+ * SLIP decoder
+ *
+ * buf:		Decoded frame buffer
+ * size:	Decoded frame buffer size
+ * frame:	Called with each decoded frame.
+ *
+ * The other members are private.
+ */
+struct slip_decoder {
+	u8 *buf;
+	int size;
+	void (*frame)(struct slip_decoder *d, const u8 *buf, int len);
+
+	int len;			/* Bytes decoded */
+	bool esc;			/* ESC received */
+	bool error;			/* Drop the frame. */
+	u32 errors;
+};
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * slip_encode_begin() writes the leading END at 'pos' of 'buf' ('size'
+ * bytes, wrapped around at the end), using 'space' bytes at most.
+ * slip_encode() appends data and returns 0, or -1 if out of space.
+ * slip_encode_end() writes the trailing END, and returns the encoded
+ * length, or -1 if the frame did not fit.
+ *
+ * slip_decoder_init() resets the decoder. slip_decode() decodes 'len'
+ * bytes and calls 'frame' for each frame. slip_decoder_get_error()
+ * returns the number of frames dropped (invalid escape or longer than
+ * 'size'). Empty frames are ignored.
+ */
+void slip_encode_begin(struct slip_encoder *e, u8 *buf, int size, int pos,
+		       int space);
+int slip_encode(struct slip_encoder *e, const void *data, int len);
+int slip_encode_end(struct slip_encoder *e);
+void slip_decoder_init(struct slip_decoder *d);
+void slip_decode(struct slip_decoder *d, const void *data, int len);
+u32 slip_decoder_get_error(struct slip_decoder *d);
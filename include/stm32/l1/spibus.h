@@ -0,0 +1,123 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SPI bus manager
+ *
+ * Devices on one SPI bus are registered with their mode, prescaler and
+ * chip select pin. Transactions (one or more segments, e.g. command,
+ * address and data, under one chip select) are queued and executed
+ * back-to-back by spidma. The SPI is reconfigured only when the device
+ * differs from the last one. Transactions can be submitted from interrupt
+ * handlers, and the completion is notified by a callback.
+ *
+ * Include spi.h, dma.h and spidma.h before this file.
+ */
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * SPI device
+ *
+ * prescaler:	Baud rate prescaler (2 - 256)
+ * mode:	Mode of spi_set_mode() (SPI_CLOCK_POLARITY, SPI_CLOCK_PHASE,
+ *		SPI_16BIT and/or SPI_LSB_FIRST)
+ * cs:		Chip select pin (GPIO_Pxy, active low, set up as output)
+ */
+struct spibus_device {
+	int prescaler;
+	int mode;
+	int cs;
+};
+
+/*
+ * Transaction segment
+ *
+ * tx:		Tx data, or NULL to send zeros (rx-only)
+ * rx:		Rx buffer, or NULL to discard (tx-only)
+ * len:		Number of frames
+ */
+struct spibus_segment {
+	const void *tx;
+	void *rx;
+	int len;
+};
+
+/*
+ * SPI transaction
+ *
+ * dev:		Device
+ * seg:		Segments
+ * num_seg:	Number of segments
+ * done:	Called in the interrupt handler when completed, with error
+ *		= -1 if a DMA error stopped the transaction. May be NULL.
+ * arg:		For the application
+ *
+ * The transaction must not be modified until it is completed. The other
+ * members are private.
+ */
+struct spibus_transaction {
+	const struct spibus_device *dev;
+	const struct spibus_segment *seg;
+	int num_seg;
+	void (*done)(struct spibus_transaction *t, int error);
+	void *arg;
+
+	struct spibus_transaction *next;
+	int index;			/* Current segment */
+};
+
+/*
+ * SPI bus
+ *
+ * spi:		SPI
+ * dr:		SPI data register address
+ * dma_rx:	SPI Rx DMA channel
+ * dma_tx:	SPI Tx DMA channel
+ *
+ * The other members are private.
+ */
+struct spibus {
+	spi_t spi;
+	u32 dr;
+	dma_channel_t dma_rx;
+	dma_channel_t dma_tx;
+
+	struct spidma dma;
+	const struct spibus_device *dev;	/* Current configuration */
+	struct spibus_transaction * volatile head;	/* Running */
+	struct spibus_transaction *tail;
+	bool running;
+	u32 error;				/* DMA error count */
+};
+
+/*
+ * spibus_init() sets up the SPI for no device. Set the chip select pins
+ * high as outputs, enable both DMA channel interrupts in NVIC and call
+ * spibus_isr() in their handlers.
+ *
+ * spibus_submit() queues a transaction, and starts it if the bus is idle.
+ * It may be called in an interrupt handler (including 'done') that does
+ * not preempt spibus_isr(), or in the main program. spibus_busy()
+ * returns true while transactions remain.
+ */
+void spibus_init(struct spibus *bus);
+void spibus_isr(struct spibus *bus);
+void spibus_submit(struct spibus *bus, struct spibus_transaction *t);
+bool spibus_busy(struct spibus *bus);
@@ -0,0 +1,87 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SPI block transfer by DMA
+ *
+ * A block is sent and received by a pair of DMA channels: tx-only (the
+ * received data is discarded), rx-only (the 'fill' data is sent), or
+ * full-duplex. The Rx channel runs in every transfer, so the transfer is
+ * complete when the last frame has been received, and no overrun occurs.
+ * The SPI can run at the full PCLK / 2 rate without the CPU.
+ *
+ * Include spi.h and dma.h before this file.
+ */
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * SPI DMA
+ *
+ * spi:		SPI (master, set up and enabled by spi_set_mode())
+ * dr:		SPI data register address
+ * dma_rx:	SPI Rx DMA channel
+ * dma_tx:	SPI Tx DMA channel
+ * wide:	16-bit data frame (SPI_16BIT)
+ * fill:	Data sent in rx-only transfers
+ *
+ * The other members are private.
+ */
+struct spidma {
+	spi_t spi;
+	u32 dr;
+	dma_channel_t dma_rx;
+	dma_channel_t dma_tx;
+	bool wide;
+	u16 fill;
+
+	const struct dma_channel_desc *desc_rx;
+	const struct dma_channel_desc *desc_tx;
+	volatile bool busy;
+	u16 discard;			/* Rx data of tx-only transfers */
+	void (*done)(void *arg);
+	void *arg;
+	volatile u32 error;
+};
+
+/*
+ * spidma_init() resets the state. Enable both DMA channel interrupts in
+ * NVIC and call spidma_isr() in their handlers (the Tx channel interrupts
+ * only on a transfer error).
+ *
+ * spidma_transfer() starts the transfer of 'len' frames (bytes, or
+ * halfwords if 'wide') from 'tx' and/or into 'rx'. 'tx' or 'rx' may be
+ * NULL for rx-only or tx-only. It returns 0, or -1 if busy. 'done' (may
+ * be NULL) is called with 'arg' in the interrupt handler when completed.
+ * The chip select is controlled by the caller.
+ *
+ * spidma_transfer_wait() transfers a block and waits for the completion
+ * (not in an interrupt handler). It returns 0, or -1 on a DMA error.
+ *
+ * spidma_busy() returns true during a transfer. spidma_get_error()
+ * returns the number of DMA transfer errors.
+ */
+void spidma_init(struct spidma *s);
+void spidma_isr(struct spidma *s);
+int spidma_transfer(struct spidma *s, const void *tx, void *rx, int len,
+		    void (*done)(void *arg), void *arg);
+int spidma_transfer_wait(struct spidma *s, const void *tx, void *rx,
+			 int len);
+bool spidma_busy(struct spidma *s);
+u32 spidma_get_error(struct spidma *s);
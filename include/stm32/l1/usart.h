@@ -243,6 +243,30 @@ enum {
 	USART_ERROR = (1 << 10)
 };
 
+/*
+ * Baud rate
+ *
+ * baud:	Achieved baud rate
+ * error:	Error of the baud rate (ppm)
+ * over8:	Oversampling by 8 (baud rate above clock / 16)
+ * brr:		USART_BRR value
+ */
+struct usart_baudrate {
+	int baud;
+	int error;
+	bool over8;
+	u16 brr;
+};
+
+/*
+ * usart_calc_baudrate() returns -1 if the baud rate is out of range
+ * (clock / 65535 - clock / 8). usart_set_baudrate_tolerance() returns -1
+ * and leaves the USART unchanged if the error exceeds 'tolerance' (ppm).
+ * 'br' may be NULL. Set the baud rate while the USART is disabled.
+ */
+int usart_calc_baudrate(int clock, int baud, struct usart_baudrate *br);
+int usart_set_baudrate_tolerance(usart_t usart, int clock, int baud,
+				 int tolerance, struct usart_baudrate *br);
 void usart_set_baudrate(usart_t usart, int clock, int baud);
 void usart_set_databits(usart_t usart, int bits);
 void usart_set_stopbits(usart_t usart, usart_stop_t stopbits);
@@ -256,6 +280,7 @@ void usart_enable(usart_t usart);
 void usart_disable(usart_t usart);
 void usart_send(usart_t usart, u16 data);
 u16 usart_recv(usart_t usart);
+void usart_send_break(usart_t usart);
 void usart_wait_send_ready(usart_t usart);
 void usart_wait_recv_ready(usart_t usart);
 void usart_send_blocking(usart_t usart, u16 data);
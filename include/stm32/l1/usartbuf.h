@@ -0,0 +1,91 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Interrupt-driven buffered USART
+ *
+ * Received data is written into 'rx_ring' by the RXNE interrupt, and
+ * 'tx_ring' is sent by the TXE interrupt. Any of USART1-3 and UART4/5
+ * can be used, one struct usartbuf for each.
+ *
+ * Include usart.h before this file.
+ */
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * Buffered USART
+ *
+ * usart:	USART
+ * rx_ring:	Rx ring buffer
+ * rx_size:	Rx ring buffer size (holds rx_size - 1 bytes)
+ * tx_ring:	Tx ring buffer
+ * tx_size:	Tx ring buffer size (holds tx_size - 1 bytes)
+ *
+ * The other members are private.
+ */
+struct usartbuf {
+	usart_t usart;
+	u8 *rx_ring;
+	int rx_size;
+	u8 *tx_ring;
+	int tx_size;
+
+	volatile int rx_head;		/* Read position */
+	volatile int rx_tail;		/* Write position (interrupt) */
+	volatile int tx_head;		/* Read position (interrupt) */
+	volatile int tx_tail;		/* Write position */
+
+	/* Error counts */
+	volatile u32 ore;
+	volatile u32 fe;
+	volatile u32 nf;
+	volatile u32 pe;
+	volatile u32 overflow;		/* Rx ring buffer full */
+};
+
+/*
+ * usartbuf_init() enables the RXNE interrupt. Set up the USART
+ * (usart_init()) and enable its interrupt in NVIC, and call usartbuf_isr()
+ * in the interrupt handler.
+ *
+ * usartbuf_write() and usartbuf_read() do not block, and return the number
+ * of bytes queued or read (may be 0).
+ *
+ * usartbuf_tx_reserve() returns the free space of the Tx ring buffer and
+ * its start position in 'pos', so that the data (e.g. a frame encoded by
+ * cobs.h or slip.h) can be written into 'tx_ring' directly.
+ * usartbuf_tx_commit() queues 'len' bytes written there.
+ *
+ * usartbuf_get_error() returns the number of errors of 'error' (USART_ORE,
+ * USART_FE, USART_NF and/or USART_PE). Bytes with FE, NF or PE are still
+ * put into the Rx ring buffer. usartbuf_get_overflow() returns the number
+ * of bytes lost because the Rx ring buffer was full.
+ */
+void usartbuf_init(struct usartbuf *u);
+void usartbuf_isr(struct usartbuf *u);
+int usartbuf_write(struct usartbuf *u, const void *buf, int len);
+int usartbuf_read(struct usartbuf *u, void *buf, int len);
+int usartbuf_tx_reserve(struct usartbuf *u, int *pos);
+void usartbuf_tx_commit(struct usartbuf *u, int len);
+int usartbuf_get_rx_count(struct usartbuf *u);
+int usartbuf_get_tx_free(struct usartbuf *u);
+bool usartbuf_tx_empty(struct usartbuf *u);
+u32 usartbuf_get_error(struct usartbuf *u, int error);
+u32 usartbuf_get_overflow(struct usartbuf *u);
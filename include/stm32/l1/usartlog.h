@@ -0,0 +1,79 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Non-blocking USART output by DMA (printf backend)
+ *
+ * The data is copied into 'ring', and sent by USART Tx DMA, one transfer
+ * after another up to the end of the ring buffer. This file provides
+ * _write() for stdout and stderr, so do not define it in the application
+ * when usartlog_init() is used.
+ *
+ * Include usart.h and dma.h before this file.
+ */
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/* Policy when the ring buffer is full */
+typedef enum {
+	USARTLOG_DROP,		/* Drop the data that does not fit. */
+	USARTLOG_BLOCK		/* Wait for space (not in an interrupt). */
+} usartlog_policy_t;
+
+/*
+ * USART log
+ *
+ * usart:	USART
+ * dr:		USART data register address
+ * dma:		USART Tx DMA channel
+ * ring:	Ring buffer
+ * size:	Ring buffer size (holds size - 1 bytes)
+ * policy:	USARTLOG_DROP or USARTLOG_BLOCK
+ *
+ * The other members are private.
+ */
+struct usartlog {
+	usart_t usart;
+	u32 dr;
+	dma_channel_t dma;
+	u8 *ring;
+	int size;
+	usartlog_policy_t policy;
+
+	volatile int head;		/* DMA read position */
+	volatile int tail;		/* Write position */
+	volatile int dma_len;		/* Length of the current DMA transfer */
+	volatile u32 dropped;		/* Bytes dropped */
+};
+
+/*
+ * usartlog_init() enables the USART Tx DMA, and makes 'log' the output of
+ * _write(). Set up the USART (usart_init()) before, enable the DMA channel
+ * interrupt in NVIC, and call usartlog_dma_isr() in the interrupt handler.
+ *
+ * usartlog_write() returns the number of bytes queued. It is not
+ * reentrant: do not call it (or printf()) from an interrupt handler that
+ * may preempt another call, even with USARTLOG_DROP.
+ * usartlog_flush() waits until all data is sent.
+ */
+void usartlog_init(struct usartlog *log);
+int usartlog_write(struct usartlog *log, const void *buf, int len);
+void usartlog_dma_isr(struct usartlog *log);
+void usartlog_flush(struct usartlog *log);
+u32 usartlog_get_dropped(struct usartlog *log);
@@ -0,0 +1,76 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * USART DMA receiver with idle line detection
+ *
+ * USART Rx data is written into 'ring' by DMA in circular mode. The data
+ * received so far is passed to the application on the IDLE interrupt (end
+ * of a frame) and on the DMA half transfer and transfer complete
+ * interrupts (long frames), so there is no interrupt per byte.
+ *
+ * Include usart.h and dma.h before this file.
+ */
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * USART DMA receiver
+ *
+ * usart:	USART
+ * dr:		USART data register address
+ * dma:		USART Rx DMA channel
+ * ring:	Rx ring buffer
+ * size:	Rx ring buffer size
+ * receive:	Called with the new data. 'end' is true at the idle line
+ *		(the last call for a frame, 'len' may be 0). Data across the
+ *		end of the ring buffer is passed by two calls.
+ *
+ * The other members are private.
+ */
+struct usartrx {
+	usart_t usart;
+	u32 dr;
+	dma_channel_t dma;
+	u8 *ring;
+	int size;
+	void (*receive)(struct usartrx *r, const u8 *data, int len, bool end);
+
+	const struct dma_channel_desc *desc;
+	int head;			/* Read position */
+	bool in_frame;			/* Passed without 'end' */
+	volatile u32 ore;
+	volatile u32 fe;
+	volatile u32 nf;
+};
+
+/*
+ * usartrx_init() starts the DMA and enables the IDLE and error interrupts
+ * of the USART. Set up the USART (usart_init()) before, and enable both
+ * interrupts in NVIC. Call usartrx_usart_isr() in the USART interrupt
+ * handler, and usartrx_dma_isr() in the DMA channel interrupt handler.
+ * They must not preempt each other.
+ *
+ * usartrx_get_error() returns the number of errors of 'error' (USART_ORE,
+ * USART_FE and/or USART_NF).
+ */
+void usartrx_init(struct usartrx *r);
+void usartrx_usart_isr(struct usartrx *r);
+void usartrx_dma_isr(struct usartrx *r);
+u32 usartrx_get_error(struct usartrx *r, int error);
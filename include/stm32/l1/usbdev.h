@@ -0,0 +1,145 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3.h>
+
+/*
+ * USB device core
+ *
+ * Control transfer (endpoint 0) and standard device requests on top of
+ * usbdevfs. Class and vendor requests are passed to the application.
+ *
+ * Universal Serial Bus Specification Revision 2.0
+ * 9 USB Device Framework
+ */
+
+/* --- Definitions --------------------------------------------------------- */
+
+/* Maximum number of interfaces */
+#define USBDEV_INTERFACE_MAX		8
+
+/* IN data buffer size (bytes) */
+#define USBDEV_IN_BUFFER_SIZE		128
+
+/* Control transfer stages */
+typedef enum {
+	USBDEV_STAGE_SETUP,
+	USBDEV_STAGE_STATUS
+} usbdev_stage_t;
+
+/* Return value of 'request' and 'check_data' to hold the transfer */
+#define USBDEV_WAIT			(-2)
+
+struct usb_setup_data;
+struct usb_device_descriptor;
+struct usb_config_descriptor;
+
+/*
+ * Strings of a language
+ *
+ * langid:	Language ID
+ * string:	NUL-terminated UNICODE strings (index 1 - num_string)
+ */
+struct usbdev_language {
+	u16 langid;
+	const u16 * const *string;
+};
+
+/*
+ * USB device
+ *
+ * device:	Device descriptor
+ * config:	Configuration descriptor (followed by the interface,
+ *		endpoint and class-specific descriptors, wTotalLength bytes)
+ * langid:	Language ID of the strings
+ * num_string:	Number of strings (string index 1 - num_string)
+ * string:	NUL-terminated UNICODE strings
+ * string_desc:	String descriptors (index 0 - num_string), sent as they
+ *		are. Used instead of 'string' if not NULL. See usb/descriptor.h.
+ * num_language: Number of languages in 'language'
+ * language:	Strings of several languages. Used instead of 'langid' and
+ *		'string' if not NULL.
+ * dbl_buf:	Bulk endpoints to be double-buffered (1 << ep_id)
+ * buf:		OUT data buffer
+ * bufsize:	OUT data buffer size
+ *
+ * request:	Class, vendor and other (unsupported) standard requests.
+ *		Called with USBDEV_STAGE_SETUP for every request, return -1
+ *		to stall. For an IN request, put the data into 'buf'
+ *		(USBDEV_IN_BUFFER_SIZE bytes) or elsewhere, set '*data' and
+ *		return the length. For an OUT request, return 0, and it is
+ *		called again with USBDEV_STAGE_STATUS and the data in 'buf'.
+ *		Return USBDEV_WAIT at USBDEV_STAGE_SETUP to hold the request
+ *		(NAK) until usbdev_control_resume(), which calls it again.
+ * check_data:	Called with the OUT data before the status stage. Return 0,
+ *		-1 to stall, or USBDEV_WAIT to hold the status stage until
+ *		usbdev_control_resume(), which calls it again.
+ * set_configuration: Called on SET_CONFIGURATION.
+ * set_interface: Called on SET_INTERFACE.
+ * reset:	Called on USB RESET.
+ *
+ * Each endpoint in the configuration must have its own endpoint register,
+ * ep_id = (bEndpointAddress & 0xf). Callbacks may be NULL.
+ */
+struct usbdev_device {
+	const struct usb_device_descriptor *device;
+	const struct usb_config_descriptor *config;
+	u16 langid;
+	int num_string;
+	const u16 * const *string;
+	const void * const *string_desc;
+	int num_language;
+	const struct usbdev_language *language;
+	u8 dbl_buf;
+	u8 *buf;
+	int bufsize;
+
+	int (*request)(struct usb_setup_data *req, usbdev_stage_t stage,
+		       u8 *buf, u8 **data);
+	int (*check_data)(struct usb_setup_data *req, u8 *buf);
+	void (*set_configuration)(int value);
+	void (*set_interface)(int interface, int altsetting);
+	void (*reset)(void);
+};
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * usbdev_init() assigns the packet memory to the endpoints, and returns the
+ * unused packet memory size or -1. Call it after the USB is powered up.
+ * Call usbdev_reset() on USB RESET, usbdev_control_setup/rx/tx() on CTR of
+ * endpoint 0.
+ *
+ * usbdev_control_resume() continues the transfer held by USBDEV_WAIT. It
+ * does nothing if no transfer is held (e.g. the host sent a new SETUP).
+ * It must not preempt the functions above.
+ */
+int usbdev_init(const struct usbdev_device *dev);
+void usbdev_reset(void);
+void usbdev_control_setup(void);
+void usbdev_control_rx(void);
+void usbdev_control_tx(void);
+void usbdev_control_resume(void);
+
+int usbdev_get_state(void);
+int usbdev_get_configuration(void);
+int usbdev_get_interface(int interface);
+bool usbdev_get_endpoint_halt(u8 address);
+void usbdev_set_endpoint_halt(u8 address);
+bool usbdev_get_remote_wakeup(void);
@@ -299,6 +299,12 @@
 /* Buffer descriptor table */
 #define USBDEVFS_BUFFER_TABLE_SIZE	(2 * 4 * USBDEVFS_EP_MAX)
 
+/* Packet buffer memory size (bytes) */
+#define USBDEVFS_PACKET_MEMORY_SIZE	512
+
+/* Endpoint direction (bit 7 of the endpoint address) */
+#define USBDEVFS_ADDRESS_IN		(1 << 7)
+
 /* Alias */
 #define usbdevfs_enable_interrupt usbdevfs_enable_function
 #define usbdevfs_disable_interrupt usbdevfs_disable_function
@@ -365,6 +371,30 @@ typedef enum {
 	USBDEVFS_INTERRUPT = 6
 } usbdevfs_endpoint_t;
 
+/*
+ * Packet memory allocation
+ *
+ * ep_id:	Endpoint register number (0 - 7)
+ * type:	Endpoint type (USBDEVFS_ISOCHRONOUS and USBDEVFS_BULK_DBL_BUF
+ *		use two buffers)
+ * address:	Endpoint address (USBDEVFS_ADDRESS_IN: IN, otherwise OUT.
+ *		USBDEVFS_CONTROL uses both.)
+ * size:	Maximum packet size
+ *
+ * Use one entry for each direction of a single-buffered endpoint.
+ * The buffer table is placed at offset 0 and the buffers follow it in the
+ * order of the table. usbdevfs_allocate_packet_memory() returns the unused
+ * packet memory size, or -1 if the endpoints do not fit (nothing is
+ * changed). It may be called again with another table on
+ * SET_CONFIGURATION or SET_INTERFACE, when no transfer is in progress.
+ */
+struct usbdevfs_packet_memory {
+	int ep_id;
+	usbdevfs_endpoint_t type;
+	u8 address;
+	int size;
+};
+
 void usbdevfs_enable_function(int function);
 void usbdevfs_disable_function(int function);
 int usbdevfs_get_function(int function);
@@ -379,6 +409,8 @@ int usbdevfs_assign_packet_memory_tx(int ep_id, int offset, int size);
 int usbdevfs_assign_packet_memory_tx1(int ep_id, int offset, int size);
 int usbdevfs_assign_packet_memory_rx(int ep_id, int offset, int size);
 int usbdevfs_assign_packet_memory_rx0(int ep_id, int offset, int size);
+int usbdevfs_allocate_packet_memory(const struct usbdevfs_packet_memory *pm,
+				    int n);
 void usbdevfs_setup_endpoint(int ep_id, usbdevfs_endpoint_t type, u8 address);
 int usbdevfs_get_ep_status(int ep_id, int status);
 void usbdevfs_set_ep_bit(int ep_id, int setbit, int resetbit);
@@ -386,6 +418,10 @@ int usbdevfs_write(int ep_id, u16 *buf, int len);
 int usbdevfs_write1(int ep_id, u16 *buf, int len);
 int usbdevfs_read(int ep_id, u16 *buf, int buflen);
 int usbdevfs_read0(int ep_id, u16 *buf, int buflen);
+/* Copy a packet from/to a ring buffer of 'size' bytes, starting at 'start'. */
+int usbdevfs_write_ring(int ep_id, const u8 *ring, int size, int start,
+			int len);
+int usbdevfs_read_ring(int ep_id, u8 *ring, int size, int start, int buflen);
 
 void usbdevfs_set_control_state(int ep_id, usbdevfs_control_state_t state);
 
@@ -399,3 +435,100 @@ void usbdevfs_halt_endpoint_rx(int ep_id);
 void usbdevfs_clear_endpoint_interrupt(int ep_id);
 void usbdevfs_reset_endpoint_data_toggle(int ep_id);
 
+
+/*
+ * Double-buffered bulk endpoint
+ *
+ * usbdevfs_write_dbl_buf() returns -1 if both buffers are in use.
+ * usbdevfs_read_dbl_buf() returns -1 if no packet has been received.
+ * Call usbdevfs_complete_dbl_buf_tx/rx() on CTR_TX/CTR_RX.
+ * These functions must not be preempted by the USB interrupt.
+ */
+int usbdevfs_assign_dbl_buf_packet_memory_tx(int ep_id, int offset, int size);
+int usbdevfs_assign_dbl_buf_packet_memory_rx(int ep_id, int offset, int size);
+void usbdevfs_enable_dbl_buf_endpoint_tx(int ep_id);
+void usbdevfs_enable_dbl_buf_endpoint_rx(int ep_id);
+int usbdevfs_write_dbl_buf(int ep_id, u16 *buf, int len);
+int usbdevfs_read_dbl_buf(int ep_id, u16 *buf, int buflen);
+void usbdevfs_complete_dbl_buf_tx(int ep_id);
+void usbdevfs_complete_dbl_buf_rx(int ep_id);
+int usbdevfs_get_dbl_buf_tx_free(int ep_id);
+int usbdevfs_get_dbl_buf_rx_count(int ep_id);
+
+/*
+ * Endpoint callback dispatch
+ *
+ * ep_id:	Endpoint register number (0 - 7)
+ * setup:	Called on CTR_RX of a SETUP transaction
+ * rx:		Called on CTR_RX (OUT transaction)
+ * tx:		Called on CTR_TX (IN transaction)
+ *
+ * The callbacks are called before the interrupt is cleared, and must clear
+ * it. If a callback is NULL, the CTR bit of its direction is cleared and
+ * ignored; the other direction is left to its callback.
+ * Call usbdevfs_dispatch() in usb_lp_isr() on USBDEVFS_CORRECT_TRANSFER,
+ * and usbdevfs_dispatch_hp() in usb_hp_isr(). All pending transfers are
+ * handled in one pass, USBDEVFS_EP_MAX at most. Isochronous and
+ * double-buffered bulk endpoints are left to usbdevfs_dispatch_hp().
+ */
+struct usbdevfs_callback {
+	int ep_id;
+	void (*setup)(void);
+	void (*rx)(void);
+	void (*tx)(void);
+};
+
+void usbdevfs_set_callback(const struct usbdevfs_callback *cb, int n);
+void usbdevfs_dispatch(void);
+void usbdevfs_dispatch_hp(void);
+
+/*
+ * Event trace
+ *
+ * Compiled in only when USBDEVFS_TRACE is defined ('make USBDEVFS_TRACE=1'
+ * for the library, and -DUSBDEVFS_TRACE for the application).
+ * Events are recorded by usbdevfs_clear_interrupt() (reset, suspend,
+ * wakeup, error, overrun), usbdevfs_read() (SETUP), usbdevfs_dispatch()
+ * and usbdevfs_dispatch_hp() (CTR, before any callback runs) and stall,
+ * with USB_FNR and the DWT cycle counter.
+ * The oldest events are overwritten.
+ *
+ * usbdevfs_trace_init() enables the cycle counter and clears the buffer.
+ * usbdevfs_trace_read() copies up to 'n' events, oldest first, and returns
+ * the number of events. It must not preempt the USB interrupt handlers.
+ * usbdevfs_trace_lost() returns the number of overwritten events.
+ */
+
+/* Number of events (power of 2) */
+#define USBDEVFS_TRACE_SIZE		64
+
+/* Event */
+typedef enum {
+	USBDEVFS_TRACE_RESET,		/* data0: USB_ISTR */
+	USBDEVFS_TRACE_SUSPEND,
+	USBDEVFS_TRACE_WAKEUP,
+	USBDEVFS_TRACE_ERROR,
+	USBDEVFS_TRACE_OVERRUN,
+	USBDEVFS_TRACE_SETUP,		/* data0/1: SETUP data (8 bytes) */
+	USBDEVFS_TRACE_CTR_RX,		/* data0: USB_EPR, data1: COUNT_RX */
+	USBDEVFS_TRACE_CTR_TX,		/* data0: USB_EPR */
+	USBDEVFS_TRACE_STALL		/* data0: USB_EPR */
+} usbdevfs_trace_event_t;
+
+struct usbdevfs_trace {
+	u32 cycle;			/* DWT_CYCCNT */
+	u16 frame;			/* USB_FNR */
+	u8 event;
+	u8 ep_id;
+	u32 data0;
+	u32 data1;
+};
+
+#ifdef USBDEVFS_TRACE
+void usbdevfs_trace_init(void);
+void usbdevfs_trace(int event, int ep_id, u32 data0, u32 data1);
+int usbdevfs_trace_read(struct usbdevfs_trace *buf, int n);
+u32 usbdevfs_trace_lost(void);
+#else
+#define usbdevfs_trace(event, ep_id, data0, data1) do { } while (0)
+#endif
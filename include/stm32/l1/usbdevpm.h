@@ -0,0 +1,72 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3.h>
+
+/*
+ * USB device suspend and resume
+ *
+ * On SUSPEND, the clock configuration (SYSCLK source, HSE/HSI/PLL, VCORE
+ * and flash access) is saved, SYSCLK is switched to MSI, and the next WFI
+ * enters Stop mode. Resume (EXTI18, USB wakeup) restores the clocks before
+ * the USB leaves the low-power mode. Restoring the HSE/PLL tree takes
+ * the HSE startup time (a few ms at most), within the 10 ms resume
+ * recovery time.
+ *
+ * Universal Serial Bus Specification Revision 2.0
+ * 7.1.7.7 Resume
+ */
+
+/* Resume signalling for remote wakeup (ESOF count, 1 ESOF = 1 ms) */
+#define USBDEVPM_RESUME_ESOF		3
+
+/* --- Function prototypes ------------------------------------------------- */
+
+/*
+ * USB device power management
+ *
+ * suspend:	Called on SUSPEND before the clocks are slowed down. Turn off
+ *		the LEDs and the peripherals to meet the suspend current.
+ * resume:	Called after the clocks are restored.
+ *
+ * Callbacks may be NULL.
+ */
+struct usbdevpm {
+	void (*suspend)(void);
+	void (*resume)(void);
+};
+
+/*
+ * usbdevpm_init() enables EXTI18 (rising edge) and the USB FS wakeup
+ * interrupt. Enable the SUSPEND and WAKEUP interrupts of the USB.
+ * Call usbdevpm_suspend() on SUSPEND, usbdevpm_wakeup() on WAKEUP and in
+ * usb_fs_wkup_isr(), and usbdevpm_esof() on ESOF. The ESOF interrupt is
+ * managed internally: usbdevpm_remote_wakeup() enables it, and
+ * usbdevpm_esof() disables it at the end of the resume signalling.
+ * usbdevpm_remote_wakeup() signals resume to the host if the host enabled
+ * remote wakeup, and returns -1 otherwise. Call it from an interrupt
+ * handler that can wake the MCU from Stop mode (EXTI). These functions
+ * must not preempt each other.
+ */
+void usbdevpm_init(const struct usbdevpm *pm);
+void usbdevpm_suspend(void);
+void usbdevpm_wakeup(void);
+void usbdevpm_esof(void);
+int usbdevpm_remote_wakeup(void);
+bool usbdevpm_is_suspended(void);
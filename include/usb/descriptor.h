@@ -0,0 +1,104 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3.h>
+
+/*
+ * Compile-time descriptor builder
+ *
+ * The descriptors are built by the compiler as const data (in flash) and
+ * are sent as they are. bLength, bDescriptorType and wTotalLength are
+ * filled in from the types. Number interfaces and strings with an enum,
+ * whose last member gives bNumInterfaces or the number of string
+ * descriptors (including string descriptor zero):
+ *
+ *	enum { INTERFACE_COMM, INTERFACE_DATA, NUM_INTERFACE };
+ *	enum { STRING_LANGID, STRING_MANUFACTURER, STRING_PRODUCT,
+ *	       NUM_STRING_DESC };
+ *
+ * Include usb/standard.h before this file.
+ */
+
+/* Standard descriptor initializers */
+#define USB_DEVICE_DESCRIPTOR_INIT(...)				\
+	{								\
+		.bLength = sizeof(struct usb_device_descriptor),	\
+		.bDescriptorType = USB_DT_DEVICE,			\
+		__VA_ARGS__						\
+	}
+
+/* 'type' is the whole configuration (wTotalLength). */
+#define USB_CONFIG_DESCRIPTOR_INIT(type, ...)				\
+	{								\
+		.bLength = sizeof(struct usb_config_descriptor),	\
+		.bDescriptorType = USB_DT_CONFIGURATION,		\
+		.wTotalLength = sizeof(type),				\
+		__VA_ARGS__						\
+	}
+
+#define USB_INTERFACE_DESCRIPTOR_INIT(...)				\
+	{								\
+		.bLength = sizeof(struct usb_interface_descriptor),	\
+		.bDescriptorType = USB_DT_INTERFACE,			\
+		__VA_ARGS__						\
+	}
+
+#define USB_ENDPOINT_DESCRIPTOR_INIT(...)				\
+	{								\
+		.bLength = sizeof(struct usb_endpoint_descriptor),	\
+		.bDescriptorType = USB_DT_ENDPOINT,			\
+		__VA_ARGS__						\
+	}
+
+#define USB_IFACE_ASSOC_DESCRIPTOR_INIT(...)				\
+	{								\
+		.bLength = sizeof(struct usb_iface_assoc_descriptor),	\
+		.bDescriptorType = USB_DT_INTERFACE_ASSOCIATION,	\
+		__VA_ARGS__						\
+	}
+
+/*
+ * String descriptor from a UNICODE string literal (L"...", -fshort-wchar)
+ *
+ * static USB_DEFINE_STRING_DESCRIPTOR(product, L"USB Serial");
+ * defines 'const struct {...} product'. The terminating NUL is not
+ * included.
+ */
+#define USB_DEFINE_STRING_DESCRIPTOR(name, s)				\
+	const struct {							\
+		u8 bLength;						\
+		u8 bDescriptorType;					\
+		u16 wData[sizeof(s) / sizeof(u16) - 1];			\
+	} __attribute__ ((packed, aligned(2))) name = {			\
+		.bLength = sizeof(s),					\
+		.bDescriptorType = USB_DT_STRING,			\
+		.wData = s,						\
+	}
+
+/* String descriptor zero (one LANGID) */
+#define USB_DEFINE_LANGID_DESCRIPTOR(name, langid)			\
+	const struct {							\
+		u8 bLength;						\
+		u8 bDescriptorType;					\
+		u16 wLANGID[1];						\
+	} __attribute__ ((packed, aligned(2))) name = {			\
+		.bLength = 4,						\
+		.bDescriptorType = USB_DT_STRING,			\
+		.wLANGID = {langid},					\
+	}
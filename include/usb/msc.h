@@ -0,0 +1,167 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3.h>
+
+/*
+ * Universal Serial Bus Mass Storage Class
+ * Specification Overview Revision 1.4
+ * Bulk-Only Transport Revision 1.0
+ *
+ * SCSI Primary Commands (SPC-2), SCSI Block Commands (SBC-2)
+ */
+
+/* --- Class codes --------------------------------------------------------- */
+
+#define USB_CLASS_MSC			0x08
+
+/* Subclass codes */
+#define USB_MSC_SUBCLASS_RBC		0x01
+#define USB_MSC_SUBCLASS_MMC5		0x02
+#define USB_MSC_SUBCLASS_UFI		0x04
+#define USB_MSC_SUBCLASS_SCSI		0x06
+#define USB_MSC_SUBCLASS_LSDFS		0x07
+#define USB_MSC_SUBCLASS_IEEE1667	0x08
+
+/* Protocol codes */
+#define USB_MSC_PROTO_CBI_INT		0x00
+#define USB_MSC_PROTO_CBI		0x01
+#define USB_MSC_PROTO_BBB		0x50
+#define USB_MSC_PROTO_UAS		0x62
+
+/* --- Class-specific requests --------------------------------------------- */
+
+#define USB_MSC_REQ_GET_MAX_LUN		0xfe
+#define USB_MSC_REQ_BOMSR		0xff	/* Bulk-Only Mass Storage Reset */
+
+/* --- Bulk-Only Transport ------------------------------------------------- */
+
+/* Command Block Wrapper */
+#define USB_MSC_CBW_SIGNATURE		0x43425355
+#define USB_MSC_CBW_FLAGS_IN		(1 << 7)
+
+struct usb_msc_cbw {
+	u32 dCBWSignature;
+	u32 dCBWTag;
+	u32 dCBWDataTransferLength;
+	u8 bmCBWFlags;
+	u8 bCBWLUN;
+	u8 bCBWCBLength;
+	u8 CBWCB[16];
+} __attribute__ ((packed));
+
+/* Command Status Wrapper */
+#define USB_MSC_CSW_SIGNATURE		0x53425355
+
+#define USB_MSC_CSW_STATUS_PASSED	0x00
+#define USB_MSC_CSW_STATUS_FAILED	0x01
+#define USB_MSC_CSW_STATUS_PHASE_ERROR	0x02
+
+struct usb_msc_csw {
+	u32 dCSWSignature;
+	u32 dCSWTag;
+	u32 dCSWDataResidue;
+	u8 bCSWStatus;
+} __attribute__ ((packed));
+
+/* --- SCSI commands ------------------------------------------------------- */
+
+#define SCSI_TEST_UNIT_READY		0x00
+#define SCSI_REQUEST_SENSE		0x03
+#define SCSI_FORMAT_UNIT		0x04
+#define SCSI_INQUIRY			0x12
+#define SCSI_MODE_SELECT_6		0x15
+#define SCSI_MODE_SENSE_6		0x1a
+#define SCSI_START_STOP_UNIT		0x1b
+#define SCSI_SEND_DIAGNOSTIC		0x1d
+#define SCSI_PREVENT_ALLOW_MEDIUM_REMOVAL 0x1e
+#define SCSI_READ_FORMAT_CAPACITIES	0x23
+#define SCSI_READ_CAPACITY_10		0x25
+#define SCSI_READ_10			0x28
+#define SCSI_WRITE_10			0x2a
+#define SCSI_VERIFY_10			0x2f
+#define SCSI_SYNCHRONIZE_CACHE_10	0x35
+#define SCSI_MODE_SELECT_10		0x55
+#define SCSI_MODE_SENSE_10		0x5a
+
+/* Sense keys */
+#define SCSI_SENSE_NO_SENSE		0x00
+#define SCSI_SENSE_RECOVERED_ERROR	0x01
+#define SCSI_SENSE_NOT_READY		0x02
+#define SCSI_SENSE_MEDIUM_ERROR		0x03
+#define SCSI_SENSE_HARDWARE_ERROR	0x04
+#define SCSI_SENSE_ILLEGAL_REQUEST	0x05
+#define SCSI_SENSE_UNIT_ATTENTION	0x06
+#define SCSI_SENSE_DATA_PROTECT		0x07
+
+/* Additional sense codes (ASC << 8 | ASCQ) */
+#define SCSI_ASC_NONE				0x0000
+#define SCSI_ASC_WRITE_FAULT			0x0300
+#define SCSI_ASC_UNRECOVERED_READ_ERROR		0x1100
+#define SCSI_ASC_INVALID_COMMAND_OPERATION_CODE	0x2000
+#define SCSI_ASC_LBA_OUT_OF_RANGE		0x2100
+#define SCSI_ASC_INVALID_FIELD_IN_CDB		0x2400
+#define SCSI_ASC_WRITE_PROTECTED		0x2700
+#define SCSI_ASC_MEDIUM_NOT_PRESENT		0x3a00
+
+/* Peripheral device type */
+#define SCSI_TYPE_DISK			0x00
+
+/* Standard INQUIRY data */
+struct scsi_inquiry_data {
+	u8 peripheral;
+	u8 rmb;			/* Removable (bit 7) */
+	u8 version;
+	u8 response_data_format;
+	u8 additional_length;
+	u8 flags[3];
+	u8 vendor_id[8];
+	u8 product_id[16];
+	u8 product_revision[4];
+} __attribute__ ((packed));
+
+/* Fixed format sense data */
+#define SCSI_SENSE_RESPONSE_CURRENT	0x70
+
+struct scsi_sense_data {
+	u8 response_code;
+	u8 obsolete;
+	u8 sense_key;
+	u8 information[4];
+	u8 additional_length;
+	u8 command_specific[4];
+	u8 asc;
+	u8 ascq;
+	u8 fruc;
+	u8 sense_key_specific[3];
+} __attribute__ ((packed));
+
+/*
+ * SCSI multi-byte fields are big endian. Use these with a byte pointer
+ * into the CDB or the data.
+ */
+#define SCSI_GET_BE16(p)	(((p)[0] << 8) | (p)[1])
+#define SCSI_GET_BE32(p)	(((u32)(p)[0] << 24) | ((p)[1] << 16) | \
+				 ((p)[2] << 8) | (p)[3])
+#define SCSI_PUT_BE32(p, v)	do {					\
+		(p)[0] = (u8)((v) >> 24);				\
+		(p)[1] = (u8)((v) >> 16);				\
+		(p)[2] = (u8)((v) >> 8);				\
+		(p)[3] = (u8)(v);					\
+	} while (0)
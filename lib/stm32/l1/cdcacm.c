@@ -0,0 +1,480 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/usart.h>
+#include <stm32/l1/dma.h>
+#include <stm32/l1/usbdevfs.h>
+#include <stm32/l1/usbdev.h>
+
+#include <usb/standard.h>
+#include <usb/cdc.h>
+
+#include <stm32/l1/cdcacm.h>
+
+/* CDC-ACM port */
+static const struct cdcacm_port *port;
+
+/* Line coding (default: 115200 bps, 8N1) */
+static struct usb_cdc_line_coding line_coding = {
+	.dwDTERate = 115200,
+	.bCharFormat = USB_CDC_LINE_CODING_CHARFORMAT_1_STOP_BIT,
+	.bParityType = USB_CDC_LINE_CODING_PARITYTYPE_NONE,
+	.bDataBits = 8,
+};
+
+/* Control Line State */
+static int control_line_state;
+
+static bool configured;
+
+/* USART Rx -> IN endpoint */
+static int rx_head;		/* Read position of the Rx ring buffer */
+static u32 rx_read;		/* Bytes read */
+static u32 rx_written;		/* Bytes written until the last HT/TC */
+static int rx_boundary;		/* Position of the last HT/TC */
+static u32 rx_overrun;
+static bool in_busy;
+static bool in_full;		/* The last packet was max packet size. */
+
+/* OUT endpoint -> USART Tx */
+static int tx_head;		/* DMA read position */
+static int tx_tail;		/* Write position */
+static int tx_dma_len;		/* Length of the current DMA transfer */
+static bool out_pending;	/* OUT packet is not read (NAK). */
+
+/* Notification */
+static bool notification_busy;
+static u16 serial_state;	/* The last state from the application */
+static bool overrun_pending;	/* bOverRun is not notified yet. */
+
+/* --- USART --------------------------------------------------------------- */
+
+static void set_line_coding(void)
+{
+	usart_parity_t parity;
+	usart_stop_t stop;
+	int bits;
+
+	switch (line_coding.bParityType) {
+	case USB_CDC_LINE_CODING_PARITYTYPE_ODD:
+		parity = USART_ODD;
+		break;
+	case USB_CDC_LINE_CODING_PARITYTYPE_EVEN:
+		parity = USART_EVEN;
+		break;
+	default:
+		parity = USART_PARITY_NONE;
+		break;
+	}
+
+	/* The parity bit is included in the word length. */
+	if (parity != USART_PARITY_NONE && line_coding.bDataBits == 8)
+		bits = 9;
+	else
+		bits = 8;
+
+	switch (line_coding.bCharFormat) {
+	case USB_CDC_LINE_CODING_CHARFORMAT_1_5_STOP_BITS:
+		stop = USART_STOP_1_5;
+		break;
+	case USB_CDC_LINE_CODING_CHARFORMAT_2_STOP_BITS:
+		stop = USART_STOP_2;
+		break;
+	default:
+		stop = USART_STOP_1;
+		break;
+	}
+
+	usart_disable(port->usart);
+	usart_set_baudrate(port->usart, port->clock, line_coding.dwDTERate);
+	usart_set_databits(port->usart, bits);
+	usart_set_stopbits(port->usart, stop);
+	usart_set_parity(port->usart, parity);
+	usart_enable(port->usart);
+}
+
+/* DMA write position of the Rx ring buffer */
+static int rx_tail(void)
+{
+	int tail;
+
+	tail = port->rx_size - dma_get_number_of_data(port->dma_rx);
+	if (tail >= port->rx_size)
+		tail = 0;
+	return tail;
+}
+
+/*
+ * Bytes written by DMA. The lap is counted by the HT/TC interrupts, and
+ * the offset from the last one is valid while it is pending.
+ */
+static u32 rx_total(void)
+{
+	int n;
+
+	n = rx_tail() - rx_boundary;
+	if (n < 0)
+		n += port->rx_size;
+	return rx_written + n;
+}
+
+static int send_serial_state(u16 state);
+
+/* Discard the unread data if DMA has caught up with 'rx_head'. */
+static void check_rx_overrun(void)
+{
+	u32 total;
+
+	total = rx_total();
+	if (total - rx_read < (u32)port->rx_size)
+		return;
+
+	rx_head = rx_tail();
+	rx_read = total;
+	rx_overrun++;
+
+	/* Report bOverRun now, or on the next SOF. */
+	overrun_pending = true;
+	if (!send_serial_state(serial_state | USB_CDC_SERIAL_STATE_OVERRUN))
+		overrun_pending = false;
+}
+
+/* Number of bytes in the Rx ring buffer */
+static int rx_count(void)
+{
+	check_rx_overrun();
+	return rx_total() - rx_read;
+}
+
+/* DMA has passed 'pos' (HT or TC). */
+static void rx_advance(int pos)
+{
+	int n;
+
+	n = pos - rx_boundary;
+	if (n <= 0)
+		n += port->rx_size;
+	rx_written += n;
+	rx_boundary = pos;
+}
+
+void cdcacm_usart_rx_isr(void)
+{
+	int status;
+	int half;
+
+	status = dma_get_interrupt_status(port->dma_rx,
+					  DMA_HALF | DMA_COMPLETE);
+	dma_clear_interrupt(port->dma_rx, status | DMA_GLOBAL);
+
+	/* If both are pending, the one behind the DMA position is later. */
+	half = port->rx_size / 2;
+	if ((status & DMA_HALF) && (status & DMA_COMPLETE) &&
+	    rx_tail() >= half) {
+		rx_advance(0);
+		rx_advance(half);
+	} else {
+		if (status & DMA_HALF)
+			rx_advance(half);
+		if (status & DMA_COMPLETE)
+			rx_advance(0);
+	}
+
+	check_rx_overrun();
+}
+
+/* Free space of the Tx ring buffer */
+static int tx_free(void)
+{
+	int n;
+
+	n = tx_head - tx_tail - 1;
+	if (n < 0)
+		n += port->tx_size;
+	return n;
+}
+
+/* Send the Tx ring buffer (until the end of the buffer) by DMA. */
+static void start_usart_tx(void)
+{
+	if (tx_dma_len || tx_head == tx_tail)
+		return;
+
+	if (tx_tail > tx_head)
+		tx_dma_len = tx_tail - tx_head;
+	else
+		tx_dma_len = port->tx_size - tx_head;
+
+	dma_disable(port->dma_tx);
+	dma_setup_channel(port->dma_tx, (u32)(port->tx_ring + tx_head),
+			  port->dr, tx_dma_len,
+			  DMA_M_TO_P | DMA_M_INC | DMA_P_8BIT | DMA_M_8BIT |
+			  DMA_HIGH | DMA_COMPLETE | DMA_ENABLE);
+}
+
+void cdcacm_usart_tx_complete(void)
+{
+	dma_clear_interrupt(port->dma_tx, DMA_COMPLETE | DMA_GLOBAL);
+
+	tx_head += tx_dma_len;
+	if (tx_head >= port->tx_size)
+		tx_head -= port->tx_size;
+	tx_dma_len = 0;
+
+	/* Read the OUT packet waiting for free space. */
+	if (out_pending)
+		cdcacm_data_rx();
+
+	start_usart_tx();
+}
+
+/* --- USB ----------------------------------------------------------------- */
+
+/* Send a packet from the Rx ring buffer to the host. */
+static void send_packet(void)
+{
+	int n;
+
+	n = rx_count();
+	if (n > port->packet_size)
+		n = port->packet_size;
+
+	/* Terminate the transfer with a zero-length packet. */
+	if (!n && !in_full) {
+		in_busy = false;
+		return;
+	}
+
+	usbdevfs_write_ring(port->data_tx_ep, port->rx_ring, port->rx_size,
+			    rx_head, n);
+
+	/* TX NAK->VALID */
+	usbdevfs_start_endpoint_tx(port->data_tx_ep);
+
+	rx_head += n;
+	if (rx_head >= port->rx_size)
+		rx_head -= port->rx_size;
+	rx_read += n;
+	in_full = (n == port->packet_size);
+	in_busy = true;
+}
+
+void cdcacm_data_tx(void)
+{
+	/* Clear interrupt. */
+	usbdevfs_clear_endpoint_interrupt(port->data_tx_ep);
+
+	/* Next packet (in the same frame) */
+	send_packet();
+}
+
+void cdcacm_sof(void)
+{
+	if (configured && !in_busy)
+		send_packet();
+
+	if (overrun_pending &&
+	    !send_serial_state(serial_state | USB_CDC_SERIAL_STATE_OVERRUN))
+		overrun_pending = false;
+}
+
+void cdcacm_data_rx(void)
+{
+	int n;
+
+	/* Leave the endpoint NAK until the Tx ring buffer has space. */
+	if (tx_free() < port->packet_size) {
+		if (!out_pending) {
+			usbdevfs_clear_endpoint_interrupt(port->data_rx_ep);
+			out_pending = true;
+		}
+		return;
+	}
+
+	n = usbdevfs_read_ring(port->data_rx_ep, port->tx_ring, port->tx_size,
+			       tx_tail, port->packet_size);
+	tx_tail += n;
+	if (tx_tail >= port->tx_size)
+		tx_tail -= port->tx_size;
+	out_pending = false;
+
+	/* Rx NAK -> VALID */
+	usbdevfs_enable_endpoint_rx(port->data_rx_ep);
+
+	start_usart_tx();
+}
+
+void cdcacm_notification_tx(void)
+{
+	/* Clear interrupt. */
+	usbdevfs_clear_endpoint_interrupt(port->notification_ep);
+
+	notification_busy = false;
+}
+
+static int send_serial_state(u16 state)
+{
+	u16 buf[(sizeof(struct usb_cdc_notification) + 2) / 2];
+	struct usb_cdc_notification *notif;
+
+	if (!configured || notification_busy)
+		return -1;
+
+	notif = (struct usb_cdc_notification *)buf;
+	notif->bmRequestType = (USB_DIR_IN | USB_TYPE_CLASS |
+				USB_RECIP_INTERFACE);
+	notif->bNotification = USB_CDC_NOTIFY_SERIAL_STATE;
+	notif->wValue = 0;
+	notif->wIndex = port->interface;
+	notif->wLength = 2;
+	buf[sizeof(struct usb_cdc_notification) / 2] = state;
+
+	usbdevfs_write(port->notification_ep, buf, sizeof(buf));
+
+	/* TX NAK->VALID */
+	usbdevfs_start_endpoint_tx(port->notification_ep);
+
+	notification_busy = true;
+	return 0;
+}
+
+int cdcacm_notify_serial_state(u16 state)
+{
+	serial_state = state;
+
+	/* bOverRun is cleared when notified. */
+	if (overrun_pending)
+		state |= USB_CDC_SERIAL_STATE_OVERRUN;
+	if (send_serial_state(state))
+		return -1;
+	overrun_pending = false;
+	return 0;
+}
+
+u32 cdcacm_get_overrun(void)
+{
+	return rx_overrun;
+}
+
+int cdcacm_get_control_line_state(void)
+{
+	return control_line_state;
+}
+
+/* --- Class-specific Requests --------------------------------------------- */
+
+static bool line_coding_error(struct usb_cdc_line_coding *p)
+{
+	if (!p->dwDTERate || p->bCharFormat > 2 || p->bParityType > 4)
+		return true;
+	if (!(p->bDataBits == 8 ||
+	      (p->bDataBits == 7 &&
+	       p->bParityType != USB_CDC_LINE_CODING_PARITYTYPE_NONE)))
+		return true;
+	return false;
+}
+
+int cdcacm_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		   u8 **data)
+{
+	/* bmRequestType = x0100001B */
+	if ((req->bmRequestType & ~USB_DIR_IN) !=
+	    (USB_TYPE_CLASS | USB_RECIP_INTERFACE) ||
+	    req->wIndex != port->interface)
+		return -1;
+
+	switch (req->bRequest) {
+	case USB_CDC_REQ_SET_LINE_CODING:
+		if ((req->bmRequestType & USB_DIR_IN) || req->wValue ||
+		    req->wLength != sizeof(struct usb_cdc_line_coding))
+			return -1;
+		if (stage == USBDEV_STAGE_STATUS &&
+		    !line_coding_error((struct usb_cdc_line_coding *)buf)) {
+			line_coding = *(struct usb_cdc_line_coding *)buf;
+			set_line_coding();
+		}
+		return 0;
+	case USB_CDC_REQ_GET_LINE_CODING:
+		if (!(req->bmRequestType & USB_DIR_IN) || req->wValue ||
+		    req->wLength != sizeof(struct usb_cdc_line_coding))
+			return -1;
+		*data = (u8 *)&line_coding;
+		return sizeof(struct usb_cdc_line_coding);
+	case USB_CDC_REQ_SET_CONTROL_LINE_STATE:
+		if ((req->bmRequestType & USB_DIR_IN) || req->wLength)
+			return -1;
+		if (stage == USBDEV_STAGE_STATUS)
+			control_line_state = req->wValue;
+		return 0;
+	case USB_CDC_REQ_SEND_BREAK:
+		/* One break character regardless of the duration */
+		if ((req->bmRequestType & USB_DIR_IN) || req->wLength)
+			return -1;
+		if (stage == USBDEV_STAGE_STATUS && req->wValue)
+			usart_send_break(port->usart);
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+void cdcacm_set_configuration(int value)
+{
+	configured = (value != 0);
+
+	/* Discard the data received before. */
+	rx_head = rx_tail();
+	rx_read = rx_total();
+	in_busy = false;
+	in_full = false;
+	out_pending = false;
+	notification_busy = false;
+	overrun_pending = false;
+}
+
+void cdcacm_reset(void)
+{
+	configured = false;
+	control_line_state = 0;
+}
+
+void cdcacm_init(const struct cdcacm_port *p)
+{
+	port = p;
+
+	set_line_coding();
+
+	/* USART Rx -> Rx ring buffer (circular) */
+	dma_clear_interrupt(p->dma_rx, DMA_HALF | DMA_COMPLETE | DMA_GLOBAL);
+	dma_setup_channel(p->dma_rx, (u32)p->rx_ring, p->dr, p->rx_size,
+			  DMA_P_TO_M | DMA_CIRCULAR | DMA_M_INC | DMA_P_8BIT |
+			  DMA_M_8BIT | DMA_HIGH | DMA_HALF | DMA_COMPLETE |
+			  DMA_ENABLE);
+	rx_head = 0;
+	rx_read = 0;
+	rx_written = 0;
+	rx_boundary = 0;
+	rx_overrun = 0;
+	tx_head = 0;
+	tx_tail = 0;
+	tx_dma_len = 0;
+
+	usart_set_mode(p->usart, USART_TX_RX);
+	usart_enable_dma(p->usart, USART_DMA_TX_RX);
+}
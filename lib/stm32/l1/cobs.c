@@ -0,0 +1,150 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/cobs.h>
+
+/* --- Encoder ------------------------------------------------------------- */
+
+/* Append a byte. 'len' keeps counting when out of space. */
+static void put(struct cobs_encoder *e, int c)
+{
+	if (e->len++ >= e->space)
+		return;
+	e->buf[e->pos] = c;
+	if (++e->pos >= e->size)
+		e->pos = 0;
+}
+
+/* Fill in the code byte, and reserve the next one. */
+static void next_block(struct cobs_encoder *e)
+{
+	if (e->len <= e->space)
+		e->buf[e->code_pos] = e->code;
+	e->code_pos = e->pos;
+	e->code = 1;
+	put(e, 0);
+}
+
+void cobs_encode_begin(struct cobs_encoder *e, u8 *buf, int size, int pos,
+		       int space)
+{
+	e->buf = buf;
+	e->size = size;
+	e->pos = pos;
+	e->space = space;
+	e->len = 0;
+	e->code_pos = pos;
+	e->code = 1;
+	put(e, 0);
+}
+
+int cobs_encode(struct cobs_encoder *e, const void *data, int len)
+{
+	const u8 *p = data;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (p[i]) {
+			put(e, p[i]);
+			if (++e->code < 0xff)
+				continue;
+		}
+		/* A zero byte or 254 data bytes end the block. */
+		next_block(e);
+	}
+
+	return (e->len <= e->space) ? 0 : -1;
+}
+
+int cobs_encode_end(struct cobs_encoder *e)
+{
+	if (e->len <= e->space)
+		e->buf[e->code_pos] = e->code;
+
+	/* Delimiter */
+	put(e, 0);
+
+	return (e->len <= e->space) ? e->len : -1;
+}
+
+/* --- Decoder ------------------------------------------------------------- */
+
+static void reset(struct cobs_decoder *d)
+{
+	d->len = 0;
+	d->n = 0;
+	d->zero = false;
+	d->in_frame = false;
+	d->error = false;
+}
+
+static void store(struct cobs_decoder *d, int c)
+{
+	if (d->len < d->size)
+		d->buf[d->len++] = c;
+	else
+		d->error = true;
+}
+
+void cobs_decoder_init(struct cobs_decoder *d)
+{
+	reset(d);
+	d->errors = 0;
+}
+
+void cobs_decode(struct cobs_decoder *d, const void *data, int len)
+{
+	const u8 *p = data;
+	int c;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		c = p[i];
+
+		/* Delimiter */
+		if (!c) {
+			if (d->in_frame) {
+				if (d->error || d->n)
+					d->errors++;
+				else
+					d->frame(d, d->buf, d->len);
+			}
+			reset(d);
+			continue;
+		}
+
+		if (d->n) {
+			store(d, c);
+			d->n--;
+			continue;
+		}
+
+		/* Code byte. The last block is not followed by a zero. */
+		if (d->zero)
+			store(d, 0);
+		d->n = c - 1;
+		d->zero = (c != 0xff);
+		d->in_frame = true;
+	}
+}
+
+u32 cobs_decoder_get_error(struct cobs_decoder *d)
+{
+	return d->errors;
+}
@@ -19,83 +19,50 @@
 
 #include <stm32/l1/dma.h>
 
-static u32 base_addr(dma_channel_t dma)
-{
-	switch (dma) {
-	case DMA1_CHANNEL1:
-	case DMA1_CHANNEL2:
-	case DMA1_CHANNEL3:
-	case DMA1_CHANNEL4:
-	case DMA1_CHANNEL5:
-	case DMA1_CHANNEL6:
-	case DMA1_CHANNEL7:
-		return DMA1_BASE;
-	case DMA2_CHANNEL1:
-	case DMA2_CHANNEL2:
-	case DMA2_CHANNEL3:
-	case DMA2_CHANNEL4:
-	case DMA2_CHANNEL5:
-		return DMA2_BASE;
-	default:
-		break;
-	}
-	return 0;
-}
+/* Channel descriptors, indexed by dma_channel_t */
+static const struct dma_channel_desc channel_desc[] = {
+	DMA_CHANNEL_DESC(DMA1_CHANNEL1),
+	DMA_CHANNEL_DESC(DMA1_CHANNEL2),
+	DMA_CHANNEL_DESC(DMA1_CHANNEL3),
+	DMA_CHANNEL_DESC(DMA1_CHANNEL4),
+	DMA_CHANNEL_DESC(DMA1_CHANNEL5),
+	DMA_CHANNEL_DESC(DMA1_CHANNEL6),
+	DMA_CHANNEL_DESC(DMA1_CHANNEL7),
+	DMA_CHANNEL_DESC(DMA2_CHANNEL1),
+	DMA_CHANNEL_DESC(DMA2_CHANNEL2),
+	DMA_CHANNEL_DESC(DMA2_CHANNEL3),
+	DMA_CHANNEL_DESC(DMA2_CHANNEL4),
+	DMA_CHANNEL_DESC(DMA2_CHANNEL5),
+};
 
-static int channel_num(dma_channel_t dma)
+const struct dma_channel_desc *dma_get_channel_desc(dma_channel_t dma)
 {
-	switch (dma) {
-	case DMA1_CHANNEL1:
-		return 0;
-	case DMA1_CHANNEL2:
-		return 1;
-	case DMA1_CHANNEL3:
-		return 2;
-	case DMA1_CHANNEL4:
-		return 3;
-	case DMA1_CHANNEL5:
-		return 4;
-	case DMA1_CHANNEL6:
-		return 5;
-	case DMA1_CHANNEL7:
-		return 6;
-	case DMA2_CHANNEL1:
-		return 0;
-	case DMA2_CHANNEL2:
-		return 1;
-	case DMA2_CHANNEL3:
-		return 2;
-	case DMA2_CHANNEL4:
-		return 3;
-	case DMA2_CHANNEL5:
-		return 4;
-	default:
-		break;
-	}
-	return 0;
+	return &channel_desc[dma];
 }
 
 void dma_setup_channel(dma_channel_t dma, u32 ma, u32 pa, int ndt, int mode)
 {
-	u32 base;
-	int channel;
+	const struct dma_channel_desc *d = &channel_desc[dma];
+
+	DMA_DESC_CMAR(d) = ma;
+	DMA_DESC_CPAR(d) = pa;
+	DMA_DESC_CNDTR(d) = (ndt & 0xffff);
+	DMA_DESC_CCR(d) = mode;
+}
 
-	base = base_addr(dma);
-	channel = channel_num(dma);
-	DMA_CMAR(base, channel) = ma;
-	DMA_CPAR(base, channel) = pa;
-	DMA_CNDTR(base, channel) = (ndt & 0xffff);
-	DMA_CCR(base, channel) = mode;
+int dma_get_number_of_data(dma_channel_t dma)
+{
+	return dma_desc_get_number_of_data(&channel_desc[dma]);
 }
 
 void dma_enable(dma_channel_t dma)
 {
-	DMA_CCR(base_addr(dma), channel_num(dma)) |= DMA_CCR_EN;
+	DMA_DESC_CCR(&channel_desc[dma]) |= DMA_CCR_EN;
 }
 
 void dma_disable(dma_channel_t dma)
 {
-	DMA_CCR(base_addr(dma), channel_num(dma)) &= ~DMA_CCR_EN;
+	dma_desc_disable(&channel_desc[dma]);
 }
 
 void dma_enable_interrupt(dma_channel_t dma, int ch_int)
@@ -105,29 +72,25 @@ void dma_enable_interrupt(dma_channel_t dma, int ch_int)
 	 * DMA_HALF     = DMA_CCR_HTIE
 	 * DMA_COMPLETE = DMA_TCIE
 	 */
-	DMA_CCR(base_addr(dma), channel_num(dma)) |= ch_int;
+	DMA_DESC_CCR(&channel_desc[dma]) |= ch_int;
 }
 
 void dma_disable_interrupt(dma_channel_t dma, int ch_int)
 {
-	DMA_CCR(base_addr(dma), channel_num(dma)) &= ~ch_int;
+	DMA_DESC_CCR(&channel_desc[dma]) &= ~ch_int;
 }
 
 int dma_get_interrupt_mask(dma_channel_t dma, int ch_int)
 {
-	return DMA_CCR(base_addr(dma), channel_num(dma)) & ch_int;
+	return DMA_DESC_CCR(&channel_desc[dma]) & ch_int;
 }
 
 int dma_get_interrupt_status(dma_channel_t dma, int ch_int)
 {
-	return (DMA_ISR(base_addr(dma)) >> (4 * channel_num(dma))) & ch_int;
+	return dma_desc_get_interrupt_status(&channel_desc[dma], ch_int);
 }
 
 void dma_clear_interrupt(dma_channel_t dma, int ch_int)
 {
-	u32 base;
-
-	base = base_addr(dma);
-	DMA_IFCR(base) = ch_int << (4 * channel_num(dma));
-	DMA_IFCR(base) = 0;
+	dma_desc_clear_interrupt(&channel_desc[dma], ch_int);
 }
@@ -0,0 +1,276 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/cortex.h>
+#include <stm32/l1/dma.h>
+
+#include <stm32/l1/dmacopy.h>
+
+/*
+ * Request
+ *
+ * src:		Source, or NULL for memset
+ * c:		Fill byte
+ */
+struct request {
+	u8 *dst;
+	const u8 *src;
+	u8 c;
+	int len;
+	void (*done)(void *arg);
+	void *arg;
+};
+
+static dma_channel_t channel;
+
+/* queue[head] is in progress, queue[tail] is the next free entry. */
+static struct request queue[DMACOPY_QUEUE_SIZE];
+static volatile int head;
+static volatile int tail;
+
+static bool busy;		/* DMA is running for queue[head]. */
+static int dma_len;		/* Bytes of the current DMA transfer */
+static u32 pattern;		/* Source word of memset */
+static int threshold = DMACOPY_THRESHOLD;
+static volatile u32 error_count;
+
+/* --- CPU ----------------------------------------------------------------- */
+
+static void cpu_copy(u8 *d, const u8 *s, int len)
+{
+	u32 *dw;
+	const u32 *sw;
+
+	if (!(((u32)d | (u32)s) & 3)) {
+		dw = (u32 *)d;
+		sw = (const u32 *)s;
+		for (; len >= 4; len -= 4)
+			*dw++ = *sw++;
+		d = (u8 *)dw;
+		s = (const u8 *)sw;
+	}
+	while (len--)
+		*d++ = *s++;
+}
+
+static void cpu_set(u8 *d, u8 c, int len)
+{
+	u32 *dw;
+	u32 w;
+
+	if (!((u32)d & 3)) {
+		w = c * 0x01010101;
+		dw = (u32 *)d;
+		for (; len >= 4; len -= 4)
+			*dw++ = w;
+		d = (u8 *)dw;
+	}
+	while (len--)
+		*d++ = c;
+}
+
+static void cpu_request(struct request *r)
+{
+	if (r->src)
+		cpu_copy(r->dst, r->src, r->len);
+	else
+		cpu_set(r->dst, r->c, r->len);
+	r->len = 0;
+}
+
+/* --- DMA ----------------------------------------------------------------- */
+
+static void start_dma(struct request *r)
+{
+	u32 align;
+	u32 pa;
+	int mode;
+	int n;
+
+	align = (u32)r->dst | (u32)r->src;
+	if (!(align & 3)) {
+		n = r->len >> 2;
+		mode = DMA_M_32BIT | DMA_P_32BIT;
+		dma_len = 4;
+	} else if (!(align & 1)) {
+		n = r->len >> 1;
+		mode = DMA_M_16BIT | DMA_P_16BIT;
+		dma_len = 2;
+	} else {
+		n = r->len;
+		mode = DMA_M_8BIT | DMA_P_8BIT;
+		dma_len = 1;
+	}
+	if (n > 0xffff)
+		n = 0xffff;
+	dma_len *= n;
+
+	/* The "peripheral" is the source. */
+	if (r->src) {
+		pa = (u32)r->src;
+		mode |= DMA_P_INC;
+	} else {
+		pattern = r->c * 0x01010101;
+		pa = (u32)&pattern;
+	}
+
+	dma_disable(channel);
+	dma_setup_channel(channel, (u32)r->dst, pa, n,
+			  mode | DMA_M_TO_M | DMA_P_TO_M | DMA_M_INC |
+			  DMA_MEDIUM | DMA_ERROR | DMA_COMPLETE | DMA_ENABLE);
+	busy = true;
+}
+
+/* Remove queue[head] and call the callback. */
+static void complete(void)
+{
+	struct request *r;
+	void (*done)(void *arg);
+	void *arg;
+
+	r = &queue[head];
+	done = r->done;
+	arg = r->arg;
+	head = (head + 1) % DMACOPY_QUEUE_SIZE;
+	if (done)
+		done(arg);
+}
+
+/* Start the next request. Short requests are done by the CPU. */
+static void start(void)
+{
+	struct request *r;
+
+	while (!busy && head != tail) {
+		r = &queue[head];
+		if (r->len < threshold || r->len < 4) {
+			cpu_request(r);
+			complete();
+		} else {
+			start_dma(r);
+		}
+	}
+}
+
+void dmacopy_isr(void)
+{
+	struct request *r;
+	int status;
+
+	status = dma_get_interrupt_status(channel, DMA_ERROR | DMA_COMPLETE);
+	dma_clear_interrupt(channel, status | DMA_GLOBAL);
+	if (!busy || !status)
+		return;
+	busy = false;
+
+	r = &queue[head];
+	if (status & DMA_ERROR) {
+		error_count++;
+		r->len = 0;
+	} else {
+		r->dst += dma_len;
+		if (r->src)
+			r->src += dma_len;
+		r->len -= dma_len;
+	}
+
+	/* More than 65535 data, or the unaligned tail */
+	if (r->len >= threshold && r->len >= 4) {
+		start_dma(r);
+		return;
+	}
+	cpu_request(r);
+	complete();
+	start();
+}
+
+/* --- API ----------------------------------------------------------------- */
+
+static int submit(void *dst, const void *src, int c, int len,
+		  void (*done)(void *arg), void *arg)
+{
+	struct request *r;
+	u32 primask;
+	int next;
+
+	primask = irq_save();
+
+	next = (tail + 1) % DMACOPY_QUEUE_SIZE;
+	if (next == head) {
+		irq_restore(primask);
+		return -1;
+	}
+
+	r = &queue[tail];
+	r->dst = dst;
+	r->src = src;
+	r->c = c;
+	r->len = len;
+	r->done = done;
+	r->arg = arg;
+	tail = next;
+
+	start();
+
+	irq_restore(primask);
+	return 0;
+}
+
+int dmacopy_memcpy(void *dst, const void *src, int len,
+		   void (*done)(void *arg), void *arg)
+{
+	return submit(dst, src, 0, len, done, arg);
+}
+
+int dmacopy_memset(void *dst, int c, int len, void (*done)(void *arg),
+		   void *arg)
+{
+	return submit(dst, 0, c, len, done, arg);
+}
+
+bool dmacopy_busy(void)
+{
+	return head != tail;
+}
+
+void dmacopy_flush(void)
+{
+	while (head != tail)
+		;
+}
+
+void dmacopy_set_threshold(int bytes)
+{
+	threshold = bytes;
+}
+
+u32 dmacopy_get_error(void)
+{
+	return error_count;
+}
+
+void dmacopy_init(dma_channel_t dma)
+{
+	channel = dma;
+	head = 0;
+	tail = 0;
+	busy = false;
+	error_count = 0;
+	dma_disable(dma);
+}
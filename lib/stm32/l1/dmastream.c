@@ -0,0 +1,144 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/dma.h>
+
+#include <stm32/l1/dmastream.h>
+
+/* Half 0 is done on DMA_HALF, half 1 on DMA_COMPLETE. */
+static void half_done(struct dmastream *s, int half)
+{
+	u32 n;
+
+	n = s->produced + 1;
+
+	/* A full cycle was missed. */
+	if (((n - 1) & 1) != (u32)half)
+		n++;
+	s->produced = n;
+}
+
+static void *half_addr(struct dmastream *s, u32 n)
+{
+	return (u8 *)s->buf + (n & 1) * s->half_bytes;
+}
+
+void dmastream_isr(struct dmastream *s)
+{
+	int status;
+	u32 n;
+
+	status = dma_desc_get_interrupt_status(s->desc, DMA_ERROR | DMA_HALF |
+					       DMA_COMPLETE);
+	dma_desc_clear_interrupt(s->desc, status | DMA_GLOBAL);
+
+	/* The channel is disabled by the hardware. */
+	if (status & DMA_ERROR)
+		s->error++;
+
+	/* Both flags: the handler is late, keep the order of the halves. */
+	if ((status & DMA_HALF) && (status & DMA_COMPLETE)) {
+		if (s->produced & 1) {
+			half_done(s, 1);
+			half_done(s, 0);
+		} else {
+			half_done(s, 0);
+			half_done(s, 1);
+		}
+	} else if (status & DMA_HALF) {
+		half_done(s, 0);
+	} else if (status & DMA_COMPLETE) {
+		half_done(s, 1);
+	} else {
+		return;
+	}
+
+	if (!s->ready)
+		return;
+
+	n = s->produced;
+	if (n - s->consumed > 1)
+		s->overrun += n - s->consumed - 1;
+	s->ready(s, half_addr(s, n - 1));
+	s->consumed = n;
+}
+
+void *dmastream_get(struct dmastream *s)
+{
+	u32 n;
+
+	n = s->produced;
+	if (n == s->consumed)
+		return 0;
+
+	/* Skip to the latest half, the older ones are overwritten. */
+	if (n - s->consumed > 1) {
+		s->overrun += n - s->consumed - 1;
+		s->consumed = n - 1;
+	}
+	return half_addr(s, s->consumed);
+}
+
+int dmastream_release(struct dmastream *s)
+{
+	bool late;
+
+	late = (s->produced - s->consumed > 1);
+	s->consumed++;
+	return late ? -1 : 0;
+}
+
+u32 dmastream_get_overrun(struct dmastream *s)
+{
+	return s->overrun;
+}
+
+u32 dmastream_get_error(struct dmastream *s)
+{
+	return s->error;
+}
+
+void dmastream_start(struct dmastream *s)
+{
+	s->produced = 0;
+	s->consumed = 0;
+
+	dma_disable(s->dma);
+	dma_clear_interrupt(s->dma, DMA_ERROR | DMA_HALF | DMA_COMPLETE |
+			    DMA_GLOBAL);
+	dma_setup_channel(s->dma, (u32)s->buf, s->pa, s->ndt,
+			  (s->mode & ~DMA_ENABLE) | DMA_CIRCULAR | DMA_M_INC |
+			  DMA_ERROR | DMA_HALF | DMA_COMPLETE | DMA_ENABLE);
+}
+
+void dmastream_stop(struct dmastream *s)
+{
+	dma_disable(s->dma);
+}
+
+void dmastream_init(struct dmastream *s)
+{
+	s->desc = dma_get_channel_desc(s->dma);
+	/* DMA_M_8BIT, DMA_M_16BIT or DMA_M_32BIT */
+	s->half_bytes = (s->ndt / 2) << ((s->mode >> 10) & 3);
+	s->produced = 0;
+	s->consumed = 0;
+	s->overrun = 0;
+	s->error = 0;
+}
@@ -18,6 +18,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stm32/l1/cortex.h>
 #include <stm32/l1/flash.h>
 
 void flash_enable_64bit_access(int wait)
@@ -168,17 +169,33 @@ void flash_erase_page(u32 page_address)
 	*(u32 *)page_address = 0;
 }
 
-/* Program memory */
-void flash_program_half_page(u32 address, u32 *data)
+/*
+ * Program memory
+ *
+ * Half-page programming must be executed from RAM with no Flash memory
+ * access during the 32 word writes, so this function is in .data and
+ * 'data' must be in RAM. The interrupts are masked while the words are
+ * latched.
+ */
+void __attribute__ ((section(".data.ramfunc"), long_call, noinline))
+flash_program_half_page(u32 address, u32 *data)
 {
 	int i;
-	u32 *p = (u32 *)address;
+	u32 primask;
+	volatile u32 *p = (u32 *)address;
 
+	primask = irq_save();
 	FLASH_PECR |= (FLASH_PECR_FPRG | FLASH_PECR_PROG);
 	while (FLASH_SR & FLASH_SR_BSY)
 		;
 	for (i = 0; i < 32; i++)
 		*p++ = *data++;
+	irq_restore(primask);
+
+	/* Interrupt handlers are stalled on Flash memory access until the end. */
+	while (FLASH_SR & FLASH_SR_BSY)
+		;
+	FLASH_PECR &= ~(FLASH_PECR_FPRG | FLASH_PECR_PROG);
 }
 
 /* Data EEPROM */
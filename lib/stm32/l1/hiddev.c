@@ -0,0 +1,296 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/cortex.h>
+#include <stm32/l1/usbdevfs.h>
+#include <stm32/l1/usbdev.h>
+
+#include <usb/standard.h>
+#include <usb/hid.h>
+
+#include <stm32/l1/hiddev.h>
+
+/* HID port */
+static const struct hiddev_port *port;
+
+static bool configured;
+static int protocol;		/* 0: Boot Protocol, 1: Report Protocol */
+static int idle_rate;		/* 4 msec unit (0: indefinite) */
+static int idle_count;		/* msec since the last report */
+
+/* Input report queue */
+static u16 queue[HIDDEV_QUEUE_SIZE][HIDDEV_REPORT_SIZE_MAX / 2];
+static u8 queue_len[HIDDEV_QUEUE_SIZE];
+static int queue_head;
+static int queue_count;
+
+/* The last report (sent again at the idle rate) */
+static u16 last_report[HIDDEV_REPORT_SIZE_MAX / 2];
+static int last_len;
+static bool in_busy;		/* The last report is not read by the host. */
+
+static void copy_report(u16 *d, const u8 *s, int len)
+{
+	u8 *p;
+
+	p = (u8 *)d;
+	while (len--)
+		*p++ = *s++;
+}
+
+static int report_id(const u8 *report)
+{
+	return port->report_id ? report[0] : 0;
+}
+
+/* Write the last report into the packet memory. */
+static void send_last_report(void)
+{
+	usbdevfs_write(port->in_ep, last_report, last_len);
+
+	/* TX NAK->VALID */
+	usbdevfs_start_endpoint_tx(port->in_ep);
+
+	in_busy = true;
+	idle_count = 0;
+}
+
+int hiddev_send_report(const u8 *report, int len)
+{
+	u32 primask;
+	int i;
+	int n;
+	int r;
+
+	if (len <= 0 || len > port->packet_size)
+		return -1;
+
+	r = 0;
+	primask = irq_save();
+
+	if (!configured) {
+		r = -1;
+	} else if (!in_busy) {
+		copy_report(last_report, report, len);
+		last_len = len;
+		send_last_report();
+	} else {
+		/* Replace the queued report with the same ID. */
+		for (n = 0; n < queue_count; n++) {
+			i = (queue_head + n) % HIDDEV_QUEUE_SIZE;
+			if (report_id((u8 *)queue[i]) == report_id(report))
+				break;
+		}
+		if (n == queue_count) {
+			if (queue_count == HIDDEV_QUEUE_SIZE)
+				r = -1;
+			else
+				queue_count++;
+		}
+		if (!r) {
+			i = (queue_head + n) % HIDDEV_QUEUE_SIZE;
+			copy_report(queue[i], report, len);
+			queue_len[i] = len;
+		}
+	}
+
+	irq_restore(primask);
+	return r;
+}
+
+void hiddev_in_tx(void)
+{
+	u32 primask;
+
+	/* Clear interrupt. */
+	usbdevfs_clear_endpoint_interrupt(port->in_ep);
+
+	primask = irq_save();
+
+	in_busy = false;
+	if (queue_count) {
+		copy_report(last_report, (u8 *)queue[queue_head],
+			    queue_len[queue_head]);
+		last_len = queue_len[queue_head];
+		queue_head = (queue_head + 1) % HIDDEV_QUEUE_SIZE;
+		queue_count--;
+		send_last_report();
+	}
+
+	irq_restore(primask);
+}
+
+void hiddev_out_rx(void)
+{
+	u16 buf[HIDDEV_REPORT_SIZE_MAX / 2];
+	int n;
+
+	/* Clear interrupt. */
+	usbdevfs_clear_endpoint_interrupt(port->out_ep);
+
+	n = usbdevfs_read(port->out_ep, buf, HIDDEV_REPORT_SIZE_MAX);
+	if (n > HIDDEV_REPORT_SIZE_MAX)
+		n = HIDDEV_REPORT_SIZE_MAX;
+	if (n > 0 && port->set_report)
+		port->set_report(USB_HID_REPORT_TYPE_OUTPUT,
+				 report_id((u8 *)buf), (u8 *)buf, n);
+
+	/* Rx NAK -> VALID */
+	usbdevfs_enable_endpoint_rx(port->out_ep);
+}
+
+void hiddev_sof(void)
+{
+	u32 primask;
+
+	if (!configured || !idle_rate || !last_len)
+		return;
+
+	primask = irq_save();
+
+	/* Send the last report again. */
+	if (++idle_count >= idle_rate * 4 && !in_busy)
+		send_last_report();
+
+	irq_restore(primask);
+}
+
+int hiddev_get_protocol(void)
+{
+	return protocol;
+}
+
+/* --- Class-specific Requests --------------------------------------------- */
+
+/* Get_Descriptor (HID, Report) */
+static int request_get_descriptor(struct usb_setup_data *req, u8 **data)
+{
+	switch (req->wValue >> 8) {
+	case USB_DT_HID:
+		*data = (u8 *)port->hid_desc;
+		return port->hid_desc[0];
+	case USB_DT_REPORT:
+		*data = (u8 *)port->report_desc;
+		return port->report_desc_len;
+	default:
+		return -1;
+	}
+}
+
+int hiddev_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		   u8 **data)
+{
+	bool in;
+	int len;
+
+	/* Class descriptors (bmRequestType = 10000001B) */
+	if (req->bmRequestType == (USB_DIR_IN | USB_TYPE_STANDARD |
+				   USB_RECIP_INTERFACE) &&
+	    req->bRequest == USB_REQ_GET_DESCRIPTOR &&
+	    req->wIndex == port->interface)
+		return request_get_descriptor(req, data);
+
+	/* bmRequestType = x0100001B */
+	if ((req->bmRequestType & ~USB_DIR_IN) !=
+	    (USB_TYPE_CLASS | USB_RECIP_INTERFACE) ||
+	    req->wIndex != port->interface)
+		return -1;
+
+	in = ((req->bmRequestType & USB_DIR_IN) != 0);
+	switch (req->bRequest) {
+	case USB_HID_GET_REPORT:
+		if (!in || !port->get_report)
+			return -1;
+		len = req->wLength;
+		if (len > USBDEV_IN_BUFFER_SIZE)
+			len = USBDEV_IN_BUFFER_SIZE;
+		*data = buf;
+		return port->get_report(req->wValue >> 8, req->wValue & 0xff,
+					buf, len);
+	case USB_HID_SET_REPORT:
+		if (in || !port->set_report)
+			return -1;
+		if (stage == USBDEV_STAGE_STATUS)
+			return port->set_report(req->wValue >> 8,
+						req->wValue & 0xff, buf,
+						req->wLength);
+		return 0;
+	case USB_HID_GET_IDLE:
+		if (!in || req->wLength != 1)
+			return -1;
+		*buf = idle_rate;
+		*data = buf;
+		return 1;
+	case USB_HID_SET_IDLE:
+		/* One idle rate for all the reports */
+		if (in || req->wLength)
+			return -1;
+		if (stage == USBDEV_STAGE_STATUS) {
+			idle_rate = req->wValue >> 8;
+			idle_count = 0;
+		}
+		return 0;
+	case USB_HID_GET_PROTOCOL:
+		if (!in || req->wValue || req->wLength != 1)
+			return -1;
+		*buf = protocol;
+		*data = buf;
+		return 1;
+	case USB_HID_SET_PROTOCOL:
+		if (in || req->wValue > 1 || req->wLength)
+			return -1;
+		if (stage == USBDEV_STAGE_STATUS)
+			protocol = req->wValue;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+void hiddev_set_configuration(int value)
+{
+	u32 primask;
+
+	primask = irq_save();
+
+	configured = (value != 0);
+
+	/* Discard the queued reports. */
+	queue_head = 0;
+	queue_count = 0;
+	last_len = 0;
+	in_busy = false;
+
+	irq_restore(primask);
+}
+
+void hiddev_reset(void)
+{
+	configured = false;
+	protocol = 1;
+	idle_rate = 0;
+}
+
+void hiddev_init(const struct hiddev_port *p)
+{
+	port = p;
+
+	hiddev_reset();
+	hiddev_set_configuration(0);
+}
@@ -0,0 +1,393 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/cortex.h>
+#include <stm32/l1/usart.h>
+#include <stm32/l1/dma.h>
+#include <stm32/l1/tim.h>
+#include <stm32/l1/gpio.h>
+
+#include <stm32/l1/modbus.h>
+
+/* State */
+enum {
+	MODBUS_RX,			/* Receiving */
+	MODBUS_TX,			/* Sending */
+	MODBUS_WAIT			/* Master: waiting for a response */
+};
+
+/* CRC-16 (polynomial 0xa001, reflected) */
+static const u16 crc_table[256] = {
+	0x0000, 0xc0c1, 0xc181, 0x0140, 0xc301, 0x03c0, 0x0280, 0xc241,
+	0xc601, 0x06c0, 0x0780, 0xc741, 0x0500, 0xc5c1, 0xc481, 0x0440,
+	0xcc01, 0x0cc0, 0x0d80, 0xcd41, 0x0f00, 0xcfc1, 0xce81, 0x0e40,
+	0x0a00, 0xcac1, 0xcb81, 0x0b40, 0xc901, 0x09c0, 0x0880, 0xc841,
+	0xd801, 0x18c0, 0x1980, 0xd941, 0x1b00, 0xdbc1, 0xda81, 0x1a40,
+	0x1e00, 0xdec1, 0xdf81, 0x1f40, 0xdd01, 0x1dc0, 0x1c80, 0xdc41,
+	0x1400, 0xd4c1, 0xd581, 0x1540, 0xd701, 0x17c0, 0x1680, 0xd641,
+	0xd201, 0x12c0, 0x1380, 0xd341, 0x1100, 0xd1c1, 0xd081, 0x1040,
+	0xf001, 0x30c0, 0x3180, 0xf141, 0x3300, 0xf3c1, 0xf281, 0x3240,
+	0x3600, 0xf6c1, 0xf781, 0x3740, 0xf501, 0x35c0, 0x3480, 0xf441,
+	0x3c00, 0xfcc1, 0xfd81, 0x3d40, 0xff01, 0x3fc0, 0x3e80, 0xfe41,
+	0xfa01, 0x3ac0, 0x3b80, 0xfb41, 0x3900, 0xf9c1, 0xf881, 0x3840,
+	0x2800, 0xe8c1, 0xe981, 0x2940, 0xeb01, 0x2bc0, 0x2a80, 0xea41,
+	0xee01, 0x2ec0, 0x2f80, 0xef41, 0x2d00, 0xedc1, 0xec81, 0x2c40,
+	0xe401, 0x24c0, 0x2580, 0xe541, 0x2700, 0xe7c1, 0xe681, 0x2640,
+	0x2200, 0xe2c1, 0xe381, 0x2340, 0xe101, 0x21c0, 0x2080, 0xe041,
+	0xa001, 0x60c0, 0x6180, 0xa141, 0x6300, 0xa3c1, 0xa281, 0x6240,
+	0x6600, 0xa6c1, 0xa781, 0x6740, 0xa501, 0x65c0, 0x6480, 0xa441,
+	0x6c00, 0xacc1, 0xad81, 0x6d40, 0xaf01, 0x6fc0, 0x6e80, 0xae41,
+	0xaa01, 0x6ac0, 0x6b80, 0xab41, 0x6900, 0xa9c1, 0xa881, 0x6840,
+	0x7800, 0xb8c1, 0xb981, 0x7940, 0xbb01, 0x7bc0, 0x7a80, 0xba41,
+	0xbe01, 0x7ec0, 0x7f80, 0xbf41, 0x7d00, 0xbdc1, 0xbc81, 0x7c40,
+	0xb401, 0x74c0, 0x7580, 0xb541, 0x7700, 0xb7c1, 0xb681, 0x7640,
+	0x7200, 0xb2c1, 0xb381, 0x7340, 0xb101, 0x71c0, 0x7080, 0xb041,
+	0x5000, 0x90c1, 0x9181, 0x5140, 0x9301, 0x53c0, 0x5280, 0x9241,
+	0x9601, 0x56c0, 0x5780, 0x9741, 0x5500, 0x95c1, 0x9481, 0x5440,
+	0x9c01, 0x5cc0, 0x5d80, 0x9d41, 0x5f00, 0x9fc1, 0x9e81, 0x5e40,
+	0x5a00, 0x9ac1, 0x9b81, 0x5b40, 0x9901, 0x59c0, 0x5880, 0x9841,
+	0x8801, 0x48c0, 0x4980, 0x8941, 0x4b00, 0x8bc1, 0x8a81, 0x4a40,
+	0x4e00, 0x8ec1, 0x8f81, 0x4f40, 0x8d01, 0x4dc0, 0x4c80, 0x8c41,
+	0x4400, 0x84c1, 0x8581, 0x4540, 0x8701, 0x47c0, 0x4680, 0x8641,
+	0x8201, 0x42c0, 0x4380, 0x8341, 0x4100, 0x81c1, 0x8081, 0x4040,
+};
+
+u16 modbus_crc16(const u8 *buf, int len)
+{
+	u16 crc = 0xffff;
+
+	while (len--)
+		crc = (crc >> 8) ^ crc_table[(crc ^ *buf++) & 0xff];
+	return crc;
+}
+
+static int get16(const u8 *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static void put16(u8 *p, int v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+/* Timer update after 'ticks' (>= 2) */
+static void start_timer(struct modbus *m, int ticks)
+{
+	tim_disable_counter(m->tim);
+	tim_set_autoreload_value(m->tim, ticks - 1);
+	tim_set_counter(m->tim, 0);
+	tim_clear_interrupt(m->tim, TIM_UPDATE);
+	tim_enable_counter(m->tim);
+}
+
+static void start_rx(struct modbus *m)
+{
+	dma_disable(m->dma_rx);
+
+	/* Clear IDLE and the errors (SR and then DR). */
+	usart_get_interrupt_status(m->usart, USART_IDLE);
+	usart_recv(m->usart);
+
+	dma_setup_channel(m->dma_rx, (u32)m->rx, m->dr, MODBUS_ADU_MAX,
+			  DMA_P_TO_M | DMA_M_INC | DMA_P_8BIT | DMA_M_8BIT |
+			  DMA_HIGH | DMA_ENABLE);
+	m->ndt = MODBUS_ADU_MAX;
+	m->state = MODBUS_RX;
+}
+
+/* Send 'len' bytes of 'tx' followed by the CRC. */
+static void send(struct modbus *m, int len)
+{
+	u16 crc;
+
+	crc = modbus_crc16(m->tx, len);
+	m->tx[len++] = crc;
+	m->tx[len++] = crc >> 8;
+
+	tim_disable_counter(m->tim);
+	dma_disable(m->dma_rx);
+	m->state = MODBUS_TX;
+
+	if (m->de)
+		gpio_set(m->de);
+
+	/* TC is set by the last byte. */
+	usart_clear_interrupt(m->usart, USART_TC);
+	dma_disable(m->dma_tx);
+	dma_setup_channel(m->dma_tx, (u32)m->tx, m->dr, len,
+			  DMA_M_TO_P | DMA_M_INC | DMA_P_8BIT | DMA_M_8BIT |
+			  DMA_HIGH | DMA_ENABLE);
+	usart_enable_interrupt(m->usart, USART_TC);
+}
+
+/* Process a request PDU in place, and return the response PDU length. */
+static int slave_request(struct modbus *m, u8 *pdu, int len)
+{
+	u16 regs[125];
+	int addr;
+	int n;
+	int i;
+	int r;
+
+	switch (pdu[0]) {
+	case MODBUS_READ_HOLDING_REGISTERS:
+	case MODBUS_READ_INPUT_REGISTERS:
+		if (!m->read_registers)
+			return -MODBUS_ILLEGAL_FUNCTION;
+		if (len != 5)
+			return -MODBUS_ILLEGAL_DATA_VALUE;
+		addr = get16(pdu + 1);
+		n = get16(pdu + 3);
+		if (n < 1 || n > 125)
+			return -MODBUS_ILLEGAL_DATA_VALUE;
+		if (addr + n > 0x10000)
+			return -MODBUS_ILLEGAL_DATA_ADDRESS;
+		r = m->read_registers(m, pdu[0], addr, n, regs);
+		if (r)
+			return -r;
+		pdu[1] = n * 2;
+		for (i = 0; i < n; i++)
+			put16(pdu + 2 + i * 2, regs[i]);
+		return 2 + n * 2;
+	case MODBUS_WRITE_SINGLE_REGISTER:
+		if (!m->write_registers)
+			return -MODBUS_ILLEGAL_FUNCTION;
+		if (len != 5)
+			return -MODBUS_ILLEGAL_DATA_VALUE;
+		regs[0] = get16(pdu + 3);
+		r = m->write_registers(m, get16(pdu + 1), 1, regs);
+		if (r)
+			return -r;
+		/* Echo of the request */
+		return 5;
+	case MODBUS_WRITE_MULTIPLE_REGISTERS:
+		if (!m->write_registers)
+			return -MODBUS_ILLEGAL_FUNCTION;
+		if (len < 6)
+			return -MODBUS_ILLEGAL_DATA_VALUE;
+		addr = get16(pdu + 1);
+		n = get16(pdu + 3);
+		if (n < 1 || n > 123 || pdu[5] != n * 2 || len != 6 + n * 2)
+			return -MODBUS_ILLEGAL_DATA_VALUE;
+		if (addr + n > 0x10000)
+			return -MODBUS_ILLEGAL_DATA_ADDRESS;
+		for (i = 0; i < n; i++)
+			regs[i] = get16(pdu + 6 + i * 2);
+		r = m->write_registers(m, addr, n, regs);
+		if (r)
+			return -r;
+		/* Address and quantity */
+		return 5;
+	default:
+		if (!m->request)
+			return -MODBUS_ILLEGAL_FUNCTION;
+		return m->request(m, pdu, len);
+	}
+}
+
+/* A frame of 'len' bytes has been received. */
+static void frame(struct modbus *m, int len)
+{
+	bool wait;
+	int i;
+	int n;
+
+	wait = (m->state == MODBUS_WAIT);
+
+	/* The CRC of a frame including its CRC is 0. */
+	if (len < 4 || modbus_crc16(m->rx, len)) {
+		m->error++;
+		start_rx(m);
+		if (wait && m->response)
+			m->response(m, 0, -1);
+		return;
+	}
+
+	/* Master */
+	if (!m->address) {
+		if (!wait || m->rx[0] != m->slave) {
+			start_rx(m);
+			return;
+		}
+		/* 'rx' is not overwritten until start_rx(). */
+		m->state = MODBUS_RX;
+		if (m->response)
+			m->response(m, m->rx + 1, len - 3);
+		if (m->state == MODBUS_RX)
+			start_rx(m);
+		return;
+	}
+
+	/* Slave */
+	if (m->rx[0] != m->address && m->rx[0] != MODBUS_BROADCAST) {
+		start_rx(m);
+		return;
+	}
+
+	for (i = 0; i < len - 2; i++)
+		m->tx[i] = m->rx[i];
+	n = slave_request(m, m->tx + 1, len - 3);
+	if (n < 0) {
+		/* Exception response */
+		m->tx[1] |= 0x80;
+		m->tx[2] = -n;
+		n = 2;
+	}
+
+	/* No response to a broadcast */
+	if (!n || m->rx[0] == MODBUS_BROADCAST)
+		start_rx(m);
+	else
+		send(m, n + 1);
+}
+
+void modbus_usart_isr(struct modbus *m)
+{
+	int status;
+
+	/* End of transmission */
+	if (m->state == MODBUS_TX &&
+	    usart_get_interrupt_mask(m->usart, USART_TC) &&
+	    usart_get_interrupt_status(m->usart, USART_TC)) {
+		usart_disable_interrupt(m->usart, USART_TC);
+		if (m->de)
+			gpio_clear(m->de);
+		start_rx(m);
+
+		if (!m->address && m->slave != MODBUS_BROADCAST) {
+			m->state = MODBUS_WAIT;
+			start_timer(m, m->timeout * (1000 / MODBUS_TICK));
+		} else if (!m->address && m->response) {
+			m->response(m, 0, 0);
+		}
+	}
+
+	status = usart_get_interrupt_status(m->usart, USART_IDLE | USART_ORE |
+					    USART_NF | USART_FE);
+	if (!status)
+		return;
+
+	/* Reading SR and then DR clears the flags. */
+	usart_recv(m->usart);
+
+	/* Wait for the rest of t3.5. */
+	if ((status & USART_IDLE) && m->state != MODBUS_TX) {
+		m->ndt = dma_get_number_of_data(m->dma_rx);
+		start_timer(m, m->gap);
+	}
+}
+
+void modbus_tim_isr(struct modbus *m)
+{
+	int ndt;
+	int len;
+
+	if (!tim_get_interrupt_status(m->tim, TIM_UPDATE))
+		return;
+	tim_clear_interrupt(m->tim, TIM_UPDATE);
+
+	if (m->state == MODBUS_TX)
+		return;
+
+	ndt = dma_get_number_of_data(m->dma_rx);
+	len = MODBUS_ADU_MAX - ndt;
+
+	/* Response timeout */
+	if (m->state == MODBUS_WAIT && !len) {
+		start_rx(m);
+		if (m->response)
+			m->response(m, 0, -1);
+		return;
+	}
+
+	/* Data received after IDLE: wait for the next IDLE. */
+	if (!len || ndt != m->ndt)
+		return;
+
+	frame(m, len);
+}
+
+int modbus_master_send(struct modbus *m, int slave, const u8 *pdu, int len)
+{
+	u32 primask;
+	int i;
+
+	if (len < 1 || len > MODBUS_ADU_MAX - 3)
+		return -1;
+
+	primask = irq_save();
+	if (m->state != MODBUS_RX) {
+		irq_restore(primask);
+		return -1;
+	}
+	m->state = MODBUS_TX;
+	irq_restore(primask);
+
+	m->slave = slave;
+	m->tx[0] = slave;
+	for (i = 0; i < len; i++)
+		m->tx[i + 1] = pdu[i];
+	send(m, len + 1);
+	return 0;
+}
+
+bool modbus_busy(struct modbus *m)
+{
+	return m->state != MODBUS_RX;
+}
+
+u32 modbus_get_error(struct modbus *m)
+{
+	return m->error;
+}
+
+void modbus_init(struct modbus *m)
+{
+	int t1;
+	int t35;
+
+	/* 11 bits per character, fixed t3.5 above 19200 baud */
+	t1 = 11000000 / m->baud;
+	t35 = (m->baud > 19200) ? 1750 : t1 * 7 / 2;
+
+	/* IDLE is set after t1. */
+	m->gap = (t35 - t1 + MODBUS_TICK - 1) / MODBUS_TICK;
+	if (m->gap < 2)
+		m->gap = 2;
+	m->error = 0;
+
+	/* One-pulse timer, the update generation does not set UIF. */
+	tim_disable_counter(m->tim);
+	tim_disable_update_interrupt_on_any(m->tim);
+	tim_setup_counter(m->tim, m->tim_clock / (1000000 / MODBUS_TICK) - 1,
+			  0xffff);
+	tim_enable_one_pulse_mode(m->tim);
+	tim_clear_interrupt(m->tim, TIM_UPDATE);
+	tim_enable_interrupt(m->tim, TIM_UPDATE);
+
+	if (m->de)
+		gpio_clear(m->de);
+
+	usart_disable_interrupt(m->usart, USART_TC);
+	usart_enable_dma(m->usart, USART_DMA_TX_RX);
+	start_rx(m);
+	usart_enable_interrupt(m->usart, USART_IDLE | USART_ERROR);
+}
@@ -0,0 +1,659 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/usbdevfs.h>
+#include <stm32/l1/usbdev.h>
+
+#include <usb/standard.h>
+#include <usb/msc.h>
+
+#include <stm32/l1/msc.h>
+
+/* Bulk-Only Transport state */
+enum {
+	STATE_CBW,		/* Waiting for a CBW */
+	STATE_DATA_OUT,
+	STATE_DATA_IN,
+	STATE_CSW,		/* CSW is not sent yet. */
+	STATE_ERROR		/* Invalid CBW (waiting for Reset Recovery) */
+};
+
+/* Cache entry */
+struct cache_entry {
+	u32 lba;
+	u32 used;		/* cache_clock of the last access */
+	bool valid;
+	bool dirty;
+};
+
+/* MSC port */
+static const struct msc_port *port;
+
+static bool configured;
+static int state;
+
+/* Command and status */
+static struct usb_msc_cbw cbw __attribute__ ((aligned(4)));
+static struct usb_msc_csw csw __attribute__ ((aligned(4)));
+static u32 residue;		/* Data not processed by the device */
+static u8 status;
+
+/* Data phase */
+static u32 xfer;		/* Data to be processed by the device */
+static u32 lba;			/* Next block of READ(10) and WRITE(10) */
+static const u8 *in_ptr;
+static int in_len;		/* Data left in 'in_ptr' */
+static bool in_short;		/* The last packet was short. */
+static u8 *out_ptr;
+static int out_len;		/* Space left in 'out_ptr' */
+static u32 out_left;		/* OUT data left in the transfer */
+static int out_entry;		/* Cache entry being received */
+
+/* Response data, discarded OUT packets */
+static u32 packet[64 / 4];
+
+/* Sense data */
+static u8 sense_key;
+static u16 sense_asc;
+
+/* Write-back cache */
+static struct cache_entry cache[MSC_CACHE_MAX];
+static u32 cache_clock;
+static bool write_error;	/* Not reported to the host yet */
+static int idle;		/* Idle frames */
+
+/* --- Cache --------------------------------------------------------------- */
+
+static u8 *cache_data(int i)
+{
+	return port->cache + i * MSC_BLOCK_SIZE;
+}
+
+static int cache_lookup(u32 block)
+{
+	int i;
+
+	for (i = 0; i < port->cache_blocks; i++) {
+		if (cache[i].valid && cache[i].lba == block)
+			return i;
+	}
+	return -1;
+}
+
+static void cache_write_back(int i)
+{
+	if (!cache[i].dirty)
+		return;
+	if (port->dev->write(cache[i].lba, cache_data(i)) < 0)
+		write_error = true;
+	cache[i].dirty = false;
+}
+
+/*
+ * Get an entry for 'block', writing back the least recently used one.
+ * The entry is invalid until the whole block is received. An entry of
+ * 'block' itself is written back too, not to lose the previous data if
+ * the transfer ends early.
+ */
+static int cache_alloc(u32 block)
+{
+	int i;
+	int victim;
+
+	victim = cache_lookup(block);
+	if (victim < 0) {
+		victim = 0;
+		for (i = 0; i < port->cache_blocks; i++) {
+			if (!cache[i].valid) {
+				victim = i;
+				break;
+			}
+			if ((int)(cache[i].used - cache[victim].used) < 0)
+				victim = i;
+		}
+	}
+	cache_write_back(victim);
+
+	cache[victim].lba = block;
+	cache[victim].valid = false;
+	cache[victim].dirty = false;
+	return victim;
+}
+
+int msc_flush(void)
+{
+	int i;
+
+	for (i = 0; i < port->cache_blocks; i++) {
+		if (cache[i].valid)
+			cache_write_back(i);
+	}
+	return write_error ? -1 : 0;
+}
+
+/* --- Bulk-Only Transport ------------------------------------------------- */
+
+static void fail(u8 key, u16 asc)
+{
+	sense_key = key;
+	sense_asc = asc;
+	status = USB_MSC_CSW_STATUS_FAILED;
+}
+
+static void send_csw(void)
+{
+	/* Deferred write error of the cache */
+	if (write_error) {
+		write_error = false;
+		if (status == USB_MSC_CSW_STATUS_PASSED)
+			fail(SCSI_SENSE_MEDIUM_ERROR, SCSI_ASC_WRITE_FAULT);
+	}
+
+	csw.dCSWSignature = USB_MSC_CSW_SIGNATURE;
+	csw.dCSWTag = cbw.dCBWTag;
+	csw.dCSWDataResidue = residue;
+	csw.bCSWStatus = status;
+	usbdevfs_write_dbl_buf(port->data_tx_ep, (u16 *)&csw,
+			       sizeof(struct usb_msc_csw));
+
+	state = STATE_CBW;
+	idle = 0;
+}
+
+/* Next block of READ(10), from the cache or the block device */
+static void read_block(void)
+{
+	int i;
+
+	i = cache_lookup(lba);
+	if (i >= 0) {
+		cache[i].used = ++cache_clock;
+		in_ptr = cache_data(i);
+	} else if (port->dev->read(lba, port->block) < 0) {
+		fail(SCSI_SENSE_MEDIUM_ERROR, SCSI_ASC_UNRECOVERED_READ_ERROR);
+		xfer = 0;
+		return;
+	} else {
+		in_ptr = port->block;
+	}
+	in_len = MSC_BLOCK_SIZE;
+	lba++;
+}
+
+/* Fill the free buffers of the IN endpoint (data and CSW). */
+static void send_data(void)
+{
+	int n;
+
+	while (usbdevfs_get_dbl_buf_tx_free(port->data_tx_ep)) {
+		if (state == STATE_DATA_IN) {
+			if (!in_len && xfer)
+				read_block();
+			if (xfer) {
+				n = in_len;
+				if (n > port->packet_size)
+					n = port->packet_size;
+				if ((u32)n > xfer)
+					n = xfer;
+				usbdevfs_write_dbl_buf(port->data_tx_ep,
+						       (u16 *)in_ptr, n);
+				in_ptr += n;
+				in_len -= n;
+				xfer -= n;
+				residue -= n;
+				in_short = (n < port->packet_size);
+				continue;
+			}
+
+			/* Terminate the data phase with a short packet. */
+			if (residue && !in_short) {
+				usbdevfs_write_dbl_buf(port->data_tx_ep,
+						       (u16 *)packet, 0);
+				in_short = true;
+				continue;
+			}
+			state = STATE_CSW;
+		}
+
+		if (state != STATE_CSW)
+			break;
+		send_csw();
+	}
+}
+
+static void start_data(bool in, u32 len)
+{
+	bool host_in;
+
+	host_in = ((cbw.bmCBWFlags & USB_MSC_CBW_FLAGS_IN) != 0);
+	if (len && (!residue || in != host_in)) {
+		/* Hn < Di, Hn < Do, Hi <> Do, Ho <> Di */
+		status = USB_MSC_CSW_STATUS_PHASE_ERROR;
+		len = 0;
+	} else if (len > residue) {
+		/* Hi < Di, Ho < Do */
+		status = USB_MSC_CSW_STATUS_PHASE_ERROR;
+		len = residue;
+	}
+	xfer = len;
+
+	if (!residue) {
+		state = STATE_CSW;
+		send_data();
+	} else if (host_in) {
+		state = STATE_DATA_IN;
+		in_short = false;
+		send_data();
+	} else {
+		state = STATE_DATA_OUT;
+		out_len = 0;
+		out_left = residue;
+	}
+}
+
+/* Next block of WRITE(10) into the cache */
+static void write_block(void)
+{
+	out_entry = cache_alloc(lba);
+	out_ptr = cache_data(out_entry);
+	out_len = MSC_BLOCK_SIZE;
+	lba++;
+}
+
+/* Receive an OUT data packet. */
+static void receive_data(void)
+{
+	u8 *p;
+	int n;
+
+	if (!out_len && xfer)
+		write_block();
+
+	/* Data beyond the command is discarded. */
+	p = out_len ? out_ptr : (u8 *)packet;
+	n = usbdevfs_read_dbl_buf(port->data_rx_ep, (u16 *)p,
+				  port->packet_size);
+	if ((u32)n > out_left)
+		n = out_left;
+	out_left -= n;
+
+	if (out_len) {
+		out_ptr += n;
+		out_len -= n;
+		xfer -= n;
+		residue -= n;
+		if (!out_len) {
+			cache[out_entry].valid = true;
+			cache[out_entry].dirty = true;
+			cache[out_entry].used = ++cache_clock;
+		}
+	}
+
+	if (!out_left || n < port->packet_size) {
+		state = STATE_CSW;
+		send_data();
+	}
+}
+
+/* --- SCSI commands ------------------------------------------------------- */
+
+/* Copy a string padded with spaces. */
+static void copy_id(u8 *d, const char *s, int len)
+{
+	while (len--)
+		*d++ = (s && *s) ? *s++ : ' ';
+}
+
+/* IN data in 'packet', up to the allocation length */
+static u32 reply(u32 len, u32 alloc)
+{
+	if (len > alloc)
+		len = alloc;
+	in_ptr = (const u8 *)packet;
+	in_len = len;
+	return len;
+}
+
+static u32 inquiry(void)
+{
+	struct scsi_inquiry_data *p;
+
+	p = (struct scsi_inquiry_data *)packet;
+	p->peripheral = SCSI_TYPE_DISK;
+	p->rmb = 0x80;
+	p->version = 0x04;		/* SPC-2 */
+	p->response_data_format = 0x02;
+	p->additional_length = sizeof(struct scsi_inquiry_data) - 5;
+	p->flags[0] = 0;
+	p->flags[1] = 0;
+	p->flags[2] = 0;
+	copy_id(p->vendor_id, port->vendor, sizeof(p->vendor_id));
+	copy_id(p->product_id, port->product, sizeof(p->product_id));
+	copy_id(p->product_revision, port->revision,
+		sizeof(p->product_revision));
+
+	return sizeof(struct scsi_inquiry_data);
+}
+
+static u32 request_sense(void)
+{
+	struct scsi_sense_data *p;
+	u8 *b;
+	int i;
+
+	b = (u8 *)packet;
+	for (i = 0; i < (int)sizeof(struct scsi_sense_data); i++)
+		b[i] = 0;
+
+	p = (struct scsi_sense_data *)packet;
+	p->response_code = SCSI_SENSE_RESPONSE_CURRENT;
+	p->sense_key = sense_key;
+	p->additional_length = sizeof(struct scsi_sense_data) - 8;
+	p->asc = sense_asc >> 8;
+	p->ascq = sense_asc;
+
+	sense_key = SCSI_SENSE_NO_SENSE;
+	sense_asc = SCSI_ASC_NONE;
+
+	return sizeof(struct scsi_sense_data);
+}
+
+/* MODE SENSE(6) and (10) header without block descriptors and pages */
+static u32 mode_sense(bool ten)
+{
+	u8 *b;
+	u8 wp;
+
+	b = (u8 *)packet;
+	wp = port->dev->write ? 0 : 0x80;
+	if (ten) {
+		b[0] = 0;
+		b[1] = 6;		/* Mode data length */
+		b[2] = 0;
+		b[3] = wp;
+		b[4] = 0;
+		b[5] = 0;
+		b[6] = 0;
+		b[7] = 0;
+		return 8;
+	}
+	b[0] = 3;			/* Mode data length */
+	b[1] = 0;
+	b[2] = wp;
+	b[3] = 0;
+	return 4;
+}
+
+static u32 read_capacity(void)
+{
+	u8 *b;
+
+	b = (u8 *)packet;
+	SCSI_PUT_BE32(b, port->dev->block_count - 1);
+	SCSI_PUT_BE32(b + 4, MSC_BLOCK_SIZE);
+	return 8;
+}
+
+static u32 read_format_capacities(void)
+{
+	u8 *b;
+
+	b = (u8 *)packet;
+	b[0] = 0;
+	b[1] = 0;
+	b[2] = 0;
+	b[3] = 8;			/* Capacity list length */
+	SCSI_PUT_BE32(b + 4, port->dev->block_count);
+	SCSI_PUT_BE32(b + 8, MSC_BLOCK_SIZE);
+	b[8] = 0x02;			/* Formatted media */
+	return 12;
+}
+
+/* Check the LBA and the transfer length of READ(10) etc. */
+static bool range_error(const u8 *cb)
+{
+	u32 block;
+	u32 n;
+
+	block = SCSI_GET_BE32(cb + 2);
+	n = SCSI_GET_BE16(cb + 7);
+	if (block >= port->dev->block_count ||
+	    n > port->dev->block_count - block) {
+		fail(SCSI_SENSE_ILLEGAL_REQUEST, SCSI_ASC_LBA_OUT_OF_RANGE);
+		return true;
+	}
+	lba = block;
+	return false;
+}
+
+static void scsi_command(void)
+{
+	const u8 *cb;
+	bool in;
+	u32 len;
+
+	cb = cbw.CBWCB;
+	in = false;
+	len = 0;
+
+	/* Sense data of the previous command */
+	if (cb[0] != SCSI_REQUEST_SENSE) {
+		sense_key = SCSI_SENSE_NO_SENSE;
+		sense_asc = SCSI_ASC_NONE;
+	}
+
+	switch (cb[0]) {
+	case SCSI_TEST_UNIT_READY:
+		break;
+	case SCSI_REQUEST_SENSE:
+		in = true;
+		len = reply(request_sense(), cb[4]);
+		break;
+	case SCSI_INQUIRY:
+		/* Vital product data is not supported. */
+		if (cb[1] & 0x01) {
+			fail(SCSI_SENSE_ILLEGAL_REQUEST,
+			     SCSI_ASC_INVALID_FIELD_IN_CDB);
+			break;
+		}
+		in = true;
+		len = reply(inquiry(), SCSI_GET_BE16(cb + 3));
+		break;
+	case SCSI_MODE_SENSE_6:
+		in = true;
+		len = reply(mode_sense(false), cb[4]);
+		break;
+	case SCSI_MODE_SENSE_10:
+		in = true;
+		len = reply(mode_sense(true), SCSI_GET_BE16(cb + 7));
+		break;
+	case SCSI_START_STOP_UNIT:
+	case SCSI_PREVENT_ALLOW_MEDIUM_REMOVAL:
+	case SCSI_SYNCHRONIZE_CACHE_10:
+		msc_flush();
+		break;
+	case SCSI_READ_FORMAT_CAPACITIES:
+		in = true;
+		len = reply(read_format_capacities(), SCSI_GET_BE16(cb + 7));
+		break;
+	case SCSI_READ_CAPACITY_10:
+		in = true;
+		len = reply(read_capacity(), 8);
+		break;
+	case SCSI_READ_10:
+		if (range_error(cb))
+			break;
+		in = true;
+		len = SCSI_GET_BE16(cb + 7) * MSC_BLOCK_SIZE;
+		in_len = 0;
+		break;
+	case SCSI_WRITE_10:
+		if (!port->dev->write) {
+			fail(SCSI_SENSE_DATA_PROTECT,
+			     SCSI_ASC_WRITE_PROTECTED);
+			break;
+		}
+		if (range_error(cb))
+			break;
+		len = SCSI_GET_BE16(cb + 7) * MSC_BLOCK_SIZE;
+		break;
+	case SCSI_VERIFY_10:
+		/* Byte check (data-out) is not supported. */
+		if (cb[1] & 0x02) {
+			fail(SCSI_SENSE_ILLEGAL_REQUEST,
+			     SCSI_ASC_INVALID_FIELD_IN_CDB);
+			break;
+		}
+		range_error(cb);
+		break;
+	default:
+		fail(SCSI_SENSE_ILLEGAL_REQUEST,
+		     SCSI_ASC_INVALID_COMMAND_OPERATION_CODE);
+		break;
+	}
+
+	start_data(in, len);
+}
+
+/* Receive a CBW. */
+static void receive_cbw(void)
+{
+	int n;
+
+	n = usbdevfs_read_dbl_buf(port->data_rx_ep, (u16 *)&cbw,
+				  sizeof(struct usb_msc_cbw));
+
+	/* Stall both endpoints until Reset Recovery. */
+	if (n != sizeof(struct usb_msc_cbw) ||
+	    cbw.dCBWSignature != USB_MSC_CBW_SIGNATURE) {
+		usbdev_set_endpoint_halt(port->data_tx_ep | USB_DIR_IN);
+		usbdev_set_endpoint_halt(port->data_rx_ep);
+		state = STATE_ERROR;
+		return;
+	}
+
+	residue = cbw.dCBWDataTransferLength;
+	status = USB_MSC_CSW_STATUS_PASSED;
+	idle = 0;
+
+	if (cbw.bCBWLUN || !cbw.bCBWCBLength || cbw.bCBWCBLength > 16) {
+		fail(SCSI_SENSE_ILLEGAL_REQUEST,
+		     SCSI_ASC_INVALID_FIELD_IN_CDB);
+		start_data(false, 0);
+		return;
+	}
+	scsi_command();
+}
+
+/* --- USB ----------------------------------------------------------------- */
+
+void msc_data_rx(void)
+{
+	usbdevfs_complete_dbl_buf_rx(port->data_rx_ep);
+	if (!configured)
+		return;
+
+	/* Packets are left (NAK) in the data-in and status phases. */
+	while (usbdevfs_get_dbl_buf_rx_count(port->data_rx_ep)) {
+		if (state == STATE_CBW)
+			receive_cbw();
+		else if (state == STATE_DATA_OUT)
+			receive_data();
+		else
+			break;
+	}
+}
+
+void msc_data_tx(void)
+{
+	usbdevfs_complete_dbl_buf_tx(port->data_tx_ep);
+	if (configured)
+		send_data();
+}
+
+void msc_sof(void)
+{
+	if (state != STATE_CBW || idle >= MSC_FLUSH_DELAY)
+		return;
+
+	/* Errors are reported with the next command. */
+	if (++idle == MSC_FLUSH_DELAY)
+		msc_flush();
+}
+
+/* --- Class-specific Requests --------------------------------------------- */
+
+int msc_request(struct usb_setup_data *req, usbdev_stage_t stage, u8 *buf,
+		u8 **data)
+{
+	/* bmRequestType = x0100001B */
+	if ((req->bmRequestType & ~USB_DIR_IN) !=
+	    (USB_TYPE_CLASS | USB_RECIP_INTERFACE) ||
+	    req->wIndex != port->interface || req->wValue)
+		return -1;
+
+	switch (req->bRequest) {
+	case USB_MSC_REQ_GET_MAX_LUN:
+		if (!(req->bmRequestType & USB_DIR_IN) || req->wLength != 1)
+			return -1;
+		*buf = 0;
+		*data = buf;
+		return 1;
+	case USB_MSC_REQ_BOMSR:
+		/* The host clears the halt of the endpoints after this. */
+		if ((req->bmRequestType & USB_DIR_IN) || req->wLength)
+			return -1;
+		if (stage == USBDEV_STAGE_STATUS)
+			state = STATE_CBW;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+void msc_set_configuration(int value)
+{
+	configured = (value != 0);
+	state = STATE_CBW;
+}
+
+void msc_reset(void)
+{
+	/* Dirty blocks are written after MSC_FLUSH_DELAY frames. */
+	configured = false;
+	state = STATE_CBW;
+	idle = 0;
+}
+
+void msc_init(const struct msc_port *p)
+{
+	int i;
+
+	port = p;
+
+	for (i = 0; i < MSC_CACHE_MAX; i++) {
+		cache[i].valid = false;
+		cache[i].dirty = false;
+	}
+	cache_clock = 0;
+	write_error = false;
+	sense_key = SCSI_SENSE_NO_SENSE;
+	sense_asc = SCSI_ASC_NONE;
+	state = STATE_CBW;
+}
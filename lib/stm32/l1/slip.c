@@ -0,0 +1,135 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/slip.h>
+
+/* --- Encoder ------------------------------------------------------------- */
+
+/* Append a byte. 'len' keeps counting when out of space. */
+static void put(struct slip_encoder *e, int c)
+{
+	if (e->len++ >= e->space)
+		return;
+	e->buf[e->pos] = c;
+	if (++e->pos >= e->size)
+		e->pos = 0;
+}
+
+void slip_encode_begin(struct slip_encoder *e, u8 *buf, int size, int pos,
+		       int space)
+{
+	e->buf = buf;
+	e->size = size;
+	e->pos = pos;
+	e->space = space;
+	e->len = 0;
+
+	/* Flush the noise on the line. */
+	put(e, SLIP_END);
+}
+
+int slip_encode(struct slip_encoder *e, const void *data, int len)
+{
+	const u8 *p = data;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		switch (p[i]) {
+		case SLIP_END:
+			put(e, SLIP_ESC);
+			put(e, SLIP_ESC_END);
+			break;
+		case SLIP_ESC:
+			put(e, SLIP_ESC);
+			put(e, SLIP_ESC_ESC);
+			break;
+		default:
+			put(e, p[i]);
+			break;
+		}
+	}
+
+	return (e->len <= e->space) ? 0 : -1;
+}
+
+int slip_encode_end(struct slip_encoder *e)
+{
+	put(e, SLIP_END);
+
+	return (e->len <= e->space) ? e->len : -1;
+}
+
+/* --- Decoder ------------------------------------------------------------- */
+
+static void reset(struct slip_decoder *d)
+{
+	d->len = 0;
+	d->esc = false;
+	d->error = false;
+}
+
+static void store(struct slip_decoder *d, int c)
+{
+	if (d->len < d->size)
+		d->buf[d->len++] = c;
+	else
+		d->error = true;
+}
+
+void slip_decoder_init(struct slip_decoder *d)
+{
+	reset(d);
+	d->errors = 0;
+}
+
+void slip_decode(struct slip_decoder *d, const void *data, int len)
+{
+	const u8 *p = data;
+	int c;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		c = p[i];
+
+		if (c == SLIP_END) {
+			if (d->error || d->esc)
+				d->errors++;
+			else if (d->len)
+				d->frame(d, d->buf, d->len);
+			reset(d);
+		} else if (d->esc) {
+			if (c == SLIP_ESC_END)
+				store(d, SLIP_END);
+			else if (c == SLIP_ESC_ESC)
+				store(d, SLIP_ESC);
+			else
+				d->error = true;
+			d->esc = false;
+		} else if (c == SLIP_ESC) {
+			d->esc = true;
+		} else {
+			store(d, c);
+		}
+	}
+}
+
+u32 slip_decoder_get_error(struct slip_decoder *d)
+{
+	return d->errors;
+}
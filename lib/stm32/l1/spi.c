@@ -200,18 +200,20 @@ u16 spi_recv(spi_t spi)
 
 int spi_transfer(spi_t spi, u16 data)
 {
+	u32 base;
 	u32 r;
 
-	while (!((r = SPI_SR(base_addr(spi))) & (SPI_SR_TXE | SPI_SR_ERROR)))
+	base = base_addr(spi);
+	while (!((r = SPI_SR(base)) & (SPI_SR_TXE | SPI_SR_ERROR)))
 		;
 	if (r & SPI_SR_ERROR)
 		return -SPI_TRANSFER_ERROR | r;
 
-	SPI_DR(base_addr(spi)) = data;
-	while (!((r = SPI_SR(base_addr(spi))) & (SPI_SR_RXNE | SPI_SR_ERROR)))
+	SPI_DR(base) = data;
+	while (!((r = SPI_SR(base)) & (SPI_SR_RXNE | SPI_SR_ERROR)))
 		;
 	if (r & SPI_SR_ERROR)
 		return -SPI_TRANSFER_ERROR | r;
 
-	return SPI_DR(base_addr(spi));
+	return SPI_DR(base);
 }
@@ -0,0 +1,147 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/cortex.h>
+#include <stm32/l1/spi.h>
+#include <stm32/l1/dma.h>
+#include <stm32/l1/gpio.h>
+#include <stm32/l1/spidma.h>
+
+#include <stm32/l1/spibus.h>
+
+static void segment_done(void *arg);
+
+/* Start the next non-empty segment, and return false if none. */
+static bool start_segment(struct spibus *bus)
+{
+	struct spibus_transaction *t = bus->head;
+	const struct spibus_segment *s;
+
+	while (t->index < t->num_seg) {
+		s = &t->seg[t->index++];
+		if (s->len > 0) {
+			spidma_transfer(&bus->dma, s->tx, s->rx, s->len,
+					segment_done, bus);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void finish(struct spibus *bus, int error);
+
+/* Start the transaction at the head of the queue. */
+static void start(struct spibus *bus)
+{
+	struct spibus_transaction *t = bus->head;
+	const struct spibus_device *dev = t->dev;
+
+	bus->running = true;
+
+	/* Reconfigure the SPI for another device. */
+	if (dev != bus->dev) {
+		spi_disable(bus->spi);
+		spi_set_mode(bus->spi, dev->prescaler, dev->mode |
+			     SPI_NSS_SOFTWARE | SPI_NSS_HIGH | SPI_MASTER |
+			     SPI_ENABLE);
+		bus->dma.wide = ((dev->mode & SPI_16BIT) != 0);
+		bus->dev = dev;
+	}
+
+	gpio_clear(dev->cs);
+
+	t->index = 0;
+	bus->error = spidma_get_error(&bus->dma);
+	if (!start_segment(bus))
+		finish(bus, 0);
+}
+
+/* Complete the transaction at the head, and start the next one. */
+static void finish(struct spibus *bus, int error)
+{
+	struct spibus_transaction *t = bus->head;
+
+	gpio_set(t->dev->cs);
+
+	bus->head = t->next;
+	if (!bus->head)
+		bus->tail = 0;
+	bus->running = false;
+
+	/* 'done' may submit a transaction, which starts at once. */
+	if (t->done)
+		t->done(t, error);
+
+	if (!bus->running && bus->head)
+		start(bus);
+}
+
+static void segment_done(void *arg)
+{
+	struct spibus *bus = arg;
+
+	if (spidma_get_error(&bus->dma) != bus->error)
+		finish(bus, -1);
+	else if (!start_segment(bus))
+		finish(bus, 0);
+}
+
+void spibus_isr(struct spibus *bus)
+{
+	spidma_isr(&bus->dma);
+}
+
+void spibus_submit(struct spibus *bus, struct spibus_transaction *t)
+{
+	u32 primask;
+
+	t->next = 0;
+
+	primask = irq_save();
+	if (bus->tail)
+		bus->tail->next = t;
+	else
+		bus->head = t;
+	bus->tail = t;
+
+	if (!bus->running)
+		start(bus);
+	irq_restore(primask);
+}
+
+bool spibus_busy(struct spibus *bus)
+{
+	return bus->head != 0;
+}
+
+void spibus_init(struct spibus *bus)
+{
+	bus->dma.spi = bus->spi;
+	bus->dma.dr = bus->dr;
+	bus->dma.dma_rx = bus->dma_rx;
+	bus->dma.dma_tx = bus->dma_tx;
+	bus->dma.wide = false;
+	bus->dma.fill = 0;
+	spidma_init(&bus->dma);
+
+	bus->dev = 0;
+	bus->head = 0;
+	bus->tail = 0;
+	bus->running = false;
+}
@@ -0,0 +1,141 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/cortex.h>
+#include <stm32/l1/spi.h>
+#include <stm32/l1/dma.h>
+
+#include <stm32/l1/spidma.h>
+
+int spidma_transfer(struct spidma *s, const void *tx, void *rx, int len,
+		    void (*done)(void *arg), void *arg)
+{
+	u32 primask;
+	int size;
+	int rx_mode;
+	int tx_mode;
+
+	if (len <= 0)
+		return -1;
+
+	primask = irq_save();
+	if (s->busy) {
+		irq_restore(primask);
+		return -1;
+	}
+	s->busy = true;
+	irq_restore(primask);
+
+	s->done = done;
+	s->arg = arg;
+
+	size = s->wide ? (DMA_P_16BIT | DMA_M_16BIT) : (DMA_P_8BIT | DMA_M_8BIT);
+
+	/* The Rx channel has the higher priority not to overrun. */
+	rx_mode = DMA_P_TO_M | size | DMA_VERYHIGH | DMA_COMPLETE | DMA_ERROR;
+	if (rx)
+		rx_mode |= DMA_M_INC;
+	else
+		rx = &s->discard;
+
+	tx_mode = DMA_M_TO_P | size | DMA_HIGH | DMA_ERROR;
+	if (tx)
+		tx_mode |= DMA_M_INC;
+	else
+		tx = &s->fill;
+
+	dma_disable(s->dma_rx);
+	dma_disable(s->dma_tx);
+	dma_clear_interrupt(s->dma_rx, DMA_ERROR | DMA_HALF | DMA_COMPLETE |
+			    DMA_GLOBAL);
+	dma_clear_interrupt(s->dma_tx, DMA_ERROR | DMA_HALF | DMA_COMPLETE |
+			    DMA_GLOBAL);
+	dma_setup_channel(s->dma_rx, (u32)rx, s->dr, len, rx_mode);
+	dma_setup_channel(s->dma_tx, (u32)tx, s->dr, len, tx_mode);
+
+	/* Rx first, and Tx starts the transfer. */
+	spi_enable_dma(s->spi, SPI_DMA_RX);
+	dma_enable(s->dma_rx);
+	dma_enable(s->dma_tx);
+	spi_enable_dma(s->spi, SPI_DMA_TX);
+
+	return 0;
+}
+
+void spidma_isr(struct spidma *s)
+{
+	int rx;
+	int tx;
+
+	rx = dma_desc_get_interrupt_status(s->desc_rx,
+					   DMA_ERROR | DMA_COMPLETE);
+	tx = dma_desc_get_interrupt_status(s->desc_tx, DMA_ERROR);
+	if (!rx && !tx)
+		return;
+	dma_desc_clear_interrupt(s->desc_rx, rx | DMA_GLOBAL);
+	dma_desc_clear_interrupt(s->desc_tx, tx | DMA_GLOBAL);
+
+	/* The transfer stops at an error. */
+	if ((rx | tx) & DMA_ERROR)
+		s->error++;
+
+	dma_desc_disable(s->desc_rx);
+	dma_desc_disable(s->desc_tx);
+	spi_disable_dma(s->spi, SPI_DMA_TX_RX);
+
+	s->busy = false;
+	if (s->done)
+		s->done(s->arg);
+}
+
+int spidma_transfer_wait(struct spidma *s, const void *tx, void *rx,
+			 int len)
+{
+	u32 error;
+
+	error = s->error;
+	while (spidma_transfer(s, tx, rx, len, 0, 0))
+		;
+	while (s->busy)
+		;
+	return (s->error == error) ? 0 : -1;
+}
+
+bool spidma_busy(struct spidma *s)
+{
+	return s->busy;
+}
+
+u32 spidma_get_error(struct spidma *s)
+{
+	return s->error;
+}
+
+void spidma_init(struct spidma *s)
+{
+	s->desc_rx = dma_get_channel_desc(s->dma_rx);
+	s->desc_tx = dma_get_channel_desc(s->dma_tx);
+	dma_disable(s->dma_rx);
+	dma_disable(s->dma_tx);
+	spi_disable_dma(s->spi, SPI_DMA_TX_RX);
+
+	s->busy = false;
+	s->done = 0;
+	s->error = 0;
+}
@@ -38,8 +38,73 @@ static u32 base_addr(usart_t usart)
 	return 0;
 }
 
+/*
+ * clock / baud is USARTDIV in 1/16 (OVER8 = 0) and in 1/8 (OVER8 = 1), so
+ * both have the same resolution. Oversampling by 8 is less tolerant of
+ * the clock deviation, and is used only above clock / 16.
+ */
+int usart_calc_baudrate(int clock, int baud, struct usart_baudrate *br)
+{
+	u32 div;
+	u32 rate;
+	u32 diff;
+
+	if (clock <= 0 || baud <= 0)
+		return -1;
+
+	/* Round to nearest. */
+	div = ((u32)clock + baud / 2) / baud;
+	if (div >= 16 && div <= 0xffff) {
+		br->over8 = false;
+		br->brr = div;
+	} else if (div >= 8 && div < 16) {
+		br->over8 = true;
+		br->brr = ((div >> 3) << 4) | (div & 7);
+	} else {
+		return -1;
+	}
+
+	br->baud = ((u32)clock + div / 2) / div;
+
+	/* Error (ppm) = (clock / div - baud) / baud */
+	rate = div * baud;
+	if ((u32)clock >= rate) {
+		diff = clock - rate;
+		br->error = (u64)diff * 1000000 / rate;
+	} else {
+		diff = rate - clock;
+		br->error = -(int)((u64)diff * 1000000 / rate);
+	}
+	return 0;
+}
+
+static void set_brr(u32 base, const struct usart_baudrate *br)
+{
+	if (br->over8)
+		USART_CR1(base) |= USART_CR1_OVER8;
+	else
+		USART_CR1(base) &= ~USART_CR1_OVER8;
+	USART_BRR(base) = br->brr;
+}
+
+int usart_set_baudrate_tolerance(usart_t usart, int clock, int baud,
+				 int tolerance, struct usart_baudrate *br)
+{
+	struct usart_baudrate tmp;
+
+	if (!br)
+		br = &tmp;
+	if (usart_calc_baudrate(clock, baud, br) ||
+	    br->error > tolerance || br->error < -tolerance)
+		return -1;
+	set_brr(base_addr(usart), br);
+	return 0;
+}
+
 void usart_set_baudrate(usart_t usart, int clock, int baud)
 {
+	struct usart_baudrate br;
+
 	/*
 	 * Yes it is as simple as that. The reference manual is
 	 * talking about fractional calculation but it seems to be only
@@ -49,9 +114,8 @@ void usart_set_baudrate(usart_t usart, int clock, int baud)
 	 * Note: We round() the value rather than floor()ing it, for more
 	 * accurate divisor selection.
 	 */
-	/* oversampling by 16 (OVER8 = 0) */
-	USART_BRR(base_addr(usart)) =
-		((2 * clock) + baud) / (2 * baud);
+	if (!usart_calc_baudrate(clock, baud, &br))
+		set_brr(base_addr(usart), &br);
 }
 
 void usart_set_databits(usart_t usart, int bits)
@@ -130,7 +194,7 @@ void usart_init(usart_t usart, int clock, int baud, int bits,
 	base = base_addr(usart);
 
 	/* Baudrate */
-	USART_BRR(base) = ((2 * clock) + baud) / (2 * baud);
+	usart_set_baudrate(usart, clock, baud);
 
 	/* Data bits */
 	reg32 = USART_CR1(base);
@@ -193,6 +257,12 @@ u16 usart_recv(usart_t usart)
 	return USART_DR(base_addr(usart));
 }
 
+void usart_send_break(usart_t usart)
+{
+	/* Break character is sent after the current transmission. */
+	USART_CR1(base_addr(usart)) |= USART_CR1_SBK;
+}
+
 void usart_wait_send_ready(usart_t usart)
 {
 	/* Wait until the data has been transferred into the shift register. */
@@ -0,0 +1,199 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/usart.h>
+
+#include <stm32/l1/usartbuf.h>
+
+void usartbuf_isr(struct usartbuf *u)
+{
+	int status;
+	int next;
+	u8 data;
+
+	status = usart_get_interrupt_status(u->usart, USART_TXE | USART_RXNE |
+					    USART_ORE | USART_NF | USART_FE |
+					    USART_PE);
+
+	/* Reading SR and then DR clears the error flags. */
+	if (status & (USART_RXNE | USART_ORE)) {
+		if (status & USART_ORE)
+			u->ore++;
+		if (status & USART_FE)
+			u->fe++;
+		if (status & USART_NF)
+			u->nf++;
+		if (status & USART_PE)
+			u->pe++;
+
+		data = usart_recv(u->usart);
+		if (status & USART_RXNE) {
+			next = u->rx_tail + 1;
+			if (next >= u->rx_size)
+				next = 0;
+			if (next == u->rx_head) {
+				u->overflow++;
+			} else {
+				u->rx_ring[u->rx_tail] = data;
+				u->rx_tail = next;
+			}
+		}
+	}
+
+	/* TXE is set whenever the transmit data register is empty. */
+	if ((status & USART_TXE) &&
+	    usart_get_interrupt_mask(u->usart, USART_TXE)) {
+		if (u->tx_head == u->tx_tail) {
+			usart_disable_interrupt(u->usart, USART_TXE);
+		} else {
+			usart_send(u->usart, u->tx_ring[u->tx_head]);
+			next = u->tx_head + 1;
+			if (next >= u->tx_size)
+				next = 0;
+			u->tx_head = next;
+		}
+	}
+}
+
+int usartbuf_get_rx_count(struct usartbuf *u)
+{
+	int n;
+
+	n = u->rx_tail - u->rx_head;
+	if (n < 0)
+		n += u->rx_size;
+	return n;
+}
+
+int usartbuf_get_tx_free(struct usartbuf *u)
+{
+	int n;
+
+	n = u->tx_head - u->tx_tail - 1;
+	if (n < 0)
+		n += u->tx_size;
+	return n;
+}
+
+bool usartbuf_tx_empty(struct usartbuf *u)
+{
+	return u->tx_head == u->tx_tail;
+}
+
+int usartbuf_write(struct usartbuf *u, const void *buf, int len)
+{
+	const u8 *p = buf;
+	int tail;
+	int n;
+	int i;
+
+	n = usartbuf_get_tx_free(u);
+	if (len > n)
+		len = n;
+	if (!len)
+		return 0;
+
+	tail = u->tx_tail;
+	for (i = 0; i < len; i++) {
+		u->tx_ring[tail++] = p[i];
+		if (tail >= u->tx_size)
+			tail = 0;
+	}
+	u->tx_tail = tail;
+
+	usart_enable_interrupt(u->usart, USART_TXE);
+	return len;
+}
+
+int usartbuf_tx_reserve(struct usartbuf *u, int *pos)
+{
+	*pos = u->tx_tail;
+	return usartbuf_get_tx_free(u);
+}
+
+void usartbuf_tx_commit(struct usartbuf *u, int len)
+{
+	int tail;
+
+	if (len <= 0)
+		return;
+
+	tail = u->tx_tail + len;
+	if (tail >= u->tx_size)
+		tail -= u->tx_size;
+	u->tx_tail = tail;
+
+	usart_enable_interrupt(u->usart, USART_TXE);
+}
+
+int usartbuf_read(struct usartbuf *u, void *buf, int len)
+{
+	u8 *p = buf;
+	int head;
+	int n;
+	int i;
+
+	n = usartbuf_get_rx_count(u);
+	if (len > n)
+		len = n;
+
+	head = u->rx_head;
+	for (i = 0; i < len; i++) {
+		p[i] = u->rx_ring[head++];
+		if (head >= u->rx_size)
+			head = 0;
+	}
+	u->rx_head = head;
+	return len;
+}
+
+u32 usartbuf_get_error(struct usartbuf *u, int error)
+{
+	u32 n = 0;
+
+	if (error & USART_ORE)
+		n += u->ore;
+	if (error & USART_FE)
+		n += u->fe;
+	if (error & USART_NF)
+		n += u->nf;
+	if (error & USART_PE)
+		n += u->pe;
+	return n;
+}
+
+u32 usartbuf_get_overflow(struct usartbuf *u)
+{
+	return u->overflow;
+}
+
+void usartbuf_init(struct usartbuf *u)
+{
+	u->rx_head = 0;
+	u->rx_tail = 0;
+	u->tx_head = 0;
+	u->tx_tail = 0;
+	u->ore = 0;
+	u->fe = 0;
+	u->nf = 0;
+	u->pe = 0;
+	u->overflow = 0;
+
+	usart_enable_interrupt(u->usart, USART_RXNE);
+}
@@ -0,0 +1,149 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/cortex.h>
+#include <stm32/l1/usart.h>
+#include <stm32/l1/dma.h>
+
+#include <stm32/l1/usartlog.h>
+
+#include <syscall.h>
+
+/* Output of _write() */
+static struct usartlog *stdout_log;
+
+static int tx_free(struct usartlog *log)
+{
+	int n;
+
+	n = log->head - log->tail - 1;
+	if (n < 0)
+		n += log->size;
+	return n;
+}
+
+/* Send the ring buffer (until the end of the buffer) by DMA. */
+static void start_dma(struct usartlog *log)
+{
+	int len;
+
+	if (log->dma_len || log->head == log->tail)
+		return;
+
+	if (log->tail > log->head)
+		len = log->tail - log->head;
+	else
+		len = log->size - log->head;
+	log->dma_len = len;
+
+	dma_disable(log->dma);
+	/* TC is set by the last byte, for usartlog_flush(). */
+	usart_clear_interrupt(log->usart, USART_TC);
+	dma_setup_channel(log->dma, (u32)(log->ring + log->head), log->dr, len,
+			  DMA_M_TO_P | DMA_M_INC | DMA_P_8BIT | DMA_M_8BIT |
+			  DMA_LOW | DMA_COMPLETE | DMA_ENABLE);
+}
+
+void usartlog_dma_isr(struct usartlog *log)
+{
+	int head;
+
+	if (!dma_get_interrupt_status(log->dma, DMA_COMPLETE))
+		return;
+	dma_clear_interrupt(log->dma, DMA_COMPLETE | DMA_GLOBAL);
+
+	head = log->head + log->dma_len;
+	if (head >= log->size)
+		head -= log->size;
+	log->head = head;
+	log->dma_len = 0;
+
+	/* Next chunk */
+	start_dma(log);
+}
+
+int usartlog_write(struct usartlog *log, const void *buf, int len)
+{
+	const u8 *p = buf;
+	u32 primask;
+	int tail;
+	int done = 0;
+	int n;
+
+	while (done < len) {
+		n = tx_free(log);
+		if (!n) {
+			if (log->policy == USARTLOG_BLOCK)
+				continue;
+			log->dropped += len - done;
+			break;
+		}
+		if (n > len - done)
+			n = len - done;
+
+		tail = log->tail;
+		while (n--) {
+			log->ring[tail++] = p[done++];
+			if (tail >= log->size)
+				tail = 0;
+		}
+		log->tail = tail;
+
+		primask = irq_save();
+		start_dma(log);
+		irq_restore(primask);
+	}
+	return done;
+}
+
+void usartlog_flush(struct usartlog *log)
+{
+	while (log->head != log->tail)
+		;
+	while (!usart_get_interrupt_status(log->usart, USART_TC))
+		;
+}
+
+u32 usartlog_get_dropped(struct usartlog *log)
+{
+	return log->dropped;
+}
+
+void usartlog_init(struct usartlog *log)
+{
+	log->head = 0;
+	log->tail = 0;
+	log->dma_len = 0;
+	log->dropped = 0;
+
+	usart_enable_dma(log->usart, USART_DMA_TX);
+	stdout_log = log;
+}
+
+int _write(int file, char *ptr, int len)
+{
+	if ((file == 1 || file == 2) && stdout_log) {
+		/* Dropped data is not an error, or newlib tries again. */
+		usartlog_write(stdout_log, ptr, len);
+		return len;
+	}
+
+	errno = EIO;
+	return -1;
+}
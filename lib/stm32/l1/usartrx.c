@@ -0,0 +1,124 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/usart.h>
+#include <stm32/l1/dma.h>
+
+#include <stm32/l1/usartrx.h>
+
+/* Pass the data from 'head' to the DMA write position. */
+static void flush(struct usartrx *r, bool end)
+{
+	int tail;
+	bool last;
+
+	tail = r->size - dma_desc_get_number_of_data(r->desc);
+	if (tail >= r->size)
+		tail = 0;
+
+	/* Wraparound */
+	if (tail < r->head) {
+		last = end && !tail;
+		r->receive(r, r->ring + r->head, r->size - r->head, last);
+		r->head = 0;
+		r->in_frame = !last;
+	}
+
+	if (tail > r->head) {
+		r->receive(r, r->ring + r->head, tail - r->head, end);
+		r->head = tail;
+		r->in_frame = !end;
+	} else if (end && r->in_frame) {
+		/* All data was passed by the DMA interrupts. */
+		r->receive(r, r->ring + r->head, 0, true);
+		r->in_frame = false;
+	}
+}
+
+void usartrx_usart_isr(struct usartrx *r)
+{
+	int status;
+
+	status = usart_get_interrupt_status(r->usart, USART_IDLE | USART_ORE |
+					    USART_NF | USART_FE);
+	if (!status)
+		return;
+
+	/* Reading SR and then DR clears the flags. */
+	usart_recv(r->usart);
+
+	if (status & USART_ORE)
+		r->ore++;
+	if (status & USART_FE)
+		r->fe++;
+	if (status & USART_NF)
+		r->nf++;
+
+	if (status & USART_IDLE)
+		flush(r, true);
+}
+
+void usartrx_dma_isr(struct usartrx *r)
+{
+	int status;
+
+	status = dma_desc_get_interrupt_status(r->desc,
+					       DMA_HALF | DMA_COMPLETE);
+	dma_desc_clear_interrupt(r->desc, status | DMA_GLOBAL);
+	if (status)
+		flush(r, false);
+}
+
+u32 usartrx_get_error(struct usartrx *r, int error)
+{
+	u32 n = 0;
+
+	if (error & USART_ORE)
+		n += r->ore;
+	if (error & USART_FE)
+		n += r->fe;
+	if (error & USART_NF)
+		n += r->nf;
+	return n;
+}
+
+void usartrx_init(struct usartrx *r)
+{
+	r->desc = dma_get_channel_desc(r->dma);
+	r->head = 0;
+	r->in_frame = false;
+	r->ore = 0;
+	r->fe = 0;
+	r->nf = 0;
+
+	/* USART Rx -> Rx ring buffer (circular) */
+	dma_disable(r->dma);
+	dma_clear_interrupt(r->dma, DMA_HALF | DMA_COMPLETE | DMA_GLOBAL);
+	dma_setup_channel(r->dma, (u32)r->ring, r->dr, r->size,
+			  DMA_P_TO_M | DMA_CIRCULAR | DMA_M_INC | DMA_P_8BIT |
+			  DMA_M_8BIT | DMA_HIGH | DMA_HALF | DMA_COMPLETE |
+			  DMA_ENABLE);
+
+	/* Clear IDLE and the errors (SR and then DR). */
+	usart_get_interrupt_status(r->usart, USART_IDLE);
+	usart_recv(r->usart);
+
+	usart_enable_dma(r->usart, USART_DMA_RX);
+	usart_enable_interrupt(r->usart, USART_IDLE | USART_ERROR);
+}
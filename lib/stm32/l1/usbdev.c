@@ -0,0 +1,1112 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/usbdevfs.h>
+#include <stm32/l1/usbdev.h>
+
+#include <usb/standard.h>
+
+/* USB device */
+static const struct usbdev_device *device;
+
+/* Endpoints (packet memory table) */
+static struct usbdevfs_packet_memory packet_memory[USBDEVFS_EP_MAX];
+static int num_endpoint;
+
+/* USB Device States */
+static usb_standard_state_t standard_state = USB_STATE_POWERED;
+static int configuration;
+static u8 altsetting[USBDEV_INTERFACE_MAX];
+static u8 halt;			/* (1 << ep_id) */
+static bool remote_wakeup;
+
+/* Control transfer state */
+static usbdevfs_control_state_t control_state;
+static int maxpacketsize0;
+
+/* Current device request */
+static struct usb_setup_data curreq;
+
+/* IN data */
+static u16 inbuf[USBDEV_IN_BUFFER_SIZE / 2];
+static u8 *inp;			/* IN data pointer */
+static int inlen;		/* IN data length */
+
+/* OUT data */
+static u8 *outp;		/* OUT data pointer */
+static int outlen;		/* OUT data length */
+
+/* Flag */
+static bool in_zero_length_packet;
+
+/* Transfer held by USBDEV_WAIT */
+static enum {
+	WAIT_NONE,
+	WAIT_SETUP,
+	WAIT_DATA
+} wait;
+
+/* --- Configuration ------------------------------------------------------- */
+
+#define CONFIG_BEGIN()	((const u8 *)device->config)
+#define CONFIG_END()	(CONFIG_BEGIN() + device->config->wTotalLength)
+
+static usbdevfs_endpoint_t endpoint_type(const struct usb_endpoint_descriptor
+					 *ep)
+{
+	switch (ep->bmAttributes & USB_ENDPOINT_TRANS_MASK) {
+	case USB_ENDPOINT_TRANS_ISOCHRONOUS:
+		return USBDEVFS_ISOCHRONOUS;
+	case USB_ENDPOINT_TRANS_BULK:
+		if (device->dbl_buf & (1 << (ep->bEndpointAddress & 0xf)))
+			return USBDEVFS_BULK_DBL_BUF;
+		return USBDEVFS_BULK;
+	case USB_ENDPOINT_TRANS_INTERRUPT:
+		return USBDEVFS_INTERRUPT;
+	default:
+		return USBDEVFS_CONTROL;
+	}
+}
+
+/* Endpoint type of the endpoint register */
+static usbdevfs_endpoint_t register_type(int ep_id)
+{
+	int i;
+
+	for (i = 0; i < num_endpoint; i++)
+		if (packet_memory[i].ep_id == ep_id)
+			return packet_memory[i].type;
+	return USBDEVFS_BULK;
+}
+
+/* Does the interface have the alternate setting? */
+static bool altsetting_exists(int interface, int alt)
+{
+	const u8 *p;
+	const struct usb_interface_descriptor *iface;
+
+	for (p = CONFIG_BEGIN(); p < CONFIG_END() && p[0]; p += p[0]) {
+		if (p[1] != USB_DT_INTERFACE)
+			continue;
+		iface = (const struct usb_interface_descriptor *)p;
+		if (iface->bInterfaceNumber == interface &&
+		    iface->bAlternateSetting == alt)
+			return true;
+	}
+	return false;
+}
+
+/* Is the endpoint in the current alternate setting? */
+static bool endpoint_exists(u8 address)
+{
+	const u8 *p;
+	const struct usb_interface_descriptor *iface;
+	bool active = false;
+
+	for (p = CONFIG_BEGIN(); p < CONFIG_END() && p[0]; p += p[0]) {
+		if (p[1] == USB_DT_INTERFACE) {
+			iface = (const struct usb_interface_descriptor *)p;
+			active = (iface->bInterfaceNumber <
+				  USBDEV_INTERFACE_MAX &&
+				  altsetting[iface->bInterfaceNumber] ==
+				  iface->bAlternateSetting);
+		} else if (p[1] == USB_DT_ENDPOINT && active &&
+			   ((const struct usb_endpoint_descriptor *)p)->
+			   bEndpointAddress == address) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void enable_endpoint(u8 address)
+{
+	int ep_id;
+
+	ep_id = address & 0xf;
+	halt &= ~(1 << ep_id);
+
+	if (register_type(ep_id) == USBDEVFS_BULK_DBL_BUF) {
+		if (address & USB_DIR_IN)
+			usbdevfs_enable_dbl_buf_endpoint_tx(ep_id);
+		else
+			usbdevfs_enable_dbl_buf_endpoint_rx(ep_id);
+		return;
+	}
+
+	/* DATA0 */
+	usbdevfs_reset_endpoint_data_toggle(ep_id);
+
+	if (address & USB_DIR_IN)
+		usbdevfs_enable_endpoint_tx(ep_id);
+	else
+		usbdevfs_enable_endpoint_rx(ep_id);
+}
+
+static void disable_endpoint(u8 address)
+{
+	int ep_id;
+
+	ep_id = address & 0xf;
+	halt &= ~(1 << ep_id);
+
+	if (address & USB_DIR_IN)
+		usbdevfs_disable_endpoint_tx(ep_id);
+	else
+		usbdevfs_disable_endpoint_rx(ep_id);
+}
+
+/*
+ * Enable the endpoints of the alternate setting 'alt' of the interface, or
+ * disable all the endpoints of the interface.
+ */
+static void setup_interface(int interface, int alt, bool enable)
+{
+	const u8 *p;
+	const struct usb_interface_descriptor *iface;
+	const struct usb_endpoint_descriptor *ep;
+	bool match = false;
+
+	for (p = CONFIG_BEGIN(); p < CONFIG_END() && p[0]; p += p[0]) {
+		if (p[1] == USB_DT_INTERFACE) {
+			iface = (const struct usb_interface_descriptor *)p;
+			match = (iface->bInterfaceNumber == interface &&
+				 (!enable || iface->bAlternateSetting == alt));
+		} else if (p[1] == USB_DT_ENDPOINT && match) {
+			ep = (const struct usb_endpoint_descriptor *)p;
+			if (enable)
+				enable_endpoint(ep->bEndpointAddress);
+			else
+				disable_endpoint(ep->bEndpointAddress);
+		}
+	}
+}
+
+static void setup_configuration(int value)
+{
+	int i;
+
+	for (i = 0; i < device->config->bNumInterfaces; i++) {
+		setup_interface(i, 0, false);
+		altsetting[i] = 0;
+		if (value)
+			setup_interface(i, 0, true);
+	}
+	configuration = value;
+	halt = 0;
+}
+
+/* --- USB Device Requests ------------------------------------------------- */
+
+/* Strings of the language, or NULL */
+static const u16 * const *language_string(u16 langid)
+{
+	int i;
+
+	if (!device->language)
+		return (langid == device->langid) ? device->string : 0;
+
+	for (i = 0; i < device->num_language; i++)
+		if (device->language[i].langid == langid)
+			return device->language[i].string;
+	return 0;
+}
+
+/* Endpoint 0 or an endpoint of the current configuration */
+static bool endpoint_error(u16 index)
+{
+	if (!(index & ~USB_DIR_IN))
+		return false;
+	if (index & ~(USB_DIR_IN | 0xf))
+		return true;
+	return (standard_state != USB_STATE_CONFIGURED ||
+		!endpoint_exists(index));
+}
+
+/*
+ * Get Descriptor
+ *
+ * | bmRequestType | bRequest | wValue | wIndex      | wLength
+ * | 10000000B     | 6        | Type & | Zero or     | Length
+ * |               |          | Index  | Language ID |
+ */
+static bool get_descriptor_error(struct usb_setup_data *req)
+{
+	int dt;
+	int index;
+
+	/* Descriptor Type */
+	dt = (req->wValue >> 8);
+	/* Descriptor Index */
+	index = (req->wValue & 0xff);
+
+	switch (dt) {
+	case USB_DT_DEVICE:
+	case USB_DT_CONFIGURATION:
+		if (index || req->wIndex)
+			return true;
+		break;
+	case USB_DT_STRING:
+		if ((!index && req->wIndex) || index > device->num_string)
+			return true;
+		if (index && (device->string_desc ?
+			      req->wIndex != device->langid :
+			      !language_string(req->wIndex)))
+			return true;
+		break;
+	default:
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Get Configuration
+ *
+ * | bmRequestType | bRequest | wValue | wIndex | wLength
+ * | 10000000B     | 8        | Zero   | Zero   | One
+ */
+static bool get_configuration_error(struct usb_setup_data *req)
+{
+	/* bmRequestType = 10000000B */
+	if (req->bmRequestType != (USB_DIR_IN | USB_TYPE_STANDARD |
+				   USB_RECIP_DEVICE))
+		return true;
+
+	/* Not specified. */
+	if (req->wValue || req->wIndex || req->wLength != 1 ||
+	    standard_state == USB_STATE_DEFAULT)
+		return true;
+
+	return false;
+}
+
+/*
+ * Get Interface
+ *
+ * | bmRequestType | bRequest | wValue | wIndex    | wLength
+ * | 10000001B     | 10       | Zero   | Interface | One
+ */
+static bool get_interface_error(struct usb_setup_data *req)
+{
+	/* bmRequestType = 10000001B */
+	if (req->bmRequestType != (USB_DIR_IN | USB_TYPE_STANDARD |
+				   USB_RECIP_INTERFACE))
+		return true;
+
+	/* Request Error */
+	if (req->wIndex >= device->config->bNumInterfaces ||
+	    standard_state != USB_STATE_CONFIGURED)
+		return true;
+
+	/* Not specified. */
+	if (req->wValue || req->wLength != 1)
+		return true;
+
+	return false;
+}
+
+/*
+ * Get Status
+ *
+ * | bmRequestType | bRequest | wValue | wIndex    | wLength
+ * | 10000000B     | 0        | Zero   | Zero      | Two
+ * | 10000001B     |          |        | Interface |
+ * | 10000010B     |          |        | Endpoint  |
+ */
+static bool get_status_error(struct usb_setup_data *req)
+{
+	switch (req->bmRequestType) {
+	case (USB_DIR_IN | USB_TYPE_STANDARD | USB_RECIP_DEVICE):
+		if (req->wIndex)
+			return true;
+		break;
+	case (USB_DIR_IN | USB_TYPE_STANDARD | USB_RECIP_INTERFACE):
+		if (req->wIndex >= device->config->bNumInterfaces ||
+		    standard_state != USB_STATE_CONFIGURED)
+			return true;
+		break;
+	case (USB_DIR_IN | USB_TYPE_STANDARD | USB_RECIP_ENDPOINT):
+		if (endpoint_error(req->wIndex))
+			return true;
+		break;
+	default:
+		return true;
+	}
+
+	/* Not specified */
+	if (req->wValue || req->wLength != 2 ||
+	    standard_state == USB_STATE_DEFAULT)
+		return true;
+
+	return false;
+}
+
+/*
+ * Set Address
+ *
+ * | bmRequestType | bRequest | wValue  | wIndex | wLength
+ * | 00000000B     | 5        | Address | Zero   | Zero
+ */
+static bool set_address_error(struct usb_setup_data *req)
+{
+	/* bmRequestType = 00000000B */
+	if (req->bmRequestType != (USB_DIR_OUT | USB_TYPE_STANDARD |
+				   USB_RECIP_DEVICE))
+		return true;
+
+	/* Not specified. */
+	if (req->wValue > 127 || req->wIndex || req->wLength ||
+	    standard_state == USB_STATE_CONFIGURED)
+		return true;
+
+	return false;
+}
+
+/*
+ * Set Configuration
+ *
+ * | bmRequestType | bRequest | wValue  | wIndex | wLength
+ * | 00000000B     | 9        | Value   | Zero   | Zero
+ */
+static bool set_configuration_error(struct usb_setup_data *req)
+{
+	/* bmRequestType = 00000000B */
+	if (req->bmRequestType != (USB_DIR_OUT | USB_TYPE_STANDARD |
+				   USB_RECIP_DEVICE))
+		return true;
+
+	/* Configuration value */
+	if (req->wValue && req->wValue != device->config->bConfigurationValue)
+		return true;
+
+	/* Not specified. */
+	if (req->wIndex || req->wLength || standard_state == USB_STATE_DEFAULT)
+		return true;
+
+	return false;
+}
+
+/*
+ * Set Interface
+ *
+ * | bmRequestType | bRequest | wValue    | wIndex    | wLength
+ * | 00000001B     | 11       | Alternate | Interface | Zero
+ * |               |          | Setting   |           |
+ */
+static bool set_interface_error(struct usb_setup_data *req)
+{
+	/* bmRequestType = 00000001B */
+	if (req->bmRequestType !=
+	    (USB_DIR_OUT | USB_TYPE_STANDARD | USB_RECIP_INTERFACE))
+		return true;
+
+	/* Request Error */
+	if (req->wIndex >= device->config->bNumInterfaces ||
+	    standard_state != USB_STATE_CONFIGURED ||
+	    !altsetting_exists(req->wIndex, req->wValue))
+		return true;
+
+	/* Not specified. */
+	if (req->wLength)
+		return true;
+
+	return false;
+}
+
+/*
+ * Clear Feature, Set Feature
+ *
+ * | bmRequestType | bRequest | wValue   | wIndex    | wLength
+ * | 00000000B     | 1 or 3   | Feature  | Zero      | Zero
+ * | 00000001B     |          | Selector | Interface |
+ * | 00000010B     |          |          | Endpoint  |
+ */
+static bool feature_error(struct usb_setup_data *req)
+{
+	switch (req->bmRequestType) {
+	case (USB_DIR_OUT | USB_TYPE_STANDARD | USB_RECIP_DEVICE):
+		/* TEST_MODE is not supported. */
+		if (req->wIndex ||
+		    req->wValue != USB_FEAT_DEVICE_REMOTE_WAKEUP ||
+		    !(device->config->bmAttributes &
+		      USB_CONFIG_ATTR_REMOTE_WAKEUP))
+			return true;
+		break;
+	case (USB_DIR_OUT | USB_TYPE_STANDARD | USB_RECIP_ENDPOINT):
+		if (req->wValue != USB_FEAT_ENDPOINT_HALT ||
+		    endpoint_error(req->wIndex))
+			return true;
+		break;
+	default:
+		/* No interface feature */
+		return true;
+	}
+
+	/* Not specified. */
+	if (req->wLength || standard_state == USB_STATE_DEFAULT)
+		return true;
+
+	return false;
+}
+
+/* Requests handled here */
+static bool standard_request_supported(struct usb_setup_data *req)
+{
+	int dt;
+
+	switch (req->bRequest) {
+	case USB_REQ_GET_DESCRIPTOR:
+		/* Class-specific descriptors are passed to the application. */
+		if (req->bmRequestType != (USB_DIR_IN | USB_TYPE_STANDARD |
+					   USB_RECIP_DEVICE))
+			return false;
+		dt = (req->wValue >> 8);
+		return (dt == USB_DT_DEVICE || dt == USB_DT_CONFIGURATION ||
+			dt == USB_DT_STRING);
+	case USB_REQ_GET_CONFIGURATION:
+	case USB_REQ_GET_INTERFACE:
+	case USB_REQ_GET_STATUS:
+	case USB_REQ_SET_ADDRESS:
+	case USB_REQ_SET_CONFIGURATION:
+	case USB_REQ_SET_INTERFACE:
+	case USB_REQ_SET_FEATURE:
+	case USB_REQ_CLEAR_FEATURE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool standard_request_error(struct usb_setup_data *req)
+{
+	switch (req->bRequest) {
+	case USB_REQ_GET_DESCRIPTOR:
+		return get_descriptor_error(req);
+	case USB_REQ_GET_CONFIGURATION:
+		return get_configuration_error(req);
+	case USB_REQ_GET_INTERFACE:
+		return get_interface_error(req);
+	case USB_REQ_GET_STATUS:
+		return get_status_error(req);
+	case USB_REQ_SET_ADDRESS:
+		return set_address_error(req);
+	case USB_REQ_SET_CONFIGURATION:
+		return set_configuration_error(req);
+	case USB_REQ_SET_INTERFACE:
+		return set_interface_error(req);
+	case USB_REQ_SET_FEATURE:
+	case USB_REQ_CLEAR_FEATURE:
+		return feature_error(req);
+	default:
+		return true;
+	}
+}
+
+/* Make string descriptor from NUL-terminated string. */
+static int make_string_descriptor(int index, u16 langid, u16 *buf)
+{
+	int i;
+	const u16 *p;
+	u8 *s;
+
+	if (index == 0 && device->language) {
+		/* LANGIDs */
+		for (i = 1; i <= device->num_language &&
+			     i < USBDEV_IN_BUFFER_SIZE / 2; i++)
+			buf[i] = device->language[i - 1].langid;
+	} else if (index == 0) {
+		/* LANGID */
+		buf[1] = device->langid;
+		i = 2;
+	} else {
+		/* UNICODE encoded string (not include EOS(0)) */
+		p = language_string(langid)[index - 1];
+		for (i = 1; *p && i < USBDEV_IN_BUFFER_SIZE / 2; i++)
+			buf[i] = *p++;
+	}
+
+	/* Add bLength and bDescriptorType. */
+	s = (u8 *)buf;
+	*s++ = i * sizeof(u16);
+	*s = USB_DT_STRING;
+
+	/* Return descriptor size. */
+	return i * (int)sizeof(u16);
+}
+
+/* Get Descriptor */
+static int request_get_descriptor(struct usb_setup_data *req, u8 *buf,
+				  u8 **data)
+{
+	/* Descriptors are sent from where they are (no copy). */
+	switch (req->wValue >> 8) {
+	case USB_DT_DEVICE:
+		*data = (u8 *)device->device;
+		return sizeof(struct usb_device_descriptor);
+	case USB_DT_CONFIGURATION:
+		*data = (u8 *)device->config;
+		return device->config->wTotalLength;
+	default:
+		/* USB_DT_STRING */
+		if (device->string_desc) {
+			*data = (u8 *)device->string_desc[req->wValue & 0xff];
+			return **data;
+		}
+		*data = buf;
+		return make_string_descriptor(req->wValue & 0xff, req->wIndex,
+					      (u16 *)buf);
+	}
+}
+
+/* Get Status */
+static int request_get_status(struct usb_setup_data *req, u8 *buf, u8 **data)
+{
+	u16 *p;
+
+	p = (u16 *)buf;
+	*p = 0;
+	switch (req->bmRequestType & USB_RECIP_MASK) {
+	case USB_RECIP_DEVICE:
+		if (device->config->bmAttributes & USB_CONFIG_ATTR_SELF_POWERED)
+			*p |= USB_DEV_STATUS_SELF_POWERED;
+		if (remote_wakeup)
+			*p |= USB_DEV_STATUS_REMOTE_WAKEUP;
+		break;
+	case USB_RECIP_ENDPOINT:
+		if (halt & (1 << (req->wIndex & 0xf)))
+			*p |= USB_EP_STATUS_HALT;
+		break;
+	default:
+		break;
+	}
+	*data = buf;
+
+	return sizeof(u16);
+}
+
+/* Set Address */
+static int request_set_address(struct usb_setup_data *req)
+{
+	if (standard_state == USB_STATE_DEFAULT) {
+		/*
+		 * If the address specified is non-zero,
+		 * then the device shall enter the Address state.
+		 */
+		if (req->wValue)
+			standard_state = USB_STATE_ADDRESS;
+	} else if (standard_state == USB_STATE_ADDRESS) {
+		/*
+		 * If the address specified is zero,
+		 * then the device shall enter the Default state.
+		 */
+		if (!req->wValue)
+			standard_state = USB_STATE_DEFAULT;
+	}
+
+	/* Set device address. */
+	usbdevfs_set_device_address(req->wValue);
+
+	return 0;
+}
+
+/* Set Configuration */
+static int request_set_configuration(struct usb_setup_data *req)
+{
+	/*
+	 * The configuration value zero puts the device in the Address state.
+	 * Selecting a configuration (again) resets the endpoints.
+	 */
+	setup_configuration(req->wValue);
+	if (req->wValue)
+		standard_state = USB_STATE_CONFIGURED;
+	else
+		standard_state = USB_STATE_ADDRESS;
+
+	if (device->set_configuration)
+		device->set_configuration(req->wValue);
+
+	return 0;
+}
+
+/* Set Interface */
+static int request_set_interface(struct usb_setup_data *req)
+{
+	setup_interface(req->wIndex, 0, false);
+	altsetting[req->wIndex] = req->wValue;
+	setup_interface(req->wIndex, req->wValue, true);
+
+	if (device->set_interface)
+		device->set_interface(req->wIndex, req->wValue);
+
+	return 0;
+}
+
+/* Set Feature, Clear Feature */
+static int request_feature(struct usb_setup_data *req, bool set)
+{
+	int ep_id;
+
+	if ((req->bmRequestType & USB_RECIP_MASK) == USB_RECIP_DEVICE) {
+		/* DEVICE_REMOTE_WAKEUP */
+		remote_wakeup = set;
+		return 0;
+	}
+
+	/* ENDPOINT_HALT (endpoint 0 is never halted.) */
+	ep_id = req->wIndex & 0xf;
+	if (!ep_id)
+		return 0;
+	if (set) {
+		if (req->wIndex & USB_DIR_IN)
+			usbdevfs_halt_endpoint_tx(ep_id);
+		else
+			usbdevfs_halt_endpoint_rx(ep_id);
+		halt |= (1 << ep_id);
+	} else if ((halt & (1 << ep_id)) ||
+		   register_type(ep_id) == USBDEVFS_BULK_DBL_BUF) {
+		/* STALL -> NAK (Tx) or VALID (Rx), DATA0 */
+		enable_endpoint(req->wIndex);
+	} else {
+		/* DATA0 */
+		usbdevfs_reset_endpoint_data_toggle(ep_id);
+	}
+
+	return 0;
+}
+
+static int standard_request(struct usb_setup_data *req, u8 *buf, u8 **data)
+{
+	switch (req->bRequest) {
+	case USB_REQ_GET_DESCRIPTOR:
+		return request_get_descriptor(req, buf, data);
+	case USB_REQ_GET_CONFIGURATION:
+		*buf = configuration;
+		*data = buf;
+		return 1;
+	case USB_REQ_GET_INTERFACE:
+		*buf = altsetting[req->wIndex];
+		*data = buf;
+		return 1;
+	case USB_REQ_GET_STATUS:
+		return request_get_status(req, buf, data);
+	case USB_REQ_SET_ADDRESS:
+		return request_set_address(req);
+	case USB_REQ_SET_CONFIGURATION:
+		return request_set_configuration(req);
+	case USB_REQ_SET_INTERFACE:
+		return request_set_interface(req);
+	case USB_REQ_SET_FEATURE:
+		return request_feature(req, true);
+	case USB_REQ_CLEAR_FEATURE:
+		return request_feature(req, false);
+	default:
+		return -1;
+	}
+}
+
+/* --- USB Control Transfer ------------------------------------------------ */
+
+static int device_request(struct usb_setup_data *req, usbdev_stage_t stage)
+{
+	int len;
+
+	if ((req->bmRequestType & USB_TYPE_MASK) == USB_TYPE_STANDARD &&
+	    standard_request_supported(req)) {
+		/* Standard Device Request */
+		switch (stage) {
+		case USBDEV_STAGE_SETUP:
+			/* Check error. */
+			if (standard_request_error(req))
+				return -1;
+
+			/* GET request */
+			if (req->bmRequestType & USB_DIR_IN)
+				return standard_request(req, (u8 *)inbuf,
+							&inp);
+			break;
+		case USBDEV_STAGE_STATUS:
+			/* SET request */
+			if (!(req->bmRequestType & USB_DIR_IN))
+				return standard_request(req, 0, 0);
+			break;
+		}
+		return 0;
+	}
+
+	/* Class-specific, vendor-specific and other standard requests */
+	if (!device->request ||
+	    ((req->bmRequestType & USB_TYPE_MASK) != USB_TYPE_STANDARD &&
+	     standard_state != USB_STATE_CONFIGURED))
+		return -1;
+
+	switch (stage) {
+	case USBDEV_STAGE_SETUP:
+		/* GET request */
+		if (req->bmRequestType & USB_DIR_IN)
+			return device->request(req, stage, (u8 *)inbuf, &inp);
+
+		/* SET request (check error) */
+		if (req->wLength > device->bufsize)
+			return -1;
+		len = device->request(req, stage, device->buf, 0);
+		if (len == USBDEV_WAIT)
+			return len;
+		return (len < 0 ? -1 : 0);
+	case USBDEV_STAGE_STATUS:
+		/* SET request */
+		if (!(req->bmRequestType & USB_DIR_IN))
+			return device->request(req, stage, device->buf, 0);
+		break;
+	}
+	return 0;
+}
+
+/* Send the next IN data packet. */
+static void send_data(void)
+{
+	int n;
+
+	if (inlen < maxpacketsize0)
+		n = inlen;
+	else
+		n = maxpacketsize0;
+	usbdevfs_write(0, (u16 *)inp, n);
+
+	/* Set buffer pointer and length. */
+	inp += n;
+	inlen -= n;
+
+	/* Next State */
+	if (n < maxpacketsize0 || (inlen == 0 && !in_zero_length_packet))
+		control_state = USBDEVFS_LAST_DATA_IN;
+	else
+		control_state = USBDEVFS_DATA_IN;
+}
+
+/* OUT transaction */
+void usbdev_control_rx(void)
+{
+	int len;
+
+	/* Read data packet. */
+	len = usbdevfs_read(0, (u16 *)outp, outlen);
+
+	switch (control_state) {
+	case USBDEVFS_DATA_OUT:
+		/* Illegal packet size */
+		if (len != maxpacketsize0) {
+			control_state = USBDEVFS_STALL;
+			break;
+		}
+
+		/* Set buffer pointer and length. */
+		outp += len;
+		outlen -= len;
+
+		/* Next State */
+		if (outlen <= maxpacketsize0)
+			control_state = USBDEVFS_LAST_DATA_OUT;
+		else
+			control_state = USBDEVFS_DATA_OUT;
+		break;
+	case USBDEVFS_LAST_DATA_OUT:
+		/* Illegal packet size */
+		if (len != outlen) {
+			control_state = USBDEVFS_STALL;
+			break;
+		}
+
+		/* Check data. */
+		if (device->check_data) {
+			len = device->check_data(&curreq, device->buf);
+			if (len == USBDEV_WAIT) {
+				/* Status stage is NAKed until resumed. */
+				wait = WAIT_DATA;
+				usbdevfs_clear_endpoint_interrupt(0);
+				return;
+			}
+			if (len < 0) {
+				control_state = USBDEVFS_STALL;
+				break;
+			}
+		}
+
+		/* Send zero length packet. */
+		usbdevfs_write(0, 0, 0);
+
+		/* Next State */
+		control_state = USBDEVFS_STATUS_IN;
+		break;
+	default:
+		/* STATUS_OUT or ??? */
+		control_state = USBDEVFS_STALL;
+		break;
+	}
+	usbdevfs_set_control_state(0, control_state);
+}
+
+/* IN transaction */
+void usbdev_control_tx(void)
+{
+	switch (control_state) {
+	case USBDEVFS_DATA_IN:
+		send_data();
+		break;
+	case USBDEVFS_LAST_DATA_IN:
+		/* Next State */
+		control_state = USBDEVFS_STATUS_OUT;
+		break;
+	case USBDEVFS_STATUS_IN:
+		/* Execute SET request. */
+		device_request(&curreq, USBDEV_STAGE_STATUS);
+
+		/* Next State */
+		control_state = USBDEVFS_STALL;
+		break;
+	default:
+		/* ??? */
+		control_state = USBDEVFS_STALL;
+		break;
+	}
+	usbdevfs_set_control_state(0, control_state);
+}
+
+/* Start the data or status stage of 'curreq'. */
+static void setup_request(void)
+{
+	int len;
+
+	/* Device Request */
+	len = device_request(&curreq, USBDEV_STAGE_SETUP);
+	if (len == USBDEV_WAIT) {
+		/* Both directions are NAKed until resumed. */
+		wait = WAIT_SETUP;
+		return;
+	}
+	if (len < 0) {
+		/* Request Error */
+		control_state = USBDEVFS_STALL;
+		usbdevfs_set_control_state(0, control_state);
+		return;
+	}
+
+	if (curreq.bmRequestType & USB_DIR_IN) {
+		/* IN transaction */
+		inlen = (len > curreq.wLength ? curreq.wLength : len);
+
+		/* Zero-length packet */
+		in_zero_length_packet = (inlen < curreq.wLength &&
+					 inlen % maxpacketsize0 == 0);
+
+		/* Send data packet. */
+		send_data();
+	} else if (curreq.wLength) {
+		/* OUT transaction (data stage) */
+		outp = device->buf;
+		outlen = curreq.wLength;
+
+		if (curreq.wLength <= maxpacketsize0)
+			control_state = USBDEVFS_LAST_DATA_OUT;
+		else
+			control_state = USBDEVFS_DATA_OUT;
+	} else {
+		/* No data stage */
+
+		/* Send zero length packet. */
+		usbdevfs_write(0, 0, 0);
+
+		/* Status Stage */
+		control_state = USBDEVFS_STATUS_IN;
+	}
+	usbdevfs_set_control_state(0, control_state);
+}
+
+/* SETUP transaction */
+void usbdev_control_setup(void)
+{
+	int len;
+
+	/* A new SETUP aborts the held transfer. */
+	wait = WAIT_NONE;
+
+	/* Read setup packet. */
+	len = usbdevfs_read(0, (u16 *)&curreq, sizeof(curreq));
+
+	/* Unknown packet */
+	if (len != sizeof(struct usb_setup_data)) {
+		control_state = USBDEVFS_STALL;
+		usbdevfs_set_control_state(0, control_state);
+		return;
+	}
+
+	setup_request();
+	if (wait == WAIT_SETUP)
+		usbdevfs_clear_endpoint_interrupt(0);
+}
+
+/* Continue the transfer held by USBDEV_WAIT. */
+void usbdev_control_resume(void)
+{
+	int r;
+
+	switch (wait) {
+	case WAIT_SETUP:
+		wait = WAIT_NONE;
+		setup_request();
+		break;
+	case WAIT_DATA:
+		r = device->check_data(&curreq, device->buf);
+		if (r == USBDEV_WAIT)
+			break;
+		wait = WAIT_NONE;
+		if (r < 0) {
+			control_state = USBDEVFS_STALL;
+		} else {
+			/* Send zero length packet. */
+			usbdevfs_write(0, 0, 0);
+			control_state = USBDEVFS_STATUS_IN;
+		}
+		usbdevfs_set_control_state(0, control_state);
+		break;
+	default:
+		break;
+	}
+}
+
+/* --- USB Device ---------------------------------------------------------- */
+
+int usbdev_init(const struct usbdev_device *dev)
+{
+	const u8 *p;
+	const struct usb_endpoint_descriptor *ep;
+	struct usbdevfs_packet_memory *pm;
+	int ep_id;
+	int i;
+
+	device = dev;
+	maxpacketsize0 = dev->device->bMaxPacketSize0;
+	if (dev->config->bNumInterfaces > USBDEV_INTERFACE_MAX)
+		return -1;
+
+	/* Endpoint 0 */
+	packet_memory[0].ep_id = 0;
+	packet_memory[0].type = USBDEVFS_CONTROL;
+	packet_memory[0].address = 0;
+	packet_memory[0].size = maxpacketsize0;
+	num_endpoint = 1;
+
+	/* Endpoints of all alternate settings (maximum packet size) */
+	for (p = CONFIG_BEGIN(); p < CONFIG_END() && p[0]; p += p[0]) {
+		if (p[1] != USB_DT_ENDPOINT)
+			continue;
+		ep = (const struct usb_endpoint_descriptor *)p;
+		ep_id = ep->bEndpointAddress & 0xf;
+		if (!ep_id || ep_id >= USBDEVFS_EP_MAX)
+			return -1;
+
+		for (i = 1; i < num_endpoint; i++)
+			if (packet_memory[i].ep_id == ep_id)
+				break;
+		pm = &packet_memory[i];
+		if (i == num_endpoint) {
+			pm->ep_id = ep_id;
+			pm->type = endpoint_type(ep);
+			pm->address = ep->bEndpointAddress;
+			pm->size = 0;
+			num_endpoint++;
+		} else if (pm->address != ep->bEndpointAddress) {
+			/* IN and OUT on the same endpoint register */
+			return -1;
+		}
+		if (pm->size < (ep->wMaxPacketSize & 0x7ff))
+			pm->size = ep->wMaxPacketSize & 0x7ff;
+	}
+
+	return usbdevfs_allocate_packet_memory(packet_memory, num_endpoint);
+}
+
+void usbdev_reset(void)
+{
+	int i;
+
+	/* Set endpoint type and address. */
+	for (i = 0; i < num_endpoint; i++)
+		usbdevfs_setup_endpoint(packet_memory[i].ep_id,
+					packet_memory[i].type,
+					packet_memory[i].address);
+
+	/* Set default address. */
+	usbdevfs_set_device_address(0);
+
+	/* Reset standard settings. */
+	standard_state = USB_STATE_DEFAULT;
+	configuration = 0;
+	for (i = 0; i < USBDEV_INTERFACE_MAX; i++)
+		altsetting[i] = 0;
+	halt = 0;
+	remote_wakeup = false;
+
+	/* Reset class settings. */
+	if (device->reset)
+		device->reset();
+
+	/* Set control transfer state. */
+	wait = WAIT_NONE;
+	control_state = USBDEVFS_STALL;
+	usbdevfs_set_control_state(0, control_state);
+}
+
+int usbdev_get_state(void)
+{
+	return standard_state;
+}
+
+int usbdev_get_configuration(void)
+{
+	return configuration;
+}
+
+int usbdev_get_interface(int interface)
+{
+	return altsetting[interface];
+}
+
+bool usbdev_get_endpoint_halt(u8 address)
+{
+	return (halt & (1 << (address & 0xf))) != 0;
+}
+
+/* Halt an endpoint from the class driver (as SET_FEATURE(ENDPOINT_HALT)). */
+void usbdev_set_endpoint_halt(u8 address)
+{
+	int ep_id;
+
+	ep_id = address & 0xf;
+	if (address & USB_DIR_IN)
+		usbdevfs_halt_endpoint_tx(ep_id);
+	else
+		usbdevfs_halt_endpoint_rx(ep_id);
+	halt |= (1 << ep_id);
+}
+
+bool usbdev_get_remote_wakeup(void)
+{
+	return remote_wakeup;
+}
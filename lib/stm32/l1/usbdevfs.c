@@ -19,6 +19,122 @@
 
 #include <stm32/l1/usbdevfs.h>
 
+#ifdef USBDEVFS_TRACE
+/* Cycle counter (Cortex-M3 DWT) */
+#define DEMCR				MMIO32(SCS_BASE + 0xdfc)
+#define DEMCR_TRCENA			(1 << 24)
+#define DWT_CTRL			MMIO32(DWT_BASE + 0x00)
+#define DWT_CTRL_CYCCNTENA		(1 << 0)
+#define DWT_CYCCNT			MMIO32(DWT_BASE + 0x04)
+
+static struct usbdevfs_trace trace_buf[USBDEVFS_TRACE_SIZE];
+static volatile u32 trace_head;	/* Number of events recorded */
+static u32 trace_tail;		/* Number of events read or lost */
+static u32 trace_lost;
+
+void usbdevfs_trace_init(void)
+{
+	DEMCR |= DEMCR_TRCENA;
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+
+	trace_tail = trace_head;
+	trace_lost = 0;
+}
+
+void usbdevfs_trace(int event, int ep_id, u32 data0, u32 data1)
+{
+	u32 i;
+	u32 fail;
+	struct usbdevfs_trace *p;
+
+	/* Reserve an entry (the interrupt handlers may nest). */
+	do {
+		__asm__ volatile ("ldrex %0, [%1]"
+				  : "=r" (i) : "r" (&trace_head));
+		__asm__ volatile ("strex %0, %2, [%1]"
+				  : "=&r" (fail)
+				  : "r" (&trace_head), "r" (i + 1)
+				  : "memory");
+	} while (fail);
+
+	p = &trace_buf[i & (USBDEVFS_TRACE_SIZE - 1)];
+	p->cycle = DWT_CYCCNT;
+	p->frame = USB_FNR;
+	p->event = event;
+	p->ep_id = ep_id;
+	p->data0 = data0;
+	p->data1 = data1;
+}
+
+int usbdevfs_trace_read(struct usbdevfs_trace *buf, int n)
+{
+	int i = 0;
+
+	while (i < n) {
+		/* Skip overwritten events. */
+		if (trace_head - trace_tail > USBDEVFS_TRACE_SIZE) {
+			trace_lost += trace_head - trace_tail -
+				USBDEVFS_TRACE_SIZE;
+			trace_tail = trace_head - USBDEVFS_TRACE_SIZE;
+		}
+		if (trace_tail == trace_head)
+			break;
+
+		buf[i] = trace_buf[trace_tail & (USBDEVFS_TRACE_SIZE - 1)];
+
+		/* Overwritten while copying */
+		if (trace_head - trace_tail > USBDEVFS_TRACE_SIZE)
+			continue;
+
+		trace_tail++;
+		i++;
+	}
+
+	return i;
+}
+
+u32 usbdevfs_trace_lost(void)
+{
+	return trace_lost;
+}
+
+/* Interrupt events */
+static void trace_interrupt(int interrupt)
+{
+	u16 istr;
+
+	istr = USB_ISTR;
+	interrupt &= istr;
+	if (interrupt & USB_ISTR_RESET)
+		usbdevfs_trace(USBDEVFS_TRACE_RESET, 0, istr, 0);
+	if (interrupt & USB_ISTR_SUSP)
+		usbdevfs_trace(USBDEVFS_TRACE_SUSPEND, 0, istr, 0);
+	if (interrupt & USB_ISTR_WKUP)
+		usbdevfs_trace(USBDEVFS_TRACE_WAKEUP, 0, istr, 0);
+	if (interrupt & USB_ISTR_ERR)
+		usbdevfs_trace(USBDEVFS_TRACE_ERROR, 0, istr, 0);
+	if (interrupt & USB_ISTR_PMAOVR)
+		usbdevfs_trace(USBDEVFS_TRACE_OVERRUN, 0, istr, 0);
+}
+
+/* CTR events, before the callbacks clear the interrupt */
+static void trace_ctr(int ep_id, u16 clear)
+{
+	u16 reg16;
+
+	reg16 = USB_EPR(ep_id);
+	if (reg16 & clear & USB_EPR_CTR_RX)
+		usbdevfs_trace(USBDEVFS_TRACE_CTR_RX, ep_id, reg16,
+			       USB_COUNT_RX(ep_id) & 0x3ff);
+	if (reg16 & clear & USB_EPR_CTR_TX)
+		usbdevfs_trace(USBDEVFS_TRACE_CTR_TX, ep_id, reg16, 0);
+}
+#else
+#define trace_interrupt(interrupt) do { } while (0)
+#define trace_ctr(ep_id, clear) do { } while (0)
+#endif
+
 void usbdevfs_enable_function(int function)
 {
 	USB_CNTR |= function;
@@ -41,6 +157,7 @@ int usbdevfs_get_interrupt_status(int interrupt)
 
 void usbdevfs_clear_interrupt(int interrupt)
 {
+	trace_interrupt(interrupt);
 	USB_ISTR &= ~interrupt;
 }
 
@@ -111,6 +228,95 @@ int usbdevfs_assign_packet_memory_rx0(int ep_id, int offset, int size)
 	return offset;
 }
 
+static int tx_buffer_size(int size)
+{
+	return (size + 1) & ~1;
+}
+
+static int rx_buffer_size(int size)
+{
+	if (size <= 62)
+		return (size + 1) & ~1;
+	return (size + 31) & ~31;
+}
+
+static int packet_memory_size(const struct usbdevfs_packet_memory *pm)
+{
+	switch (pm->type) {
+	case USBDEVFS_CONTROL:
+		return tx_buffer_size(pm->size) + rx_buffer_size(pm->size);
+	case USBDEVFS_BULK_DBL_BUF:
+	case USBDEVFS_ISOCHRONOUS:
+		if (pm->address & USBDEVFS_ADDRESS_IN)
+			return 2 * tx_buffer_size(pm->size);
+		return 2 * rx_buffer_size(pm->size);
+	default:
+		if (pm->address & USBDEVFS_ADDRESS_IN)
+			return tx_buffer_size(pm->size);
+		return rx_buffer_size(pm->size);
+	}
+}
+
+int usbdevfs_allocate_packet_memory(const struct usbdevfs_packet_memory *pm,
+				    int n)
+{
+	int i;
+	int offset;
+	int max_ep_id;
+
+	/* Buffer table */
+	max_ep_id = 0;
+	for (i = 0; i < n; i++) {
+		if (pm[i].ep_id >= USBDEVFS_EP_MAX)
+			return -1;
+		if (pm[i].ep_id > max_ep_id)
+			max_ep_id = pm[i].ep_id;
+	}
+	offset = (max_ep_id + 1) * 8;
+
+	/* Check size. */
+	for (i = 0; i < n; i++)
+		offset += packet_memory_size(&pm[i]);
+	if (offset > USBDEVFS_PACKET_MEMORY_SIZE)
+		return -1;
+
+	/* Assign packet memory. */
+	usbdevfs_set_buffer_table_address(0);
+	offset = (max_ep_id + 1) * 8;
+	for (i = 0; i < n; i++) {
+		switch (pm[i].type) {
+		case USBDEVFS_CONTROL:
+			offset = usbdevfs_assign_packet_memory_tx(pm[i].ep_id,
+								  offset,
+								  pm[i].size);
+			offset = usbdevfs_assign_packet_memory_rx(pm[i].ep_id,
+								  offset,
+								  pm[i].size);
+			break;
+		case USBDEVFS_BULK_DBL_BUF:
+		case USBDEVFS_ISOCHRONOUS:
+			if (pm[i].address & USBDEVFS_ADDRESS_IN)
+				offset = usbdevfs_assign_dbl_buf_packet_memory_tx(
+					pm[i].ep_id, offset, pm[i].size);
+			else
+				offset = usbdevfs_assign_dbl_buf_packet_memory_rx(
+					pm[i].ep_id, offset, pm[i].size);
+			break;
+		default:
+			if (pm[i].address & USBDEVFS_ADDRESS_IN)
+				offset = usbdevfs_assign_packet_memory_tx(
+					pm[i].ep_id, offset, pm[i].size);
+			else
+				offset = usbdevfs_assign_packet_memory_rx(
+					pm[i].ep_id, offset, pm[i].size);
+			break;
+		}
+	}
+
+	/* Free space */
+	return USBDEVFS_PACKET_MEMORY_SIZE - offset;
+}
+
 void usbdevfs_setup_endpoint(int ep_id, usbdevfs_endpoint_t type, u8 address)
 {
 	USB_EPR(ep_id) = (type << 8) | (address & 0xf);
@@ -134,37 +340,149 @@ void usbdevfs_set_ep_bit(int ep_id, int setbit, int resetbit)
 			  (setbit & ~USB_EPR_TOGGLE & ~USB_EPR_C_W0));
 }
 
-int usbdevfs_write(int ep_id, u16 *buf, int len)
+/*
+ * Packet memory access
+ *
+ * The packet memory is 16 bits wide, and each half-word is located on a
+ * 32-bit boundary. The copy loops are unrolled, and the buffer is accessed
+ * by words, half-words or bytes depending on its alignment.
+ */
+#define PMA(offset)	((volatile u32 *)(USB_DEV_FS_SRAM_BASE + (offset) * 2))
+
+/* Copy 'n' (even) bytes to the packet memory. */
+static volatile u32 *copy_to_pma(volatile u32 *d, const u8 *s, int n)
 {
-	u32 *d;
-	int i;
+	const u32 *sp32;
+	const u16 *sp16;
+	u32 w;
 
-	d = (u32 *)(USB_DEV_FS_SRAM_BASE + USB_ADDR_TX(ep_id) * 2);
+	if (((u32)s & 3) == 0) {
+		sp32 = (const u32 *)s;
+		for (; n >= 16; n -= 16) {
+			w = *sp32++;
+			d[0] = (u16)w;
+			d[1] = w >> 16;
+			w = *sp32++;
+			d[2] = (u16)w;
+			d[3] = w >> 16;
+			w = *sp32++;
+			d[4] = (u16)w;
+			d[5] = w >> 16;
+			w = *sp32++;
+			d[6] = (u16)w;
+			d[7] = w >> 16;
+			d += 8;
+		}
+		for (; n >= 4; n -= 4) {
+			w = *sp32++;
+			d[0] = (u16)w;
+			d[1] = w >> 16;
+			d += 2;
+		}
+		if (n)
+			*d++ = *(const u16 *)sp32;
+	} else if (((u32)s & 1) == 0) {
+		sp16 = (const u16 *)s;
+		for (; n >= 8; n -= 8) {
+			d[0] = sp16[0];
+			d[1] = sp16[1];
+			d[2] = sp16[2];
+			d[3] = sp16[3];
+			sp16 += 4;
+			d += 4;
+		}
+		for (; n >= 2; n -= 2)
+			*d++ = *sp16++;
+	} else {
+		for (; n >= 2; n -= 2) {
+			*d++ = s[0] | (s[1] << 8);
+			s += 2;
+		}
+	}
 
-	for (i = 0; i < len / 2; i++)
-		*d++ = *buf++;
+	return d;
+}
 
-	if (len % 2)
-		*d = *(u8 *)buf;
+/* Copy 'n' (even) bytes from the packet memory. */
+static volatile u32 *copy_from_pma(u8 *d, volatile u32 *s, int n)
+{
+	u32 *dp32;
+	u16 *dp16;
+	u32 w;
 
-	USB_COUNT_TX(ep_id) = len;
+	if (((u32)d & 3) == 0) {
+		dp32 = (u32 *)d;
+		for (; n >= 16; n -= 16) {
+			dp32[0] = (s[0] & 0xffff) | (s[1] << 16);
+			dp32[1] = (s[2] & 0xffff) | (s[3] << 16);
+			dp32[2] = (s[4] & 0xffff) | (s[5] << 16);
+			dp32[3] = (s[6] & 0xffff) | (s[7] << 16);
+			dp32 += 4;
+			s += 8;
+		}
+		for (; n >= 4; n -= 4) {
+			*dp32++ = (s[0] & 0xffff) | (s[1] << 16);
+			s += 2;
+		}
+		if (n)
+			*(u16 *)dp32 = *s++;
+	} else if (((u32)d & 1) == 0) {
+		dp16 = (u16 *)d;
+		for (; n >= 8; n -= 8) {
+			dp16[0] = s[0];
+			dp16[1] = s[1];
+			dp16[2] = s[2];
+			dp16[3] = s[3];
+			dp16 += 4;
+			s += 4;
+		}
+		for (; n >= 2; n -= 2)
+			*dp16++ = *s++;
+	} else {
+		for (; n >= 2; n -= 2) {
+			w = *s++;
+			d[0] = w;
+			d[1] = w >> 8;
+			d += 2;
+		}
+	}
 
-	return len;
+	return s;
 }
 
-int usbdevfs_write1(int ep_id, u16 *buf, int len)
+static void write_packet(volatile u32 *d, const u8 *s, int len)
 {
-	u32 *d;
-	int i;
+	d = copy_to_pma(d, s, len & ~1);
+	if (len & 1)
+		*d = s[len - 1];
+}
+
+static int read_packet(volatile u32 *s, u8 *d, int len, int buflen)
+{
+	int n;
 
-	d = (u32 *)(USB_DEV_FS_SRAM_BASE + USB_ADDR_RX(ep_id) * 2);
+	if (buflen < len)
+		n = buflen;
+	else
+		n = len;
+	s = copy_from_pma(d, s, n & ~1);
+	if (n & 1)
+		d[n - 1] = *s;
 
-	for (i = 0; i < len / 2; i++)
-		*d++ = *buf++;
+	return len;
+}
+
+int usbdevfs_write(int ep_id, u16 *buf, int len)
+{
+	write_packet(PMA(USB_ADDR_TX(ep_id)), (const u8 *)buf, len);
+	USB_COUNT_TX(ep_id) = len;
 
-	if (len % 2)
-		*d = *(u8 *)buf;
+	return len;
+}
 
+int usbdevfs_write1(int ep_id, u16 *buf, int len)
+{
+	write_packet(PMA(USB_ADDR_RX(ep_id)), (const u8 *)buf, len);
 	USB_COUNT_RX(ep_id) = len;
 
 	return len;
@@ -172,46 +490,85 @@ int usbdevfs_write1(int ep_id, u16 *buf, int len)
 
 int usbdevfs_read(int ep_id, u16 *buf, int buflen)
 {
-	u32 *s;
-	int len;
 	int n;
-	int i;
 
-	s = (u32 *)(USB_DEV_FS_SRAM_BASE + USB_ADDR_RX(ep_id) * 2);
-	len = USB_COUNT_RX(ep_id) & 0x3ff;
+	n = read_packet(PMA(USB_ADDR_RX(ep_id)), (u8 *)buf,
+			USB_COUNT_RX(ep_id) & 0x3ff, buflen);
+#ifdef USBDEVFS_TRACE
+	/* read_packet() returns COUNT, not the number of bytes copied */
+	if ((USB_EPR(ep_id) & USB_EPR_SETUP) && n >= 8 && buflen >= 8)
+		usbdevfs_trace(USBDEVFS_TRACE_SETUP, ep_id,
+			       buf[0] | (buf[1] << 16), buf[2] | (buf[3] << 16));
+#endif
+	return n;
+}
 
-	if (buflen < len)
-		n = buflen;
-	else
+int usbdevfs_read0(int ep_id, u16 *buf, int buflen)
+{
+	return read_packet(PMA(USB_ADDR_TX(ep_id)), (u8 *)buf,
+			   USB_COUNT_TX(ep_id) & 0x3ff, buflen);
+}
+
+int usbdevfs_write_ring(int ep_id, const u8 *ring, int size, int start,
+			int len)
+{
+	volatile u32 *d;
+	int n;
+
+	d = PMA(USB_ADDR_TX(ep_id));
+
+	/* Until the end of the ring buffer */
+	n = size - start;
+	if (n > len)
 		n = len;
-	for (i = 0; i < n / 2; i++)
-		*buf++ = *s++;
+	d = copy_to_pma(d, ring + start, n & ~1);
+
+	if (n & 1) {
+		if (n < len) {
+			/* Half-word across the wraparound */
+			*d++ = ring[start + n - 1] | (ring[0] << 8);
+			write_packet(d, ring + 1, len - n - 1);
+		} else {
+			*d = ring[start + n - 1];
+		}
+	} else {
+		write_packet(d, ring, len - n);
+	}
 
-	if (n % 2)
-		*(u8 *)buf = *s;
+	USB_COUNT_TX(ep_id) = len;
 
 	return len;
 }
 
-int usbdevfs_read0(int ep_id, u16 *buf, int buflen)
+int usbdevfs_read_ring(int ep_id, u8 *ring, int size, int start, int buflen)
 {
-	u32 *s;
+	volatile u32 *s;
 	int len;
 	int n;
-	int i;
+	u32 w;
 
-	s = (u32 *)(USB_DEV_FS_SRAM_BASE + USB_ADDR_TX(ep_id) * 2);
-	len = USB_COUNT_TX(ep_id) & 0x3ff;
+	s = PMA(USB_ADDR_RX(ep_id));
+	len = USB_COUNT_RX(ep_id) & 0x3ff;
+	if (buflen > len)
+		buflen = len;
 
-	if (buflen < len)
+	/* Until the end of the ring buffer */
+	n = size - start;
+	if (n > buflen)
 		n = buflen;
-	else
-		n = len;
-	for (i = 0; i < n / 2; i++)
-		*buf++ = *s++;
+	s = copy_from_pma(ring + start, s, n & ~1);
 
-	if (n % 2)
-		*(u8 *)buf = *s;
+	if (n & 1) {
+		w = *s++;
+		ring[start + n - 1] = w;
+		if (n < buflen) {
+			/* Half-word across the wraparound */
+			ring[0] = w >> 8;
+			read_packet(s, ring + 1, buflen - n - 1, buflen - n - 1);
+		}
+	} else {
+		read_packet(s, ring, buflen - n, buflen - n);
+	}
 
 	return len;
 }
@@ -222,6 +579,7 @@ void usbdevfs_set_control_state(int ep_id, usbdevfs_control_state_t state)
 {
 	switch (state) {
 	case USBDEVFS_STALL:
+		usbdevfs_trace(USBDEVFS_TRACE_STALL, ep_id, USB_EPR(ep_id), 0);
 		usbdevfs_set_ep_bit(ep_id, USB_EPR_STAT_RX0 | USB_EPR_STAT_TX0,
 				    USB_EPR_STAT_RX1 | USB_EPR_STAT_TX1 |
 				    USB_EPR_EP_KIND |
@@ -384,6 +742,7 @@ void usbdevfs_halt_endpoint_tx(int ep_id)
 {
 	u16 reg16;
 
+	usbdevfs_trace(USBDEVFS_TRACE_STALL, ep_id, USB_EPR(ep_id), 0);
 	reg16 = USB_EPR(ep_id);
 	reg16 &= ~USB_EPR_CTR_TX; /* Clear interrupt */
 	if ((reg16 & (USB_EPR_STAT_TX1 | USB_EPR_STAT_TX0)) ==
@@ -410,6 +769,7 @@ void usbdevfs_halt_endpoint_rx(int ep_id)
 {
 	u16 reg16;
 
+	usbdevfs_trace(USBDEVFS_TRACE_STALL, ep_id, USB_EPR(ep_id), 0);
 	reg16 = USB_EPR(ep_id);
 	reg16 &= ~USB_EPR_CTR_RX; /* Clear interrupt */
 	if ((reg16 & (USB_EPR_STAT_RX1 | USB_EPR_STAT_RX0)) ==
@@ -451,3 +811,275 @@ void usbdevfs_reset_endpoint_data_toggle(int ep_id)
 	USB_EPR(ep_id) = (reg16 & ~(USB_EPR_STAT_RX1 | USB_EPR_STAT_RX0 |
 				    USB_EPR_STAT_TX1 | USB_EPR_STAT_TX0));
 }
+
+/* Double-buffered bulk endpoint */
+
+/*
+ * The hardware uses the buffer selected by DTOG, the application uses the
+ * buffer selected by SW_BUF (DTOG_RX for IN, DTOG_TX for OUT endpoints).
+ * While both bits are equal, the endpoint is in NAK condition.
+ *
+ * Buffer 0: ADDRn_TX/COUNTn_TX, Buffer 1: ADDRn_RX/COUNTn_RX
+ */
+
+/* Software state */
+enum {
+	DBL_BUF_PENDING = (1 << 0),	/* Waiting for the other side */
+	DBL_BUF_READY = (1 << 1)	/* Application buffer has data (OUT) */
+};
+
+static volatile u8 dbl_buf_state[USBDEVFS_EP_MAX];
+
+static void toggle_sw_buf_tx(int ep_id)
+{
+	u16 reg16;
+
+	reg16 = USB_EPR(ep_id);
+	USB_EPR(ep_id) = ((reg16 & ~USB_EPR_TOGGLE) | USB_EPR_C_W0 |
+			  USB_EPR_DTOG_RX);
+}
+
+static void toggle_sw_buf_rx(int ep_id)
+{
+	u16 reg16;
+
+	reg16 = USB_EPR(ep_id);
+	USB_EPR(ep_id) = ((reg16 & ~USB_EPR_TOGGLE) | USB_EPR_C_W0 |
+			  USB_EPR_DTOG_TX);
+}
+
+int usbdevfs_assign_dbl_buf_packet_memory_tx(int ep_id, int offset, int size)
+{
+	offset = usbdevfs_assign_packet_memory_tx(ep_id, offset, size);
+	return usbdevfs_assign_packet_memory_tx1(ep_id, offset, size);
+}
+
+int usbdevfs_assign_dbl_buf_packet_memory_rx(int ep_id, int offset, int size)
+{
+	offset = usbdevfs_assign_packet_memory_rx0(ep_id, offset, size);
+	return usbdevfs_assign_packet_memory_rx(ep_id, offset, size);
+}
+
+void usbdevfs_enable_dbl_buf_endpoint_tx(int ep_id)
+{
+	dbl_buf_state[ep_id] = 0;
+
+	/* TX VALID, DTOG_TX = 0, SW_BUF = 0 (NAK until the first write) */
+	usbdevfs_set_ep_bit(ep_id, USB_EPR_STAT_TX1 | USB_EPR_STAT_TX0,
+			    USB_EPR_DTOG_TX | USB_EPR_DTOG_RX);
+}
+
+void usbdevfs_enable_dbl_buf_endpoint_rx(int ep_id)
+{
+	dbl_buf_state[ep_id] = 0;
+
+	/* RX VALID, DTOG_RX = 0, SW_BUF = 1 (Hardware uses buffer 0) */
+	usbdevfs_set_ep_bit(ep_id, USB_EPR_STAT_RX1 | USB_EPR_STAT_RX0 |
+			    USB_EPR_DTOG_TX, USB_EPR_DTOG_RX);
+}
+
+int usbdevfs_write_dbl_buf(int ep_id, u16 *buf, int len)
+{
+	u16 reg16;
+
+	/* Both buffers are owned by the hardware. */
+	if (dbl_buf_state[ep_id] & DBL_BUF_PENDING)
+		return -1;
+
+	reg16 = USB_EPR(ep_id);
+	if (reg16 & USB_EPR_DTOG_RX)
+		usbdevfs_write1(ep_id, buf, len);
+	else
+		usbdevfs_write0(ep_id, buf, len);
+
+	if (!(reg16 & USB_EPR_DTOG_TX) == !(reg16 & USB_EPR_DTOG_RX))
+		/* Hardware is idle (NAK). Hand over the buffer now. */
+		toggle_sw_buf_tx(ep_id);
+	else
+		/* Hand over the buffer at the end of the current packet. */
+		dbl_buf_state[ep_id] |= DBL_BUF_PENDING;
+
+	return len;
+}
+
+int usbdevfs_read_dbl_buf(int ep_id, u16 *buf, int buflen)
+{
+	int len;
+
+	/* No data */
+	if (!(dbl_buf_state[ep_id] & DBL_BUF_READY))
+		return -1;
+
+	if (USB_EPR(ep_id) & USB_EPR_DTOG_TX)
+		len = usbdevfs_read1(ep_id, buf, buflen);
+	else
+		len = usbdevfs_read0(ep_id, buf, buflen);
+
+	if (dbl_buf_state[ep_id] & DBL_BUF_PENDING) {
+		/* The other buffer is full. Swap buffers. */
+		dbl_buf_state[ep_id] &= ~DBL_BUF_PENDING;
+		toggle_sw_buf_rx(ep_id);
+	} else {
+		dbl_buf_state[ep_id] &= ~DBL_BUF_READY;
+	}
+
+	return len;
+}
+
+void usbdevfs_complete_dbl_buf_tx(int ep_id)
+{
+	u16 reg16;
+
+	/* Clear interrupt. */
+	reg16 = USB_EPR(ep_id);
+	USB_EPR(ep_id) = ((reg16 & ~(USB_EPR_TOGGLE | USB_EPR_CTR_TX)) |
+			  USB_EPR_CTR_RX);
+
+	if (dbl_buf_state[ep_id] & DBL_BUF_PENDING) {
+		/* Start the next packet. */
+		dbl_buf_state[ep_id] &= ~DBL_BUF_PENDING;
+		toggle_sw_buf_tx(ep_id);
+	}
+}
+
+void usbdevfs_complete_dbl_buf_rx(int ep_id)
+{
+	u16 reg16;
+
+	/* Clear interrupt. */
+	reg16 = USB_EPR(ep_id);
+	USB_EPR(ep_id) = ((reg16 & ~(USB_EPR_TOGGLE | USB_EPR_CTR_RX)) |
+			  USB_EPR_CTR_TX);
+
+	if (dbl_buf_state[ep_id] & DBL_BUF_READY) {
+		/* Application buffer is not empty. */
+		dbl_buf_state[ep_id] |= DBL_BUF_PENDING;
+	} else {
+		/* Swap buffers. */
+		dbl_buf_state[ep_id] |= DBL_BUF_READY;
+		toggle_sw_buf_rx(ep_id);
+	}
+}
+
+int usbdevfs_get_dbl_buf_tx_free(int ep_id)
+{
+	u16 reg16;
+	int n;
+
+	if (dbl_buf_state[ep_id] & DBL_BUF_PENDING)
+		return 0;
+
+	reg16 = USB_EPR(ep_id);
+	n = 2;
+	if (!(reg16 & USB_EPR_DTOG_TX) != !(reg16 & USB_EPR_DTOG_RX))
+		n--;		/* Hardware is sending a packet. */
+
+	return n;
+}
+
+int usbdevfs_get_dbl_buf_rx_count(int ep_id)
+{
+	int n;
+
+	n = 0;
+	if (dbl_buf_state[ep_id] & DBL_BUF_READY)
+		n++;
+	if (dbl_buf_state[ep_id] & DBL_BUF_PENDING)
+		n++;
+
+	return n;
+}
+
+/* Endpoint callback dispatch */
+
+static const struct usbdevfs_callback *callback[USBDEVFS_EP_MAX];
+
+void usbdevfs_set_callback(const struct usbdevfs_callback *cb, int n)
+{
+	int i;
+
+	for (i = 0; i < USBDEVFS_EP_MAX; i++)
+		callback[i] = 0;
+	for (i = 0; i < n; i++)
+		callback[cb[i].ep_id] = &cb[i];
+}
+
+/* CTR of isochronous and double-buffered bulk endpoints (USB_HP) */
+static bool high_priority(u16 reg16)
+{
+	switch (reg16 & USB_EPR_EP_TYPE_MASK) {
+	case USB_EPR_EP_TYPE_ISO:
+		return true;
+	case USB_EPR_EP_TYPE_BULK:
+		return reg16 & USB_EPR_EP_KIND;
+	default:
+		return false;
+	}
+}
+
+/* Clear the CTR bits 'ctr' only, writing 1 to the other CTR bit. */
+static void clear_ctr(int ep_id, u16 ctr)
+{
+	u16 reg16;
+
+	reg16 = USB_EPR(ep_id);
+	USB_EPR(ep_id) = ((reg16 & ~(USB_EPR_TOGGLE | ctr)) |
+			  (USB_EPR_C_W0 & ~ctr));
+}
+
+static void dispatch(bool hp)
+{
+	int i;
+	int ep_id;
+	u16 reg16;
+	u16 clear;
+	void (*rx)(void);
+	void (*tx)(void);
+
+	for (i = 0; i < USBDEVFS_EP_MAX; i++) {
+		/* The highest priority endpoint with CTR */
+		if (!(USB_ISTR & USB_ISTR_CTR))
+			return;
+		ep_id = USB_ISTR & USB_ISTR_EP_ID_MASK;
+		reg16 = USB_EPR(ep_id);
+		if (high_priority(reg16) != hp ||
+		    !(reg16 & (USB_EPR_CTR_RX | USB_EPR_CTR_TX)))
+			return;
+		trace_ctr(ep_id, USB_EPR_CTR_RX | USB_EPR_CTR_TX);
+
+		rx = 0;
+		tx = 0;
+		if (callback[ep_id]) {
+			if (reg16 & USB_EPR_SETUP)
+				rx = callback[ep_id]->setup;
+			else
+				rx = callback[ep_id]->rx;
+			tx = callback[ep_id]->tx;
+		}
+
+		/* Only the direction without a callback */
+		clear = 0;
+		if ((reg16 & USB_EPR_CTR_RX) && !rx)
+			clear |= USB_EPR_CTR_RX;
+		if ((reg16 & USB_EPR_CTR_TX) && !tx)
+			clear |= USB_EPR_CTR_TX;
+		if (clear)
+			clear_ctr(ep_id, clear);
+
+		/* IN before OUT/SETUP (control endpoint) */
+		if ((reg16 & USB_EPR_CTR_TX) && tx)
+			(*tx)();
+		if ((reg16 & USB_EPR_CTR_RX) && rx)
+			(*rx)();
+	}
+}
+
+void usbdevfs_dispatch(void)
+{
+	dispatch(false);
+}
+
+void usbdevfs_dispatch_hp(void)
+{
+	dispatch(true);
+}
@@ -0,0 +1,201 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * Copyright (C) 2013 Toshiaki Yoshida <yoshida@mpc.net>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stm32/l1/rcc.h>
+#include <stm32/l1/pwr.h>
+#include <stm32/l1/flash.h>
+#include <stm32/l1/scb.h>
+#include <stm32/l1/exti.h>
+#include <stm32/l1/nvic.h>
+#include <stm32/l1/usbdevfs.h>
+#include <stm32/l1/usbdev.h>
+
+#include <stm32/l1/usbdevpm.h>
+
+static const struct usbdevpm *pm;
+
+static bool suspended;
+
+/* Remaining ESOFs of the resume signalling */
+static int resume_count;
+
+/* Clock configuration saved on suspend */
+static rcc_osc_t sysclk;
+static u32 osc;			/* RCC_CR: HSEON, HSION, PLLON */
+static int vos;
+static u32 acr;			/* FLASH_ACR: ACC64, PRFTEN, LATENCY */
+
+/* --- Clock --------------------------------------------------------------- */
+
+static void save_clock(void)
+{
+	sysclk = rcc_get_sysclk_source();
+	osc = RCC_CR & (RCC_CR_HSEON | RCC_CR_HSION | RCC_CR_PLLON);
+	vos = pwr_get_vos();
+	acr = FLASH_ACR & (FLASH_ACR_ACC64 | FLASH_ACR_PRFTEN |
+			   FLASH_ACR_LATENCY);
+}
+
+/* SYSCLK -> MSI, HSE/HSI/PLL off, VCORE range 2 */
+static void slow_down_clock(void)
+{
+	if (sysclk == RCC_MSI)
+		return;
+
+	rcc_enable_osc(RCC_MSI);
+	rcc_set_sysclk_source(RCC_MSI);
+	while (rcc_get_sysclk_source() != RCC_MSI)
+		;
+	if (osc & RCC_CR_PLLON)
+		rcc_disable_osc(RCC_PLL);
+	if (osc & RCC_CR_HSEON)
+		rcc_disable_osc(RCC_HSE);
+	if (osc & RCC_CR_HSION)
+		rcc_disable_osc(RCC_HSI);
+	flash_disable_64bit_access();
+	pwr_set_vos(PWR_1_5_V);
+}
+
+/* Stop mode exits with MSI, restore the saved configuration. */
+static void restore_clock(void)
+{
+	pwr_set_run_mode();
+	pwr_wait_for_regulator_main_mode();
+	scb_set_sleep(0);
+
+	if (sysclk == RCC_MSI)
+		return;
+
+	/* VCORE and wait state first, then the oscillators */
+	pwr_set_vos(vos);
+	if (acr & FLASH_ACR_ACC64)
+		flash_enable_64bit_access(acr & FLASH_ACR_LATENCY);
+	if (osc & RCC_CR_HSION)
+		rcc_enable_osc(RCC_HSI);
+	if (osc & RCC_CR_HSEON)
+		rcc_enable_osc(RCC_HSE);
+	if (osc & RCC_CR_PLLON)
+		rcc_enable_osc(RCC_PLL);
+	rcc_set_sysclk_source(sysclk);
+	while (rcc_get_sysclk_source() != sysclk)
+		;
+}
+
+/* --- Suspend and resume -------------------------------------------------- */
+
+static void resume(void)
+{
+	restore_clock();
+
+	/* Exit low-power mode and suspend mode. */
+	usbdevfs_disable_function(USBDEVFS_LOW_POWER_MODE);
+	usbdevfs_disable_function(USBDEVFS_FORCE_SUSPEND);
+	suspended = false;
+
+	if (pm && pm->resume)
+		pm->resume();
+}
+
+void usbdevpm_suspend(void)
+{
+	/* Clear interrupt. */
+	usbdevfs_clear_interrupt(USBDEVFS_SUSPEND);
+
+	if (suspended)
+		return;
+
+	if (pm && pm->suspend)
+		pm->suspend();
+
+	/* Enter suspend mode and low-power mode. */
+	usbdevfs_enable_function(USBDEVFS_FORCE_SUSPEND);
+	usbdevfs_enable_function(USBDEVFS_LOW_POWER_MODE);
+	suspended = true;
+
+	save_clock();
+	slow_down_clock();
+
+	/* The next WFI enters Stop mode. */
+	exti_clear_interrupt(EXTI_USB_WAKEUP);
+	pwr_enable_ultralow_power_mode(true);
+	pwr_set_stop_mode();
+	scb_set_sleep(SCB_SCR_SLEEPDEEP);
+}
+
+void usbdevpm_wakeup(void)
+{
+	/* Clear interrupt. */
+	exti_clear_interrupt(EXTI_USB_WAKEUP);
+
+	if (!usbdevfs_get_interrupt_status(USBDEVFS_WAKEUP))
+		return;
+
+	if (suspended)
+		resume();
+
+	/* Clear interrupt. */
+	usbdevfs_clear_interrupt(USBDEVFS_WAKEUP);
+}
+
+int usbdevpm_remote_wakeup(void)
+{
+	if (!suspended || resume_count || !usbdev_get_remote_wakeup())
+		return -1;
+
+	/* The USB clock is needed to time the resume signalling. */
+	resume();
+
+	usbdevfs_clear_interrupt(USBDEVFS_EXPECTED_SOF);
+	usbdevfs_enable_interrupt(USBDEVFS_EXPECTED_SOF);
+	usbdevfs_enable_function(USBDEVFS_RESUME);
+	resume_count = USBDEVPM_RESUME_ESOF;
+	return 0;
+}
+
+void usbdevpm_esof(void)
+{
+	/* Clear interrupt. */
+	usbdevfs_clear_interrupt(USBDEVFS_EXPECTED_SOF);
+
+	/* 1 - 15 ms */
+	if (resume_count && !--resume_count) {
+		usbdevfs_disable_function(USBDEVFS_RESUME);
+		usbdevfs_disable_interrupt(USBDEVFS_EXPECTED_SOF);
+	}
+}
+
+bool usbdevpm_is_suspended(void)
+{
+	return suspended;
+}
+
+void usbdevpm_init(const struct usbdevpm *p)
+{
+	pm = p;
+	suspended = false;
+	resume_count = 0;
+
+	/* EXTI18 is connected to USB Device FS wakeup event. */
+	exti_set_trigger(EXTI_USB_WAKEUP, EXTI_RISING);
+	exti_clear_interrupt(EXTI_USB_WAKEUP);
+	exti_enable_interrupt(EXTI_USB_WAKEUP);
+
+	/* Enable USB Device FS Wakeup interrupt. */
+	nvic_enable_irq(NVIC_USB_FS_WKUP_IRQ);
+}